@@ -0,0 +1,380 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+// * KS_TEXT_ATLAS_CACHE_NO_MMAP reads files into memory
+//   instead, ie. so AddressSanitizer checks the reads
+#if !defined(_WIN32) && !defined(KS_TEXT_ATLAS_CACHE_NO_MMAP)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define KS_TEXT_ATLAS_CACHE_MMAP
+#endif
+
+#include <ks/text/KsTextAtlasCache.hpp>
+
+namespace ks
+{
+    namespace text
+    {
+        namespace
+        {
+            u64 const kHashMul = 0x9E3779B97F4A7C15ull;
+
+            inline u64 MixHash(u64 x)
+            {
+                x ^= x >> 33;
+                x *= 0xFF51AFD7ED558CCDull;
+                x ^= x >> 33;
+                return x;
+            }
+
+            // LZ77 coder
+            // * A sequence is a token (literal count << 4 |
+            //   match length-kLZMinMatch), extra literal count
+            //   bytes, the literals, a 16-bit offset and extra
+            //   match length bytes; counts of 15 or more are
+            //   continued with bytes that are added until one
+            //   is less than 255
+            // * The last sequence only has literals
+            uint const kLZHashBits = 14;
+            uint const kLZMinMatch = 4;
+            size_t const kLZMaxOffset = 65535;
+
+            // * Matches end at least this many bytes before the
+            //   end and don't start in the last kLZMatchEndDist
+            //   bytes (same as LZ4)
+            size_t const kLZLastLiterals = 5;
+            size_t const kLZMatchEndDist = 12;
+
+            inline u32 ReadU32(u8 const * data)
+            {
+                u32 value;
+                std::memcpy(&value,data,4);
+                return value;
+            }
+
+            inline u32 HashLZ(u32 value)
+            {
+                return (value*2654435761u) >> (32-kLZHashBits);
+            }
+
+            void AppendLZCount(std::vector<u8> &list_packed, size_t count)
+            {
+                for(; count >= 255; count -= 255)
+                {
+                    list_packed.push_back(255);
+                }
+                list_packed.push_back(u8(count));
+            }
+
+            void AppendLZSequence(std::vector<u8> &list_packed,
+                                  u8 const * literals,
+                                  size_t literal_count,
+                                  size_t offset,
+                                  size_t match_length)
+            {
+                // The last sequence has no match (offset 0)
+                size_t const extra_length =
+                        (offset > 0) ? (match_length-kLZMinMatch) : 0;
+
+                list_packed.push_back(
+                            u8((std::min<size_t>(literal_count,15) << 4) |
+                               std::min<size_t>(extra_length,15)));
+
+                if(literal_count >= 15)
+                {
+                    AppendLZCount(list_packed,literal_count-15);
+                }
+
+                list_packed.insert(list_packed.end(),
+                                   literals,
+                                   literals+literal_count);
+
+                if(offset == 0)
+                {
+                    return;
+                }
+
+                list_packed.push_back(u8(offset & 0xFF));
+                list_packed.push_back(u8(offset >> 8));
+
+                if(extra_length >= 15)
+                {
+                    AppendLZCount(list_packed,extra_length-15);
+                }
+            }
+
+            bool ReadLZCount(u8 const * &src, u8 const * src_end, size_t &count)
+            {
+                u8 value;
+                do
+                {
+                    if(src == src_end)
+                    {
+                        return false;
+                    }
+                    value = *src++;
+                    count += value;
+                }
+                while(value == 255);
+
+                return true;
+            }
+        }
+
+        // =========================================================== //
+
+        u64 HashAtlasCacheData(u8 const * data, size_t size, u64 seed)
+        {
+            // Four independent lanes so the multiplies
+            // don't wait on each other
+            u64 list_lanes[4] = {
+                seed ^ (size*kHashMul),
+                seed + kHashMul,
+                seed ^ 0xC2B2AE3D27D4EB4Full,
+                seed - kHashMul
+            };
+
+            size_t i=0;
+            for(; i+32 <= size; i+=32)
+            {
+                for(uint j=0; j < 4; j++)
+                {
+                    u64 word;
+                    std::memcpy(&word,data+i+j*8,8);
+                    list_lanes[j] = (list_lanes[j] ^ MixHash(word))*kHashMul;
+                }
+            }
+
+            u64 hash = list_lanes[0];
+            for(uint j=1; j < 4; j++)
+            {
+                hash = (hash ^ MixHash(list_lanes[j]))*kHashMul;
+            }
+
+            for(; i < size; i++)
+            {
+                hash = (hash ^ data[i])*kHashMul;
+            }
+
+            return MixHash(hash);
+        }
+
+        // =========================================================== //
+
+        void CompressAtlasImage(u8 const * data,
+                                size_t size,
+                                std::vector<u8> &list_packed)
+        {
+            list_packed.clear();
+            list_packed.reserve(size/2);
+
+            // Most recent position of each hashed 4-byte sequence
+            std::vector<u32> list_positions(1 << kLZHashBits,0);
+
+            size_t const match_start_limit =
+                    (size > kLZMatchEndDist) ? (size-kLZMatchEndDist) : 0;
+
+            size_t const match_end_limit =
+                    (size > kLZLastLiterals) ? (size-kLZLastLiterals) : 0;
+
+            size_t anchor = 0;
+            size_t i = 0;
+            while(i < match_start_limit)
+            {
+                u32 const sequence = ReadU32(data+i);
+                u32 &position = list_positions[HashLZ(sequence)];
+                size_t const candidate = position;
+                position = u32(i);
+
+                if((candidate >= i) ||
+                   (i-candidate > kLZMaxOffset) ||
+                   (ReadU32(data+candidate) != sequence))
+                {
+                    i++;
+                    continue;
+                }
+
+                size_t length = kLZMinMatch;
+                while((i+length < match_end_limit) &&
+                      (data[candidate+length] == data[i+length]))
+                {
+                    length++;
+                }
+
+                AppendLZSequence(list_packed,
+                                 data+anchor,
+                                 i-anchor,
+                                 i-candidate,
+                                 length);
+
+                i += length;
+                anchor = i;
+            }
+
+            AppendLZSequence(list_packed,data+anchor,size-anchor,0,0);
+        }
+
+        bool DecompressAtlasImage(std::vector<u8> const &list_packed,
+                                  u8 * data,
+                                  size_t size)
+        {
+            u8 const * src = list_packed.data();
+            u8 const * const src_end = src + list_packed.size();
+            size_t i = 0;
+
+            while(src != src_end)
+            {
+                u8 const token = *src++;
+
+                size_t literal_count = token >> 4;
+                if((literal_count == 15) &&
+                   !ReadLZCount(src,src_end,literal_count))
+                {
+                    return false;
+                }
+
+                if((literal_count > size_t(src_end-src)) ||
+                   (literal_count > size-i))
+                {
+                    return false;
+                }
+
+                std::memcpy(data+i,src,literal_count);
+                src += literal_count;
+                i += literal_count;
+
+                if(src == src_end)
+                {
+                    break;
+                }
+
+                if(src_end-src < 2)
+                {
+                    return false;
+                }
+
+                size_t const offset = src[0] | (size_t(src[1]) << 8);
+                src += 2;
+
+                size_t length = token & 15;
+                if((length == 15) && !ReadLZCount(src,src_end,length))
+                {
+                    return false;
+                }
+                length += kLZMinMatch;
+
+                if((offset == 0) || (offset > i) || (length > size-i))
+                {
+                    return false;
+                }
+
+                // Matches can overlap the bytes they
+                // write (ie. a run of the same value)
+                u8 * dst = data+i;
+                u8 const * match = dst-offset;
+                if(offset >= length)
+                {
+                    std::memcpy(dst,match,length);
+                }
+                else
+                {
+                    for(size_t j=0; j < length; j++)
+                    {
+                        dst[j] = match[j];
+                    }
+                }
+                i += length;
+            }
+
+            return (i == size);
+        }
+
+        // =========================================================== //
+
+        MappedFile::MappedFile(std::string const &file_path) :
+            m_data(nullptr),
+            m_size(0)
+        {
+#ifdef KS_TEXT_ATLAS_CACHE_MMAP
+            int const fd = open(file_path.c_str(),O_RDONLY);
+            if(fd < 0)
+            {
+                return;
+            }
+
+            struct stat file_stat;
+            if((fstat(fd,&file_stat) == 0) && (file_stat.st_size > 0))
+            {
+                void * data = mmap(nullptr,file_stat.st_size,
+                                   PROT_READ,MAP_PRIVATE,fd,0);
+
+                if(data != MAP_FAILED)
+                {
+                    m_data = static_cast<u8 const *>(data);
+                    m_size = file_stat.st_size;
+                }
+            }
+
+            // The mapping stays valid after the file is closed
+            close(fd);
+#else
+            std::ifstream ifs(file_path,std::ios::in | std::ios::binary);
+            if(!ifs.is_open())
+            {
+                return;
+            }
+
+            ifs.seekg(0,std::ios::end);
+            m_list_file_data.resize(ifs.tellg());
+            ifs.seekg(0,std::ios::beg);
+            ifs.read(reinterpret_cast<char*>(m_list_file_data.data()),
+                     m_list_file_data.size());
+
+            if(ifs && !m_list_file_data.empty())
+            {
+                m_data = m_list_file_data.data();
+                m_size = m_list_file_data.size();
+            }
+#endif
+        }
+
+        MappedFile::~MappedFile()
+        {
+#ifdef KS_TEXT_ATLAS_CACHE_MMAP
+            if(m_data)
+            {
+                munmap(const_cast<u8*>(m_data),m_size);
+            }
+#endif
+        }
+
+        u8 const * MappedFile::GetData() const
+        {
+            return m_data;
+        }
+
+        size_t MappedFile::GetSize() const
+        {
+            return m_size;
+        }
+    }
+}
@@ -0,0 +1,120 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_TEXT_ATLAS_CACHE_HPP
+#define KS_TEXT_ATLAS_CACHE_HPP
+
+#include <string>
+#include <vector>
+
+#include <ks/KsGlobal.hpp>
+
+namespace ks
+{
+    namespace text
+    {
+        // AtlasCacheHeader
+        // * Start of an atlas cache file written by TextAtlas;
+        //   it's followed by:
+        //   u64 font hashes [font_count]
+        //   GlyphImageDesc missing glyph
+        //   u32 rectangle counts [atlas_count]
+        //   u32 row counts [atlas_count]
+        //   AtlasRect rectangles in the order they were packed,
+        //             grouped by atlas [rect_count]
+        //   GlyphImageDesc glyphs [glyph_count]
+        //   u32 glyph last uses [glyph_count]
+        //   padding to 8 bytes
+        //   u8 atlas pixels, only for the rows down to the
+        //      bottom of the lowest glyph in each atlas
+        //      [row count*atlas_size_px*channels for each atlas]
+        // * With channel packing every channel of an atlas is
+        //   packed separately, so atlas_count is the number of
+        //   channels that have been used and each atlas image
+        //   is saved down to the lowest row of its channels
+        // * Files are only read on the machine that wrote them,
+        //   so everything is in native byte order
+        struct AtlasCacheHeader
+        {
+            u32 magic;
+            u32 version;
+
+            // * Checksum of everything after the header
+            u64 checksum;
+
+            // * Everything that changes the glyph images
+            u32 atlas_size_px;
+            u32 glyph_res_px;
+            u32 sdf_offset_px;
+            u32 sdf_engine;
+            u32 packer_type;
+            u32 channels;
+
+            u32 font_count;
+            u32 atlas_count;
+            u32 rect_count;
+            u32 glyph_count;
+        };
+
+        u32 const kAtlasCacheMagic = 0x4154534B; // 'KSTA'
+        u32 const kAtlasCacheVersion = 5;
+
+        // * Non-cryptographic 64-bit hash used to identify font
+        //   files and to check cache files for corruption
+        u64 HashAtlasCacheData(u8 const * data, size_t size, u64 seed=0);
+
+        // * Compresses @size bytes at @data into @list_packed
+        //   with a byte-oriented LZ77 coder (LZ4's block format)
+        // * Atlas images are mostly empty space and repeated
+        //   distance ramps and usually shrink to about half;
+        //   decompressing is a few copies per glyph row
+        void CompressAtlasImage(u8 const * data,
+                                size_t size,
+                                std::vector<u8> &list_packed);
+
+        // * Returns false if @list_packed doesn't decompress
+        //   to exactly @size bytes
+        bool DecompressAtlasImage(std::vector<u8> const &list_packed,
+                                  u8 * data,
+                                  size_t size);
+
+        // MappedFile
+        // * A read-only view of a whole file; the file is
+        //   memory-mapped where that's supported and read
+        //   into memory otherwise
+        class MappedFile final
+        {
+        public:
+            // * GetData() is nullptr if @file_path couldn't
+            //   be opened
+            MappedFile(std::string const &file_path);
+            ~MappedFile();
+
+            MappedFile(MappedFile const &) = delete;
+            MappedFile & operator = (MappedFile const &) = delete;
+
+            u8 const * GetData() const;
+            size_t GetSize() const;
+
+        private:
+            u8 const * m_data;
+            size_t m_size;
+            std::vector<u8> m_list_file_data;
+        };
+    }
+}
+
+#endif // KS_TEXT_ATLAS_CACHE_HPP
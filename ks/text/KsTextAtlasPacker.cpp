@@ -0,0 +1,510 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <limits>
+
+#include <ks/text/KsTextAtlasPacker.hpp>
+
+namespace ks
+{
+    namespace text
+    {
+        namespace
+        {
+            // ShelfPacker
+            // * BinPackShelf with the position of the current
+            //   shelf tracked from the rectangles it returns
+            class ShelfPacker final : public AtlasPacker
+            {
+            public:
+                ShelfPacker(uint width, uint height, uint spacing) :
+                    AtlasPacker(width,height,spacing),
+                    m_bin(width,height,spacing),
+                    m_shelf_x(0),
+                    m_shelf_y(0),
+                    m_shelf_height(0)
+                {}
+
+                bool AddRectangle(BinPackRectangle &rect) override
+                {
+                    if(!m_bin.AddRectangle(rect))
+                    {
+                        return false;
+                    }
+
+                    if(rect.y != m_shelf_y)
+                    {
+                        m_shelf_y = rect.y;
+                        m_shelf_height = 0;
+                    }
+
+                    m_shelf_x = rect.x + rect.width + m_spacing;
+                    m_shelf_height = std::max(m_shelf_height,
+                                              rect.height + m_spacing);
+
+                    addUsedArea(rect);
+                    return true;
+                }
+
+            private:
+                u64 getLargestFreeArea() const override
+                {
+                    // Either the rest of the current shelf
+                    // or everything below it
+                    u64 const shelf_area =
+                            (m_width > m_shelf_x) ?
+                                u64(m_width-m_shelf_x)*(m_height-m_shelf_y) : 0;
+
+                    u64 const below_area =
+                            (m_height > m_shelf_y+m_shelf_height) ?
+                                u64(m_width)*(m_height-m_shelf_y-m_shelf_height) : 0;
+
+                    return std::max(shelf_area,below_area);
+                }
+
+                BinPackShelf m_bin;
+                uint m_shelf_x;
+                uint m_shelf_y;
+                uint m_shelf_height;
+            };
+
+            // ============================================================= //
+
+            // SkylinePacker
+            // * Bottom-left skyline: the skyline is a list of
+            //   horizontal segments that cover the width of the
+            //   atlas, each at the top of the free space below it
+            //   (y increases downwards like the atlas image)
+            class SkylinePacker final : public AtlasPacker
+            {
+            public:
+                SkylinePacker(uint width, uint height, uint spacing) :
+                    AtlasPacker(width,height,spacing)
+                {
+                    m_list_segments.push_back(Segment{0,0,width});
+                }
+
+                bool AddRectangle(BinPackRectangle &rect) override
+                {
+                    uint const width = rect.width + m_spacing;
+                    uint const height = rect.height + m_spacing;
+
+                    // Find the segment where the rectangle's
+                    // bottom edge is lowest, then narrowest
+                    uint best_segment = m_list_segments.size();
+                    uint best_bottom = std::numeric_limits<uint>::max();
+                    uint best_width = std::numeric_limits<uint>::max();
+                    uint best_y = 0;
+
+                    for(uint i=0; i < m_list_segments.size(); i++)
+                    {
+                        uint y;
+                        if(!getFit(i,width,height,y))
+                        {
+                            continue;
+                        }
+
+                        uint const bottom = y + height;
+                        if((bottom < best_bottom) ||
+                           ((bottom == best_bottom) &&
+                            (m_list_segments[i].width < best_width)))
+                        {
+                            best_segment = i;
+                            best_bottom = bottom;
+                            best_width = m_list_segments[i].width;
+                            best_y = y;
+                        }
+                    }
+
+                    if(best_segment == m_list_segments.size())
+                    {
+                        return false;
+                    }
+
+                    rect.x = m_list_segments[best_segment].x;
+                    rect.y = best_y;
+
+                    addSegment(best_segment,
+                               Segment{rect.x,best_bottom,width});
+
+                    addUsedArea(rect);
+                    return true;
+                }
+
+            private:
+                struct Segment
+                {
+                    uint x;
+                    uint y;
+                    uint width;
+                };
+
+                // * Sets @y to the top of a @width x @height
+                //   rectangle whose left edge is at segment @i
+                bool getFit(uint i, uint width, uint height, uint &y) const
+                {
+                    uint const x = m_list_segments[i].x;
+                    if(x + width > m_width)
+                    {
+                        return false;
+                    }
+
+                    y = 0;
+                    uint width_left = width;
+                    while(width_left > 0)
+                    {
+                        Segment const &segment = m_list_segments[i];
+                        y = std::max(y,segment.y);
+                        if(y + height > m_height)
+                        {
+                            return false;
+                        }
+
+                        width_left -= std::min(width_left,segment.width);
+                        i++;
+                    }
+
+                    return true;
+                }
+
+                void addSegment(uint i, Segment const &new_segment)
+                {
+                    m_list_segments.insert(m_list_segments.begin()+i,new_segment);
+
+                    // Trim the segments under the new one
+                    uint const end_x = new_segment.x + new_segment.width;
+                    for(uint j=i+1; j < m_list_segments.size();)
+                    {
+                        Segment &segment = m_list_segments[j];
+                        if(segment.x >= end_x)
+                        {
+                            break;
+                        }
+
+                        uint const segment_end_x = segment.x + segment.width;
+                        if(segment_end_x <= end_x)
+                        {
+                            m_list_segments.erase(m_list_segments.begin()+j);
+                            continue;
+                        }
+
+                        segment.width = segment_end_x - end_x;
+                        segment.x = end_x;
+                        break;
+                    }
+
+                    // Merge neighbours at the same height
+                    for(uint j=0; j+1 < m_list_segments.size();)
+                    {
+                        if(m_list_segments[j].y == m_list_segments[j+1].y)
+                        {
+                            m_list_segments[j].width += m_list_segments[j+1].width;
+                            m_list_segments.erase(m_list_segments.begin()+j+1);
+                        }
+                        else
+                        {
+                            j++;
+                        }
+                    }
+                }
+
+                u64 getLargestFreeArea() const override
+                {
+                    // Largest rectangle in the histogram of the
+                    // free space below each segment
+                    u64 largest_area = 0;
+                    std::vector<std::pair<uint,uint>> list_stack; // (x,free height)
+
+                    for(uint i=0; i <= m_list_segments.size(); i++)
+                    {
+                        uint const x = (i < m_list_segments.size()) ?
+                                    m_list_segments[i].x : m_width;
+
+                        uint const free_height = (i < m_list_segments.size()) ?
+                                    m_height - m_list_segments[i].y : 0;
+
+                        uint start_x = x;
+                        while(!list_stack.empty() &&
+                              (list_stack.back().second >= free_height))
+                        {
+                            start_x = list_stack.back().first;
+                            largest_area = std::max(
+                                        largest_area,
+                                        u64(x-start_x)*list_stack.back().second);
+                            list_stack.pop_back();
+                        }
+
+                        list_stack.emplace_back(start_x,free_height);
+                    }
+
+                    return largest_area;
+                }
+
+                std::vector<Segment> m_list_segments;
+            };
+
+            // ============================================================= //
+
+            // MaxRectsPacker
+            // * Keeps a list of the free rectangles that can't
+            //   be grown in any direction; free rectangles can
+            //   overlap each other
+            class MaxRectsPacker final : public AtlasPacker
+            {
+            public:
+                MaxRectsPacker(uint width, uint height, uint spacing) :
+                    AtlasPacker(width,height,spacing)
+                {
+                    m_list_free.push_back(Rect{0,0,width,height});
+                }
+
+                bool AddRectangle(BinPackRectangle &rect) override
+                {
+                    uint const width = rect.width + m_spacing;
+                    uint const height = rect.height + m_spacing;
+
+                    // Best short side fit
+                    uint best_free = m_list_free.size();
+                    uint best_short_side = std::numeric_limits<uint>::max();
+                    uint best_long_side = std::numeric_limits<uint>::max();
+
+                    for(uint i=0; i < m_list_free.size(); i++)
+                    {
+                        Rect const &free = m_list_free[i];
+                        if((free.width < width) || (free.height < height))
+                        {
+                            continue;
+                        }
+
+                        uint const dx = free.width - width;
+                        uint const dy = free.height - height;
+                        uint const short_side = std::min(dx,dy);
+                        uint const long_side = std::max(dx,dy);
+
+                        if((short_side < best_short_side) ||
+                           ((short_side == best_short_side) &&
+                            (long_side < best_long_side)))
+                        {
+                            best_free = i;
+                            best_short_side = short_side;
+                            best_long_side = long_side;
+                        }
+                    }
+
+                    if(best_free == m_list_free.size())
+                    {
+                        return false;
+                    }
+
+                    Rect const used{
+                        m_list_free[best_free].x,
+                        m_list_free[best_free].y,
+                        width,
+                        height
+                    };
+
+                    splitFreeRects(used);
+
+                    rect.x = used.x;
+                    rect.y = used.y;
+
+                    addUsedArea(rect);
+                    return true;
+                }
+
+            private:
+                struct Rect
+                {
+                    uint x;
+                    uint y;
+                    uint width;
+                    uint height;
+                };
+
+                static bool contains(Rect const &a, Rect const &b)
+                {
+                    return (b.x >= a.x) && (b.y >= a.y) &&
+                           (b.x+b.width <= a.x+a.width) &&
+                           (b.y+b.height <= a.y+a.height);
+                }
+
+                void splitFreeRects(Rect const &used)
+                {
+                    // Replace each free rectangle that overlaps
+                    // @used with the parts of it on each side
+                    m_list_new_free.clear();
+
+                    for(uint i=0; i < m_list_free.size();)
+                    {
+                        Rect const free = m_list_free[i];
+                        if((used.x >= free.x+free.width) ||
+                           (used.x+used.width <= free.x) ||
+                           (used.y >= free.y+free.height) ||
+                           (used.y+used.height <= free.y))
+                        {
+                            i++;
+                            continue;
+                        }
+
+                        if(used.x > free.x)
+                        {
+                            m_list_new_free.push_back(
+                                        Rect{free.x,free.y,
+                                             used.x-free.x,free.height});
+                        }
+
+                        if(used.x+used.width < free.x+free.width)
+                        {
+                            m_list_new_free.push_back(
+                                        Rect{used.x+used.width,free.y,
+                                             (free.x+free.width)-(used.x+used.width),
+                                             free.height});
+                        }
+
+                        if(used.y > free.y)
+                        {
+                            m_list_new_free.push_back(
+                                        Rect{free.x,free.y,
+                                             free.width,used.y-free.y});
+                        }
+
+                        if(used.y+used.height < free.y+free.height)
+                        {
+                            m_list_new_free.push_back(
+                                        Rect{free.x,used.y+used.height,
+                                             free.width,
+                                             (free.y+free.height)-(used.y+used.height)});
+                        }
+
+                        m_list_free[i] = m_list_free.back();
+                        m_list_free.pop_back();
+                    }
+
+                    // Only the new rectangles can be contained in
+                    // another one or contain one of the old ones
+                    for(uint i=0; i < m_list_new_free.size(); i++)
+                    {
+                        bool contained = false;
+                        for(uint j=0; j < m_list_new_free.size(); j++)
+                        {
+                            if((i != j) &&
+                               contains(m_list_new_free[j],m_list_new_free[i]) &&
+                               ((j < i) || !contains(m_list_new_free[i],m_list_new_free[j])))
+                            {
+                                contained = true;
+                                break;
+                            }
+                        }
+
+                        for(uint j=0; (j < m_list_free.size()) && !contained; j++)
+                        {
+                            contained = contains(m_list_free[j],m_list_new_free[i]);
+                        }
+
+                        if(contained)
+                        {
+                            continue;
+                        }
+
+                        for(uint j=0; j < m_list_free.size();)
+                        {
+                            if(contains(m_list_new_free[i],m_list_free[j]))
+                            {
+                                m_list_free[j] = m_list_free.back();
+                                m_list_free.pop_back();
+                            }
+                            else
+                            {
+                                j++;
+                            }
+                        }
+
+                        m_list_free.push_back(m_list_new_free[i]);
+                    }
+                }
+
+                u64 getLargestFreeArea() const override
+                {
+                    u64 largest_area = 0;
+                    for(auto const &free : m_list_free)
+                    {
+                        largest_area = std::max(largest_area,
+                                                u64(free.width)*free.height);
+                    }
+
+                    return largest_area;
+                }
+
+                std::vector<Rect> m_list_free;
+                std::vector<Rect> m_list_new_free;
+            };
+        }
+
+        // =========================================================== //
+
+        AtlasPacker::AtlasPacker(uint width, uint height, uint spacing) :
+            m_width(width),
+            m_height(height),
+            m_spacing(spacing),
+            m_rect_count(0),
+            m_used_px(0)
+        {
+            // empty
+        }
+
+        AtlasOccupancy AtlasPacker::GetOccupancy() const
+        {
+            AtlasOccupancy occupancy;
+            occupancy.glyph_count = m_rect_count;
+            occupancy.used_px = m_used_px;
+            occupancy.total_px = u64(m_width)*m_height;
+            occupancy.largest_free_px = getLargestFreeArea();
+            occupancy.occupancy = double(m_used_px)/occupancy.total_px;
+
+            u64 const unused_px = occupancy.total_px - m_used_px;
+            occupancy.fragmentation =
+                    (unused_px == 0) ? 0.0f :
+                    1.0 - std::min(1.0,double(occupancy.largest_free_px)/unused_px);
+
+            return occupancy;
+        }
+
+        void AtlasPacker::addUsedArea(BinPackRectangle const &rect)
+        {
+            m_rect_count++;
+            m_used_px += u64(rect.width)*rect.height;
+        }
+
+        unique_ptr<AtlasPacker> CreateAtlasPacker(AtlasPackerType type,
+                                                  uint width,
+                                                  uint height,
+                                                  uint spacing)
+        {
+            if(type == AtlasPackerType::Skyline)
+            {
+                return make_unique<SkylinePacker>(width,height,spacing);
+            }
+
+            if(type == AtlasPackerType::MaxRects)
+            {
+                return make_unique<MaxRectsPacker>(width,height,spacing);
+            }
+
+            return make_unique<ShelfPacker>(width,height,spacing);
+        }
+    }
+}
@@ -0,0 +1,113 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_TEXT_ATLAS_PACKER_HPP
+#define KS_TEXT_ATLAS_PACKER_HPP
+
+#include <vector>
+
+#include <ks/KsGlobal.hpp>
+#include <ks/shared/KsBinPackShelf.hpp>
+
+namespace ks
+{
+    namespace text
+    {
+        // AtlasPackerType
+        // * Selects how glyph images are packed into atlases
+        enum class AtlasPackerType
+        {
+            // * Rows of glyphs (BinPackShelf); each row is as
+            //   tall as its tallest glyph
+            Shelf,
+
+            // * Each glyph goes where its bottom edge is the
+            //   lowest on the skyline formed by the glyphs that
+            //   were already added (bottom-left rule)
+            Skyline,
+
+            // * Keeps every maximal free rectangle and puts each
+            //   glyph in the one it fits most tightly (best short
+            //   side fit); packs the densest but is the slowest
+            MaxRects
+        };
+
+        // AtlasOccupancy
+        // * How full a single atlas is
+        struct AtlasOccupancy
+        {
+            uint glyph_count;
+
+            // * Area of the glyph images, not including spacing
+            u64 used_px;
+
+            // * Area of the whole atlas
+            u64 total_px;
+
+            // * Area of the largest rectangle that can still
+            //   be added
+            u64 largest_free_px;
+
+            // * used_px/total_px
+            float occupancy;
+
+            // * Fraction of the unused area that isn't part of
+            //   the largest free rectangle; 0 if all of the
+            //   unused area is in one piece
+            float fragmentation;
+        };
+
+        // AtlasPacker
+        // * Places rectangles in a single atlas; used by
+        //   TextAtlas for each of its atlases
+        class AtlasPacker
+        {
+        public:
+            virtual ~AtlasPacker() = default;
+
+            // * Sets the position of @rect and returns true if
+            //   there's room for it; @rect is unchanged otherwise
+            // * Rectangles are separated by the spacing passed
+            //   to CreateAtlasPacker
+            virtual bool AddRectangle(BinPackRectangle &rect) = 0;
+
+            AtlasOccupancy GetOccupancy() const;
+
+        protected:
+            AtlasPacker(uint width, uint height, uint spacing);
+
+            virtual u64 getLargestFreeArea() const = 0;
+
+            // * Call for every rectangle that's added
+            void addUsedArea(BinPackRectangle const &rect);
+
+            uint const m_width;
+            uint const m_height;
+            uint const m_spacing;
+
+        private:
+            uint m_rect_count;
+            u64 m_used_px;
+        };
+
+        unique_ptr<AtlasPacker> CreateAtlasPacker(AtlasPackerType type,
+                                                  uint width,
+                                                  uint height,
+                                                  uint spacing);
+    }
+}
+
+#endif // KS_TEXT_ATLAS_PACKER_HPP
@@ -22,6 +22,8 @@
 
 namespace ks
 {
+    struct ImageData;
+
     namespace text
     {
         // =========================================================== //
@@ -61,6 +63,36 @@ namespace ks
             // text will be truncated before the line width limit
             // is reached and appended with '...' at the end
             bool elide{false};
+
+            // The maximum number of lines shown when @elide is
+            // set. If this is greater than one, text is broken
+            // into lines as usual and the last visible line is
+            // elided if there's more text than fits
+            uint max_lines{1};
+
+            // Allows runs in simple scripts (Latin, Greek, Cyrillic,
+            // CJK, ...) to be shaped directly from the font's cmap,
+            // hmtx and kern tables instead of going through HarfBuzz
+            // when the font has no OpenType features for the script.
+            // The results are the same either way.
+            bool simple_shaping{true};
+        };
+
+        // =========================================================== //
+
+        // GlyphImageType
+        // * What a glyph's atlas image holds (see TextManager::AddFont)
+        enum class GlyphImageType : u8
+        {
+            // * A signed distance field made with the TextManager's
+            //   SDFEngine, with the sdf offset around the glyph
+            SDF,
+
+            // * The glyph's hinted 8-bit coverage bitmap without
+            //   a border; meant to be drawn at its own size, which
+            //   looks sharper than a distance field for small text
+            //   and is much cheaper to generate
+            Bitmap
         };
 
         // =========================================================== //
@@ -70,15 +102,35 @@ namespace ks
             uint cluster;
             u16  atlas;
 
+            // channel of the atlas that has this glyph's distance
+            // field; always 0 unless channel packing is enabled
+            // (see TextManager::EnableChannelPacking)
+            u16  channel;
+
+            // what the glyph's image holds; bitmap glyphs
+            // have no sdf border (sdf_x and sdf_y are 0)
+            GlyphImageType image_type;
+
             // texture coords (pixels) for the top
             // left corner of the glyph tex in its atlas
             u16 tex_x;
             u16 tex_y;
 
-            // sdf quad <--> glyph offset vector (pixels)
+            // sdf quad <--> glyph offset vector (atlas pixels)
             u16 sdf_x;
             u16 sdf_y;
 
+            // size of the glyph's image in its atlas including
+            // the sdf border on each side; 0 if there's no image
+            u16 tex_width;
+            u16 tex_height;
+
+            // layout pixels per atlas pixel; this is 1 unless the
+            // glyph's font was added with its own glyph_res_px
+            // * the glyph's quad is its image scaled by this with
+            //   the top left corner at (x0-sdf_x*scale,y1+sdf_y*scale)
+            float scale;
+
             s32 x0;
             s32 y0;
             s32 x1; // x1 is to the right of x0
@@ -89,6 +141,33 @@ namespace ks
 
         // =========================================================== //
 
+        // ClusterSpan
+        // * A run of glyphs in a line that share the same cluster
+        // * Clusters are shaped with HarfBuzz's default cluster
+        //   level (monotone graphemes) so combining marks are
+        //   merged with their base character; this makes cluster
+        //   boundaries valid caret positions
+        struct ClusterSpan
+        {
+            // * Logical range of code units [start,end)
+            uint start;
+            uint end;
+
+            // * Pen position extents (not the glyph bounding
+            //   box) for this cluster on the line's baseline
+            sint x0;
+            sint x1;
+
+            // * Index of the first glyph in Line::list_glyphs
+            //   and the number of glyphs in this cluster
+            uint glyph;
+            uint glyph_count;
+
+            bool rtl;
+        };
+
+        // =========================================================== //
+
         struct Line
         {
             uint start;
@@ -123,6 +202,142 @@ namespace ks
             // * Overall direction for the paragraph this
             //   line belongs to (rtl stands for right-to-left)
             bool rtl;
+
+            // Hit testing and caret positions
+            // * See KsTextTextLayout.hpp for queries that use these
+
+            // * Position of this line's baseline relative to the
+            //   first line's baseline (each baseline is spacing
+            //   below the previous one, y decreases going down)
+            sint baseline_y;
+
+            // * Cluster spans in visual order (sorted by x)
+            std::vector<ClusterSpan> list_cluster_spans;
+
+            // * Indices into list_cluster_spans sorted
+            //   by logical order (ClusterSpan::start)
+            std::vector<uint> list_logical_spans;
+        };
+
+        // =========================================================== //
+
+        struct LineMetrics
+        {
+            uint start;
+            uint end;
+
+            // * Sum of the advances of all glyphs in this line
+            sint advance;
+
+            // Bounding box
+            // * Same as the Line bounding box; computed from
+            //   glyph metrics without rasterizing any glyphs
+            sint x_min;
+            sint x_max;
+            sint y_min;
+            sint y_max;
+
+            // Font Metrics
+            // * Same as the Line font metrics
+            sint ascent;
+            sint descent;
+            uint spacing;
+
+            bool rtl;
+        };
+
+        // =========================================================== //
+
+        struct TextMetrics
+        {
+            std::vector<LineMetrics> list_lines;
+
+            // Bounding box
+            // * Bounding box for all lines. The baseline of the
+            //   first line is at y=0 and the baseline of each
+            //   following line is its spacing below the previous
+            //   baseline (y decreases going down)
+            sint x_min;
+            sint x_max;
+            sint y_min;
+            sint y_max;
+        };
+
+        // =========================================================== //
+
+        // AtlasUpdateMode
+        // * How new glyph images are passed on to renderers
+        enum class AtlasUpdateMode
+        {
+            // * signal_new_glyph is emitted with the image of
+            //   each new glyph as soon as it's added
+            PerGlyph,
+
+            // * New glyph images are copied to a staging image
+            //   for their atlas and signal_atlas_updated is
+            //   emitted once for each atlas that changed at the
+            //   end of every GetGlyphs call, with a few dirty
+            //   rectangles that cover the new glyphs
+            Batched,
+
+            // * Same as Batched, but instead of a signal each
+            //   dirty rectangle is queued with a copy of its
+            //   pixels, to be taken with TakeAtlasUpdates
+            Queued
+        };
+
+        struct AtlasRect
+        {
+            u16 x;
+            u16 y;
+            u16 width;
+            u16 height;
+        };
+
+        // AtlasUpdate
+        // * A dirty rectangle in an atlas and its pixels
+        struct AtlasUpdate
+        {
+            uint atlas;
+            AtlasRect rect;
+
+            // * rect.width x rect.height pixels in the
+            //   same format as the atlas
+            shared_ptr<ImageData> image;
+        };
+
+        // FreeTypeMemoryStats
+        // * What FreeType has allocated across all of the
+        //   FreeType libraries used by a TextManager (its own and
+        //   one for each raster thread)
+        struct FreeTypeMemoryStats
+        {
+            // * Bytes FreeType has allocated and not freed
+            u64 bytes_in_use{0};
+
+            // * The sum of the highest bytes_in_use of each
+            //   library
+            u64 peak_bytes{0};
+
+            // * Bytes taken from the system, including freed
+            //   blocks that are kept for reuse
+            u64 reserved_bytes{0};
+
+            u64 alloc_count{0};
+
+            // * Allocations that failed because they would have
+            //   gone over the limit (see SetFreeTypeMemoryLimit)
+            u64 failed_alloc_count{0};
+
+            // * bytes_in_use for each font, by the font's index
+            //   (fonts are numbered from 1 in the order they were
+            //   added); index 0 has what isn't counted for a font,
+            //   like the libraries' modules
+            // * Library caches made while a font's glyphs are
+            //   loaded (ie. the TrueType interpreter's context)
+            //   are counted for that font and aren't released
+            //   with it
+            std::vector<u64> list_font_bytes;
         };
 
         // =========================================================== //
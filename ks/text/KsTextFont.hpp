@@ -18,6 +18,7 @@
 #define KS_TEXT_FONT_HPP
 
 #include <ks/text/KsTextFreeType.hpp>
+#include <ks/text/KsTextGlyphDesc.hpp>
 
 #include <harfbuzz/hb.h>
 #include <harfbuzz/hb-ft.h>
@@ -26,6 +27,39 @@ namespace ks
 {
 	namespace text
 	{
+        // SimpleShapingTables
+        // * Tables used to shape runs in simple scripts without
+        //   going through HarfBuzz (see ShapeLine)
+        // * Built the first time a run in the font is shaped
+        struct SimpleShapingTables
+        {
+            // Glyph indices for codepoints, split into pages
+            // of 256 codepoints that are filled on demand
+            std::vector<unique_ptr<std::vector<u32>>> list_cmap_pages;
+
+            // Horizontal advance for each glyph (26.6)
+            std::vector<s32> list_advances;
+
+            // Pairs from the 'kern' table sorted by
+            // ((left glyph << 16) | right glyph) with
+            // their kerning values (26.6)
+            std::vector<std::pair<u32,s32>> list_kern_pairs;
+
+            // Whether or not the font has GDEF glyph classes
+            bool has_glyph_classes;
+
+            // Whether or not HarfBuzz would apply fallback
+            // kerning (only done for fonts without GPOS)
+            bool fallback_kern;
+
+            // False if the font can't be shaped this way
+            bool valid;
+
+            // Scripts that have been checked so far and whether
+            // or not they have any GSUB or GPOS lookups
+            std::vector<std::pair<hb_script_t,bool>> list_scripts;
+        };
+
 		struct Font
         {
             std::string name;
@@ -34,10 +68,43 @@ namespace ks
 
             // FreeType reference for this font
             // (we only use face 0 of the font)
-            FT_Face ft_face;
+            FT_Face ft_face{nullptr};
 
             // HarfBuzz reference for this font
-            hb_font_t* hb_font;
+            hb_font_t* hb_font{nullptr};
+
+            // Whether hb_font gets glyphs and advances from the
+            // font data with HarfBuzz's OpenType font functions
+            // instead of from ft_face through hb-ft (see
+            // TextManager::EnableOpenTypeFontFuncs)
+            bool hb_ot_funcs{false};
+
+            // Resolution glyph images are rasterized at and the
+            // sdf offset around them (px); ft_face and hb_font
+            // are always sized to the TextManager's glyph_res_px
+            // so every font is shaped in the same units
+            uint glyph_res_px{0};
+            uint sdf_offset_px{0};
+
+            // What glyph images are generated for this font;
+            // sdf_offset_px is 0 for GlyphImageType::Bitmap
+            GlyphImageType image_type{GlyphImageType::SDF};
+
+            // Face sized to glyph_res_px that glyph images are
+            // rasterized from; this is ft_face if glyph_res_px
+            // is the TextManager's glyph_res_px
+            FT_Face ft_raster_face{nullptr};
+
+            // Shaped '...' glyphs used to elide text in this
+            // font; shaped once the first time they're needed
+            bool elide_shaped{false};
+            sint elide_advance{0};
+            std::vector<GlyphInfo> list_elide_glyph_info;
+            std::vector<GlyphOffset> list_elide_glyph_offsets;
+
+            // Tables for shaping simple scripts without
+            // HarfBuzz; created the first time they're needed
+            unique_ptr<SimpleShapingTables> simple_shaping_tables;
         };
 	}
 }
@@ -20,10 +20,20 @@ namespace ks
     {
         std::string GetFreeTypeError(FT_Error error)
         {
+            // The table is in the order of fterrdef.h, not
+            // indexed by error code, and ends with a null message
+            FreeTypeErrorDesc const * error_desc = FT_ErrorDesc;
+            while(error_desc->message && (error_desc->code != error))
+            {
+                error_desc++;
+            }
+
             std::string desc = "FreeType err:";
-            desc += ks::ToString(FT_ErrorDesc[error].code);
+            desc += ks::ToString(error);
             desc += std::string(": ");
-            desc += ks::ToString(FT_ErrorDesc[error].message);
+            desc += (error_desc->message) ?
+                        std::string(error_desc->message) :
+                        std::string("Unknown error");
 
             return desc;
         }
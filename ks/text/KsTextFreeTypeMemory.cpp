@@ -0,0 +1,399 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include <ks/text/KsTextFreeTypeMemory.hpp>
+
+#include FT_MODULE_H
+
+namespace ks
+{
+    namespace text
+    {
+        namespace {
+
+            // * Every block starts with a header so it can be
+            //   freed without its size; 16 bytes keeps the memory
+            //   after it aligned like malloc's
+            struct BlockHeader
+            {
+                // bytes requested by FreeType
+                u64 size;
+
+                // index into kSizeClasses or kLargeBlock
+                u32 size_class;
+
+                // font the block is counted for
+                u32 font;
+            };
+
+            static_assert(sizeof(BlockHeader) == 16,
+                          "BlockHeader must be 16 bytes");
+
+            u64 const kHeaderSize = sizeof(BlockHeader);
+
+            // * Block sizes including the header; most of what
+            //   FreeType allocates is well under 1K
+            u32 const kSizeClasses[] = {
+                32,48,64,80,96,112,128,
+                160,192,224,256,
+                320,384,448,512,
+                640,768,896,1024,
+                1280,1536,1792,2048,
+                2560,3072,3584,4096
+            };
+
+            uint const kSizeClassCount =
+                    sizeof(kSizeClasses)/sizeof(kSizeClasses[0]);
+
+            // * Blocks larger than the last size class are
+            //   allocated with malloc
+            u32 const kLargeBlock = 0xFFFFFFFF;
+
+            uint const kChunkSize = 64*1024;
+
+            u32 GetSizeClass(u64 block_size)
+            {
+                if(block_size > kSizeClasses[kSizeClassCount-1])
+                {
+                    return kLargeBlock;
+                }
+
+                return std::lower_bound(kSizeClasses,
+                                        kSizeClasses+kSizeClassCount,
+                                        block_size) - kSizeClasses;
+            }
+
+            BlockHeader & GetHeader(void * block)
+            {
+                return *reinterpret_cast<BlockHeader*>(
+                            static_cast<u8*>(block)-kHeaderSize);
+            }
+        }
+
+        // =========================================================== //
+
+        FreeTypeMemory::Scope::Scope(FreeTypeMemory &memory, uint font) :
+            m_memory(&memory),
+            m_prev_font(memory.m_font)
+        {
+            m_memory->m_font = font;
+        }
+
+        FreeTypeMemory::Scope::Scope(FT_Face face, uint font) :
+            m_memory((face && (face->memory->alloc == &FreeTypeMemory::Alloc)) ?
+                         static_cast<FreeTypeMemory*>(face->memory->user) : nullptr),
+            m_prev_font(0)
+        {
+            if(m_memory)
+            {
+                m_prev_font = m_memory->m_font;
+                m_memory->m_font = font;
+            }
+        }
+
+        FreeTypeMemory::Scope::~Scope()
+        {
+            if(m_memory)
+            {
+                m_memory->m_font = m_prev_font;
+            }
+        }
+
+        // =========================================================== //
+
+        FreeTypeMemory::FreeTypeMemory() :
+            m_max_bytes(0),
+            m_font(0),
+            m_list_free_blocks(kSizeClassCount,nullptr),
+            m_chunk_pos(nullptr),
+            m_chunk_end(nullptr),
+            m_bytes_in_use(0),
+            m_peak_bytes(0),
+            m_reserved_bytes(0),
+            m_alloc_count(0),
+            m_failed_alloc_count(0),
+            m_list_font_bytes(1,0)
+        {
+            m_ft_memory.user = this;
+            m_ft_memory.alloc = &FreeTypeMemory::Alloc;
+            m_ft_memory.free = &FreeTypeMemory::Free;
+            m_ft_memory.realloc = &FreeTypeMemory::Realloc;
+        }
+
+        FreeTypeMemory::~FreeTypeMemory()
+        {
+            for(void * chunk : m_list_chunks)
+            {
+                std::free(chunk);
+            }
+        }
+
+        FT_Error FreeTypeMemory::NewLibrary(FT_Library * library)
+        {
+            FT_Error const error = FT_New_Library(&m_ft_memory,library);
+            if(error)
+            {
+                return error;
+            }
+
+            FT_Add_Default_Modules(*library);
+
+            return error;
+        }
+
+        void FreeTypeMemory::SetLimit(u64 max_bytes)
+        {
+            m_max_bytes = max_bytes;
+        }
+
+        void FreeTypeMemory::AddStats(FreeTypeMemoryStats &stats) const
+        {
+            stats.bytes_in_use += m_bytes_in_use;
+            stats.peak_bytes += m_peak_bytes;
+            stats.reserved_bytes += m_reserved_bytes;
+            stats.alloc_count += m_alloc_count;
+            stats.failed_alloc_count += m_failed_alloc_count;
+
+            if(stats.list_font_bytes.size() < m_list_font_bytes.size())
+            {
+                stats.list_font_bytes.resize(m_list_font_bytes.size(),0);
+            }
+
+            for(uint i=0; i < m_list_font_bytes.size(); i++)
+            {
+                stats.list_font_bytes[i] += m_list_font_bytes[i];
+            }
+        }
+
+        void * FreeTypeMemory::Alloc(FT_Memory ft_memory,
+                                     long size)
+        {
+            FreeTypeMemory * memory =
+                    static_cast<FreeTypeMemory*>(ft_memory->user);
+
+            if(memory->isOverLimit(size))
+            {
+                memory->m_failed_alloc_count++;
+                return nullptr;
+            }
+
+            return memory->allocate(size);
+        }
+
+        void FreeTypeMemory::Free(FT_Memory ft_memory,
+                                  void * block)
+        {
+            static_cast<FreeTypeMemory*>(
+                        ft_memory->user)->release(block);
+        }
+
+        void * FreeTypeMemory::Realloc(FT_Memory ft_memory,
+                                       long,
+                                       long new_size,
+                                       void * block)
+        {
+            // The block's header has its current size
+            return static_cast<FreeTypeMemory*>(
+                        ft_memory->user)->reallocate(new_size,block);
+        }
+
+        bool FreeTypeMemory::isOverLimit(u64 added_size) const
+        {
+            return ((m_max_bytes > 0) &&
+                    (m_bytes_in_use+added_size > m_max_bytes));
+        }
+
+        void * FreeTypeMemory::allocate(u64 size)
+        {
+            u64 const block_size = size+kHeaderSize;
+            u32 const size_class = GetSizeClass(block_size);
+
+            u8 * block;
+            if(size_class == kLargeBlock)
+            {
+                block = static_cast<u8*>(std::malloc(block_size));
+                if(block)
+                {
+                    m_reserved_bytes += block_size;
+                }
+            }
+            else
+            {
+                block = takeBlock(size_class);
+            }
+
+            if(block == nullptr)
+            {
+                m_failed_alloc_count++;
+                return nullptr;
+            }
+
+            BlockHeader &header = *reinterpret_cast<BlockHeader*>(block);
+            header.size = size;
+            header.size_class = size_class;
+            header.font = m_font;
+
+            if(m_list_font_bytes.size() <= m_font)
+            {
+                m_list_font_bytes.resize(m_font+1,0);
+            }
+
+            m_list_font_bytes[m_font] += size;
+            m_bytes_in_use += size;
+            m_peak_bytes = std::max(m_peak_bytes,m_bytes_in_use);
+            m_alloc_count++;
+
+            return block+kHeaderSize;
+        }
+
+        void FreeTypeMemory::release(void * block)
+        {
+            if(block == nullptr)
+            {
+                return;
+            }
+
+            BlockHeader &header = GetHeader(block);
+            m_list_font_bytes[header.font] -= header.size;
+            m_bytes_in_use -= header.size;
+
+            if(header.size_class == kLargeBlock)
+            {
+                m_reserved_bytes -= (header.size+kHeaderSize);
+                std::free(&header);
+                return;
+            }
+
+            // Push the block onto its free list
+            void * &first_free = m_list_free_blocks[header.size_class];
+            *reinterpret_cast<void**>(&header) = first_free;
+            first_free = &header;
+        }
+
+        void * FreeTypeMemory::reallocate(u64 new_size, void * block)
+        {
+            u64 const cur_size = block ? GetHeader(block).size : 0;
+            if((new_size > cur_size) && isOverLimit(new_size-cur_size))
+            {
+                m_failed_alloc_count++;
+                return nullptr;
+            }
+
+            if(block == nullptr)
+            {
+                return allocate(new_size);
+            }
+
+            BlockHeader &header = GetHeader(block);
+            u32 const size_class = GetSizeClass(new_size+kHeaderSize);
+
+            if((size_class != kLargeBlock) &&
+               (header.size_class != kLargeBlock) &&
+               (size_class <= header.size_class))
+            {
+                // Still fits in the same block; blocks aren't
+                // moved to a smaller class when they shrink
+                // since FreeType usually grows them again
+            }
+            else if((size_class == kLargeBlock) &&
+                    (header.size_class == kLargeBlock))
+            {
+                void * large_block =
+                        std::realloc(&header,new_size+kHeaderSize);
+
+                if(large_block == nullptr)
+                {
+                    m_failed_alloc_count++;
+                    return nullptr;
+                }
+
+                m_reserved_bytes += new_size;
+                m_reserved_bytes -= cur_size;
+
+                block = static_cast<u8*>(large_block)+kHeaderSize;
+            }
+            else
+            {
+                // Moves to a different block; the new block is
+                // counted for the same font as the old one. The
+                // limit was already checked for the difference
+                u32 const font = m_font;
+                m_font = header.font;
+                void * new_block = allocate(new_size);
+                m_font = font;
+
+                if(new_block == nullptr)
+                {
+                    return nullptr;
+                }
+
+                std::memcpy(new_block,block,std::min(cur_size,new_size));
+                release(block);
+
+                return new_block;
+            }
+
+            BlockHeader &new_header = GetHeader(block);
+            new_header.size = new_size;
+
+            m_list_font_bytes[new_header.font] += new_size;
+            m_list_font_bytes[new_header.font] -= cur_size;
+            m_bytes_in_use += new_size;
+            m_bytes_in_use -= cur_size;
+            m_peak_bytes = std::max(m_peak_bytes,m_bytes_in_use);
+
+            return block;
+        }
+
+        u8 * FreeTypeMemory::takeBlock(u32 size_class)
+        {
+            // Reuse a freed block
+            void * &first_free = m_list_free_blocks[size_class];
+            if(first_free)
+            {
+                u8 * block = static_cast<u8*>(first_free);
+                first_free = *reinterpret_cast<void**>(block);
+                return block;
+            }
+
+            // Carve a new block out of the current chunk; the
+            // end of a chunk that's too small is left unused
+            u32 const block_size = kSizeClasses[size_class];
+            if(u64(m_chunk_end-m_chunk_pos) < block_size)
+            {
+                u8 * chunk = static_cast<u8*>(std::malloc(kChunkSize));
+                if(chunk == nullptr)
+                {
+                    return nullptr;
+                }
+
+                m_list_chunks.push_back(chunk);
+                m_reserved_bytes += kChunkSize;
+                m_chunk_pos = chunk;
+                m_chunk_end = chunk+kChunkSize;
+            }
+
+            u8 * block = m_chunk_pos;
+            m_chunk_pos += block_size;
+
+            return block;
+        }
+    }
+}
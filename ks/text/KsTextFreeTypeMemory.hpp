@@ -0,0 +1,136 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_TEXT_FREETYPE_MEMORY_HPP
+#define KS_TEXT_FREETYPE_MEMORY_HPP
+
+#include <ks/text/KsTextDataTypes.hpp>
+#include <ks/text/KsTextFreeType.hpp>
+
+#include FT_SYSTEM_H
+
+namespace ks
+{
+    namespace text
+    {
+        // FreeTypeMemory
+        // * The FT_Memory for a single FT_Library
+        // * FreeType makes many small allocations while loading
+        //   faces and glyphs. Small blocks are carved out of
+        //   larger chunks and kept in a free list for their size
+        //   class when they're freed, so they're reused without
+        //   going through malloc; larger blocks use malloc
+        // * Memory in the free lists is only returned to the
+        //   system when the FreeTypeMemory is destroyed
+        // * Like its library, a FreeTypeMemory isn't locked and
+        //   must only be used by one thread at a time. Each
+        //   library having its own means raster threads never
+        //   wait on each other to allocate
+        class FreeTypeMemory final
+        {
+        public:
+            // Scope
+            // * Allocations made while a Scope exists are counted
+            //   for @font (see FreeTypeMemoryStats::list_font_bytes)
+            //   until they're freed
+            class Scope final
+            {
+            public:
+                Scope(FreeTypeMemory &memory, uint font);
+
+                // * Uses the FreeTypeMemory of @face's library;
+                //   does nothing if the library wasn't created
+                //   with a FreeTypeMemory
+                Scope(FT_Face face, uint font);
+
+                ~Scope();
+
+            private:
+                FreeTypeMemory * const m_memory;
+                u32 m_prev_font;
+            };
+
+            FreeTypeMemory();
+            ~FreeTypeMemory();
+
+            FreeTypeMemory(FreeTypeMemory const &) = delete;
+            FreeTypeMemory & operator = (FreeTypeMemory const &) = delete;
+
+            // * Same as FT_Init_FreeType but the library allocates
+            //   from this FreeTypeMemory
+            // * The library must be released with FT_Done_Library
+            //   (not FT_Done_FreeType) before this is destroyed
+            FT_Error NewLibrary(FT_Library * library);
+
+            // * Allocations fail once FreeType would have more
+            //   than @max_bytes in use; FreeType then returns
+            //   an out of memory error from the call that made
+            //   them. 0 means no limit
+            void SetLimit(u64 max_bytes);
+
+            // * Adds the counters for this FreeTypeMemory
+            //   to @stats
+            void AddStats(FreeTypeMemoryStats &stats) const;
+
+        private:
+            static void * Alloc(FT_Memory ft_memory,
+                                long size);
+
+            static void Free(FT_Memory ft_memory,
+                             void * block);
+
+            static void * Realloc(FT_Memory ft_memory,
+                                  long cur_size,
+                                  long new_size,
+                                  void * block);
+
+            bool isOverLimit(u64 added_size) const;
+            void * allocate(u64 size);
+            void release(void * block);
+            void * reallocate(u64 new_size, void * block);
+
+            u8 * takeBlock(u32 size_class);
+
+            FT_MemoryRec_ m_ft_memory;
+
+            u64 m_max_bytes;
+
+            // * Font that new allocations are counted for
+            u32 m_font;
+
+            // list_free_blocks
+            // * The first free block of each size class; each
+            //   free block starts with a pointer to the next one
+            std::vector<void*> m_list_free_blocks;
+
+            // * Chunks that small blocks are carved out of; new
+            //   blocks come from [chunk_pos,chunk_end) of the
+            //   last chunk
+            std::vector<void*> m_list_chunks;
+            u8 * m_chunk_pos;
+            u8 * m_chunk_end;
+
+            u64 m_bytes_in_use;
+            u64 m_peak_bytes;
+            u64 m_reserved_bytes;
+            u64 m_alloc_count;
+            u64 m_failed_alloc_count;
+            std::vector<u64> m_list_font_bytes;
+        };
+    }
+}
+
+#endif // KS_TEXT_FREETYPE_MEMORY_HPP
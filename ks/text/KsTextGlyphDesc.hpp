@@ -19,6 +19,7 @@
 
 #include <vector>
 #include <ks/KsGlobal.hpp>
+#include <ks/text/KsTextDataTypes.hpp>
 
 namespace ks
 {
@@ -102,6 +103,18 @@ namespace ks
             s16 bearing_y;
             u16 width;
             u16 height;
+
+            // resolution the glyph was rasterized at (pixels
+            // per em); every other value is in these pixels
+            u16 res_px;
+
+            // channel of the atlas the glyph's image is in;
+            // always 0 unless channel packing is enabled
+            u8 channel;
+
+            // the font's image type (the missing glyph is
+            // always an SDF)
+            GlyphImageType image_type;
         };
 
         // Generated by ShapeText. Contains the glyph
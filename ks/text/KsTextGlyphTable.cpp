@@ -0,0 +1,224 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <limits>
+
+#include <ks/text/KsTextGlyphTable.hpp>
+
+namespace ks
+{
+    namespace text
+    {
+        namespace
+        {
+            // Number of glyphs FindBatch hashes and prefetches
+            // before it starts probing
+            uint const kBatchSize = 16;
+
+            inline void PrefetchSlot(void const * ptr)
+            {
+#if defined(__GNUC__) || defined(__clang__)
+                __builtin_prefetch(ptr);
+#else
+                (void)ptr;
+#endif
+            }
+        }
+
+        // =========================================================== //
+
+        u64 const GlyphTable::m_empty_key =
+                std::numeric_limits<u64>::max();
+
+        GlyphTable::GlyphTable() :
+            m_capacity_bits(0)
+        {
+            rehash(64);
+        }
+
+        GlyphImageDesc const * GlyphTable::Find(uint font,
+                                                uint index) const
+        {
+            uint const slot = findSlot(getKey(font,index));
+            if(m_list_keys[slot] == m_empty_key)
+            {
+                return nullptr;
+            }
+
+            return &(m_list_glyphs[m_list_slot_glyphs[slot]]);
+        }
+
+        void GlyphTable::FindBatch(std::vector<GlyphInfo> const &list_glyph_info,
+                                   GlyphImageDesc * list_glyphs,
+                                   std::vector<uint> &list_misses,
+                                   u32 use_stamp)
+        {
+            uint const mask = (1u << m_capacity_bits)-1;
+
+            u64 list_batch_keys[kBatchSize];
+            uint list_batch_slots[kBatchSize];
+
+            uint const count = list_glyph_info.size();
+            for(uint i=0; i < count; i+=kBatchSize)
+            {
+                uint const batch_count = std::min(kBatchSize,count-i);
+
+                // Hash the whole batch first and prefetch each
+                // home slot so the cache misses for the batch
+                // overlap instead of happening one at a time
+                for(uint j=0; j < batch_count; j++)
+                {
+                    GlyphInfo const &glyph_info = list_glyph_info[i+j];
+                    list_batch_keys[j] = getKey(glyph_info.font,
+                                                glyph_info.index);
+                    list_batch_slots[j] = getHomeSlot(list_batch_keys[j]);
+                }
+
+                for(uint j=0; j < batch_count; j++)
+                {
+                    PrefetchSlot(&(m_list_keys[list_batch_slots[j]]));
+                }
+
+                for(uint j=0; j < batch_count; j++)
+                {
+                    if(list_glyph_info[i+j].zero_width)
+                    {
+                        list_misses.push_back(i+j);
+                        continue;
+                    }
+
+                    u64 const key = list_batch_keys[j];
+                    uint slot = list_batch_slots[j];
+                    while((m_list_keys[slot] != key) &&
+                          (m_list_keys[slot] != m_empty_key))
+                    {
+                        slot = (slot+1) & mask;
+                    }
+
+                    if(m_list_keys[slot] == m_empty_key)
+                    {
+                        list_misses.push_back(i+j);
+                    }
+                    else
+                    {
+                        uint const glyph = m_list_slot_glyphs[slot];
+                        list_glyphs[i+j] = m_list_glyphs[glyph];
+                        m_list_last_use[glyph] = use_stamp;
+                    }
+                }
+            }
+        }
+
+        void GlyphTable::Insert(GlyphImageDesc const &glyph, u32 use_stamp)
+        {
+            u64 const key = getKey(glyph.font,glyph.index);
+            uint slot = findSlot(key);
+
+            if(m_list_keys[slot] == key)
+            {
+                m_list_glyphs[m_list_slot_glyphs[slot]] = glyph;
+                m_list_last_use[m_list_slot_glyphs[slot]] = use_stamp;
+                return;
+            }
+
+            // Keep the table at most half full
+            uint const capacity = 1u << m_capacity_bits;
+            if((m_list_glyphs.size()+1)*2 > capacity)
+            {
+                rehash(capacity*2);
+                slot = findSlot(key);
+            }
+
+            m_list_keys[slot] = key;
+            m_list_slot_glyphs[slot] = m_list_glyphs.size();
+            m_list_glyphs.push_back(glyph);
+            m_list_last_use.push_back(use_stamp);
+        }
+
+        void GlyphTable::Clear()
+        {
+            m_list_glyphs.clear();
+            m_list_last_use.clear();
+            rehash(64);
+        }
+
+        uint GlyphTable::GetSize() const
+        {
+            return m_list_glyphs.size();
+        }
+
+        std::vector<GlyphImageDesc> const & GlyphTable::GetGlyphList() const
+        {
+            return m_list_glyphs;
+        }
+
+        std::vector<u32> const & GlyphTable::GetLastUseList() const
+        {
+            return m_list_last_use;
+        }
+
+        u64 GlyphTable::getKey(uint font, uint index)
+        {
+            return ((u64(font) << 32) | index);
+        }
+
+        uint GlyphTable::getHomeSlot(u64 key) const
+        {
+            // Fibonacci hashing; the upper bits of the product
+            // depend on every bit of the key
+            return ((key*0x9E3779B97F4A7C15ull) >> (64-m_capacity_bits));
+        }
+
+        uint GlyphTable::findSlot(u64 key) const
+        {
+            // Returns the slot that holds @key or the empty
+            // slot where @key would be inserted
+            uint const mask = (1u << m_capacity_bits)-1;
+            uint slot = getHomeSlot(key);
+
+            while((m_list_keys[slot] != key) &&
+                  (m_list_keys[slot] != m_empty_key))
+            {
+                slot = (slot+1) & mask;
+            }
+
+            return slot;
+        }
+
+        void GlyphTable::rehash(uint capacity)
+        {
+            m_capacity_bits = 0;
+            while((1u << m_capacity_bits) < capacity)
+            {
+                m_capacity_bits++;
+            }
+
+            m_list_keys.assign(capacity,m_empty_key);
+            m_list_slot_glyphs.assign(capacity,0);
+
+            for(uint i=0; i < m_list_glyphs.size(); i++)
+            {
+                GlyphImageDesc const &glyph = m_list_glyphs[i];
+                u64 const key = getKey(glyph.font,glyph.index);
+                uint const slot = findSlot(key);
+
+                m_list_keys[slot] = key;
+                m_list_slot_glyphs[slot] = i;
+            }
+        }
+    }
+}
@@ -0,0 +1,97 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_TEXT_GLYPH_TABLE_HPP
+#define KS_TEXT_GLYPH_TABLE_HPP
+
+#include <ks/text/KsTextGlyphDesc.hpp>
+
+namespace ks
+{
+    namespace text
+    {
+        // GlyphTable
+        // * Hash table of GlyphImageDescs keyed by
+        //   (font index, glyph index) used by TextAtlas
+        // * Open addressing with linear probing; each slot is
+        //   an 8 byte key and the slots are kept at most half
+        //   full so most lookups touch a single cache line
+        // * The GlyphImageDescs themselves are stored in a
+        //   separate list in the order they were added
+        // * Each glyph has a last use stamp so the least
+        //   recently used glyphs can be found for eviction
+        class GlyphTable final
+        {
+        public:
+            GlyphTable();
+
+            // * Returns the glyph for (@font,@index) or nullptr
+            //   if it isn't in the table
+            // * The pointer is only valid until the next Insert
+            GlyphImageDesc const * Find(uint font, uint index) const;
+
+            // * Looks up every glyph in @list_glyph_info at once
+            //   and copies the glyphs that are found into the
+            //   corresponding element of @list_glyphs, which must
+            //   be at least as large as @list_glyph_info
+            // * The positions of glyphs that weren't found are
+            //   appended to @list_misses; zero width glyphs are
+            //   never looked up and are always counted as misses
+            // * Sets the last use of every glyph that's found
+            //   to @use_stamp
+            void FindBatch(std::vector<GlyphInfo> const &list_glyph_info,
+                           GlyphImageDesc * list_glyphs,
+                           std::vector<uint> &list_misses,
+                           u32 use_stamp);
+
+            // * Adds @glyph to the table, replacing any glyph that
+            //   has the same font and index
+            void Insert(GlyphImageDesc const &glyph, u32 use_stamp=0);
+
+            // * Removes every glyph
+            void Clear();
+
+            uint GetSize() const;
+
+            // * The glyphs in the order they were added and
+            //   the last use stamp of each one
+            std::vector<GlyphImageDesc> const & GetGlyphList() const;
+            std::vector<u32> const & GetLastUseList() const;
+
+        private:
+            static u64 getKey(uint font, uint index);
+            uint getHomeSlot(u64 key) const;
+            uint findSlot(u64 key) const;
+            void rehash(uint capacity);
+
+            static u64 const m_empty_key;
+
+            // * log2 of the number of slots
+            uint m_capacity_bits;
+
+            // list_keys, list_slot_glyphs
+            // * The key for each slot and the index of its glyph
+            //   in m_list_glyphs; empty slots have m_empty_key
+            std::vector<u64> m_list_keys;
+            std::vector<u32> m_list_slot_glyphs;
+
+            std::vector<GlyphImageDesc> m_list_glyphs;
+            std::vector<u32> m_list_last_use;
+        };
+    }
+}
+
+#endif // KS_TEXT_GLYPH_TABLE_HPP
@@ -0,0 +1,449 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define KS_TEXT_IMAGE_RENDERER_SSE2
+#include <emmintrin.h>
+#endif
+
+#include <ks/text/KsTextImageRenderer.hpp>
+
+namespace ks
+{
+    namespace text
+    {
+        namespace {
+
+            // * A glyph's quad in image pixels and its image
+            struct ImageQuad
+            {
+                float left;
+                float top;
+                float width;
+                float height;
+
+                uint atlas;
+                uint channel;
+                bool coverage;
+
+                int tex_x;
+                int tex_y;
+                int tex_width;
+                int tex_height;
+            };
+
+            // * Scratch lists for one band
+            struct BandBuffers
+            {
+                // * Per column of a quad: the two texels that
+                //   are sampled and the weight of the second one
+                std::vector<int> list_texel_x;
+                std::vector<int> list_texel_next_x;
+                std::vector<float> list_weight_x;
+
+                // * Distance (or coverage) for each pixel in a row
+                std::vector<float> list_values;
+            };
+
+            struct BlendParams
+            {
+                // * Color with alpha at 255; the color's alpha is
+                //   multiplied with the coverage instead
+                float color[4];
+                float alpha;
+
+                // * The smoothstep is from edge0 to edge0+1/inv_range
+                float edge0;
+                float inv_range;
+            };
+
+            // * Returns the range of pixels with centers that are
+            //   in [@start,@start+@size) clipped to [@min,@max)
+            void GetPixelRange(float start, float size,
+                               int min, int max,
+                               int &first, int &last)
+            {
+                first = std::max<int>(min,std::ceil(start-0.5f));
+                last = std::min<int>(max,std::ceil(start+size-0.5f));
+            }
+
+            // * Finds the texels that a linear filter samples for
+            //   @pos (atlas pixels) and the weight of the second
+            //   texel; texels are clamped to [@first,@first+@count)
+            //   so neighbouring glyphs are never sampled
+            void GetTexels(float pos, int first, int count,
+                           int &texel, int &texel_next, float &weight)
+            {
+                // Texel centers are at +0.5
+                float const center = pos-0.5f;
+                float const texel_f = std::floor(center);
+                weight = center-texel_f;
+
+                int const last = first+count-1;
+                texel = std::min(std::max(int(texel_f),first),last);
+                texel_next = std::min(std::max(int(texel_f)+1,first),last);
+            }
+
+            float Median(float a, float b, float c)
+            {
+                return std::max(std::min(a,b),std::min(std::max(a,b),c));
+            }
+
+            float Lerp(float a, float b, float t)
+            {
+                return a + (b-a)*t;
+            }
+
+            // * Fills list_values with the filtered value (0-1) of
+            //   @quad for the first @count columns of a row that
+            //   samples texel rows @ty and @ty_next
+            void SampleRow(ImageQuad const &quad,
+                           AtlasImage const &atlas,
+                           bool median,
+                           int ty,
+                           int ty_next,
+                           float weight_y,
+                           uint count,
+                           BandBuffers &buffers)
+            {
+                uint const channels = atlas.channels;
+                uint const row_size = atlas.size_px*channels;
+
+                u8 const * row0 = atlas.data + ty*row_size;
+                u8 const * row1 = atlas.data + ty_next*row_size;
+
+                float const k_div = 1.0f/255.0f;
+
+                for(uint i=0; i < count; i++)
+                {
+                    uint const x0 = buffers.list_texel_x[i]*channels;
+                    uint const x1 = buffers.list_texel_next_x[i]*channels;
+
+                    float const wx = buffers.list_weight_x[i];
+
+                    if(!median)
+                    {
+                        uint const c = quad.channel;
+                        float const top = Lerp(row0[x0+c],row0[x1+c],wx);
+                        float const bottom = Lerp(row1[x0+c],row1[x1+c],wx);
+                        buffers.list_values[i] = Lerp(top,bottom,weight_y)*k_div;
+                        continue;
+                    }
+
+                    // Each channel is filtered before the median
+                    // is taken, the same as on a GPU
+                    float list_rgb[3];
+                    for(uint c=0; c < 3; c++)
+                    {
+                        float const top = Lerp(row0[x0+c],row0[x1+c],wx);
+                        float const bottom = Lerp(row1[x0+c],row1[x1+c],wx);
+                        list_rgb[c] = Lerp(top,bottom,weight_y);
+                    }
+
+                    buffers.list_values[i] =
+                            Median(list_rgb[0],list_rgb[1],list_rgb[2])*k_div;
+                }
+            }
+
+            // * Blends @count pixels at @dst with coverage from
+            //   @list_values; the SSE2 and scalar versions use the
+            //   same operations so their results are identical
+            void BlendSpan(float const * list_values,
+                           uint count,
+                           bool coverage,
+                           BlendParams const &params,
+                           u8 * dst)
+            {
+                uint i=0;
+
+#ifdef KS_TEXT_IMAGE_RENDERER_SSE2
+                __m128 const color = _mm_loadu_ps(params.color);
+                __m128 const alpha = _mm_set1_ps(params.alpha);
+                __m128 const edge0 = _mm_set1_ps(params.edge0);
+                __m128 const inv_range = _mm_set1_ps(params.inv_range);
+                __m128 const zero = _mm_setzero_ps();
+                __m128 const one = _mm_set1_ps(1.0f);
+                __m128 const two = _mm_set1_ps(2.0f);
+                __m128 const three = _mm_set1_ps(3.0f);
+                __m128 const half = _mm_set1_ps(0.5f);
+                __m128i const zero_i = _mm_setzero_si128();
+
+                for(; i+4 <= count; i+=4)
+                {
+                    __m128 a = _mm_loadu_ps(list_values+i);
+                    if(!coverage)
+                    {
+                        // smoothstep
+                        __m128 t = _mm_mul_ps(_mm_sub_ps(a,edge0),inv_range);
+                        t = _mm_min_ps(_mm_max_ps(t,zero),one);
+                        a = _mm_mul_ps(_mm_mul_ps(t,t),
+                                       _mm_sub_ps(three,_mm_mul_ps(two,t)));
+                    }
+                    a = _mm_mul_ps(a,alpha);
+                    __m128 const inv_a = _mm_sub_ps(one,a);
+
+                    u8 * px = dst+i*4;
+                    __m128i const dst_u8 = _mm_loadu_si128(reinterpret_cast<__m128i*>(px));
+                    __m128i const dst_lo = _mm_unpacklo_epi8(dst_u8,zero_i);
+                    __m128i const dst_hi = _mm_unpackhi_epi8(dst_u8,zero_i);
+
+                    __m128 list_dst[4] = {
+                        _mm_cvtepi32_ps(_mm_unpacklo_epi16(dst_lo,zero_i)),
+                        _mm_cvtepi32_ps(_mm_unpackhi_epi16(dst_lo,zero_i)),
+                        _mm_cvtepi32_ps(_mm_unpacklo_epi16(dst_hi,zero_i)),
+                        _mm_cvtepi32_ps(_mm_unpackhi_epi16(dst_hi,zero_i))
+                    };
+
+                    __m128 const list_a[4] = {
+                        _mm_shuffle_ps(a,a,_MM_SHUFFLE(0,0,0,0)),
+                        _mm_shuffle_ps(a,a,_MM_SHUFFLE(1,1,1,1)),
+                        _mm_shuffle_ps(a,a,_MM_SHUFFLE(2,2,2,2)),
+                        _mm_shuffle_ps(a,a,_MM_SHUFFLE(3,3,3,3))
+                    };
+
+                    __m128 const list_inv_a[4] = {
+                        _mm_shuffle_ps(inv_a,inv_a,_MM_SHUFFLE(0,0,0,0)),
+                        _mm_shuffle_ps(inv_a,inv_a,_MM_SHUFFLE(1,1,1,1)),
+                        _mm_shuffle_ps(inv_a,inv_a,_MM_SHUFFLE(2,2,2,2)),
+                        _mm_shuffle_ps(inv_a,inv_a,_MM_SHUFFLE(3,3,3,3))
+                    };
+
+                    __m128i list_out[4];
+                    for(uint k=0; k < 4; k++)
+                    {
+                        __m128 const out =
+                                _mm_add_ps(
+                                    _mm_add_ps(_mm_mul_ps(color,list_a[k]),
+                                               _mm_mul_ps(list_dst[k],list_inv_a[k])),
+                                    half);
+
+                        list_out[k] = _mm_cvttps_epi32(out);
+                    }
+
+                    __m128i const out_lo = _mm_packs_epi32(list_out[0],list_out[1]);
+                    __m128i const out_hi = _mm_packs_epi32(list_out[2],list_out[3]);
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(px),
+                                     _mm_packus_epi16(out_lo,out_hi));
+                }
+#endif
+
+                for(; i < count; i++)
+                {
+                    float a = list_values[i];
+                    if(!coverage)
+                    {
+                        float t = (a-params.edge0)*params.inv_range;
+                        t = std::min(std::max(t,0.0f),1.0f);
+                        a = (t*t)*(3.0f-(2.0f*t));
+                    }
+                    a = a*params.alpha;
+                    float const inv_a = 1.0f-a;
+
+                    u8 * px = dst+i*4;
+                    for(uint k=0; k < 4; k++)
+                    {
+                        px[k] = u8(((params.color[k]*a) + (px[k]*inv_a)) + 0.5f);
+                    }
+                }
+            }
+
+            void DrawBand(std::vector<ImageQuad> const &list_quads,
+                          std::vector<AtlasImage> const &list_atlases,
+                          TextImageParams const &params,
+                          BlendParams const &blend_params,
+                          u8 * image,
+                          uint width,
+                          uint stride,
+                          int band_first,
+                          int band_last)
+            {
+                BandBuffers buffers;
+                buffers.list_texel_x.resize(width);
+                buffers.list_texel_next_x.resize(width);
+                buffers.list_weight_x.resize(width);
+                buffers.list_values.resize(width);
+
+                bool const median = (params.sdf_engine == SDFEngine::OutlineMSDF);
+
+                for(auto const &quad : list_quads)
+                {
+                    int col_first,col_last;
+                    GetPixelRange(quad.left,quad.width,0,width,col_first,col_last);
+
+                    int row_first,row_last;
+                    GetPixelRange(quad.top,quad.height,band_first,band_last,
+                                  row_first,row_last);
+
+                    if((col_first >= col_last) || (row_first >= row_last))
+                    {
+                        continue;
+                    }
+
+                    // Atlas pixels per image pixel
+                    float const step_x = quad.tex_width/quad.width;
+                    float const step_y = quad.tex_height/quad.height;
+
+                    uint const count = col_last-col_first;
+                    for(uint i=0; i < count; i++)
+                    {
+                        float const x = quad.tex_x +
+                                ((col_first+i)+0.5f-quad.left)*step_x;
+
+                        GetTexels(x,quad.tex_x,quad.tex_width,
+                                  buffers.list_texel_x[i],
+                                  buffers.list_texel_next_x[i],
+                                  buffers.list_weight_x[i]);
+                    }
+
+                    AtlasImage const &atlas = list_atlases[quad.atlas];
+
+                    for(int row=row_first; row < row_last; row++)
+                    {
+                        float const y = quad.tex_y + (row+0.5f-quad.top)*step_y;
+
+                        int ty,ty_next;
+                        float weight_y;
+                        GetTexels(y,quad.tex_y,quad.tex_height,ty,ty_next,weight_y);
+
+                        SampleRow(quad,atlas,median && !quad.coverage,
+                                  ty,ty_next,weight_y,count,buffers);
+
+                        BlendSpan(buffers.list_values.data(),
+                                  count,
+                                  quad.coverage,
+                                  blend_params,
+                                  image + row*stride + col_first*4);
+                    }
+                }
+            }
+        }
+
+        // =========================================================== //
+
+        void RenderTextImage(std::vector<Line> const &list_lines,
+                             std::vector<AtlasImage> const &list_atlases,
+                             TextImageParams const &params,
+                             u8 * image,
+                             uint width,
+                             uint height,
+                             uint stride)
+        {
+            // Place the quads the same way as instances
+            std::vector<GlyphInstance> list_instances(GetQuadCount(list_lines));
+            std::vector<TextDrawBatch> list_batches;
+            WriteInstances(list_lines,
+                           params.alignment,
+                           params.width,
+                           list_instances.data(),
+                           list_batches);
+
+            std::vector<ImageQuad> list_quads;
+            list_quads.reserve(list_instances.size());
+
+            for(auto const &batch : list_batches)
+            {
+                if((batch.atlas >= list_atlases.size()) ||
+                   (list_atlases[batch.atlas].data == nullptr))
+                {
+                    continue;
+                }
+
+                float const scale = batch.scale*params.scale;
+
+                for(uint i=batch.first; i < batch.first+batch.count; i++)
+                {
+                    GlyphInstance const &instance = list_instances[i];
+
+                    ImageQuad quad;
+                    quad.tex_x = instance.tex_x;
+                    quad.tex_y = instance.tex_y;
+                    quad.tex_width = instance.tex_width & kGlyphInstanceWidthMask;
+                    quad.tex_height = instance.tex_height;
+
+                    quad.left = params.x + instance.x*params.scale;
+                    quad.top = params.y - instance.y*params.scale;
+                    quad.width = quad.tex_width*scale;
+                    quad.height = quad.tex_height*scale;
+
+                    quad.atlas = batch.atlas;
+                    quad.channel = instance.tex_width >> kGlyphInstanceChannelShift;
+                    quad.coverage = (batch.image_type == GlyphImageType::Bitmap);
+
+                    list_quads.push_back(quad);
+                }
+            }
+
+            BlendParams blend_params;
+            blend_params.color[0] = params.color.r;
+            blend_params.color[1] = params.color.g;
+            blend_params.color[2] = params.color.b;
+            blend_params.color[3] = 255.0f;
+            blend_params.alpha = params.color.a/255.0f;
+            blend_params.edge0 = 0.5f-params.fuzz;
+            blend_params.inv_range = 1.0f/(2.0f*params.fuzz);
+
+            uint thread_count = params.thread_count;
+            if(thread_count == 0)
+            {
+                thread_count = std::max(1u,std::thread::hardware_concurrency());
+            }
+
+            // Each band only writes its own rows, so the bands
+            // don't need to be synchronized
+            uint const band_height =
+                    std::max(1u,(height+thread_count-1)/thread_count);
+
+            std::vector<std::thread> list_threads;
+            for(uint first=band_height; first < height; first+=band_height)
+            {
+                list_threads.emplace_back(
+                            DrawBand,
+                            std::cref(list_quads),
+                            std::cref(list_atlases),
+                            std::cref(params),
+                            std::cref(blend_params),
+                            image,
+                            width,
+                            stride,
+                            int(first),
+                            int(std::min(first+band_height,height)));
+            }
+
+            DrawBand(list_quads,
+                     list_atlases,
+                     params,
+                     blend_params,
+                     image,
+                     width,
+                     stride,
+                     0,
+                     std::min(band_height,height));
+
+            for(auto &thread : list_threads)
+            {
+                thread.join();
+            }
+        }
+
+        // =========================================================== //
+    }
+}
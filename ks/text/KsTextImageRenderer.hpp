@@ -0,0 +1,102 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_TEXT_IMAGE_RENDERER_HPP
+#define KS_TEXT_IMAGE_RENDERER_HPP
+
+#include <ks/text/KsTextTextMesh.hpp>
+
+namespace ks
+{
+    namespace text
+    {
+        // Draws lines returned by TextManager::GetGlyphs into an
+        // RGBA8 image on the CPU, ie. for thumbnails or previews
+        // on machines without a GPU and for comparing text output
+        // against reference images
+        // * Glyphs are placed the same way as KsTextTextMesh and
+        //   their images are sampled like a GL texture with
+        //   linear filtering
+        // * Distance fields are converted to coverage with the
+        //   same smoothstep as the sample sdf fragment shader
+        //   (ks/text/test/text_sdf_frag_glsl.hpp); bitmap glyphs
+        //   use their coverage directly
+        // * Glyphs are blended over the image like
+        //   glBlendFuncSeparate(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA,
+        //   GL_ONE,GL_ONE_MINUS_SRC_ALPHA) with straight alpha
+
+        // =========================================================== //
+
+        // AtlasImage
+        // * The pixels of an atlas as kept by the application from
+        //   the atlas signals; @size_px*@size_px pixels of
+        //   @channels bytes each with the first row at the top
+        struct AtlasImage
+        {
+            u8 const * data;
+            uint size_px;
+            uint channels;
+        };
+
+        struct TextImageParams
+        {
+            // * Position of the first line's baseline in the image
+            //   (pixels, y increases going down)
+            float x{0};
+            float y{0};
+
+            // * Image pixels per layout pixel
+            float scale{1};
+
+            // * Lines are aligned within @width layout pixels
+            //   (see GetAlignmentOffset)
+            TextManager::Alignment alignment{TextManager::Alignment::Left};
+            sint width{0};
+
+            glm::u8vec4 color{0,0,0,255};
+
+            // * Distance values within @fuzz of the glyph edge
+            //   (0.5) are blended; 0.025 matches the sample shader
+            float fuzz{0.025f};
+
+            // * The SDFEngine the atlases were generated with;
+            //   SDFEngine::OutlineMSDF atlases use the median of
+            //   their RGB channels
+            SDFEngine sdf_engine{SDFEngine::EDTAA3};
+
+            // * The image is split into bands of rows that are
+            //   drawn on separate threads; 0 uses one thread per
+            //   core. The result doesn't depend on this
+            uint thread_count{1};
+        };
+
+        // * Draws @list_lines into @image, which has @width x
+        //   @height RGBA8 pixels and @stride bytes per row
+        // * @list_atlases has an image for each atlas used by
+        //   the glyphs in @list_lines
+        void RenderTextImage(std::vector<Line> const &list_lines,
+                             std::vector<AtlasImage> const &list_atlases,
+                             TextImageParams const &params,
+                             u8 * image,
+                             uint width,
+                             uint height,
+                             uint stride);
+
+        // =========================================================== //
+    }
+}
+
+#endif // KS_TEXT_IMAGE_RENDERER_HPP
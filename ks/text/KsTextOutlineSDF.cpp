@@ -0,0 +1,1127 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <ks/text/KsTextOutlineSDF.hpp>
+
+#include FT_OUTLINE_H
+
+namespace ks
+{
+    namespace text
+    {
+        namespace
+        {
+            // Distances are computed the same way as msdfgen
+            // (https://github.com/Chlumsky/msdfgen):
+            // * The outline is split into line, quadratic and
+            //   cubic edges and each pixel takes the closest
+            //   distance to any edge
+            // * For multi-channel fields, edges are given colors
+            //   so that the two edges at every corner differ in
+            //   at least one channel, and each channel uses the
+            //   pseudo-distance to the closest edge that has it
+            // * Signs come from the fill rule instead of the edge
+            //   orientation, so overlapping contours are fine
+
+            // Distance from an edge where the output saturates
+            // (128 at an edge, 16 per pixel)
+            double const kSaturateDist = 8.0;
+
+            // Adjacent pixels whose channels differ by at least
+            // this much (in pixels) are checked for artifacts
+            double const kClashThreshold = 1.001;
+
+            // Corners are points where the edge direction changes
+            // by more than this (in radians)
+            double const kCornerAngle = 3.0;
+
+            // Number of lines each curve is flattened into when
+            // the fill rule is evaluated
+            uint const kFlattenSteps = 16;
+
+            double const kFar = std::numeric_limits<double>::max();
+
+            double const kPi = 3.14159265358979323846;
+
+            // =========================================================== //
+
+            struct Vec2
+            {
+                double x;
+                double y;
+
+                Vec2() : x(0), y(0) {}
+                Vec2(double x, double y) : x(x), y(y) {}
+
+                Vec2 operator + (Vec2 const &b) const { return Vec2(x+b.x,y+b.y); }
+                Vec2 operator - (Vec2 const &b) const { return Vec2(x-b.x,y-b.y); }
+                Vec2 operator * (double s) const { return Vec2(x*s,y*s); }
+                bool operator == (Vec2 const &b) const { return (x == b.x) && (y == b.y); }
+                bool operator != (Vec2 const &b) const { return !(*this == b); }
+            };
+
+            inline double Dot(Vec2 const &a, Vec2 const &b)
+            {
+                return a.x*b.x + a.y*b.y;
+            }
+
+            inline double Cross(Vec2 const &a, Vec2 const &b)
+            {
+                return a.x*b.y - a.y*b.x;
+            }
+
+            inline double Length(Vec2 const &a)
+            {
+                return std::sqrt(Dot(a,a));
+            }
+
+            inline Vec2 Normalize(Vec2 const &a)
+            {
+                double const length = Length(a);
+                return (length == 0.0) ? Vec2(0,1) : a*(1.0/length);
+            }
+
+            inline Vec2 Mix(Vec2 const &a, Vec2 const &b, double t)
+            {
+                return a + (b-a)*t;
+            }
+
+            inline double NonZeroSign(double a)
+            {
+                return (a > 0.0) ? 1.0 : -1.0;
+            }
+
+            template<typename T>
+            inline T Median(T a, T b, T c)
+            {
+                return std::max(std::min(a,b),std::min(std::max(a,b),c));
+            }
+
+            // =========================================================== //
+
+            // * Roots of a*x^2 + b*x + c; returns the number of
+            //   roots, or -1 if every x is a root
+            int SolveQuadratic(double x[2], double a, double b, double c)
+            {
+                if((a == 0.0) || (std::fabs(b) > 1e12*std::fabs(a)))
+                {
+                    if(b == 0.0)
+                    {
+                        return (c == 0.0) ? -1 : 0;
+                    }
+                    x[0] = -c/b;
+                    return 1;
+                }
+
+                double discr = b*b - 4.0*a*c;
+                if(discr > 0.0)
+                {
+                    discr = std::sqrt(discr);
+                    x[0] = (-b+discr)/(2.0*a);
+                    x[1] = (-b-discr)/(2.0*a);
+                    return 2;
+                }
+                else if(discr == 0.0)
+                {
+                    x[0] = -b/(2.0*a);
+                    return 1;
+                }
+
+                return 0;
+            }
+
+            // * Roots of x^3 + a*x^2 + b*x + c
+            int SolveCubicNormed(double x[3], double a, double b, double c)
+            {
+                double const a2 = a*a;
+                double q = (a2 - 3.0*b)/9.0;
+                double const r = (a*(2.0*a2 - 9.0*b) + 27.0*c)/54.0;
+                double const r2 = r*r;
+                double const q3 = q*q*q;
+                a /= 3.0;
+
+                if(r2 < q3)
+                {
+                    double t = std::min(std::max(r/std::sqrt(q3),-1.0),1.0);
+                    t = std::acos(t);
+                    q = -2.0*std::sqrt(q);
+                    x[0] = q*std::cos(t/3.0) - a;
+                    x[1] = q*std::cos((t + 2.0*kPi)/3.0) - a;
+                    x[2] = q*std::cos((t - 2.0*kPi)/3.0) - a;
+                    return 3;
+                }
+
+                double const u = ((r < 0.0) ? 1.0 : -1.0)*
+                        std::pow(std::fabs(r) + std::sqrt(r2-q3),1.0/3.0);
+                double const v = (u == 0.0) ? 0.0 : q/u;
+                x[0] = (u+v) - a;
+                if((u == v) || (std::fabs(u-v) < 1e-12*std::fabs(u+v)))
+                {
+                    x[1] = -0.5*(u+v) - a;
+                    return 2;
+                }
+
+                return 1;
+            }
+
+            // * Roots of a*x^3 + b*x^2 + c*x + d
+            int SolveCubic(double x[3], double a, double b, double c, double d)
+            {
+                if(a != 0.0)
+                {
+                    // Past this ratio treating a as zero
+                    // gives a smaller error
+                    double const bn = b/a;
+                    if(std::fabs(bn) < 1e6)
+                    {
+                        return SolveCubicNormed(x,bn,c/a,d/a);
+                    }
+                }
+
+                return SolveQuadratic(x,b,c,d);
+            }
+
+            // =========================================================== //
+
+            // * Channels that an edge contributes to
+            enum EdgeColor : u8
+            {
+                kBlack   = 0,
+                kRed     = 1,
+                kGreen   = 2,
+                kYellow  = 3,
+                kBlue    = 4,
+                kMagenta = 5,
+                kCyan    = 6,
+                kWhite   = 7
+            };
+
+            struct SignedDistance
+            {
+                double dist;
+
+                // * How parallel the edge is to the direction of
+                //   the pixel when the closest point is an end
+                //   point; used to pick between edges that are
+                //   the same distance away
+                double dot;
+            };
+
+            inline bool operator < (SignedDistance const &a,
+                                    SignedDistance const &b)
+            {
+                double const abs_a = std::fabs(a.dist);
+                double const abs_b = std::fabs(b.dist);
+                return (abs_a < abs_b) || ((abs_a == abs_b) && (a.dot < b.dot));
+            }
+
+            struct Edge
+            {
+                // * 1 for lines, 2 for quadratic and 3 for
+                //   cubic curves
+                uint degree;
+
+                EdgeColor color;
+
+                // * Control points (degree+1 of them)
+                Vec2 p[4];
+
+                // * Bounds of the control points, which also
+                //   bound the edge
+                Vec2 box_min;
+                Vec2 box_max;
+
+                void UpdateBox()
+                {
+                    box_min = p[0];
+                    box_max = p[0];
+                    for(uint i=1; i <= degree; i++)
+                    {
+                        box_min.x = std::min(box_min.x,p[i].x);
+                        box_min.y = std::min(box_min.y,p[i].y);
+                        box_max.x = std::max(box_max.x,p[i].x);
+                        box_max.y = std::max(box_max.y,p[i].y);
+                    }
+                }
+
+                double GetBoxDistanceSq(Vec2 const &origin) const
+                {
+                    double const dx = std::max(std::max(box_min.x-origin.x,
+                                                        origin.x-box_max.x),0.0);
+                    double const dy = std::max(std::max(box_min.y-origin.y,
+                                                        origin.y-box_max.y),0.0);
+                    return dx*dx + dy*dy;
+                }
+
+                Vec2 GetPoint(double t) const
+                {
+                    if(degree == 1)
+                    {
+                        return Mix(p[0],p[1],t);
+                    }
+                    else if(degree == 2)
+                    {
+                        return Mix(Mix(p[0],p[1],t),Mix(p[1],p[2],t),t);
+                    }
+
+                    Vec2 const p12 = Mix(p[1],p[2],t);
+                    return Mix(Mix(Mix(p[0],p[1],t),p12,t),
+                               Mix(p12,Mix(p[2],p[3],t),t),t);
+                }
+
+                Vec2 GetDirection(double t) const
+                {
+                    if(degree == 1)
+                    {
+                        return p[1]-p[0];
+                    }
+                    else if(degree == 2)
+                    {
+                        Vec2 const tangent = Mix(p[1]-p[0],p[2]-p[1],t);
+                        return (tangent == Vec2()) ? (p[2]-p[0]) : tangent;
+                    }
+
+                    Vec2 const tangent =
+                            Mix(Mix(p[1]-p[0],p[2]-p[1],t),
+                                Mix(p[2]-p[1],p[3]-p[2],t),t);
+
+                    if(tangent == Vec2())
+                    {
+                        if(t == 0.0)
+                        {
+                            return p[2]-p[0];
+                        }
+                        if(t == 1.0)
+                        {
+                            return p[3]-p[1];
+                        }
+                    }
+
+                    return tangent;
+                }
+
+                // * Signed distance from @origin to the closest point
+                //   on the edge, which is positive on the right side
+                //   of the edge
+                // * @param is set to the position of the closest point
+                //   along the edge; it's outside [0,1] if the closest
+                //   point is an end point and @origin is past it
+                SignedDistance GetSignedDistance(Vec2 const &origin,
+                                                 double &param) const
+                {
+                    if(degree == 1)
+                    {
+                        Vec2 const aq = origin-p[0];
+                        Vec2 const ab = p[1]-p[0];
+                        param = Dot(aq,ab)/Dot(ab,ab);
+
+                        Vec2 const eq = p[(param > 0.5) ? 1 : 0]-origin;
+                        double const end_dist = Length(eq);
+                        if((param > 0.0) && (param < 1.0))
+                        {
+                            double const ortho_dist = Cross(aq,ab)/Length(ab);
+                            if(std::fabs(ortho_dist) < end_dist)
+                            {
+                                return SignedDistance{ortho_dist,0.0};
+                            }
+                        }
+
+                        return SignedDistance{
+                            NonZeroSign(Cross(aq,ab))*end_dist,
+                            std::fabs(Dot(Normalize(ab),Normalize(eq)))
+                        };
+                    }
+
+                    Vec2 const pe = p[degree];
+                    Vec2 const qa = p[0]-origin;
+                    Vec2 const ab = p[1]-p[0];
+                    Vec2 const br = p[2]-p[1]-ab;
+
+                    // Start with the end points
+                    Vec2 dir = GetDirection(0.0);
+                    double min_dist = NonZeroSign(Cross(dir,qa))*Length(qa);
+                    param = -Dot(qa,dir)/Dot(dir,dir);
+                    {
+                        dir = GetDirection(1.0);
+                        double const dist = Length(pe-origin);
+                        if(dist < std::fabs(min_dist))
+                        {
+                            min_dist = NonZeroSign(Cross(dir,pe-origin))*dist;
+                            param = 1.0 + Dot(origin-pe,dir)/Dot(dir,dir);
+                        }
+                    }
+
+                    if(degree == 2)
+                    {
+                        // The closest point is where the derivative
+                        // of the squared distance is zero
+                        double t[3];
+                        int const solutions =
+                                SolveCubic(t,
+                                           Dot(br,br),
+                                           3.0*Dot(ab,br),
+                                           2.0*Dot(ab,ab) + Dot(qa,br),
+                                           Dot(qa,ab));
+
+                        for(int i=0; i < solutions; i++)
+                        {
+                            if((t[i] > 0.0) && (t[i] < 1.0))
+                            {
+                                Vec2 const qe = qa + ab*(2.0*t[i]) + br*(t[i]*t[i]);
+                                double const dist = Length(qe);
+                                if(dist <= std::fabs(min_dist))
+                                {
+                                    min_dist = NonZeroSign(Cross(ab + br*t[i],qe))*dist;
+                                    param = t[i];
+                                }
+                            }
+                        }
+                    }
+                    else
+                    {
+                        // The closest point is found with a few
+                        // Newton iterations from several starts
+                        uint const kSearchStarts = 4;
+                        uint const kSearchSteps = 4;
+
+                        Vec2 const as = (p[3]-p[2]) - (p[2]-p[1]) - br;
+                        for(uint i=0; i <= kSearchStarts; i++)
+                        {
+                            double t = double(i)/kSearchStarts;
+                            Vec2 qe = qa + ab*(3.0*t) + br*(3.0*t*t) + as*(t*t*t);
+                            for(uint step=0; step < kSearchSteps; step++)
+                            {
+                                Vec2 const d1 = ab*3.0 + br*(6.0*t) + as*(3.0*t*t);
+                                Vec2 const d2 = br*6.0 + as*(6.0*t);
+                                t -= Dot(qe,d1)/(Dot(d1,d1) + Dot(qe,d2));
+                                if((t <= 0.0) || (t >= 1.0))
+                                {
+                                    break;
+                                }
+
+                                qe = qa + ab*(3.0*t) + br*(3.0*t*t) + as*(t*t*t);
+                                double const dist = Length(qe);
+                                if(dist < std::fabs(min_dist))
+                                {
+                                    min_dist = NonZeroSign(Cross(d1,qe))*dist;
+                                    param = t;
+                                }
+                            }
+                        }
+                    }
+
+                    if((param >= 0.0) && (param <= 1.0))
+                    {
+                        return SignedDistance{min_dist,0.0};
+                    }
+                    if(param < 0.5)
+                    {
+                        return SignedDistance{
+                            min_dist,
+                            std::fabs(Dot(Normalize(GetDirection(0.0)),
+                                          Normalize(qa)))
+                        };
+                    }
+
+                    return SignedDistance{
+                        min_dist,
+                        std::fabs(Dot(Normalize(GetDirection(1.0)),
+                                      Normalize(pe-origin)))
+                    };
+                }
+
+                // * If the closest point to @origin is past one of
+                //   the end points, replaces @distance with the
+                //   distance to the edge extended along its tangent
+                //   when that's closer
+                void ToPseudoDistance(SignedDistance &distance,
+                                      Vec2 const &origin,
+                                      double param) const
+                {
+                    if(param < 0.0)
+                    {
+                        Vec2 const dir = Normalize(GetDirection(0.0));
+                        Vec2 const aq = origin-p[0];
+                        if(Dot(aq,dir) < 0.0)
+                        {
+                            double const pseudo_dist = Cross(aq,dir);
+                            if(std::fabs(pseudo_dist) <= std::fabs(distance.dist))
+                            {
+                                distance.dist = pseudo_dist;
+                                distance.dot = 0.0;
+                            }
+                        }
+                    }
+                    else if(param > 1.0)
+                    {
+                        Vec2 const dir = Normalize(GetDirection(1.0));
+                        Vec2 const bq = origin-p[degree];
+                        if(Dot(bq,dir) > 0.0)
+                        {
+                            double const pseudo_dist = Cross(bq,dir);
+                            if(std::fabs(pseudo_dist) <= std::fabs(distance.dist))
+                            {
+                                distance.dist = pseudo_dist;
+                                distance.dot = 0.0;
+                            }
+                        }
+                    }
+                }
+
+                // * The part of the edge between @t0 and @t1
+                Edge GetPart(double t0, double t1) const
+                {
+                    // Split at t1 and keep the first part, then split
+                    // that at t0 and keep the second part
+                    Edge part = *this;
+                    splitAt(part.p,t1,true);
+                    splitAt(part.p,(t1 > 0.0) ? (t0/t1) : 0.0,false);
+                    part.UpdateBox();
+                    return part;
+                }
+
+            private:
+                void splitAt(Vec2 * q, double t, bool keep_first) const
+                {
+                    // de Casteljau
+                    Vec2 list_first[4];
+                    Vec2 list_second[4];
+                    Vec2 list_pts[4] = { q[0], q[1], q[2], q[3] };
+
+                    for(uint level=0; level <= degree; level++)
+                    {
+                        list_first[level] = list_pts[0];
+                        list_second[degree-level] = list_pts[degree-level];
+                        for(uint i=0; i < degree-level; i++)
+                        {
+                            list_pts[i] = Mix(list_pts[i],list_pts[i+1],t);
+                        }
+                    }
+
+                    for(uint i=0; i <= degree; i++)
+                    {
+                        q[i] = keep_first ? list_first[i] : list_second[i];
+                    }
+                }
+            };
+
+            // =========================================================== //
+
+            struct OutlineBuffers
+            {
+                // * Edges in the order they were decomposed and the
+                //   index of the first edge of each contour
+                std::vector<Edge> list_outline_edges;
+                std::vector<uint> list_contours;
+
+                // * Edges used for distances (colored and split
+                //   for multi-channel fields)
+                std::vector<Edge> list_edges;
+                std::vector<int> list_corners;
+
+                // * Flattened outline used for the fill rule
+                std::vector<std::pair<Vec2,Vec2>> list_lines;
+                std::vector<std::pair<double,int>> list_crossings;
+
+                // * Multi-channel distances for each pixel
+                std::vector<float> list_msdf;
+                std::vector<uint> list_clashes;
+
+                // * Decompose state
+                Vec2 pen;
+            };
+
+            thread_local OutlineBuffers g_outline_buffers;
+
+            Vec2 ToVec2(FT_Vector const * v)
+            {
+                return Vec2(v->x/64.0,v->y/64.0);
+            }
+
+            void AddEdge(OutlineBuffers &buffers,
+                         uint degree,
+                         Vec2 const &p1,
+                         Vec2 const &p2,
+                         Vec2 const &p3)
+            {
+                Edge edge;
+                edge.degree = degree;
+                edge.color = kWhite;
+                edge.p[0] = buffers.pen;
+                edge.p[1] = p1;
+                edge.p[2] = p2;
+                edge.p[3] = p3;
+
+                // Skip edges that are a single point; FreeType
+                // closes contours with a line even if it ends
+                // where it started
+                bool single_point = true;
+                for(uint i=1; i <= degree; i++)
+                {
+                    single_point = single_point && (edge.p[i] == edge.p[0]);
+                }
+
+                buffers.pen = edge.p[degree];
+                if(!single_point)
+                {
+                    edge.UpdateBox();
+                    buffers.list_outline_edges.push_back(edge);
+                }
+            }
+
+            int MoveTo(FT_Vector const * to, void * user)
+            {
+                OutlineBuffers &buffers = *static_cast<OutlineBuffers*>(user);
+                buffers.list_contours.push_back(buffers.list_outline_edges.size());
+                buffers.pen = ToVec2(to);
+                return 0;
+            }
+
+            int LineTo(FT_Vector const * to, void * user)
+            {
+                OutlineBuffers &buffers = *static_cast<OutlineBuffers*>(user);
+                AddEdge(buffers,1,ToVec2(to),Vec2(),Vec2());
+                return 0;
+            }
+
+            int ConicTo(FT_Vector const * control,
+                        FT_Vector const * to,
+                        void * user)
+            {
+                OutlineBuffers &buffers = *static_cast<OutlineBuffers*>(user);
+                AddEdge(buffers,2,ToVec2(control),ToVec2(to),Vec2());
+                return 0;
+            }
+
+            int CubicTo(FT_Vector const * control1,
+                        FT_Vector const * control2,
+                        FT_Vector const * to,
+                        void * user)
+            {
+                OutlineBuffers &buffers = *static_cast<OutlineBuffers*>(user);
+                AddEdge(buffers,3,ToVec2(control1),ToVec2(control2),ToVec2(to));
+                return 0;
+            }
+
+            // =========================================================== //
+
+            bool IsCorner(Vec2 const &a, Vec2 const &b, double cross_threshold)
+            {
+                return (Dot(a,b) <= 0.0) ||
+                       (std::fabs(Cross(a,b)) > cross_threshold);
+            }
+
+            // * Changes @color to a different color with two
+            //   channels that doesn't only share one channel
+            //   with @banned
+            void SwitchColor(EdgeColor &color, EdgeColor banned=kBlack)
+            {
+                EdgeColor const combined = EdgeColor(color & banned);
+                if((combined == kRed) || (combined == kGreen) || (combined == kBlue))
+                {
+                    color = EdgeColor(combined ^ kWhite);
+                    return;
+                }
+
+                if((color == kBlack) || (color == kWhite))
+                {
+                    color = kCyan;
+                    return;
+                }
+
+                uint const shifted = color << 1;
+                color = EdgeColor((shifted | (shifted >> 3)) & kWhite);
+            }
+
+            // * Position of @i in a list of @n edges mapped to
+            //   -1, 0 or 1 so each third gets one value
+            int GetTrichotomy(int i, int n)
+            {
+                return int(3.0 + 2.875*i/(n-1) - 1.4375 + 0.5) - 3;
+            }
+
+            // * Appends the edges from @begin to @end, which form
+            //   a contour, to @list_edges with colors such that
+            //   the edges at each corner don't share more than
+            //   one channel
+            void ColorContour(Edge const * begin,
+                              Edge const * end,
+                              std::vector<int> &list_corners,
+                              std::vector<Edge> &list_edges)
+            {
+                int const count = end-begin;
+                if(count == 0)
+                {
+                    return;
+                }
+
+                // Find the corners; a corner at i is between
+                // edge i-1 and edge i
+                double const cross_threshold = std::sin(kCornerAngle);
+
+                list_corners.clear();
+                Vec2 prev_dir = Normalize(begin[count-1].GetDirection(1.0));
+                for(int i=0; i < count; i++)
+                {
+                    if(IsCorner(prev_dir,
+                                Normalize(begin[i].GetDirection(0.0)),
+                                cross_threshold))
+                    {
+                        list_corners.push_back(i);
+                    }
+                    prev_dir = Normalize(begin[i].GetDirection(1.0));
+                }
+
+                int const corner_count = list_corners.size();
+                uint const first_edge = list_edges.size();
+
+                if((corner_count == 1) && (count < 3))
+                {
+                    // Teardrop with too few edges for three
+                    // colors, so each edge is split in thirds
+                    EdgeColor colors[3] = { kWhite, kWhite, kWhite };
+                    SwitchColor(colors[0]);
+                    colors[2] = colors[0];
+                    SwitchColor(colors[2]);
+
+                    int const part_count = count*3;
+                    for(int i=0; i < count; i++)
+                    {
+                        Edge const &edge = begin[(list_corners[0]+i)%count];
+                        for(int j=0; j < 3; j++)
+                        {
+                            Edge part = edge.GetPart(j/3.0,(j+1)/3.0);
+                            part.color = colors[((i*3+j)*3)/part_count];
+                            list_edges.push_back(part);
+                        }
+                    }
+
+                    return;
+                }
+
+                list_edges.insert(list_edges.end(),begin,end);
+                Edge * edges = &(list_edges[first_edge]);
+
+                if(corner_count == 0)
+                {
+                    // Smooth contour; every channel is the same
+                    for(int i=0; i < count; i++)
+                    {
+                        edges[i].color = kWhite;
+                    }
+                }
+                else if(corner_count == 1)
+                {
+                    // Teardrop; the contour is split in three
+                    // parts with different colors
+                    EdgeColor colors[3] = { kWhite, kWhite, kWhite };
+                    SwitchColor(colors[0]);
+                    colors[2] = colors[0];
+                    SwitchColor(colors[2]);
+
+                    for(int i=0; i < count; i++)
+                    {
+                        edges[(list_corners[0]+i)%count].color =
+                                colors[1+GetTrichotomy(i,count)];
+                    }
+                }
+                else
+                {
+                    // Switch colors at each corner; the last section
+                    // also has to differ from the first
+                    EdgeColor color = kWhite;
+                    SwitchColor(color);
+                    EdgeColor const initial_color = color;
+
+                    int section = 0;
+                    for(int i=0; i < count; i++)
+                    {
+                        int const index = (list_corners[0]+i)%count;
+                        if((section+1 < corner_count) &&
+                           (list_corners[section+1] == index))
+                        {
+                            section++;
+                            SwitchColor(color,
+                                        (section == corner_count-1) ?
+                                            initial_color : kBlack);
+                        }
+                        edges[index].color = color;
+                    }
+                }
+            }
+
+            // =========================================================== //
+
+            void FlattenEdges(std::vector<Edge> const &list_edges,
+                              std::vector<std::pair<Vec2,Vec2>> &list_lines)
+            {
+                list_lines.clear();
+                for(auto const &edge : list_edges)
+                {
+                    if(edge.degree == 1)
+                    {
+                        list_lines.emplace_back(edge.p[0],edge.p[1]);
+                        continue;
+                    }
+
+                    Vec2 prev = edge.p[0];
+                    for(uint i=1; i <= kFlattenSteps; i++)
+                    {
+                        Vec2 const next = (i == kFlattenSteps) ?
+                                    edge.p[edge.degree] :
+                                    edge.GetPoint(double(i)/kFlattenSteps);
+
+                        list_lines.emplace_back(prev,next);
+                        prev = next;
+                    }
+                }
+            }
+
+            // * Sorted x positions where the outline crosses the
+            //   horizontal line at @y and the winding direction
+            void FindCrossings(std::vector<std::pair<Vec2,Vec2>> const &list_lines,
+                               double y,
+                               std::vector<std::pair<double,int>> &list_crossings)
+            {
+                list_crossings.clear();
+                for(auto const &line : list_lines)
+                {
+                    Vec2 const &a = line.first;
+                    Vec2 const &b = line.second;
+                    if((a.y <= y) != (b.y <= y))
+                    {
+                        double const x = a.x + (y-a.y)*(b.x-a.x)/(b.y-a.y);
+                        list_crossings.emplace_back(x,(b.y > a.y) ? 1 : -1);
+                    }
+                }
+
+                std::sort(list_crossings.begin(),list_crossings.end());
+            }
+
+            // * Distance in pixels, positive inside the glyph,
+            //   to the same value range as the bitmap engines
+            inline u8 EncodeDistance(double dist)
+            {
+                double const value =
+                        std::min(std::max(128.0 - dist*16.0,0.0),255.0);
+
+                return 255 - static_cast<u8>(value);
+            }
+
+            // * True if the channels of @a and @b are discontinuous
+            //   such that the median would show an artifact between
+            //   them, and @a is the one further from an edge
+            bool IsClash(float const * a, float const * b)
+            {
+                // Only consider pixels on the same side of an edge
+                uint const a_in = (a[0] > 0.0f) + (a[1] > 0.0f) + (a[2] > 0.0f);
+                uint const b_in = (b[0] > 0.0f) + (b[1] > 0.0f) + (b[2] > 0.0f);
+                if((a_in >= 2) != (b_in >= 2))
+                {
+                    return false;
+                }
+
+                // Changes between all channels agreeing and two
+                // agreeing aren't clashes
+                if((a_in == 0) || (a_in == 3) || (b_in == 0) || (b_in == 3))
+                {
+                    return false;
+                }
+
+                // Find the two channels that change sides (x, y)
+                // and the one that doesn't (z)
+                auto changes = [a,b](uint c) {
+                    return ((a[c] > 0.0f) != (b[c] > 0.0f)) &&
+                           ((a[c] < 0.0f) != (b[c] < 0.0f));
+                };
+
+                uint x, y, z;
+                if(changes(0))
+                {
+                    x = 0;
+                    if(changes(1))
+                    {
+                        y = 1;
+                        z = 2;
+                    }
+                    else if(changes(2))
+                    {
+                        y = 2;
+                        z = 1;
+                    }
+                    else
+                    {
+                        return false;
+                    }
+                }
+                else if(changes(1) && changes(2))
+                {
+                    x = 1;
+                    y = 2;
+                    z = 0;
+                }
+                else
+                {
+                    return false;
+                }
+
+                return (std::fabs(a[x]-b[x]) >= kClashThreshold) &&
+                       (std::fabs(a[y]-b[y]) >= kClashThreshold) &&
+                       (std::fabs(a[z]) >= std::fabs(b[z]));
+            }
+
+            // * Sets the channels of pixels that would show an
+            //   artifact to their median
+            void CorrectClashes(float * list_msdf,
+                                int const w,
+                                int const h,
+                                std::vector<uint> &list_clashes)
+            {
+                list_clashes.clear();
+                for(int y=0; y < h; y++)
+                {
+                    for(int x=0; x < w; x++)
+                    {
+                        int const i = y*w + x;
+                        float const * a = list_msdf + i*4;
+                        if(((x > 0) && IsClash(a,a-4)) ||
+                           ((x < w-1) && IsClash(a,a+4)) ||
+                           ((y > 0) && IsClash(a,a-w*4)) ||
+                           ((y < h-1) && IsClash(a,a+w*4)))
+                        {
+                            list_clashes.push_back(i);
+                        }
+                    }
+                }
+
+                for(uint const i : list_clashes)
+                {
+                    float * a = list_msdf + i*4;
+                    float const median = Median(a[0],a[1],a[2]);
+                    a[0] = median;
+                    a[1] = median;
+                    a[2] = median;
+                }
+            }
+        }
+
+        // =========================================================== //
+
+        void MakeOutlineDistanceMap(SDFEngine engine,
+                                    FT_Outline * outline,
+                                    FT_Pos origin_x,
+                                    FT_Pos origin_y,
+                                    u8 * image,
+                                    uint width,
+                                    uint height)
+        {
+            OutlineBuffers &buffers = g_outline_buffers;
+            bool const msdf = (engine == SDFEngine::OutlineMSDF);
+            int const w = width;
+            int const h = height;
+
+            // Split the outline into edges
+            buffers.list_outline_edges.clear();
+            buffers.list_contours.clear();
+
+            FT_Outline_Funcs funcs;
+            funcs.move_to = MoveTo;
+            funcs.line_to = LineTo;
+            funcs.conic_to = ConicTo;
+            funcs.cubic_to = CubicTo;
+            funcs.shift = 0;
+            funcs.delta = 0;
+
+            if(FT_Outline_Decompose(outline,&funcs,&buffers) != 0)
+            {
+                buffers.list_outline_edges.clear();
+                buffers.list_contours.clear();
+            }
+
+            buffers.list_edges.clear();
+            if(msdf)
+            {
+                auto const &list_outline_edges = buffers.list_outline_edges;
+                for(uint i=0; i < buffers.list_contours.size(); i++)
+                {
+                    uint const end = (i+1 < buffers.list_contours.size()) ?
+                                buffers.list_contours[i+1] :
+                                list_outline_edges.size();
+
+                    ColorContour(list_outline_edges.data()+buffers.list_contours[i],
+                                 list_outline_edges.data()+end,
+                                 buffers.list_corners,
+                                 buffers.list_edges);
+                }
+            }
+            else
+            {
+                buffers.list_edges = buffers.list_outline_edges;
+            }
+
+            auto const &list_edges = buffers.list_edges;
+
+            FlattenEdges(buffers.list_outline_edges,buffers.list_lines);
+
+            bool const even_odd = (outline->flags & FT_OUTLINE_EVEN_ODD_FILL);
+
+            // Edge distances are positive on the right side of
+            // the edge, which is the inside for TrueType outlines
+            double const edge_sign =
+                    (FT_Outline_Get_Orientation(outline) ==
+                     FT_ORIENTATION_FILL_LEFT) ? -1.0 : 1.0;
+
+            if(msdf)
+            {
+                buffers.list_msdf.resize(width*height*4);
+            }
+
+            double const left = origin_x/64.0;
+            double const top = origin_y/64.0;
+
+            for(int y=0; y < h; y++)
+            {
+                Vec2 origin(0.0,top-(y+0.5));
+
+                FindCrossings(buffers.list_lines,origin.y,buffers.list_crossings);
+                auto const &list_crossings = buffers.list_crossings;
+                uint crossing = 0;
+                int winding = 0;
+
+                for(int x=0; x < w; x++)
+                {
+                    origin.x = left+(x+0.5);
+                    int const i = y*w + x;
+
+                    while((crossing < list_crossings.size()) &&
+                          (list_crossings[crossing].first < origin.x))
+                    {
+                        winding += list_crossings[crossing].second;
+                        crossing++;
+                    }
+
+                    bool const inside = even_odd ? (winding & 1) : (winding != 0);
+
+                    // Closest edge overall and for each channel
+                    SignedDistance min_dist{-kFar,1.0};
+                    SignedDistance list_min_dist[3] = {
+                        {-kFar,1.0}, {-kFar,1.0}, {-kFar,1.0}
+                    };
+                    int list_near_edge[3] = { -1, -1, -1 };
+                    double list_near_param[3] = { 0, 0, 0 };
+
+                    for(uint e=0; e < list_edges.size(); e++)
+                    {
+                        Edge const &edge = list_edges[e];
+
+                        // Skip edges that can't be closer than what's
+                        // been found for any channel they affect
+                        double bound = std::fabs(min_dist.dist);
+                        if(msdf)
+                        {
+                            for(uint c=0; c < 3; c++)
+                            {
+                                if(edge.color & (1 << c))
+                                {
+                                    bound = std::max(bound,
+                                                     std::fabs(list_min_dist[c].dist));
+                                }
+                            }
+                        }
+
+                        if(edge.GetBoxDistanceSq(origin) > bound*bound)
+                        {
+                            continue;
+                        }
+
+                        double param;
+                        SignedDistance const dist = edge.GetSignedDistance(origin,param);
+                        if(dist < min_dist)
+                        {
+                            min_dist = dist;
+                        }
+
+                        if(msdf)
+                        {
+                            for(uint c=0; c < 3; c++)
+                            {
+                                if((edge.color & (1 << c)) && (dist < list_min_dist[c]))
+                                {
+                                    list_min_dist[c] = dist;
+                                    list_near_edge[c] = e;
+                                    list_near_param[c] = param;
+                                }
+                            }
+                        }
+                    }
+
+                    double const true_dist = inside ?
+                                std::fabs(min_dist.dist) :
+                                -std::fabs(min_dist.dist);
+
+                    if(!msdf)
+                    {
+                        image[i] = EncodeDistance(true_dist);
+                        continue;
+                    }
+
+                    float * pixel = &(buffers.list_msdf[i*4]);
+                    for(uint c=0; c < 3; c++)
+                    {
+                        if(list_near_edge[c] >= 0)
+                        {
+                            list_edges[list_near_edge[c]].ToPseudoDistance(
+                                        list_min_dist[c],
+                                        origin,
+                                        list_near_param[c]);
+                        }
+
+                        pixel[c] = std::min(std::max(edge_sign*list_min_dist[c].dist,
+                                                     -kSaturateDist*4),
+                                            kSaturateDist*4);
+                    }
+                    pixel[3] = true_dist;
+
+                    // Flip the channels if the median disagrees with
+                    // the fill rule (ie. overlapping contours)
+                    float const median = Median(pixel[0],pixel[1],pixel[2]);
+                    if((median != 0.0f) && ((median > 0.0f) != inside))
+                    {
+                        pixel[0] = -pixel[0];
+                        pixel[1] = -pixel[1];
+                        pixel[2] = -pixel[2];
+                    }
+                }
+            }
+
+            if(msdf)
+            {
+                CorrectClashes(buffers.list_msdf.data(),w,h,buffers.list_clashes);
+
+                uint const count = width*height*4;
+                for(uint i=0; i < count; i++)
+                {
+                    image[i] = EncodeDistance(buffers.list_msdf[i]);
+                }
+            }
+        }
+    }
+}
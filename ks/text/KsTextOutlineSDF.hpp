@@ -0,0 +1,47 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_TEXT_OUTLINE_SDF_HPP
+#define KS_TEXT_OUTLINE_SDF_HPP
+
+#include <ks/text/KsTextFreeType.hpp>
+#include <ks/text/KsTextSDF.hpp>
+
+namespace ks
+{
+    namespace text
+    {
+        // * Writes the distance field of @outline to @image
+        //   using @engine, which must be SDFEngine::Outline or
+        //   SDFEngine::OutlineMSDF
+        // * @image has @width x @height pixels with
+        //   GetSDFChannelCount(@engine) bytes each
+        // * (@origin_x,@origin_y) is the position of the top
+        //   left corner of @image in outline coordinates (26.6,
+        //   y increases upwards)
+        // * @outline isn't modified
+        // * Safe to call from multiple threads at once
+        void MakeOutlineDistanceMap(SDFEngine engine,
+                                    FT_Outline * outline,
+                                    FT_Pos origin_x,
+                                    FT_Pos origin_y,
+                                    u8 * image,
+                                    uint width,
+                                    uint height);
+    }
+}
+
+#endif // KS_TEXT_OUTLINE_SDF_HPP
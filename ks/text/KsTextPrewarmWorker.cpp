@@ -0,0 +1,196 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <exception>
+
+#include <ks/KsLog.hpp>
+#include <ks/text/KsTextPrewarmWorker.hpp>
+
+namespace ks
+{
+    namespace text
+    {
+        // * Foreground work tends to come in bursts (ie. laying
+        //   out every label on a screen), so steps wait a bit
+        //   instead of squeezing in between foreground calls
+        std::chrono::milliseconds const
+        PrewarmWorker::kForegroundIdleTime(4);
+
+        PrewarmWorker::PrewarmWorker() :
+            m_next_job_id(1),
+            m_running_job_id(0),
+            m_foreground_count(0),
+            m_quit(false)
+        {
+            // The thread is started by the first AddJob
+        }
+
+        PrewarmWorker::~PrewarmWorker()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_quit = true;
+                m_list_jobs.clear();
+            }
+            m_cv_work.notify_all();
+
+            if(m_thread.joinable())
+            {
+                m_thread.join();
+            }
+        }
+
+        uint PrewarmWorker::AddJob(Step step, sint priority)
+        {
+            uint job_id;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                job_id = m_next_job_id++;
+
+                auto it = std::upper_bound(
+                            m_list_jobs.begin(),
+                            m_list_jobs.end(),
+                            priority,
+                            [](sint priority, Job const &job) {
+                                return (priority > job.priority);
+                            });
+
+                m_list_jobs.insert(it,Job{job_id,priority,std::move(step)});
+
+                if(!m_thread.joinable())
+                {
+                    m_thread = std::thread(&PrewarmWorker::runWorker,this);
+                }
+            }
+            m_cv_work.notify_all();
+
+            return job_id;
+        }
+
+        void PrewarmWorker::CancelJob(uint job_id)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_list_jobs.erase(
+                            std::remove_if(
+                                m_list_jobs.begin(),
+                                m_list_jobs.end(),
+                                [job_id](Job const &job) {
+                                    return (job.id == job_id);
+                                }),
+                            m_list_jobs.end());
+            }
+            m_cv_done.notify_all();
+        }
+
+        void PrewarmWorker::CancelAllJobs()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_list_jobs.clear();
+            }
+            m_cv_done.notify_all();
+        }
+
+        void PrewarmWorker::WaitForJobs()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv_done.wait(lock,[this](){
+                return (m_list_jobs.empty() && (m_running_job_id == 0));
+            });
+        }
+
+        void PrewarmWorker::BeginForeground()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_foreground_count++;
+        }
+
+        void PrewarmWorker::EndForeground()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_foreground_count--;
+                if(m_foreground_count > 0)
+                {
+                    return;
+                }
+
+                m_foreground_end = std::chrono::steady_clock::now();
+            }
+            m_cv_work.notify_all();
+        }
+
+        void PrewarmWorker::runWorker()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while(true)
+            {
+                m_cv_work.wait(lock,[this](){
+                    return (m_quit ||
+                            (!m_list_jobs.empty() &&
+                             (m_foreground_count == 0)));
+                });
+
+                if(m_quit)
+                {
+                    break;
+                }
+
+                auto const resume_time = m_foreground_end + kForegroundIdleTime;
+                if(std::chrono::steady_clock::now() < resume_time)
+                {
+                    m_cv_work.wait_until(lock,resume_time);
+                    continue;
+                }
+
+                // The job can be cancelled while its step runs,
+                // so the step is run from a copy
+                m_running_job_id = m_list_jobs.front().id;
+                Step step = m_list_jobs.front().step;
+                lock.unlock();
+
+                bool job_done = true;
+                try
+                {
+                    job_done = !step();
+                }
+                catch(std::exception const &e)
+                {
+                    LOG.Error() << "PrewarmWorker: Job failed: " << e.what();
+                }
+
+                lock.lock();
+                if(job_done)
+                {
+                    uint const job_id = m_running_job_id;
+                    m_list_jobs.erase(
+                                std::remove_if(
+                                    m_list_jobs.begin(),
+                                    m_list_jobs.end(),
+                                    [job_id](Job const &job) {
+                                        return (job.id == job_id);
+                                    }),
+                                m_list_jobs.end());
+                }
+
+                m_running_job_id = 0;
+                m_cv_done.notify_all();
+            }
+        }
+    }
+}
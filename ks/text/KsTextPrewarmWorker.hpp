@@ -0,0 +1,107 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_TEXT_PREWARM_WORKER_HPP
+#define KS_TEXT_PREWARM_WORKER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <ks/KsGlobal.hpp>
+
+namespace ks
+{
+    namespace text
+    {
+        // PrewarmWorker
+        // * A single background thread used by TextManager to
+        //   generate glyphs before they're requested; the thread
+        //   isn't started until the first job is added
+        // * Each job is run as a series of short steps so it
+        //   can be cancelled and so foreground work never
+        //   waits long for a step to finish
+        // * Steps aren't started while foreground work is
+        //   running or until kForegroundIdleTime has passed
+        //   since it ended
+        class PrewarmWorker final
+        {
+        public:
+            // * Runs the next step of a job; returns false
+            //   once the job is done
+            using Step = std::function<bool()>;
+
+            PrewarmWorker();
+            ~PrewarmWorker();
+
+            // * Jobs with a higher @priority are run first;
+            //   jobs with the same priority are run in the
+            //   order they were added
+            // * Returns an id for CancelJob
+            uint AddJob(Step step, sint priority);
+
+            // * Removes the job; if one of its steps is running
+            //   it's allowed to finish
+            void CancelJob(uint job_id);
+            void CancelAllJobs();
+
+            // * Blocks until every job is done or cancelled
+            void WaitForJobs();
+
+            // * Calls to these must be balanced; they can
+            //   be nested and called from any thread
+            void BeginForeground();
+            void EndForeground();
+
+        private:
+            struct Job
+            {
+                uint id;
+                sint priority;
+                Step step;
+            };
+
+            void runWorker();
+
+            static std::chrono::milliseconds const kForegroundIdleTime;
+
+            std::mutex m_mutex;
+            std::condition_variable m_cv_work;
+            std::condition_variable m_cv_done;
+
+            // list_jobs
+            // * sorted by priority, highest first
+            std::vector<Job> m_list_jobs;
+            uint m_next_job_id;
+
+            // running_job_id
+            // * id of the job whose step is running;
+            //   0 if no step is running
+            uint m_running_job_id;
+
+            uint m_foreground_count;
+            std::chrono::steady_clock::time_point m_foreground_end;
+
+            bool m_quit;
+            std::thread m_thread;
+        };
+    }
+}
+
+#endif // KS_TEXT_PREWARM_WORKER_HPP
@@ -0,0 +1,270 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <ks/KsLog.hpp>
+#include <ks/text/KsTextRasterPool.hpp>
+#include <ks/text/KsTextFont.hpp>
+
+#include FT_MODULE_H
+
+namespace ks
+{
+    namespace text
+    {
+        std::string const RasterPool::m_log_prefix = "RasterPool: ";
+
+        RasterPool::RasterPool(uint thread_count) :
+            m_generation(0),
+            m_quit(false),
+            m_task(nullptr),
+            m_job_count(0),
+            m_next_job(0),
+            m_active_count(0)
+        {
+            for(uint i=0; i < thread_count; i++)
+            {
+                m_list_ft_memory.push_back(make_unique<FreeTypeMemory>());
+
+                FT_Library library = nullptr;
+                FT_Error const error = m_list_ft_memory.back()->NewLibrary(&library);
+                if(error)
+                {
+                    LOG.Error() << m_log_prefix
+                                << "Failed to init FreeType: "
+                                << GetFreeTypeError(error);
+
+                    // Jobs are still run; they'll see a nullptr
+                    // face for every font
+                    library = nullptr;
+                }
+
+                m_list_libraries.push_back(library);
+            }
+
+            for(uint i=0; i < thread_count; i++)
+            {
+                m_list_threads.emplace_back(&RasterPool::runWorker,this,i);
+            }
+        }
+
+        RasterPool::~RasterPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_quit = true;
+            }
+            m_cv_work.notify_all();
+
+            for(auto &thread : m_list_threads)
+            {
+                thread.join();
+            }
+
+            for(auto library : m_list_libraries)
+            {
+                if(library)
+                {
+                    FT_Done_Library(library);
+                }
+            }
+        }
+
+        uint RasterPool::GetThreadCount() const
+        {
+            return m_list_threads.size();
+        }
+
+        void RasterPool::AddFont(unique_ptr<Font> const &font)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            // The 'invalid' font doesn't have a face
+            m_list_font_data.push_back(
+                        (font && font->file_data) ?
+                            font->file_data.get() : nullptr);
+
+            m_list_font_res_px.push_back(font ? font->glyph_res_px : 0);
+        }
+
+        void RasterPool::Run(uint job_count, Task const &task)
+        {
+            if(job_count == 0)
+            {
+                return;
+            }
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_task = &task;
+            m_job_count = job_count;
+            m_next_job = 0;
+            m_active_count = m_list_threads.size();
+            m_generation++;
+            m_cv_work.notify_all();
+
+            m_cv_done.wait(lock,[this](){
+                return (m_active_count == 0);
+            });
+
+            m_task = nullptr;
+        }
+
+        void RasterPool::SetFreeTypeMemoryLimit(u64 max_bytes)
+        {
+            for(auto &ft_memory : m_list_ft_memory)
+            {
+                ft_memory->SetLimit(max_bytes);
+            }
+        }
+
+        void RasterPool::AddFreeTypeMemoryStats(FreeTypeMemoryStats &stats) const
+        {
+            for(auto const &ft_memory : m_list_ft_memory)
+            {
+                ft_memory->AddStats(stats);
+            }
+        }
+
+        void RasterPool::runWorker(uint worker)
+        {
+            FT_Library const library = m_list_libraries[worker];
+            FreeTypeMemory &ft_memory = *(m_list_ft_memory[worker]);
+
+            FaceList list_faces;
+            uint generation = 0;
+
+            while(true)
+            {
+                uint font_count;
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_cv_work.wait(lock,[this,generation](){
+                        return (m_quit || (m_generation != generation));
+                    });
+
+                    if(m_quit)
+                    {
+                        break;
+                    }
+
+                    generation = m_generation;
+                    font_count = m_list_font_data.size();
+                }
+
+                // Open faces for fonts that were added
+                // since the last run
+                openFaces(library,ft_memory,list_faces,font_count);
+
+                while(true)
+                {
+                    uint const job = m_next_job++;
+                    if(job >= m_job_count)
+                    {
+                        break;
+                    }
+
+                    (*m_task)(list_faces,job);
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_active_count--;
+                    if(m_active_count == 0)
+                    {
+                        m_cv_done.notify_one();
+                    }
+                }
+            }
+
+            for(auto face : list_faces)
+            {
+                if(face)
+                {
+                    FT_Done_Face(face);
+                }
+            }
+        }
+
+        void RasterPool::openFaces(FT_Library library,
+                                   FreeTypeMemory &ft_memory,
+                                   FaceList &list_faces,
+                                   uint font_count)
+        {
+            while(list_faces.size() < font_count)
+            {
+                uint const font = list_faces.size();
+                list_faces.push_back(nullptr);
+
+                // m_list_font_data only grows and its existing
+                // elements don't change, but it can be
+                // reallocated by AddFont so it has to be
+                // read while locked
+                std::vector<u8> const * file_data;
+                uint glyph_res_px;
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    file_data = m_list_font_data[font];
+                    glyph_res_px = m_list_font_res_px[font];
+                }
+
+                if((library == nullptr) || (file_data == nullptr))
+                {
+                    continue;
+                }
+
+                // What FreeType allocates for the face is
+                // counted for its font
+                FreeTypeMemory::Scope ft_scope(ft_memory,font);
+
+                FT_Face face;
+                FT_Error error =
+                        FT_New_Memory_Face(
+                            library,
+                            static_cast<FT_Byte const *>(file_data->data()),
+                            file_data->size(),
+                            0,
+                            &face);
+
+                if(error)
+                {
+                    LOG.Error() << m_log_prefix
+                                << "Failed to load face for font "
+                                << font << ": "
+                                << GetFreeTypeError(error);
+                    continue;
+                }
+
+                // Same size as the font's raster face
+                error = FT_Set_Char_Size(face,
+                                         glyph_res_px*64,
+                                         glyph_res_px*64,
+                                         72,
+                                         72);
+                if(error)
+                {
+                    LOG.Error() << m_log_prefix
+                                << "Failed to set char size for font "
+                                << font << ": "
+                                << GetFreeTypeError(error);
+
+                    FT_Done_Face(face);
+                    continue;
+                }
+
+                list_faces.back() = face;
+            }
+        }
+    }
+}
@@ -0,0 +1,121 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_TEXT_RASTER_POOL_HPP
+#define KS_TEXT_RASTER_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include <ks/text/KsTextFreeTypeMemory.hpp>
+
+namespace ks
+{
+    namespace text
+    {
+        struct Font;
+
+        // RasterPool
+        // * Worker threads used by TextAtlas to rasterize
+        //   glyphs that aren't in the atlas yet
+        // * FreeType faces can't be used from more than one
+        //   thread at a time, so each worker has its own
+        //   FT_Library and opens its own face for every font
+        //   from the font's file data
+        // * Each worker's library allocates from its own
+        //   FreeTypeMemory, so workers don't share an allocator
+        class RasterPool final
+        {
+        public:
+            // * Faces for a single worker indexed by font; the
+            //   face for the 'invalid' font (0) is nullptr, as is
+            //   the face for any font the worker couldn't open
+            using FaceList = std::vector<FT_Face>;
+
+            using Task = std::function<void(FaceList const &,uint)>;
+
+            RasterPool(uint thread_count);
+
+            ~RasterPool();
+
+            uint GetThreadCount() const;
+
+            // * Fonts must be added in the same order as they
+            //   are added to TextAtlas; @font's file data must
+            //   outlive the pool
+            // * Worker faces are sized to @font's glyph_res_px
+            void AddFont(unique_ptr<Font> const &font);
+
+            // * Calls @task once for each job in [0,@job_count)
+            //   across all of the workers and blocks until every
+            //   job is done
+            // * @task must not throw
+            void Run(uint job_count, Task const &task);
+
+            // * Sets the limit for each worker's FreeTypeMemory;
+            //   only call while Run isn't
+            void SetFreeTypeMemoryLimit(u64 max_bytes);
+
+            // * Adds the stats for the workers' FreeTypeMemory
+            //   to @stats; only call while Run isn't
+            void AddFreeTypeMemoryStats(FreeTypeMemoryStats &stats) const;
+
+        private:
+            void runWorker(uint worker);
+            void openFaces(FT_Library library,
+                           FreeTypeMemory &ft_memory,
+                           FaceList &list_faces,
+                           uint font_count);
+
+            static std::string const m_log_prefix;
+
+            std::mutex m_mutex;
+            std::condition_variable m_cv_work;
+            std::condition_variable m_cv_done;
+
+            // list_font_data
+            // * File data for each font that workers open their
+            //   faces from; nullptr for the 'invalid' font
+            std::vector<std::vector<u8> const *> m_list_font_data;
+
+            // * Resolution each font's faces are sized to (px)
+            std::vector<uint> m_list_font_res_px;
+
+            // * Incremented by Run to wake the workers up
+            uint m_generation;
+            bool m_quit;
+
+            Task const * m_task;
+            uint m_job_count;
+            std::atomic<uint> m_next_job;
+            uint m_active_count;
+
+            // * A library for each worker and the FreeTypeMemory
+            //   it allocates from. They're created and released
+            //   by the pool so the counters are never changed by
+            //   a worker outside of Run
+            std::vector<unique_ptr<FreeTypeMemory>> m_list_ft_memory;
+            std::vector<FT_Library> m_list_libraries;
+
+            std::vector<std::thread> m_list_threads;
+        };
+    }
+}
+
+#endif // KS_TEXT_RASTER_POOL_HPP
@@ -0,0 +1,518 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// * make_distance_map.hpp defines its functions in the header
+//   so it can only be included by this file
+#include <freetypegl/make_distance_map.hpp>
+
+#include <ks/text/KsTextSDF.hpp>
+
+namespace ks
+{
+    namespace text
+    {
+        namespace
+        {
+            // The fast engines are a single precision version of
+            // EDTAA3 (see freetypegl/edtaa3func.hpp) with a few
+            // changes:
+            // * Buffers are kept between calls (one set per thread)
+            // * The gradient is only computed once; the inside
+            //   transform uses the gradient of the inverted image,
+            //   which only differs in sign and EDTAA3 only uses
+            //   its magnitude
+            // * Pixels don't take distances from neighbours that
+            //   are further than some limit from an edge, so most
+            //   of the work for pixels that end up saturated or
+            //   clamped is skipped
+
+            float const kFar = 1000000.0f;
+            float const kEpsilon = 1e-3f;
+
+            // Distance from an edge where the output saturates
+            // (128 at an edge, 16 per pixel)
+            float const kSaturateDist = 8.0f;
+
+            // Neighbours that are further than the distance limit
+            // by less than this can still give a pixel a distance
+            // within the limit
+            float const kLimitMargin = 2.0f;
+
+            struct SDFBuffers
+            {
+                std::vector<float> list_a;
+                std::vector<float> list_gx;
+                std::vector<float> list_gy;
+                std::vector<float> list_outside;
+                std::vector<float> list_inside;
+                std::vector<s16> list_dx;
+                std::vector<s16> list_dy;
+            };
+
+            thread_local SDFBuffers g_sdf_buffers;
+
+            // * Same as EdgeDF for a unit gradient that's
+            //   been moved to the first octant (gx >= gy > 0)
+            inline float EdgeDFOctant(float gx, float gy, float a)
+            {
+                float const a1 = 0.5f*gy/gx;
+                if(a < a1)
+                {
+                    return 0.5f*(gx + gy) - std::sqrt(2.0f*gx*gy*a);
+                }
+                else if(a < (1.0f-a1))
+                {
+                    return (0.5f-a)*gx;
+                }
+
+                return -0.5f*(gx + gy) + std::sqrt(2.0f*gx*gy*(1.0f-a));
+            }
+
+            // * Distance from the center of an edge pixel with
+            //   coverage @a to the edge, given the direction of
+            //   the edge gradient (gx,gy)
+            inline float EdgeDF(float gx, float gy, float a)
+            {
+                if((gx == 0) || (gy == 0))
+                {
+                    return (0.5f-a);
+                }
+
+                float const glength = std::sqrt(gx*gx + gy*gy);
+                gx = std::fabs(gx/glength);
+                gy = std::fabs(gy/glength);
+                if(gx < gy)
+                {
+                    std::swap(gx,gy);
+                }
+
+                return EdgeDFOctant(gx,gy,a);
+            }
+
+            void ComputeGradient(float const * list_a,
+                                 int const w,
+                                 int const h,
+                                 float * list_gx,
+                                 float * list_gy)
+            {
+                float const sqrt2 = 1.4142136f;
+
+                // Only edge pixels need a gradient and the
+                // kernels can't be applied along the border
+                for(int y=1; y < h-1; y++)
+                {
+                    for(int x=1; x < w-1; x++)
+                    {
+                        int const k = y*w + x;
+                        if((list_a[k] <= 0.0f) || (list_a[k] >= 1.0f))
+                        {
+                            continue;
+                        }
+
+                        // Same kernels as computegradient(), including
+                        // the mixed up corners in the y kernel
+                        float gx =
+                                -list_a[k-w-1] - sqrt2*list_a[k-1] - list_a[k+w-1] +
+                                 list_a[k-w+1] + sqrt2*list_a[k+1] + list_a[k+w+1];
+
+                        float gy =
+                                -list_a[k-w-1] - sqrt2*list_a[k-w] - list_a[k+w-1] +
+                                 list_a[k-w+1] + sqrt2*list_a[k+w] + list_a[k+w+1];
+
+                        float const glength = gx*gx + gy*gy;
+                        if(glength > 0.0f)
+                        {
+                            float const inv_length = 1.0f/std::sqrt(glength);
+                            gx *= inv_length;
+                            gy *= inv_length;
+                        }
+
+                        list_gx[k] = gx;
+                        list_gy[k] = gy;
+                    }
+                }
+            }
+
+            // OffsetDesc
+            // * Length and edge direction for an offset from a
+            //   pixel to an edge pixel, folded into the first
+            //   octant (gx >= gy >= 0)
+            struct OffsetDesc
+            {
+                float di;
+                float gx;
+                float gy;
+            };
+
+            // * Offsets with components up to this size are looked
+            //   up in a table instead of being computed; offsets
+            //   can't get this long within kSaturateDist+kLimitMargin
+            int const kOffsetTableSize = 16;
+
+            OffsetDesc const * GetOffsetTable()
+            {
+                static std::vector<OffsetDesc> const list_offsets = [](){
+                    std::vector<OffsetDesc> list(kOffsetTableSize*kOffsetTableSize);
+                    for(int x=0; x < kOffsetTableSize; x++)
+                    {
+                        for(int y=0; y < kOffsetTableSize; y++)
+                        {
+                            float const fx = x;
+                            float const fy = y;
+                            float const di = std::sqrt(fx*fx + fy*fy);
+
+                            OffsetDesc &desc = list[x*kOffsetTableSize + y];
+                            desc.di = di;
+                            desc.gx = (di > 0.0f) ? std::max(fx,fy)/di : 0.0f;
+                            desc.gy = (di > 0.0f) ? std::min(fx,fy)/di : 0.0f;
+                        }
+                    }
+                    return list;
+                }();
+
+                return list_offsets.data();
+            }
+
+            // Sweep-and-update distance transform
+            // * Pixels and neighbours are visited in the same order
+            //   as edtaa3(), but only one pair of sweeps is done;
+            //   edtaa3() repeats them until nothing changes, which
+            //   for glyph bitmaps is almost always after the first
+            //   pair and doesn't change the output when it isn't
+            class DistanceSweep
+            {
+            public:
+                DistanceSweep(SDFBuffers &buffers,
+                              int w,
+                              int h,
+                              float limit,
+                              float * list_dist) :
+                    m_list_a(buffers.list_a.data()),
+                    m_list_gx(buffers.list_gx.data()),
+                    m_list_gy(buffers.list_gy.data()),
+                    m_list_dx(buffers.list_dx.data()),
+                    m_list_dy(buffers.list_dy.data()),
+                    m_list_dist(list_dist),
+                    m_list_offsets(GetOffsetTable()),
+                    m_w(w),
+                    m_h(h),
+                    m_limit(limit)
+                {}
+
+                void Run()
+                {
+                    int const w = m_w;
+                    int const h = m_h;
+
+                    // All pixels start out pointing to themselves
+                    for(int i=0; i < w*h; i++)
+                    {
+                        float const a = m_list_a[i];
+
+                        m_list_dx[i] = 0;
+                        m_list_dy[i] = 0;
+                        m_list_dist[i] =
+                                (a <= 0.0f) ? kFar :
+                                (a < 1.0f) ? EdgeDF(m_list_gx[i],m_list_gy[i],a) :
+                                0.0f;
+                    }
+
+                    // Scan rows, except the first row
+                    for(int y=1; y < h; y++)
+                    {
+                        // Scan right, propagate distances
+                        // from above and left
+                        int i = y*w;
+                        for(int x=0; x < w; x++, i++)
+                        {
+                            float dist = m_list_dist[i];
+                            if(dist <= 0.0f)
+                            {
+                                continue;
+                            }
+
+                            if(x > 0)
+                            {
+                                update(i,dist,-1,1,0);
+                                update(i,dist,-w-1,1,1);
+                            }
+                            update(i,dist,-w,0,1);
+                            if(x < w-1)
+                            {
+                                update(i,dist,-w+1,-1,1);
+                            }
+                        }
+
+                        // Scan left, propagate distances
+                        // from the right
+                        i = y*w + w-2;
+                        for(int x=w-2; x >= 0; x--, i--)
+                        {
+                            float dist = m_list_dist[i];
+                            if(dist > 0.0f)
+                            {
+                                update(i,dist,1,-1,0);
+                            }
+                        }
+                    }
+
+                    // Scan rows in reverse order, except
+                    // the last row
+                    for(int y=h-2; y >= 0; y--)
+                    {
+                        // Scan left, propagate distances
+                        // from below and right
+                        int i = y*w + w-1;
+                        for(int x=w-1; x >= 0; x--, i--)
+                        {
+                            float dist = m_list_dist[i];
+                            if(dist <= 0.0f)
+                            {
+                                continue;
+                            }
+
+                            if(x < w-1)
+                            {
+                                update(i,dist,1,-1,0);
+                                update(i,dist,w+1,-1,-1);
+                            }
+                            update(i,dist,w,0,-1);
+                            if(x > 0)
+                            {
+                                update(i,dist,w-1,1,-1);
+                            }
+                        }
+
+                        // Scan right, propagate distances
+                        // from the left
+                        i = y*w + 1;
+                        for(int x=1; x < w; x++, i++)
+                        {
+                            float dist = m_list_dist[i];
+                            if(dist > 0.0f)
+                            {
+                                update(i,dist,-1,1,0);
+                            }
+                        }
+                    }
+                }
+
+            private:
+                // * Tries to give pixel @i a shorter distance
+                //   using the closest edge pixel of its neighbour
+                //   at @i+@offset; (@step_x,@step_y) is added to
+                //   the neighbour's offset to that edge pixel
+                inline void update(int const i,
+                                   float &dist,
+                                   int const offset,
+                                   int const step_x,
+                                   int const step_y)
+                {
+                    int const c = i + offset;
+                    if(m_list_dist[c] > m_limit)
+                    {
+                        return;
+                    }
+
+                    int const cdx = m_list_dx[c];
+                    int const cdy = m_list_dy[c];
+                    int const ndx = cdx + step_x;
+                    int const ndy = cdy + step_y;
+
+                    // The edge pixel the neighbour points to
+                    int const e = c - cdx - cdy*m_w;
+                    float a = m_list_a[e];
+                    if(a <= 0.0f)
+                    {
+                        return;
+                    }
+                    a = std::min(a,1.0f);
+
+                    float new_dist;
+                    if((ndx == 0) && (ndy == 0))
+                    {
+                        new_dist = EdgeDF(m_list_gx[e],m_list_gy[e],a);
+                    }
+                    else
+                    {
+                        int const ax = std::abs(ndx);
+                        int const ay = std::abs(ndy);
+
+                        OffsetDesc desc;
+                        if((ax < kOffsetTableSize) && (ay < kOffsetTableSize))
+                        {
+                            desc = m_list_offsets[ax*kOffsetTableSize + ay];
+                        }
+                        else
+                        {
+                            float const fx = ax;
+                            float const fy = ay;
+                            desc.di = std::sqrt(fx*fx + fy*fy);
+                            desc.gx = std::max(fx,fy)/desc.di;
+                            desc.gy = std::min(fx,fy)/desc.di;
+                        }
+
+                        // The edge estimate is never less than
+                        // -sqrt(2)/2, so skip offsets that are too
+                        // long to give a shorter distance
+                        if(desc.di >= dist + 0.7072f)
+                        {
+                            return;
+                        }
+
+                        new_dist = desc.di + EdgeDFOctant(desc.gx,desc.gy,a);
+                    }
+
+                    if(new_dist < dist-kEpsilon)
+                    {
+                        m_list_dx[i] = ndx;
+                        m_list_dy[i] = ndy;
+                        m_list_dist[i] = new_dist;
+                        dist = new_dist;
+                    }
+                }
+
+                float const * const m_list_a;
+                float const * const m_list_gx;
+                float const * const m_list_gy;
+                s16 * const m_list_dx;
+                s16 * const m_list_dy;
+                float * const m_list_dist;
+                OffsetDesc const * const m_list_offsets;
+                int const m_w;
+                int const m_h;
+                float const m_limit;
+            };
+
+            void MakeDistanceMapFast(u8 * image,
+                                     uint width,
+                                     uint height,
+                                     float max_dist)
+            {
+                int const w = width;
+                int const h = height;
+                uint const count = width*height;
+
+                // Rescale the image the same way make_distance_map
+                // does; a blank image comes out as 127 everywhere
+                u8 img_min = 255;
+                u8 img_max = 0;
+                for(uint i=0; i < count; i++)
+                {
+                    img_min = std::min(img_min,image[i]);
+                    img_max = std::max(img_max,image[i]);
+                }
+
+                if(img_max == 0)
+                {
+                    std::memset(image,127,count);
+                    return;
+                }
+
+                SDFBuffers &buffers = g_sdf_buffers;
+                buffers.list_a.resize(count);
+                buffers.list_gx.assign(count,0.0f);
+                buffers.list_gy.assign(count,0.0f);
+                buffers.list_outside.resize(count);
+                buffers.list_inside.resize(count);
+                buffers.list_dx.resize(count);
+                buffers.list_dy.resize(count);
+
+                float * list_a = buffers.list_a.data();
+                float const img_min_f = img_min;
+                float const img_max_f = img_max;
+                for(uint i=0; i < count; i++)
+                {
+                    list_a[i] = (image[i]-img_min_f)/img_max_f;
+                }
+
+                ComputeGradient(list_a,w,h,
+                                buffers.list_gx.data(),
+                                buffers.list_gy.data());
+
+                float const limit = max_dist + kLimitMargin;
+
+                // Transform the background
+                float * list_outside = buffers.list_outside.data();
+                DistanceSweep(buffers,w,h,limit,list_outside).Run();
+
+                // Transform the foreground
+                for(uint i=0; i < count; i++)
+                {
+                    list_a[i] = 1.0f-list_a[i];
+                }
+
+                float * list_inside = buffers.list_inside.data();
+                DistanceSweep(buffers,w,h,limit,list_inside).Run();
+
+                // Combine both into a bipolar distance field
+                for(uint i=0; i < count; i++)
+                {
+                    float const outside =
+                            std::min(std::max(list_outside[i],0.0f),max_dist);
+
+                    float const inside =
+                            std::min(std::max(list_inside[i],0.0f),max_dist);
+
+                    float const value =
+                            std::min(std::max(128.0f+(outside-inside)*16.0f,0.0f),
+                                     255.0f);
+
+                    image[i] = 255 - static_cast<u8>(value);
+                }
+            }
+        }
+
+        // =========================================================== //
+
+        bool SDFEngineUsesOutline(SDFEngine engine)
+        {
+            return ((engine == SDFEngine::Outline) ||
+                    (engine == SDFEngine::OutlineMSDF));
+        }
+
+        uint GetSDFChannelCount(SDFEngine engine)
+        {
+            return (engine == SDFEngine::OutlineMSDF) ? 4 : 1;
+        }
+
+        void MakeDistanceMap(SDFEngine engine,
+                             u8 * image,
+                             uint width,
+                             uint height,
+                             uint band_px)
+        {
+            if(engine == SDFEngine::EDTAA3)
+            {
+                make_distance_map(image,width,height);
+            }
+            else if(engine == SDFEngine::FastBanded)
+            {
+                MakeDistanceMapFast(image,width,height,
+                                    std::min(float(band_px),kSaturateDist));
+            }
+            else
+            {
+                MakeDistanceMapFast(image,width,height,kSaturateDist);
+            }
+        }
+    }
+}
@@ -0,0 +1,87 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_TEXT_SDF_HPP
+#define KS_TEXT_SDF_HPP
+
+#include <ks/KsGlobal.hpp>
+
+namespace ks
+{
+    namespace text
+    {
+        // SDFEngine
+        // * Selects how glyph bitmaps are transformed into
+        //   signed distance fields
+        // * Every engine writes 128 at edges and changes by
+        //   16 per pixel, increasing towards the inside of the
+        //   glyph
+        enum class SDFEngine
+        {
+            // * make_distance_map from freetype-gl, which
+            //   runs EDTAA3 in double precision
+            EDTAA3,
+
+            // * The same transform in single precision with
+            //   buffers that are reused between glyphs
+            // * Distances stop propagating once they're far
+            //   enough from an edge that the output saturates
+            // * Output is within 1 of EDTAA3
+            Fast,
+
+            // * Same as Fast but distances are only computed
+            //   up to the sdf offset from an edge; anything
+            //   further away is clamped to the sdf offset
+            FastBanded,
+
+            // * Exact distances computed from the glyph outline
+            //   instead of a rendered bitmap (see
+            //   MakeOutlineDistanceMap), so glyphs stay sharp
+            //   at a lower glyph resolution
+            Outline,
+
+            // * Multi-channel distance field from the glyph
+            //   outline; glyph images are RGBA8 instead of R8
+            // * The median of the RGB channels keeps corners
+            //   sharp when the image is magnified; alpha has
+            //   the same distance field as Outline
+            OutlineMSDF
+        };
+
+        // * True if @engine computes distances from glyph
+        //   outlines instead of bitmaps
+        bool SDFEngineUsesOutline(SDFEngine engine);
+
+        // * Number of bytes per pixel in the glyph images
+        //   generated with @engine
+        uint GetSDFChannelCount(SDFEngine engine);
+
+        // * Replaces the 8-bit coverage bitmap in @image with
+        //   its signed distance field
+        // * @band_px is only used by SDFEngine::FastBanded
+        // * Outline engines use SDFEngine::Fast, since a bitmap
+        //   doesn't have an outline (ie. for bitmap-only fonts
+        //   and the missing glyph)
+        // * Safe to call from multiple threads at once
+        void MakeDistanceMap(SDFEngine engine,
+                             u8 * image,
+                             uint width,
+                             uint height,
+                             uint band_px);
+    }
+}
+
+#endif // KS_TEXT_SDF_HPP
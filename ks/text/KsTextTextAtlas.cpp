@@ -14,17 +14,274 @@
    limitations under the License.
 */
 
-#include <freetypegl/make_distance_map.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <limits>
 
 #include <ks/KsLog.hpp>
 #include <ks/text/KsTextTextAtlas.hpp>
-#include <ks/text/KsTextFreeType.hpp>
+#include <ks/text/KsTextAtlasCache.hpp>
+#include <ks/text/KsTextFreeTypeMemory.hpp>
 #include <ks/text/KsTextFont.hpp>
+#include <ks/text/KsTextOutlineSDF.hpp>
+#include <ks/text/KsTextRasterPool.hpp>
+#include <ks/text/KsTextSDF.hpp>
 
 namespace ks
 {
     namespace text
     {
+        namespace
+        {
+            // Minimum number of glyphs to generate in a
+            // single GetGlyphs call before the RasterPool
+            // is used; waking the workers up costs more
+            // than rasterizing a few glyphs
+            uint const kMinPoolGlyphs = 4;
+
+            // * Dirty rectangles in an atlas are merged until
+            //   there are at most this many, and after that
+            //   while a merged rectangle is no larger than the
+            //   two separate ones by kMergeAreaRatio
+            uint const kMaxDirtyRects = 4;
+
+            // * Fraction of the atlas budget that glyphs kept
+            //   by a compaction can use, which leaves room for
+            //   new glyphs before the next compaction
+            double const kCompactFillRatio = 0.5;
+            double const kMergeAreaRatio = 1.5;
+
+            unique_ptr<ImageData> CreateBlankImageData(uint width,
+                                                       uint height,
+                                                       uint channels)
+            {
+                if(channels == 1)
+                {
+                    Image<R8> image(width,height,R8{0});
+                    return image.ConvertToImageDataPtr();
+                }
+
+                Image<RGBA8> image(width,height,RGBA8{0,0,0,0});
+                return image.ConvertToImageDataPtr();
+            }
+
+            // * Copies @rows rows of @row_size bytes each
+            void CopyRows(u8 const * src,
+                          uint src_stride,
+                          u8 * dst,
+                          uint dst_stride,
+                          uint row_size,
+                          uint rows)
+            {
+                for(uint r=0; r < rows; r++)
+                {
+                    std::memcpy(dst+r*dst_stride,src+r*src_stride,row_size);
+                }
+            }
+
+            // * Copies @rows rows of @width single channel pixels
+            //   into one channel of RGBA8 pixels at @dst
+            void CopyRowsToChannel(u8 const * src,
+                                   uint src_stride,
+                                   u8 * dst,
+                                   uint dst_stride,
+                                   uint width,
+                                   uint rows)
+            {
+                for(uint r=0; r < rows; r++)
+                {
+                    u8 const * src_row = src+r*src_stride;
+                    u8 * dst_row = dst+r*dst_stride;
+                    for(uint c=0; c < width; c++)
+                    {
+                        dst_row[c*4] = src_row[c];
+                    }
+                }
+            }
+
+            template<typename T>
+            void AppendData(std::vector<u8> &list_data,
+                            T const * data,
+                            size_t count)
+            {
+                u8 const * bytes = reinterpret_cast<u8 const *>(data);
+                list_data.insert(list_data.end(),bytes,bytes+count*sizeof(T));
+            }
+
+            // * Copies @count Ts from @data and advances it
+            template<typename T>
+            void ReadData(u8 const * &data, T * dst, size_t count)
+            {
+                std::memcpy(dst,data,count*sizeof(T));
+                data += count*sizeof(T);
+            }
+
+            // * Rows of each atlas image saved in a cache file, given
+            //   the rows used by each bin (channel) of the atlases
+            std::vector<u32> GetAtlasRowCounts(std::vector<u32> const &list_bin_row_counts,
+                                               uint bins_per_atlas)
+            {
+                std::vector<u32> list_row_counts;
+                for(uint i=0; i < list_bin_row_counts.size(); i++)
+                {
+                    if(i%bins_per_atlas == 0)
+                    {
+                        list_row_counts.push_back(0);
+                    }
+
+                    list_row_counts.back() =
+                            std::max(list_row_counts.back(),list_bin_row_counts[i]);
+                }
+
+                return list_row_counts;
+            }
+
+            u64 GetArea(AtlasRect const &rect)
+            {
+                return u64(rect.width)*rect.height;
+            }
+
+            AtlasRect GetUnion(AtlasRect const &a, AtlasRect const &b)
+            {
+                uint const x0 = std::min(a.x,b.x);
+                uint const y0 = std::min(a.y,b.y);
+                uint const x1 = std::max(a.x+a.width,b.x+b.width);
+                uint const y1 = std::max(a.y+a.height,b.y+b.height);
+
+                return AtlasRect{
+                    u16(x0),
+                    u16(y0),
+                    u16(x1-x0),
+                    u16(y1-y0)
+                };
+            }
+
+            // * Merges the glyph rectangles in @list_rects into
+            //   a few dirty rectangles; merged rectangles can
+            //   cover pixels that didn't change
+            void MergeDirtyRects(std::vector<AtlasRect> &list_rects)
+            {
+                // Glyphs added to the same shelf are next to
+                // each other, so they're merged first
+                std::sort(list_rects.begin(),list_rects.end(),
+                          [](AtlasRect const &a, AtlasRect const &b) {
+                              return (a.y < b.y) || ((a.y == b.y) && (a.x < b.x));
+                          });
+
+                uint count = 0;
+                for(uint i=0; i < list_rects.size(); i++)
+                {
+                    if((count > 0) && (list_rects[count-1].y == list_rects[i].y))
+                    {
+                        list_rects[count-1] = GetUnion(list_rects[count-1],list_rects[i]);
+                    }
+                    else
+                    {
+                        list_rects[count] = list_rects[i];
+                        count++;
+                    }
+                }
+                list_rects.resize(count);
+
+                // Then the pair that adds the least area is
+                // merged until no pair is worth merging
+                while(list_rects.size() > 1)
+                {
+                    uint merge_a = 0;
+                    uint merge_b = 1;
+                    double min_ratio = std::numeric_limits<double>::max();
+
+                    for(uint a=0; a < list_rects.size(); a++)
+                    {
+                        for(uint b=a+1; b < list_rects.size(); b++)
+                        {
+                            double const ratio =
+                                    double(GetArea(GetUnion(list_rects[a],list_rects[b])))/
+                                    (GetArea(list_rects[a]) + GetArea(list_rects[b]));
+
+                            if(ratio < min_ratio)
+                            {
+                                min_ratio = ratio;
+                                merge_a = a;
+                                merge_b = b;
+                            }
+                        }
+                    }
+
+                    if((list_rects.size() <= kMaxDirtyRects) &&
+                       (min_ratio > kMergeAreaRatio))
+                    {
+                        break;
+                    }
+
+                    list_rects[merge_a] = GetUnion(list_rects[merge_a],list_rects[merge_b]);
+                    list_rects.erase(list_rects.begin()+merge_b);
+                }
+            }
+
+            // * Spreads the first @pixel_count bytes of @data
+            //   (a distance field generated from a bitmap) to
+            //   pixels of @channels bytes each, in place; multi-
+            //   channel formats get the same distance in every
+            //   channel
+            void ExpandChannels(u8 * data, uint pixel_count, uint channels)
+            {
+                if(channels == 1)
+                {
+                    return;
+                }
+
+                // Back to front so nothing is overwritten
+                // before it's read
+                for(uint i=pixel_count; i > 0; i--)
+                {
+                    u8 const value = data[i-1];
+                    std::memset(data+(i-1)*channels,value,channels);
+                }
+            }
+        }
+
+        // =========================================================== //
+
+        // RasterGlyph
+        // * A glyph that's been rendered and transformed
+        //   but hasn't been added to an atlas yet
+        struct TextAtlas::RasterGlyph
+        {
+            // metrics (26.6)
+            FT_Pos bearing_x;
+            FT_Pos bearing_y;
+
+            // metrics (pixels)
+            u32 width_px;
+            u32 height_px;
+
+            // the font's raster resolution and sdf offset (pixels)
+            u16 res_px;
+            u16 sdf_offset_px;
+
+            GlyphImageType image_type;
+
+            // * The glyph's distance field with space around
+            //   it for the sdf offset, in the image format
+            //   used by the SDFEngine
+            // * image_width is 0 for spacing glyphs
+            // * list_image is reused between glyphs and may be
+            //   larger than the image
+            u32 image_width;
+            u32 image_height;
+            std::vector<u8> list_image;
+
+            // * Set if the glyph couldn't be rasterized on
+            //   a RasterPool worker
+            std::exception_ptr error;
+        };
+
+        // =========================================================== //
+
         TextAtlasError::TextAtlasError(std::string msg) :
             ks::Exception(ks::Exception::ErrorLevel::ERROR,std::move(msg))
         {}
@@ -38,9 +295,22 @@ namespace ks
                              uint sdf_offset_px) :
             m_atlas_size_px(atlas_size_px),
             m_glyph_res_px(glyph_res_px),
-            m_sdf_offset_px(sdf_offset_px)
+            m_sdf_offset_px(sdf_offset_px),
+            m_raster_thread_count(0),
+            m_sdf_engine(SDFEngine::EDTAA3),
+            m_update_mode(AtlasUpdateMode::PerGlyph),
+            m_max_atlas_count(0),
+            m_packer_type(AtlasPackerType::Shelf),
+            m_ft_memory_limit(0),
+            m_bins_per_atlas(1),
+            m_keep_atlas_images(false),
+            m_compress_atlas_images(false),
+            m_bundle_font_count(0),
+            m_use_stamp(0),
+            m_font_count(0),
+            m_defer_updates(false)
         {
-
+            m_raster_glyph = make_unique<RasterGlyph>();
         }
 
         TextAtlas::~TextAtlas()
@@ -48,31 +318,165 @@ namespace ks
 
         }
 
+        void TextAtlas::SetRasterThreadCount(uint raster_thread_count)
+        {
+            checkNoFonts("The raster thread count");
+            m_raster_thread_count = raster_thread_count;
+        }
+
+        void TextAtlas::SetSDFEngine(SDFEngine sdf_engine)
+        {
+            checkNoFonts("The SDFEngine");
+
+            if((m_bins_per_atlas > 1) && (GetSDFChannelCount(sdf_engine) != 1))
+            {
+                std::string desc = m_log_prefix;
+                desc += "Channel packing needs a single channel SDFEngine";
+
+                throw TextAtlasError(desc);
+            }
+
+            m_sdf_engine = sdf_engine;
+        }
+
+        void TextAtlas::SetUpdateMode(AtlasUpdateMode update_mode)
+        {
+            checkNoFonts("The update mode");
+            m_update_mode = update_mode;
+
+            // Updates other than PerGlyph are made from a copy
+            // of the atlas
+            if(update_mode != AtlasUpdateMode::PerGlyph)
+            {
+                m_keep_atlas_images = true;
+            }
+        }
+
+        void TextAtlas::SetMaxAtlasCount(uint max_atlas_count)
+        {
+            checkNoFonts("The atlas budget");
+            m_max_atlas_count = max_atlas_count;
+        }
+
+        void TextAtlas::SetPackerType(AtlasPackerType packer_type)
+        {
+            checkNoFonts("The packer type");
+            m_packer_type = packer_type;
+        }
+
         void TextAtlas::AddFont(unique_ptr<Font> const &font)
         {
-            m_lkup_font_glyph_list.push_back(GlyphList());
+            // Fonts other than the 'invalid' font (the first one)
+            // are checked for a missing glyph before anything is
+            // changed, since this can throw (ie. if FreeType runs
+            // out of memory) and the font shouldn't be half added
+            bool const use_missing_glyph =
+                    (m_font_count > 0) && !hasMissingGlyph(font);
+
+            m_font_count++;
+
+            if(m_font_count == 1)
+            {
+                // The settings can't change once there are fonts
+                uint const raster_thread_count =
+                        (m_raster_thread_count == 0) ?
+                            std::thread::hardware_concurrency() :
+                            m_raster_thread_count;
+
+                if(raster_thread_count > 1)
+                {
+                    m_raster_pool = make_unique<RasterPool>(raster_thread_count);
+                    m_raster_pool->SetFreeTypeMemoryLimit(m_ft_memory_limit);
+                }
+            }
+
+            if(!m_cache_file_path.empty() || m_bundle_file)
+            {
+                // The font's raster settings are part of its hash
+                // since they change its glyph images
+                m_list_font_hashes.push_back(
+                            (font && font->file_data) ?
+                                HashAtlasCacheData(
+                                    font->file_data->data(),
+                                    font->file_data->size(),
+                                    (u64(font->image_type) << 32) |
+                                    (u64(font->glyph_res_px) << 16) |
+                                    font->sdf_offset_px) : 0);
+            }
 
-            if(m_lkup_font_glyph_list.size() == 1)
+            if(m_raster_pool)
+            {
+                m_raster_pool->AddFont(font);
+            }
+
+            if(m_font_count == 1)
             {
                 // Setup the initial 'invalid' font
                 addEmptyAtlas();
                 genMissingGlyph();
+                flushAtlasUpdates();
             }
-            else
+            else if(use_missing_glyph)
+            {
+                // The font doesn't have a usable missing glyph
+                // so it uses the one from the 'invalid' font
+                GlyphImageDesc missing_glyph = m_missing_glyph;
+                missing_glyph.font = m_font_count-1;
+                m_glyph_table.Insert(missing_glyph);
+            }
+
+            if(m_bundle_file && (m_font_count == m_bundle_font_count))
+            {
+                if(!loadCacheFile(*m_bundle_file,m_bundle_file_path))
+                {
+                    LOG.Error() << m_log_prefix << "Atlas bundle "
+                                << m_bundle_file_path << " doesn't match "
+                                   "the fonts or atlas settings";
+                }
+
+                m_bundle_file.reset();
+            }
+        }
+
+        void TextAtlas::BeginRequest(std::vector<unique_ptr<Font>> const &list_fonts)
+        {
+            m_use_stamp++;
+
+            if((m_max_atlas_count > 0) &&
+               (getAtlasCount() > m_max_atlas_count))
             {
-                // Assign a custom missing glyph
-                // to this font if required
-                assignMissingGlyph(font);
+                compactAtlases(list_fonts);
             }
         }
 
         void TextAtlas::GetGlyphs(std::vector<unique_ptr<Font>> const &list_fonts,
                                   std::vector<GlyphInfo> const &list_glyph_info,
                                   std::vector<GlyphImageDesc> &list_glyphs)
+        {
+            uint const offset = list_glyphs.size();
+            list_glyphs.resize(offset+list_glyph_info.size());
+
+            // Look up all of the glyphs at once; only the
+            // glyphs that weren't found need any more work
+            m_list_misses.clear();
+            m_glyph_table.FindBatch(list_glyph_info,
+                                    list_glyphs.data()+offset,
+                                    m_list_misses,
+                                    m_use_stamp);
+
+            genGlyphs(list_fonts,list_glyph_info,
+                      list_glyphs.data()+offset);
+
+            flushAtlasUpdates();
+            packAtlasImages();
+        }
+
+        void TextAtlas::GetGlyphMetrics(std::vector<unique_ptr<Font>> const &list_fonts,
+                                        std::vector<GlyphInfo> const &list_glyph_info,
+                                        std::vector<GlyphImageDesc> &list_glyphs)
         {
             for(auto const &glyph_info : list_glyph_info)
             {
-                // Check for the zero-dimension glyphs first
                 if(glyph_info.zero_width)
                 {
                     GlyphImageDesc empty_glyph;
@@ -90,24 +494,44 @@ namespace ks
                     empty_glyph.bearing_y = 0;
                     empty_glyph.width     = 0;
                     empty_glyph.height    = 0;
+                    empty_glyph.res_px    = m_glyph_res_px;
+                    empty_glyph.channel   = 0;
+                    empty_glyph.image_type = GlyphImageType::SDF;
 
                     list_glyphs.push_back(empty_glyph);
+                    continue;
                 }
-                else
+
+                if(glyph_info.font == 0)
                 {
-                    auto glyph_it = findGlyph(glyph_info.font,glyph_info.index);
+                    list_glyphs.push_back(m_missing_glyph);
+                    continue;
+                }
 
-                    if(glyph_it == m_lkup_font_glyph_list[glyph_info.font].end())
-                    {
-                        GlyphImageDesc new_glyph;
-                        genGlyph(list_fonts,glyph_info,new_glyph);
+                // Prefer glyphs that have already been rasterized
+                GlyphImageDesc const * glyph =
+                        m_glyph_table.Find(glyph_info.font,
+                                           glyph_info.index);
 
-                        list_glyphs.push_back(new_glyph);
-                    }
-                    else
-                    {
-                        list_glyphs.push_back(*glyph_it);
-                    }
+                if(glyph != nullptr)
+                {
+                    list_glyphs.push_back(*glyph);
+                    continue;
+                }
+
+                glyph = m_metrics_table.Find(glyph_info.font,
+                                             glyph_info.index);
+
+                if(glyph == nullptr)
+                {
+                    GlyphImageDesc new_glyph;
+                    genGlyphMetrics(list_fonts,glyph_info,new_glyph);
+
+                    list_glyphs.push_back(new_glyph);
+                }
+                else
+                {
+                    list_glyphs.push_back(*glyph);
                 }
             }
         }
@@ -127,228 +551,538 @@ namespace ks
             return m_sdf_offset_px;
         }
 
-        void TextAtlas::genGlyph(std::vector<unique_ptr<Font>> const &list_fonts,
-                                 GlyphInfo const &glyph_info,
-                                 GlyphImageDesc &glyph)
+        bool TextAtlas::IsAtlasBudgetFull() const
         {
-            if(glyph_info.font == 0) {
-                std::string desc = m_log_prefix;
-                desc += "Glyph gen: invalid font";
+            return ((m_max_atlas_count > 0) &&
+                    (getAtlasCount() >= m_max_atlas_count));
+        }
 
-                throw TextAtlasError(desc);
+        void TextAtlas::SetFreeTypeMemoryLimit(u64 max_bytes)
+        {
+            m_ft_memory_limit = max_bytes;
+
+            if(m_raster_pool)
+            {
+                m_raster_pool->SetFreeTypeMemoryLimit(max_bytes);
             }
+        }
 
-            // Render glyph to the active glyph slot
-            FT_Face &face = list_fonts[glyph_info.font]->ft_face;
+        void TextAtlas::AddFreeTypeMemoryStats(FreeTypeMemoryStats &stats) const
+        {
+            if(m_raster_pool)
+            {
+                m_raster_pool->AddFreeTypeMemoryStats(stats);
+            }
+        }
 
-            FT_Error const error =
-                    FT_Load_Glyph(face,glyph_info.index,FT_LOAD_RENDER);
+        std::vector<AtlasOccupancy> TextAtlas::GetAtlasOccupancy() const
+        {
+            if(m_bins_per_atlas == 1)
+            {
+                std::vector<AtlasOccupancy> list_occupancy;
+                list_occupancy.reserve(m_list_atlas_bins.size());
 
-            if(error) {
-                std::string desc = m_log_prefix;
-                desc += "Failed to render glyph: Font: ";
-                desc += list_fonts[glyph_info.font]->name;
-                desc += ", index: ";
-                desc += glyph_info.index;
-                desc += ": ";
-                desc += GetFreeTypeError(error);
+                for(auto const &atlas_bin : m_list_atlas_bins)
+                {
+                    list_occupancy.push_back(atlas_bin->GetOccupancy());
+                }
 
-                throw FreeTypeError(desc);
+                return list_occupancy;
             }
 
-            // Get glyph metrics
-            // NOTE: Most glyph metrics params are expressed in 26.6
-            //       fractional pixel format:
-            //       '64' in 26.6 format == 1 pixel
-            //        So to get pixels, divide by 64
-            FT_Glyph_Metrics &metrics = face->glyph->metrics;
-            u32 metrics_width_px  = metrics.width/64;
-            u32 metrics_height_px = metrics.height/64;
+            // Combine the channels of each atlas; channels that
+            // haven't been used yet count as free space
+            std::vector<AtlasOccupancy> list_occupancy(getAtlasCount());
 
-            // If this glyph is just a 'spacing' character,
-            // save it without generating a texture and return
-            if((metrics_width_px == 0) || (metrics_height_px == 0)) {
-                // Save glyph
-                // (ref)
-                glyph.font  = glyph_info.font;
-                glyph.index = glyph_info.index;
-                glyph.atlas = 0;
-                // (texture)
-                glyph.tex_x = 0;
-                glyph.tex_y = 0;
-                // (sdf)
-                glyph.sdf_x = m_sdf_offset_px;
-                glyph.sdf_y = m_sdf_offset_px;
-                // (metrics)
-                glyph.bearing_x = metrics.horiBearingX/64;
-                glyph.bearing_y = metrics.horiBearingY/64;
-                glyph.width     = metrics_width_px;
-                glyph.height    = metrics_height_px;
+            for(uint i=0; i < list_occupancy.size(); i++)
+            {
+                uint const bin_begin = i*m_bins_per_atlas;
+                uint const bin_end = std::min<uint>(bin_begin+m_bins_per_atlas,
+                                                    m_list_atlas_bins.size());
 
-                // TODO not sure if this should be saved here
-                auto& list_glyphs = m_lkup_font_glyph_list[glyph_info.font];
+                AtlasOccupancy &occupancy = list_occupancy[i];
+                occupancy = m_list_atlas_bins[bin_begin]->GetOccupancy();
 
-                std::vector<GlyphImageDesc>::iterator glyph_it;
-                glyph_it = std::upper_bound(list_glyphs.begin(),
-                                            list_glyphs.end(),
-                                            glyph.index,
-                                            glyphIsLessThanUB);
+                u64 const channel_px = occupancy.total_px;
+                occupancy.total_px *= m_bins_per_atlas;
 
-                list_glyphs.insert(glyph_it,glyph);
+                for(uint bin=bin_begin+1; bin < bin_end; bin++)
+                {
+                    AtlasOccupancy const bin_occupancy =
+                            m_list_atlas_bins[bin]->GetOccupancy();
 
-                return;
+                    occupancy.glyph_count += bin_occupancy.glyph_count;
+                    occupancy.used_px += bin_occupancy.used_px;
+                    occupancy.largest_free_px = bin_occupancy.largest_free_px;
+                }
+
+                if(bin_end-bin_begin < m_bins_per_atlas)
+                {
+                    occupancy.largest_free_px = channel_px;
+                }
+
+                u64 const unused_px = occupancy.total_px - occupancy.used_px;
+                occupancy.occupancy = double(occupancy.used_px)/occupancy.total_px;
+                occupancy.fragmentation =
+                        (unused_px == 0) ? 0.0f :
+                        1.0 - std::min(1.0,double(occupancy.largest_free_px)/unused_px);
             }
 
-            BinPackRectangle glyph_rect;
-            glyph_rect.width  = (metrics_width_px) + 2*m_sdf_offset_px;
-            glyph_rect.height = (metrics_height_px) + 2*m_sdf_offset_px;
+            return list_occupancy;
+        }
 
-            // Try to add the glyph rect into an atlas;
-            // create a new atlas if current ones are full
-            BinPackShelf * atlas_bin = &(m_list_atlas_bins.back());
-            if(!(atlas_bin->AddRectangle(glyph_rect))) {
-                this->addEmptyAtlas();
-                atlas_bin = &(m_list_atlas_bins.back());
-                atlas_bin->AddRectangle(glyph_rect);
+        void TextAtlas::genGlyph(std::vector<unique_ptr<Font>> const &list_fonts,
+                                 GlyphInfo const &glyph_info,
+                                 GlyphImageDesc &glyph)
+        {
+            if(glyph_info.font == 0) {
+                std::string desc = m_log_prefix;
+                desc += "Glyph gen: invalid font";
 
-                // TODO if the second add fails, we should
-                // throw; the glyph size might be bigger than
-                // the atlas size
+                throw TextAtlasError(desc);
             }
 
-            // Add the glyph bitmap with a position offset
-            unique_ptr<std::vector<R8>> glyph_subimage_data =
-                    make_unique<std::vector<R8>>();
+            RasterGlyph &raster_glyph = *m_raster_glyph;
+            rasterizeGlyph(list_fonts[glyph_info.font]->ft_raster_face,
+                           list_fonts,
+                           glyph_info,
+                           raster_glyph);
 
-            // Copy the glyph bitmap from freetype
-            // We expect a single byte/pixel
-            FT_Bitmap &bitmap = face->glyph->bitmap;
-            int const abs_pitch = abs(bitmap.pitch);
-            assert(bitmap.width == abs_pitch);
+            addGlyph(glyph_info,raster_glyph,glyph);
+        }
 
-            // Reserve space to avoid reallocation
-            glyph_subimage_data->reserve(
-                        bitmap.rows*bitmap.width);
+        void TextAtlas::genGlyphs(std::vector<unique_ptr<Font>> const &list_fonts,
+                                  std::vector<GlyphInfo> const &list_glyph_info,
+                                  GlyphImageDesc * list_glyphs)
+        {
+            // Generates the glyphs for m_list_misses
 
-            // A negative pitch indicates the first byte of
-            // the image represents the bottom left corner
-            int offset = (bitmap.pitch > 0) ?
-                        0 : (abs_pitch * (bitmap.rows-1));
+            // Find the first position of each glyph that needs
+            // to be generated; glyphs can repeat within a list
+            std::vector<std::pair<u64,uint>> list_gen_keys;
+            for(uint const i : m_list_misses)
+            {
+                GlyphInfo const &glyph_info = list_glyph_info[i];
+                if((!glyph_info.zero_width) && (glyph_info.font != 0))
+                {
+                    list_gen_keys.emplace_back(
+                                (u64(glyph_info.font) << 32) |
+                                glyph_info.index,i);
+                }
+            }
 
-            // copy byte by byte
-            for(int r=0; r < bitmap.rows; r++) {
-                for(int c=0; c < bitmap.width; c++) {
-                    // save the gray levels in the red channel
-                    glyph_subimage_data->push_back(
-                                R8{bitmap.buffer[offset+c]});
+            std::vector<uint> list_gen;
+            auto &list_raster_glyphs = m_list_raster_glyphs;
+
+            if(m_raster_pool && (list_gen_keys.size() >= kMinPoolGlyphs))
+            {
+                std::sort(list_gen_keys.begin(),list_gen_keys.end());
+                for(uint i=0; i < list_gen_keys.size(); i++)
+                {
+                    if((i == 0) ||
+                       (list_gen_keys[i].first != list_gen_keys[i-1].first))
+                    {
+                        list_gen.push_back(list_gen_keys[i].second);
+                    }
                 }
-                offset += bitmap.pitch;
+
+                // Keep the glyphs in the order they appear so they're
+                // packed and emitted in the same order as they would
+                // be on a single thread
+                std::sort(list_gen.begin(),list_gen.end());
             }
 
-            // Create the glyph subimage
-            Image<R8> glyph_subimage;
-            glyph_subimage.SetAll(metrics_width_px,
-                                  metrics_height_px,
-                                  std::move(glyph_subimage_data));
+            if(list_gen.size() >= kMinPoolGlyphs)
+            {
+                // Render and transform the glyphs in parallel; the
+                // list only grows so the glyph buffers are kept
+                while(list_raster_glyphs.size() < list_gen.size())
+                {
+                    list_raster_glyphs.push_back(make_unique<RasterGlyph>());
+                }
 
-            // Create the glyph image (ie subimage + space
-            // for the SDF transform)
-            Image<R8> glyph_image(glyph_rect.width,
-                                  glyph_rect.height,
-                                  R8{0});
+                m_raster_pool->Run(
+                            list_gen.size(),
+                            [&](RasterPool::FaceList const &list_faces,
+                                uint job) {
+                    GlyphInfo const &glyph_info =
+                            list_glyph_info[list_gen[job]];
 
-            auto sdf_ins_pixel_it =
-                    glyph_image.GetPixel(
-                        m_sdf_offset_px,
-                        m_sdf_offset_px);
+                    RasterGlyph &raster_glyph = *(list_raster_glyphs[job]);
+                    raster_glyph.error = nullptr;
 
-            glyph_image.Insert(glyph_subimage,
-                               glyph_subimage.GetPixel(0,0),
-                               sdf_ins_pixel_it);
+                    try
+                    {
+                        FT_Face face = (glyph_info.font < list_faces.size()) ?
+                                    list_faces[glyph_info.font] : nullptr;
 
+                        if(face == nullptr)
+                        {
+                            std::string desc = m_log_prefix;
+                            desc += "Failed to render glyph: Font: ";
+                            desc += list_fonts[glyph_info.font]->name;
+                            desc += ": No face on raster thread";
 
-            // Apply sdf transform
-            u8* glyph_image_bytes =
-                    reinterpret_cast<u8*>(
-                        &(glyph_image.GetData()[0]));
+                            throw FreeTypeError(desc);
+                        }
 
-            make_distance_map(glyph_image_bytes,
-                              glyph_image.GetWidth(),
-                              glyph_image.GetHeight());
+                        rasterizeGlyph(face,list_fonts,glyph_info,raster_glyph);
+                    }
+                    catch(...)
+                    {
+                        raster_glyph.error = std::current_exception();
+                    }
+                });
+            }
+            else
+            {
+                list_gen.clear();
+            }
+
+            // Add the glyphs to the atlas in order
+            uint gen_index = 0;
+
+            for(uint const i : m_list_misses)
+            {
+                GlyphInfo const &glyph_info = list_glyph_info[i];
+
+                // Check for the zero-dimension glyphs first
+                if(glyph_info.zero_width)
+                {
+                    GlyphImageDesc empty_glyph;
+                    empty_glyph.font  = glyph_info.font;
+                    empty_glyph.index = glyph_info.index;
+                    empty_glyph.atlas = 0;
+                    // (texture)
+                    empty_glyph.tex_x = 0;
+                    empty_glyph.tex_y = 0;
+                    // (sdf)
+                    empty_glyph.sdf_x = 0;
+                    empty_glyph.sdf_y = 0;
+                    // (metrics)
+                    empty_glyph.bearing_x = 0;
+                    empty_glyph.bearing_y = 0;
+                    empty_glyph.width     = 0;
+                    empty_glyph.height    = 0;
+                    empty_glyph.res_px    = m_glyph_res_px;
+                    empty_glyph.channel   = 0;
+                    empty_glyph.image_type = GlyphImageType::SDF;
+
+                    list_glyphs[i] = empty_glyph;
+                    continue;
+                }
+
+                if((gen_index < list_gen.size()) && (list_gen[gen_index] == i))
+                {
+                    RasterGlyph &raster_glyph = *(list_raster_glyphs[gen_index]);
+                    gen_index++;
+
+                    if(raster_glyph.error)
+                    {
+                        std::rethrow_exception(raster_glyph.error);
+                    }
+
+                    addGlyph(glyph_info,raster_glyph,list_glyphs[i]);
+                    continue;
+                }
+
+                // The glyph may have been generated for
+                // an earlier miss in the same list
+                GlyphImageDesc const * glyph =
+                        m_glyph_table.Find(glyph_info.font,
+                                           glyph_info.index);
+
+                if(glyph == nullptr)
+                {
+                    genGlyph(list_fonts,glyph_info,list_glyphs[i]);
+                }
+                else
+                {
+                    list_glyphs[i] = *glyph;
+                }
+            }
+        }
+
+        void TextAtlas::rasterizeGlyph(FT_Face face,
+                                       std::vector<unique_ptr<Font>> const &list_fonts,
+                                       GlyphInfo const &glyph_info,
+                                       RasterGlyph &raster_glyph) const
+        {
+            // * This only reads from TextAtlas and only uses
+            //   @face, so it can run on a RasterPool worker
+
+            Font const &font = *(list_fonts[glyph_info.font]);
+            uint const sdf_offset_px = font.sdf_offset_px;
+            bool const coverage_only = (font.image_type == GlyphImageType::Bitmap);
+
+            // Render glyph to the active glyph slot; outline
+            // engines only need the outline
+            bool const use_outline =
+                    SDFEngineUsesOutline(m_sdf_engine) && !coverage_only;
+
+            FreeTypeMemory::Scope ft_scope(face,glyph_info.font);
+
+            FT_Error error =
+                    FT_Load_Glyph(face,
+                                  glyph_info.index,
+                                  use_outline ? FT_LOAD_DEFAULT : FT_LOAD_RENDER);
+
+            if(error) {
+                std::string desc = m_log_prefix;
+                desc += "Failed to render glyph: Font: ";
+                desc += list_fonts[glyph_info.font]->name;
+                desc += ", index: ";
+                desc += ks::ToString(glyph_info.index);
+                desc += ": ";
+                desc += GetFreeTypeError(error);
+
+                throw FreeTypeError(desc);
+            }
+
+            // Get glyph metrics
+            // NOTE: Most glyph metrics params are expressed in 26.6
+            //       fractional pixel format:
+            //       '64' in 26.6 format == 1 pixel
+            //        So to get pixels, divide by 64
+            FT_Glyph_Metrics &metrics = face->glyph->metrics;
+            u32 metrics_width_px  = metrics.width/64;
+            u32 metrics_height_px = metrics.height/64;
+
+            raster_glyph.bearing_x = metrics.horiBearingX;
+            raster_glyph.bearing_y = metrics.horiBearingY;
+            raster_glyph.width_px  = metrics_width_px;
+            raster_glyph.height_px = metrics_height_px;
+            raster_glyph.res_px    = font.glyph_res_px;
+            raster_glyph.sdf_offset_px = sdf_offset_px;
+            raster_glyph.image_type = font.image_type;
+            raster_glyph.image_width  = 0;
+            raster_glyph.image_height = 0;
+
+            // If this glyph is just a 'spacing' character,
+            // there's no texture to generate
+            if((metrics_width_px == 0) || (metrics_height_px == 0)) {
+                return;
+            }
+
+            uint const image_width  = metrics_width_px + 2*sdf_offset_px;
+            uint const image_height = metrics_height_px + 2*sdf_offset_px;
+            uint const channels = GetSDFChannelCount(m_sdf_engine);
+
+            // Reuses the glyph's buffer, so this only
+            // allocates when a glyph is larger than any
+            // glyph it held before
+            std::vector<u8> &list_image = raster_glyph.list_image;
+            list_image.resize(image_width*image_height*channels);
+            raster_glyph.image_width  = image_width;
+            raster_glyph.image_height = image_height;
+
+            if(use_outline) {
+                if(face->glyph->format == FT_GLYPH_FORMAT_OUTLINE) {
+                    // The top left corner of the image is
+                    // the sdf offset away from the glyph's
+                    // top left corner
+                    FT_Pos const origin_x =
+                            metrics.horiBearingX - sdf_offset_px*64;
+
+                    FT_Pos const origin_y =
+                            metrics.horiBearingY + sdf_offset_px*64;
+
+                    // Every pixel is written
+                    MakeOutlineDistanceMap(m_sdf_engine,
+                                           &(face->glyph->outline),
+                                           origin_x,
+                                           origin_y,
+                                           list_image.data(),
+                                           image_width,
+                                           image_height);
+                    return;
+                }
+
+                // Glyphs without an outline (ie. from bitmap
+                // fonts) fall back to the bitmap path
+                error = FT_Render_Glyph(face->glyph,FT_RENDER_MODE_NORMAL);
+                if(error) {
+                    std::string desc = m_log_prefix;
+                    desc += "Failed to render glyph: Font: ";
+                    desc += list_fonts[glyph_info.font]->name;
+                    desc += ", index: ";
+                    desc += ks::ToString(glyph_info.index);
+                    desc += ": ";
+                    desc += GetFreeTypeError(error);
+
+                    throw FreeTypeError(desc);
+                }
+            }
+
+            // Copy the glyph bitmap from freetype into the
+            // image with a position offset for the sdf; we
+            // expect a single byte/pixel
+            FT_Bitmap &bitmap = face->glyph->bitmap;
+            uint const copy_width = std::min<uint>(bitmap.width,metrics_width_px);
+            uint const copy_rows = std::min<uint>(bitmap.rows,metrics_height_px);
+
+            std::fill(list_image.begin(),
+                      list_image.begin()+image_width*image_height,
+                      0);
+
+            // A negative pitch indicates the first byte of
+            // the image represents the bottom left corner
+            int offset = (bitmap.pitch > 0) ?
+                        0 : (abs(bitmap.pitch) * (bitmap.rows-1));
+
+            u8 * dst = list_image.data() +
+                    sdf_offset_px*image_width + sdf_offset_px;
+
+            for(uint r=0; r < copy_rows; r++) {
+                std::memcpy(dst,bitmap.buffer+offset,copy_width);
+                dst += image_width;
+                offset += bitmap.pitch;
+            }
+
+            // Bitmap glyphs keep their hinted coverage
+            if(!coverage_only) {
+                // Apply sdf transform
+                MakeDistanceMap(m_sdf_engine,
+                                list_image.data(),
+                                image_width,
+                                image_height,
+                                sdf_offset_px);
+            }
+
+            ExpandChannels(list_image.data(),image_width*image_height,channels);
+        }
+
+        void TextAtlas::addGlyph(GlyphInfo const &glyph_info,
+                                 RasterGlyph &raster_glyph,
+                                 GlyphImageDesc &glyph)
+        {
+            // If this glyph is just a 'spacing' character,
+            // save it without a texture
+            if(raster_glyph.image_width == 0) {
+                // Save glyph
+                // (ref)
+                glyph.font  = glyph_info.font;
+                glyph.index = glyph_info.index;
+                glyph.atlas = 0;
+                // (texture)
+                glyph.tex_x = 0;
+                glyph.tex_y = 0;
+                // (sdf)
+                glyph.sdf_x = raster_glyph.sdf_offset_px;
+                glyph.sdf_y = raster_glyph.sdf_offset_px;
+                // (metrics)
+                glyph.bearing_x = raster_glyph.bearing_x/64;
+                glyph.bearing_y = raster_glyph.bearing_y/64;
+                glyph.width     = raster_glyph.width_px;
+                glyph.height    = raster_glyph.height_px;
+                glyph.res_px    = raster_glyph.res_px;
+                glyph.channel   = 0;
+                glyph.image_type = raster_glyph.image_type;
+
+                // TODO not sure if this should be saved here
+                m_glyph_table.Insert(glyph,m_use_stamp);
+
+                return;
+            }
+
+            BinPackRectangle glyph_rect;
+            glyph_rect.width  = raster_glyph.image_width;
+            glyph_rect.height = raster_glyph.image_height;
+
+            // Try to add the glyph rect into an atlas;
+            // create a new atlas if current ones are full
+            AtlasPacker * atlas_bin = m_list_atlas_bins.back().get();
+            if(!(atlas_bin->AddRectangle(glyph_rect))) {
+                this->addEmptyAtlas();
+                atlas_bin = m_list_atlas_bins.back().get();
+                atlas_bin->AddRectangle(glyph_rect);
+
+                // TODO if the second add fails, we should
+                // throw; the glyph size might be bigger than
+                // the atlas size
+            }
 
             // Save glyph
             // (ref)
             glyph.font  = glyph_info.font;
             glyph.index = glyph_info.index;
-            glyph.atlas = m_list_atlas_bins.size()-1;
+            uint const bin = m_list_atlas_bins.size()-1;
+            glyph.atlas = bin/m_bins_per_atlas;
             // (texture)
             glyph.tex_x = glyph_rect.x;
             glyph.tex_y = glyph_rect.y;
             // (sdf)
-            glyph.sdf_x = m_sdf_offset_px;
-            glyph.sdf_y = m_sdf_offset_px;
+            glyph.sdf_x = raster_glyph.sdf_offset_px;
+            glyph.sdf_y = raster_glyph.sdf_offset_px;
             // (metrics)
-            glyph.bearing_x = metrics.horiBearingX/64.0;
-            glyph.bearing_y = metrics.horiBearingY/64.0;
-            glyph.width     = metrics_width_px;
-            glyph.height    = metrics_height_px;
+            glyph.bearing_x = raster_glyph.bearing_x/64.0;
+            glyph.bearing_y = raster_glyph.bearing_y/64.0;
+            glyph.width     = raster_glyph.width_px;
+            glyph.height    = raster_glyph.height_px;
+            glyph.res_px    = raster_glyph.res_px;
+            glyph.channel   = bin%m_bins_per_atlas;
+            glyph.image_type = raster_glyph.image_type;
 
-            auto& list_glyphs = m_lkup_font_glyph_list[glyph_info.font];
-
-            std::vector<GlyphImageDesc>::iterator glyph_it;
-            glyph_it = std::upper_bound(list_glyphs.begin(),
-                                        list_glyphs.end(),
-                                        glyph.index,
-                                        glyphIsLessThanUB);
-
-            list_glyphs.insert(glyph_it,glyph);
+            m_glyph_table.Insert(glyph,m_use_stamp);
 
             // Notify listeners
-            signal_new_glyph.Emit(
-                        glyph.atlas,
-                        glm::u16vec2(
-                            glyph_rect.x,
-                            glyph_rect.y),
-                        shared_ptr<ks::ImageData>(
-                            glyph_image.
-                            ConvertToImageDataPtr().release()));
+            updateAtlas(bin,
+                        glyph_rect,
+                        raster_glyph.list_image.data());
         }
 
-        std::vector<GlyphImageDesc>::iterator TextAtlas::findGlyph(uint font_index,
-                                                          uint glyph_index)
+        void TextAtlas::genGlyphMetrics(std::vector<unique_ptr<Font>> const &list_fonts,
+                                        GlyphInfo const &glyph_info,
+                                        GlyphImageDesc &glyph)
         {
-            auto& list_glyphs =
-                    m_lkup_font_glyph_list[font_index];
+            // Load the glyph without rendering it; the metrics
+            // are the same as those used by genGlyph
+            Font const &font = *(list_fonts[glyph_info.font]);
+            FT_Face face = font.ft_raster_face;
+            FreeTypeMemory::Scope ft_scope(face,glyph_info.font);
 
-            auto glyph_it =
-                    std::lower_bound(
-                        list_glyphs.begin(),
-                        list_glyphs.end(),
-                        glyph_index,
-                        glyphIsLessThanLB);
+            FT_Error const error =
+                    FT_Load_Glyph(face,glyph_info.index,FT_LOAD_DEFAULT);
 
-            if(glyph_it != list_glyphs.end())
-            {
-                // test to see if glyph_it is pointing
-                // to a glyph with an equivalent index
-                // or just an adjacent element
-                if(glyph_it->index != glyph_index)
-                {
-                    return list_glyphs.end();
-                }
+            if(error) {
+                std::string desc = m_log_prefix;
+                desc += "Failed to load glyph metrics: Font: ";
+                desc += list_fonts[glyph_info.font]->name;
+                desc += ", index: ";
+                desc += ks::ToString(glyph_info.index);
+                desc += ": ";
+                desc += GetFreeTypeError(error);
+
+                throw FreeTypeError(desc);
             }
 
-            return glyph_it;
+            FT_Glyph_Metrics &metrics = face->glyph->metrics;
+
+            // Save glyph
+            // (ref)
+            glyph.font  = glyph_info.font;
+            glyph.index = glyph_info.index;
+            glyph.atlas = 0;
+            // (texture)
+            glyph.tex_x = 0;
+            glyph.tex_y = 0;
+            // (sdf)
+            glyph.sdf_x = font.sdf_offset_px;
+            glyph.sdf_y = font.sdf_offset_px;
+            // (metrics)
+            glyph.bearing_x = metrics.horiBearingX/64;
+            glyph.bearing_y = metrics.horiBearingY/64;
+            glyph.width     = metrics.width/64;
+            glyph.height    = metrics.height/64;
+            glyph.res_px    = font.glyph_res_px;
+            glyph.channel   = 0;
+            glyph.image_type = font.image_type;
+
+            m_metrics_table.Insert(glyph);
         }
 
-        // rn: assignMissingGlyphIfReq
-        void TextAtlas::assignMissingGlyph(unique_ptr<Font> const &font)
+        bool TextAtlas::hasMissingGlyph(unique_ptr<Font> const &font) const
         {
-            // Generate a missing glyph for this font if
-            // it doesn't have one.
-
-            // We assume that @font belongs to the last added font
-
             FT_Face &face = font->ft_face;
             FT_Error const error = FT_Load_Glyph(face,0,FT_LOAD_RENDER);
 
@@ -372,11 +1106,7 @@ namespace ks
 
             if(metrics_width_px*metrics_height_px == 0)
             {
-                auto& list_glyphs = m_lkup_font_glyph_list.back();
-                list_glyphs.insert(list_glyphs.begin(),m_missing_glyph);
-                list_glyphs.back().font = m_lkup_font_glyph_list.size()-1;
-
-                return;
+                return false;
             }
 
             // Check that the bitmap has non-zero pixels
@@ -386,27 +1116,19 @@ namespace ks
             int offset = (bitmap.pitch > 0) ?
                         0 : (abs_pitch * (bitmap.rows-1));
 
-            bool pixel_filled = false;
             for(int r=0; r < bitmap.rows; r++)
             {
                 for(int c=0; c < bitmap.width; c++)
                 {
                     if(bitmap.buffer[offset+c] > 0)
                     {
-                        pixel_filled = true;
-                        break;
+                        return true;
                     }
                 }
                 offset += bitmap.pitch;
             }
 
-            if(pixel_filled == false)
-            {
-                auto& list_glyphs = m_lkup_font_glyph_list.back();
-                list_glyphs.insert(list_glyphs.begin(),m_missing_glyph);
-                list_glyphs.back().font = m_lkup_font_glyph_list.size()-1;
-                return;
-            }
+            return false;
         }
 
         void TextAtlas::genMissingGlyph()
@@ -429,11 +1151,12 @@ namespace ks
 
             float dim_full = dim+(2*adj);
 
-            ks::Image<ks::R8> glyph_image(dim_full,dim_full,ks::R8{0});
-            auto& glyph_image_data = glyph_image.GetData();
-
             uint const dim_full_i = dim_full;
-            for(uint i=0; i < glyph_image_data.size(); i++) {
+            uint const pixel_count = dim_full_i*dim_full_i;
+            std::vector<u8> list_image(
+                        pixel_count*GetSDFChannelCount(m_sdf_engine),0);
+
+            for(uint i=0; i < pixel_count; i++) {
                 u16 x = i%dim_full_i;
                 u16 y = i/dim_full_i;
 
@@ -441,16 +1164,20 @@ namespace ks
                 bool in2 = ((x >= x1) && (x <= x2)) && ((y >= y1) && (y <= y2));
 
                 if(in1 && (!in2)) {
-                    glyph_image_data[i].r = 255;
+                    list_image[i] = 255;
                 }
             }
 
             // apply sdf transform
-            u8* glyph_image_bytes =
-                    reinterpret_cast<u8*>(
-                        &(glyph_image_data[0]));
+            MakeDistanceMap(m_sdf_engine,
+                            list_image.data(),
+                            dim_full,
+                            dim_full,
+                            m_sdf_offset_px);
 
-            make_distance_map(glyph_image_bytes,dim_full,dim_full);
+            ExpandChannels(list_image.data(),
+                           pixel_count,
+                           GetSDFChannelCount(m_sdf_engine));
 
             // add to atlas
             BinPackRectangle glyph_rect;
@@ -459,18 +1186,13 @@ namespace ks
 
             // Try to add the glyph rect into an atlas;
             // create a new atlas if current ones are full
-            BinPackShelf * atlas_bin = &(m_list_atlas_bins.back());
+            AtlasPacker * atlas_bin = m_list_atlas_bins.back().get();
             atlas_bin->AddRectangle(glyph_rect);
 
             // notify that a glyph was created
-            signal_new_glyph.Emit(
-                        0,
-                        glm::u16vec2(
-                            glyph_rect.x,
-                            glyph_rect.y),
-                        shared_ptr<ks::ImageData>(
-                            glyph_image.
-                            ConvertToImageDataPtr().release()));
+            updateAtlas(0,
+                        glyph_rect,
+                        list_image.data());
 
             // save glyph
             // (ref)
@@ -488,29 +1210,973 @@ namespace ks
             m_missing_glyph.bearing_y = dim;
             m_missing_glyph.width     = dim;
             m_missing_glyph.height    = dim;
+            m_missing_glyph.res_px    = m_glyph_res_px;
+            m_missing_glyph.channel   = 0;
+            m_missing_glyph.image_type = GlyphImageType::SDF;
         }
 
         void TextAtlas::addEmptyAtlas()
         {
-            BinPackShelf atlas_bin(m_atlas_size_px,m_atlas_size_px,1);
-            m_list_atlas_bins.push_back(atlas_bin);
+            m_list_atlas_bins.push_back(
+                        CreateAtlasPacker(
+                            m_packer_type,
+                            m_atlas_size_px,
+                            m_atlas_size_px,
+                            1));
+
+            if(!m_cache_file_path.empty())
+            {
+                m_list_atlas_rects.emplace_back();
+            }
+
+            // With channel packing the next channel of the
+            // last atlas is used until they're all full
+            if((m_list_atlas_bins.size()-1)%m_bins_per_atlas != 0)
+            {
+                return;
+            }
+
+            if(m_keep_atlas_images)
+            {
+                m_list_atlas_staging.push_back(
+                            CreateBlankImageData(
+                                m_atlas_size_px,
+                                m_atlas_size_px,
+                                getAtlasChannelCount()));
+
+                m_list_atlas_packed.emplace_back();
+            }
 
-            signal_new_atlas.Emit(
-                        m_list_atlas_bins.size()-1,
-                        m_atlas_size_px);
+            emitSignal(signal_new_atlas,
+                       getAtlasCount()-1,
+                       m_atlas_size_px);
         }
 
-        bool TextAtlas::glyphIsLessThanLB(GlyphImageDesc const &glyph,
-                                          u32 index)
+        void TextAtlas::compactAtlases(std::vector<unique_ptr<Font>> const &list_fonts)
         {
-            return (glyph.index < index);
+            // Sort the glyphs that have images from the most
+            // to the least recently used; glyphs without images
+            // and copies of the missing glyph are always kept
+            auto const &list_glyphs = m_glyph_table.GetGlyphList();
+            auto const &list_last_use = m_glyph_table.GetLastUseList();
+
+            std::vector<std::pair<GlyphImageDesc,u32>> list_keep_glyphs;
+            std::vector<uint> list_missing_fonts;
+            std::vector<uint> list_image_glyphs;
+
+            for(uint i=0; i < list_glyphs.size(); i++)
+            {
+                GlyphImageDesc const &glyph = list_glyphs[i];
+                if((glyph.width == 0) || (glyph.height == 0))
+                {
+                    list_keep_glyphs.emplace_back(glyph,list_last_use[i]);
+                }
+                else if((glyph.atlas == m_missing_glyph.atlas) &&
+                        (glyph.channel == m_missing_glyph.channel) &&
+                        (glyph.tex_x == m_missing_glyph.tex_x) &&
+                        (glyph.tex_y == m_missing_glyph.tex_y))
+                {
+                    list_missing_fonts.push_back(glyph.font);
+                }
+                else
+                {
+                    list_image_glyphs.push_back(i);
+                }
+            }
+
+            std::stable_sort(
+                        list_image_glyphs.begin(),
+                        list_image_glyphs.end(),
+                        [&](uint a, uint b) {
+                            return (list_last_use[a] > list_last_use[b]);
+                        });
+
+            // Keep glyphs until they'd use up the fill ratio
+            // of the budget (counting the missing glyph)
+            u64 const max_area =
+                    kCompactFillRatio*m_max_atlas_count*m_bins_per_atlas*
+                    m_atlas_size_px*m_atlas_size_px;
+
+            uint const missing_size_px =
+                    m_glyph_res_px + 2*m_sdf_offset_px + 1;
+
+            u64 area = missing_size_px*missing_size_px;
+
+            std::vector<GlyphInfo> list_regen_info;
+            std::vector<u32> list_regen_last_use;
+
+            for(uint const i : list_image_glyphs)
+            {
+                GlyphImageDesc const &glyph = list_glyphs[i];
+                area += u64(glyph.width + 2*glyph.sdf_x + 1)*
+                        (glyph.height + 2*glyph.sdf_y + 1);
+
+                if(area > max_area)
+                {
+                    break;
+                }
+
+                GlyphInfo glyph_info;
+                glyph_info.index = glyph.index;
+                glyph_info.cluster = 0;
+                glyph_info.font = glyph.font;
+                glyph_info.zero_width = false;
+                glyph_info.rtl = false;
+
+                list_regen_info.push_back(glyph_info);
+                list_regen_last_use.push_back(list_last_use[i]);
+            }
+
+            LOG.Trace() << m_log_prefix << "Compacting "
+                        << getAtlasCount() << " atlases: kept "
+                        << list_regen_info.size() << " of "
+                        << list_image_glyphs.size() << " glyphs";
+
+            // Release every atlas and start over; updates that
+            // haven't been taken are for the old atlases
+            uint const atlas_count = getAtlasCount();
+
+            m_glyph_table.Clear();
+            m_list_atlas_bins.clear();
+            m_list_atlas_staging.clear();
+            m_list_atlas_packed.clear();
+            m_list_atlas_rects.clear();
+            m_list_dirty_rects.clear();
+            {
+                std::lock_guard<std::mutex> lock(m_updates_mutex);
+                m_list_updates.clear();
+            }
+
+            emitSignal(signal_atlases_compacted,atlas_count);
+
+            addEmptyAtlas();
+            genMissingGlyph();
+
+            for(auto const &keep_glyph : list_keep_glyphs)
+            {
+                m_glyph_table.Insert(keep_glyph.first,keep_glyph.second);
+            }
+
+            for(uint const font : list_missing_fonts)
+            {
+                GlyphImageDesc missing_glyph = m_missing_glyph;
+                missing_glyph.font = font;
+                m_glyph_table.Insert(missing_glyph);
+            }
+
+            // Rasterize the kept glyphs again in their new
+            // positions and restore their last use
+            std::vector<GlyphImageDesc> list_regen_glyphs(list_regen_info.size());
+
+            m_list_misses.resize(list_regen_info.size());
+            for(uint i=0; i < m_list_misses.size(); i++)
+            {
+                m_list_misses[i] = i;
+            }
+
+            genGlyphs(list_fonts,list_regen_info,list_regen_glyphs.data());
+
+            for(uint i=0; i < list_regen_glyphs.size(); i++)
+            {
+                m_glyph_table.Insert(list_regen_glyphs[i],
+                                     list_regen_last_use[i]);
+            }
+
+            flushAtlasUpdates();
+            packAtlasImages();
         }
 
-        bool TextAtlas::glyphIsLessThanUB(u32 index,
-                                          GlyphImageDesc const &glyph)
+        void TextAtlas::updateAtlas(uint bin,
+                                    BinPackRectangle const &glyph_rect,
+                                    u8 const * glyph_data)
         {
-            return (index < glyph.index);
+            uint const atlas = bin/m_bins_per_atlas;
+
+            if(!m_cache_file_path.empty())
+            {
+                m_list_atlas_rects[bin].push_back(
+                            AtlasRect{
+                                u16(glyph_rect.x),
+                                u16(glyph_rect.y),
+                                u16(glyph_rect.width),
+                                u16(glyph_rect.height)
+                            });
+            }
+
+            // Write the glyph to the staging image; anything
+            // past the edge of the atlas is dropped
+            uint const channels = getAtlasChannelCount();
+            uint const width = std::min(glyph_rect.width,
+                                        m_atlas_size_px-glyph_rect.x);
+            uint const height = std::min(glyph_rect.height,
+                                         m_atlas_size_px-glyph_rect.y);
+
+            unique_ptr<ImageData> glyph_image;
+
+            if(m_keep_atlas_images)
+            {
+                ImageData &staging = *(m_list_atlas_staging[atlas]);
+                u8 * staging_data =
+                        staging.data->data() +
+                        (glyph_rect.y*m_atlas_size_px + glyph_rect.x)*channels;
+
+                if(m_bins_per_atlas == 1)
+                {
+                    CopyRows(glyph_data,
+                             glyph_rect.width*channels,
+                             staging_data,
+                             m_atlas_size_px*channels,
+                             width*channels,
+                             height);
+                }
+                else
+                {
+                    CopyRowsToChannel(glyph_data,
+                                      glyph_rect.width,
+                                      staging_data + bin%m_bins_per_atlas,
+                                      m_atlas_size_px*channels,
+                                      width,
+                                      height);
+
+                    // The glyph shares its pixels with glyphs in
+                    // the other channels, so they're all sent
+                    glyph_image = CreateBlankImageData(width,height,channels);
+                    CopyRows(staging_data,
+                             m_atlas_size_px*channels,
+                             glyph_image->data->data(),
+                             width*channels,
+                             width*channels,
+                             height);
+                }
+            }
+
+            if(m_update_mode == AtlasUpdateMode::PerGlyph)
+            {
+                // Slots keep the image, so it's the one
+                // allocation that's made for each glyph
+                if(glyph_image == nullptr)
+                {
+                    glyph_image = CreateBlankImageData(glyph_rect.width,
+                                                       glyph_rect.height,
+                                                       channels);
+
+                    std::memcpy(glyph_image->data->data(),
+                                glyph_data,
+                                glyph_image->data->size());
+                }
+
+                emitSignal(signal_new_glyph,
+                           atlas,
+                           glm::u16vec2(
+                               glyph_rect.x,
+                               glyph_rect.y),
+                           shared_ptr<ks::ImageData>(
+                               glyph_image.release()));
+                return;
+            }
+
+            m_list_dirty_rects.emplace_back(
+                        atlas,
+                        AtlasRect{
+                            u16(glyph_rect.x),
+                            u16(glyph_rect.y),
+                            u16(width),
+                            u16(height)
+                        });
         }
 
+        void TextAtlas::flushAtlasUpdates()
+        {
+            if(m_list_dirty_rects.empty())
+            {
+                return;
+            }
+
+            // Slots can call GetGlyphs again, so the
+            // list is moved out before anything is sent
+            std::vector<std::pair<uint,AtlasRect>> list_dirty_rects;
+            list_dirty_rects.swap(m_list_dirty_rects);
+
+            std::stable_sort(
+                        list_dirty_rects.begin(),
+                        list_dirty_rects.end(),
+                        [](std::pair<uint,AtlasRect> const &a,
+                           std::pair<uint,AtlasRect> const &b) {
+                            return (a.first < b.first);
+                        });
+
+            uint const channels = getAtlasChannelCount();
+            std::vector<AtlasUpdate> list_updates;
+            std::vector<AtlasRect> list_rects;
+
+            for(uint i=0; i < list_dirty_rects.size();)
+            {
+                uint const atlas = list_dirty_rects[i].first;
+
+                list_rects.clear();
+                for(; (i < list_dirty_rects.size()) &&
+                      (list_dirty_rects[i].first == atlas); i++)
+                {
+                    list_rects.push_back(list_dirty_rects[i].second);
+                }
+
+                MergeDirtyRects(list_rects);
+
+                if(m_update_mode == AtlasUpdateMode::Batched)
+                {
+                    emitSignal(signal_atlas_updated,
+                               atlas,
+                               list_rects,
+                               m_list_atlas_staging[atlas]);
+                    continue;
+                }
+
+                // Queued updates get their own copy of the
+                // pixels since the staging image keeps changing
+                ImageData const &staging = *(m_list_atlas_staging[atlas]);
+                for(auto const &rect : list_rects)
+                {
+                    AtlasUpdate update;
+                    update.atlas = atlas;
+                    update.rect = rect;
+                    update.image = CreateBlankImageData(rect.width,
+                                                        rect.height,
+                                                        channels);
+
+                    CopyRows(staging.data->data() +
+                             (rect.y*m_atlas_size_px + rect.x)*channels,
+                             m_atlas_size_px*channels,
+                             update.image->data->data(),
+                             rect.width*channels,
+                             rect.width*channels,
+                             rect.height);
+
+                    list_updates.push_back(std::move(update));
+                }
+            }
+
+            if(!list_updates.empty())
+            {
+                queueAtlasUpdates(std::move(list_updates));
+            }
+        }
+
+        void TextAtlas::queueAtlasUpdates(std::vector<AtlasUpdate> list_updates)
+        {
+            if(m_defer_updates)
+            {
+                auto const list_deferred =
+                        make_shared<std::vector<AtlasUpdate>>(
+                            std::move(list_updates));
+
+                m_list_deferred_updates.push_back(
+                            [this,list_deferred]() {
+                                queueAtlasUpdates(std::move(*list_deferred));
+                            });
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(m_updates_mutex);
+            for(auto &update : list_updates)
+            {
+                m_list_updates.push_back(std::move(update));
+            }
+        }
+
+        void TextAtlas::SetDeferUpdates(bool defer)
+        {
+            m_defer_updates = defer;
+        }
+
+        void TextAtlas::SendDeferredUpdates()
+        {
+            if(m_list_deferred_updates.empty())
+            {
+                return;
+            }
+
+            // Slots can call back into the TextManager, so the
+            // list is moved out before anything is sent
+            std::vector<std::function<void()>> list_deferred_updates;
+            list_deferred_updates.swap(m_list_deferred_updates);
+
+            for(auto const &send : list_deferred_updates)
+            {
+                send();
+            }
+        }
+
+        void TextAtlas::packAtlasImages()
+        {
+            if(!m_compress_atlas_images)
+            {
+                return;
+            }
+
+            // Glyphs are only added to the last atlas, so the
+            // others never change again (until compaction)
+            uint const channels = getAtlasChannelCount();
+            for(uint i=0; i+1 < m_list_atlas_staging.size(); i++)
+            {
+                if(m_list_atlas_staging[i] == nullptr)
+                {
+                    continue;
+                }
+
+                CompressAtlasImage(m_list_atlas_staging[i]->data->data(),
+                                   m_atlas_size_px*m_atlas_size_px*channels,
+                                   m_list_atlas_packed[i]);
+
+                m_list_atlas_packed[i].shrink_to_fit();
+                m_list_atlas_staging[i] = nullptr;
+
+                LOG.Trace() << m_log_prefix << "Compressed atlas " << i
+                            << " to " << m_list_atlas_packed[i].size()
+                            << " bytes";
+            }
+        }
+
+        unique_ptr<ImageData> TextAtlas::copyAtlasImage(uint atlas) const
+        {
+            unique_ptr<ImageData> image =
+                    CreateBlankImageData(
+                        m_atlas_size_px,
+                        m_atlas_size_px,
+                        getAtlasChannelCount());
+
+            if(m_list_atlas_staging[atlas])
+            {
+                *(image->data) = *(m_list_atlas_staging[atlas]->data);
+            }
+            else if(!DecompressAtlasImage(m_list_atlas_packed[atlas],
+                                          image->data->data(),
+                                          image->data->size()))
+            {
+                std::string desc = m_log_prefix;
+                desc += "Failed to decompress atlas ";
+                desc += ks::ToString(atlas);
+
+                throw TextAtlasError(desc);
+            }
+
+            return image;
+        }
+
+        void TextAtlas::emitAtlasImages()
+        {
+            AtlasRect const atlas_rect{
+                0,
+                0,
+                u16(m_atlas_size_px),
+                u16(m_atlas_size_px)
+            };
+
+            for(uint i=0; i < m_list_atlas_staging.size(); i++)
+            {
+                emitSignal(signal_new_atlas,i,m_atlas_size_px);
+
+                if((m_update_mode == AtlasUpdateMode::Batched) &&
+                   m_list_atlas_staging[i])
+                {
+                    emitSignal(signal_atlas_updated,
+                               i,
+                               std::vector<AtlasRect>{atlas_rect},
+                               m_list_atlas_staging[i]);
+                    continue;
+                }
+
+                // The staging image keeps changing, so
+                // other modes get a copy
+                shared_ptr<ImageData> image(copyAtlasImage(i).release());
+
+                if(m_update_mode == AtlasUpdateMode::PerGlyph)
+                {
+                    emitSignal(signal_new_glyph,i,glm::u16vec2(0,0),image);
+                }
+                else if(m_update_mode == AtlasUpdateMode::Batched)
+                {
+                    emitSignal(signal_atlas_updated,
+                               i,
+                               std::vector<AtlasRect>{atlas_rect},
+                               image);
+                }
+                else
+                {
+                    queueAtlasUpdates({AtlasUpdate{i,atlas_rect,image}});
+                }
+            }
+        }
+
+        void TextAtlas::EnableAtlasMirror()
+        {
+            checkNoFonts("The atlas mirror");
+
+            m_keep_atlas_images = true;
+            m_compress_atlas_images = true;
+        }
+
+        void TextAtlas::RestoreAtlases()
+        {
+            if(!m_keep_atlas_images)
+            {
+                std::string desc = m_log_prefix;
+                desc += "Can't restore atlases without a mirror";
+
+                throw TextAtlasError(desc);
+            }
+
+            // Updates that haven't been taken are
+            // covered by the whole images
+            {
+                std::lock_guard<std::mutex> lock(m_updates_mutex);
+                m_list_updates.clear();
+            }
+
+            emitAtlasImages();
+        }
+
+        void TextAtlas::EnableChannelPacking()
+        {
+            checkNoFonts("Channel packing");
+
+            if(GetSDFChannelCount(m_sdf_engine) != 1)
+            {
+                std::string desc = m_log_prefix;
+                desc += "Channel packing needs a single channel SDFEngine";
+
+                throw TextAtlasError(desc);
+            }
+
+            // Glyphs are written into a channel of the staging
+            // image before they're sent, whatever the update mode
+            m_bins_per_atlas = 4;
+            m_keep_atlas_images = true;
+        }
+
+        void TextAtlas::checkNoFonts(std::string const &setting) const
+        {
+            if(m_font_count > 0)
+            {
+                std::string desc = m_log_prefix;
+                desc += setting;
+                desc += " has to be set before any fonts are added";
+
+                throw TextAtlasError(desc);
+            }
+        }
+
+        uint TextAtlas::getAtlasCount() const
+        {
+            return (m_list_atlas_bins.size()+m_bins_per_atlas-1)/m_bins_per_atlas;
+        }
+
+        uint TextAtlas::getAtlasChannelCount() const
+        {
+            return (m_bins_per_atlas > 1) ?
+                        4 : GetSDFChannelCount(m_sdf_engine);
+        }
+
+        void TextAtlas::SetCacheFile(std::string const &file_path)
+        {
+            checkNoFonts("The cache file");
+
+            m_cache_file_path = file_path;
+            m_keep_atlas_images = true;
+        }
+
+        void TextAtlas::SetBundleFile(std::string const &file_path)
+        {
+            checkNoFonts("The bundle file");
+
+            m_bundle_file = make_unique<MappedFile>(file_path);
+            m_bundle_file_path = file_path;
+
+            AtlasCacheHeader header;
+            if((m_bundle_file->GetData() == nullptr) ||
+               (m_bundle_file->GetSize() < sizeof(header)))
+            {
+                LOG.Error() << m_log_prefix << "Failed to open atlas bundle "
+                            << file_path;
+
+                m_bundle_file.reset();
+                return;
+            }
+
+            // The rest of the bundle is checked when it's loaded
+            std::memcpy(&header,m_bundle_file->GetData(),sizeof(header));
+            m_bundle_font_count = header.font_count;
+        }
+
+        bool TextAtlas::LoadCache()
+        {
+            if(m_cache_file_path.empty())
+            {
+                return false;
+            }
+
+            MappedFile file(m_cache_file_path);
+            if(file.GetData() == nullptr)
+            {
+                LOG.Trace() << m_log_prefix << "No atlas cache: "
+                            << m_cache_file_path;
+                return false;
+            }
+
+            return loadCacheFile(file,m_cache_file_path);
+        }
+
+        bool TextAtlas::loadCacheFile(MappedFile const &file,
+                                      std::string const &file_path)
+        {
+            // Check that the cache was saved with the
+            // same settings and fonts
+            AtlasCacheHeader header;
+            if(file.GetSize() < sizeof(header))
+            {
+                LOG.Error() << m_log_prefix << "Invalid atlas cache";
+                return false;
+            }
+
+            u8 const * data = file.GetData();
+            ReadData(data,&header,1);
+
+            uint const channels = getAtlasChannelCount();
+
+            if((header.magic != kAtlasCacheMagic) ||
+               (header.version != kAtlasCacheVersion) ||
+               (header.atlas_size_px != m_atlas_size_px) ||
+               (header.glyph_res_px != m_glyph_res_px) ||
+               (header.sdf_offset_px != m_sdf_offset_px) ||
+               (header.sdf_engine != u32(m_sdf_engine)) ||
+               (header.packer_type != u32(m_packer_type)) ||
+               (header.channels != channels) ||
+               (header.font_count != m_list_font_hashes.size()) ||
+               (header.atlas_count == 0))
+            {
+                LOG.Trace() << m_log_prefix << "Atlas cache is out of date";
+                return false;
+            }
+
+            // The counts are widened first so they can't
+            // overflow and pass the size check
+            u64 table_size =
+                    u64(header.font_count)*sizeof(u64) +
+                    sizeof(GlyphImageDesc) +
+                    u64(header.atlas_count)*2*sizeof(u32) +
+                    u64(header.rect_count)*sizeof(AtlasRect) +
+                    u64(header.glyph_count)*(sizeof(GlyphImageDesc)+sizeof(u32));
+
+            table_size = (table_size+7)/8*8;
+
+            if(file.GetSize() < sizeof(header)+table_size)
+            {
+                LOG.Error() << m_log_prefix << "Invalid atlas cache";
+                return false;
+            }
+
+            if(HashAtlasCacheData(data,file.GetSize()-sizeof(header)) != header.checksum)
+            {
+                LOG.Error() << m_log_prefix << "Atlas cache is corrupt";
+                return false;
+            }
+
+            std::vector<u64> list_font_hashes(header.font_count);
+            ReadData(data,list_font_hashes.data(),header.font_count);
+
+            if(list_font_hashes != m_list_font_hashes)
+            {
+                LOG.Trace() << m_log_prefix << "Atlas cache is for different fonts";
+                return false;
+            }
+
+            GlyphImageDesc missing_glyph;
+            ReadData(data,&missing_glyph,1);
+
+            std::vector<u32> list_rect_counts(header.atlas_count);
+            ReadData(data,list_rect_counts.data(),header.atlas_count);
+
+            // Only the rows down to the bottom of the
+            // lowest glyph are saved for each atlas
+            std::vector<u32> list_bin_row_counts(header.atlas_count);
+            ReadData(data,list_bin_row_counts.data(),header.atlas_count);
+
+            std::vector<u32> const list_row_counts =
+                    GetAtlasRowCounts(list_bin_row_counts,m_bins_per_atlas);
+
+            uint const image_count = list_row_counts.size();
+
+            u64 pixel_size = 0;
+            for(u32 const row_count : list_row_counts)
+            {
+                if(row_count > m_atlas_size_px)
+                {
+                    LOG.Error() << m_log_prefix << "Invalid atlas cache";
+                    return false;
+                }
+
+                pixel_size += u64(row_count)*m_atlas_size_px*channels;
+            }
+
+            if(file.GetSize() != sizeof(header)+table_size+pixel_size)
+            {
+                LOG.Error() << m_log_prefix << "Invalid atlas cache";
+                return false;
+            }
+
+            // Restore the packers by packing the same
+            // rectangles again
+            std::vector<unique_ptr<AtlasPacker>> list_atlas_bins;
+            std::vector<std::vector<AtlasRect>> list_atlas_rects(header.atlas_count);
+
+            u64 rect_count = 0;
+            for(uint i=0; i < header.atlas_count; i++)
+            {
+                rect_count += list_rect_counts[i];
+                if(rect_count > header.rect_count)
+                {
+                    LOG.Error() << m_log_prefix << "Invalid atlas cache";
+                    return false;
+                }
+
+                list_atlas_rects[i].resize(list_rect_counts[i]);
+                ReadData(data,list_atlas_rects[i].data(),list_rect_counts[i]);
+
+                list_atlas_bins.push_back(
+                            CreateAtlasPacker(
+                                m_packer_type,
+                                m_atlas_size_px,
+                                m_atlas_size_px,
+                                1));
+
+                for(auto const &rect : list_atlas_rects[i])
+                {
+                    BinPackRectangle glyph_rect;
+                    glyph_rect.width = rect.width;
+                    glyph_rect.height = rect.height;
+
+                    if(!list_atlas_bins.back()->AddRectangle(glyph_rect) ||
+                       (glyph_rect.x != rect.x) ||
+                       (glyph_rect.y != rect.y))
+                    {
+                        LOG.Error() << m_log_prefix << "Atlas cache "
+                                       "doesn't match the packer";
+                        return false;
+                    }
+                }
+            }
+
+            if(rect_count != header.rect_count)
+            {
+                LOG.Error() << m_log_prefix << "Invalid atlas cache";
+                return false;
+            }
+
+            std::vector<GlyphImageDesc> list_glyphs(header.glyph_count);
+            std::vector<u32> list_last_use(header.glyph_count);
+            ReadData(data,list_glyphs.data(),header.glyph_count);
+            ReadData(data,list_last_use.data(),header.glyph_count);
+
+            for(auto const &glyph : list_glyphs)
+            {
+                if((glyph.channel >= m_bins_per_atlas) ||
+                   (glyph.atlas*m_bins_per_atlas + glyph.channel >= header.atlas_count) ||
+                   (glyph.font >= header.font_count))
+                {
+                    LOG.Error() << m_log_prefix << "Invalid atlas cache";
+                    return false;
+                }
+            }
+
+            data = file.GetData() + sizeof(header) + table_size;
+
+            // Replace the atlases
+            uint const atlas_count = getAtlasCount();
+
+            m_missing_glyph = missing_glyph;
+            m_list_atlas_bins = std::move(list_atlas_bins);
+            m_list_atlas_rects.clear();
+            if(!m_cache_file_path.empty())
+            {
+                m_list_atlas_rects = std::move(list_atlas_rects);
+            }
+            m_list_dirty_rects.clear();
+            {
+                std::lock_guard<std::mutex> lock(m_updates_mutex);
+                m_list_updates.clear();
+            }
+
+            m_list_atlas_staging.clear();
+            m_list_atlas_packed.clear();
+            m_list_atlas_packed.resize(image_count);
+            for(uint i=0; i < image_count; i++)
+            {
+                m_list_atlas_staging.push_back(
+                            CreateBlankImageData(
+                                m_atlas_size_px,
+                                m_atlas_size_px,
+                                channels));
+
+                ReadData(data,
+                         m_list_atlas_staging.back()->data->data(),
+                         list_row_counts[i]*m_atlas_size_px*channels);
+            }
+
+            m_glyph_table.Clear();
+            for(uint i=0; i < list_glyphs.size(); i++)
+            {
+                m_glyph_table.Insert(list_glyphs[i],list_last_use[i]);
+                m_use_stamp = std::max(m_use_stamp,list_last_use[i]);
+            }
+
+            LOG.Trace() << m_log_prefix << "Loaded " << header.glyph_count
+                        << " glyphs in " << image_count
+                        << " atlases from " << file_path;
+
+            // Notify listeners; the whole atlas is sent
+            // as a single update
+            if(atlas_count > 0)
+            {
+                emitSignal(signal_atlases_compacted,atlas_count);
+            }
+
+            emitAtlasImages();
+            packAtlasImages();
+
+            if(!m_keep_atlas_images)
+            {
+                m_list_atlas_staging.clear();
+                m_list_atlas_packed.clear();
+            }
+
+            return true;
+        }
+
+        void TextAtlas::SaveCache()
+        {
+            if(m_cache_file_path.empty() || m_list_atlas_bins.empty())
+            {
+                std::string desc = m_log_prefix;
+                desc += "No atlases to save";
+
+                throw TextAtlasError(desc);
+            }
+
+            uint const channels = getAtlasChannelCount();
+            auto const &list_glyphs = m_glyph_table.GetGlyphList();
+
+            AtlasCacheHeader header;
+            header.magic = kAtlasCacheMagic;
+            header.version = kAtlasCacheVersion;
+            header.checksum = 0;
+            header.atlas_size_px = m_atlas_size_px;
+            header.glyph_res_px = m_glyph_res_px;
+            header.sdf_offset_px = m_sdf_offset_px;
+            header.sdf_engine = u32(m_sdf_engine);
+            header.packer_type = u32(m_packer_type);
+            header.channels = channels;
+            header.font_count = m_list_font_hashes.size();
+            header.atlas_count = m_list_atlas_bins.size();
+            header.rect_count = 0;
+            header.glyph_count = list_glyphs.size();
+
+            std::vector<u32> list_rect_counts;
+            std::vector<u32> list_bin_row_counts;
+            for(auto const &list_rects : m_list_atlas_rects)
+            {
+                list_rect_counts.push_back(list_rects.size());
+                header.rect_count += list_rects.size();
+
+                uint row_count = 0;
+                for(auto const &rect : list_rects)
+                {
+                    row_count = std::max<uint>(row_count,rect.y+rect.height);
+                }
+
+                list_bin_row_counts.push_back(std::min(row_count,m_atlas_size_px));
+            }
+
+            std::vector<u32> const list_row_counts =
+                    GetAtlasRowCounts(list_bin_row_counts,m_bins_per_atlas);
+
+            // Everything after the header
+            std::vector<u8> list_data;
+            AppendData(list_data,m_list_font_hashes.data(),m_list_font_hashes.size());
+            AppendData(list_data,&m_missing_glyph,1);
+            AppendData(list_data,list_rect_counts.data(),list_rect_counts.size());
+            AppendData(list_data,list_bin_row_counts.data(),list_bin_row_counts.size());
+            for(auto const &list_rects : m_list_atlas_rects)
+            {
+                AppendData(list_data,list_rects.data(),list_rects.size());
+            }
+
+            AppendData(list_data,list_glyphs.data(),list_glyphs.size());
+            AppendData(list_data,
+                       m_glyph_table.GetLastUseList().data(),
+                       m_glyph_table.GetLastUseList().size());
+
+            list_data.resize((list_data.size()+7)/8*8,0);
+
+            for(uint i=0; i < m_list_atlas_staging.size(); i++)
+            {
+                shared_ptr<ImageData> image = m_list_atlas_staging[i];
+                if(image == nullptr)
+                {
+                    image = copyAtlasImage(i);
+                }
+
+                AppendData(list_data,
+                           image->data->data(),
+                           list_row_counts[i]*m_atlas_size_px*channels);
+            }
+
+            header.checksum = HashAtlasCacheData(list_data.data(),list_data.size());
+
+            // Write to a temporary file first so a partly
+            // written cache is never loaded
+            std::string const temp_file_path = m_cache_file_path + ".tmp";
+            {
+                std::ofstream ofs(temp_file_path,
+                                  std::ios::out | std::ios::binary | std::ios::trunc);
+
+                ofs.write(reinterpret_cast<char const *>(&header),sizeof(header));
+                ofs.write(reinterpret_cast<char const *>(list_data.data()),list_data.size());
+
+                if(!ofs)
+                {
+                    std::remove(temp_file_path.c_str());
+
+                    std::string desc = m_log_prefix;
+                    desc += "Failed to write atlas cache: ";
+                    desc += temp_file_path;
+
+                    throw TextAtlasError(desc);
+                }
+            }
+
+            if(std::rename(temp_file_path.c_str(),m_cache_file_path.c_str()) != 0)
+            {
+                // Some platforms don't replace existing files
+                std::remove(m_cache_file_path.c_str());
+                if(std::rename(temp_file_path.c_str(),m_cache_file_path.c_str()) != 0)
+                {
+                    std::string desc = m_log_prefix;
+                    desc += "Failed to write atlas cache: ";
+                    desc += m_cache_file_path;
+
+                    throw TextAtlasError(desc);
+                }
+            }
+        }
+
+        std::vector<AtlasUpdate> TextAtlas::TakeAtlasUpdates()
+        {
+            std::vector<AtlasUpdate> list_updates;
+            {
+                std::lock_guard<std::mutex> lock(m_updates_mutex);
+                list_updates.swap(m_list_updates);
+            }
+
+            return list_updates;
+        }
     }
 }
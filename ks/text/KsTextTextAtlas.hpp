@@ -17,12 +17,20 @@
 #ifndef KS_TEXT_TEXT_ATLAS_HPP
 #define KS_TEXT_TEXT_ATLAS_HPP
 
+#include <functional>
+#include <mutex>
+
 #include <glm/gtc/type_precision.hpp>
 
 #include <ks/KsSignal.hpp>
 #include <ks/shared/KsImage.hpp>
 #include <ks/shared/KsBinPackShelf.hpp>
+#include <ks/text/KsTextAtlasPacker.hpp>
+#include <ks/text/KsTextDataTypes.hpp>
+#include <ks/text/KsTextFreeType.hpp>
 #include <ks/text/KsTextGlyphDesc.hpp>
+#include <ks/text/KsTextGlyphTable.hpp>
+#include <ks/text/KsTextSDF.hpp>
 
 namespace ks
 {
@@ -31,6 +39,8 @@ namespace ks
     namespace text
     {
         struct Font;
+        class MappedFile;
+        class RasterPool;
 
         // =========================================================== //
 
@@ -52,16 +62,118 @@ namespace ks
                       uint glyph_res_px=32,
                       uint sdf_offset_px=4);
 
+            // * Settings for the atlases and the glyphs in them
+            //   (see the TextManager setters with the same names);
+            //   these have to be called before any fonts are added
+            void SetRasterThreadCount(uint raster_thread_count);
+            void SetSDFEngine(SDFEngine sdf_engine);
+            void SetUpdateMode(AtlasUpdateMode update_mode);
+            void SetMaxAtlasCount(uint max_atlas_count);
+            void SetPackerType(AtlasPackerType packer_type);
+
             void AddFont(unique_ptr<Font> const &font);
 
+            // * Starts a new request for glyphs (one or more
+            //   GetGlyphs calls); glyphs used in the same request
+            //   share a last use stamp
+            // * If there are more atlases than max_atlas_count,
+            //   the most recently used glyphs are repacked into
+            //   new atlases and the rest are evicted. This is
+            //   only done here so the glyphs returned within a
+            //   request never move
+            void BeginRequest(std::vector<unique_ptr<Font>> const &list_fonts);
+
             void GetGlyphs(std::vector<unique_ptr<Font>> const &list_fonts,
                            std::vector<GlyphInfo> const &list_glyph_info,
                            std::vector<GlyphImageDesc> &list_glyphs);
 
+            // Same as GetGlyphs but glyphs that haven't already
+            // been rasterized only have their metrics loaded; no
+            // glyph images are generated and no signals are emitted
+            void GetGlyphMetrics(std::vector<unique_ptr<Font>> const &list_fonts,
+                                 std::vector<GlyphInfo> const &list_glyph_info,
+                                 std::vector<GlyphImageDesc> &list_glyphs);
+
             uint GetAtlasSizePx() const;
             uint GetGlyphResolutionPx() const;
             uint GetSDFOffsetPx() const;
 
+            // * True if there's an atlas budget and there are
+            //   at least as many atlases
+            bool IsAtlasBudgetFull() const;
+
+            // * Occupancy of each atlas
+            std::vector<AtlasOccupancy> GetAtlasOccupancy() const;
+
+            // * Sets the FreeTypeMemory limit for the raster
+            //   threads' libraries and adds their stats to @stats
+            void SetFreeTypeMemoryLimit(u64 max_bytes);
+            void AddFreeTypeMemoryStats(FreeTypeMemoryStats &stats) const;
+
+            // * Keeps a copy of every atlas image so the atlases
+            //   can be saved to and loaded from @file_path; has
+            //   to be called before any fonts are added
+            void SetCacheFile(std::string const &file_path);
+
+            // * Replaces the atlases with the ones in the cache
+            //   file if it was saved with the same fonts and
+            //   settings; returns false and leaves the atlases
+            //   as they are otherwise
+            // * signal_atlases_compacted is emitted if there are
+            //   any atlases, then signal_new_atlas and a single
+            //   update with the whole image for each atlas
+            bool LoadCache();
+
+            // * Writes the atlases to the cache file
+            void SaveCache();
+
+            // * Maps a prebaked atlas bundle (a cache file written
+            //   by ks_text_prebake) that's loaded as soon as the
+            //   fonts it was baked with have been added; has to be
+            //   called before any fonts are added
+            void SetBundleFile(std::string const &file_path);
+
+            // * Keeps a copy of every atlas image in memory so
+            //   RestoreAtlases() can send them again; atlases
+            //   that are full are kept compressed. Has to be
+            //   called before any fonts are added
+            void EnableAtlasMirror();
+
+            // * Sends every atlas again from the copies kept
+            //   in memory, ie. after the graphics context was
+            //   lost: signal_new_atlas and a single update with
+            //   the whole image are emitted for each atlas
+            // * The glyphs don't move, so text that was already
+            //   laid out stays valid
+            // * Throws if no copies are kept (the atlases are
+            //   only sent per glyph and there's no mirror or
+            //   cache file)
+            void RestoreAtlases();
+
+            // * Packs glyphs into the four channels of RGBA8
+            //   atlases; each channel is filled like a separate
+            //   atlas before the next one is used, so there are
+            //   about a quarter as many atlases
+            // * Atlas images and updates (including the ones sent
+            //   with signal_new_glyph, which cover the glyph's
+            //   rectangle in every channel) are RGBA8
+            // * Only for single channel SDFEngines; has to be
+            //   called before any fonts are added
+            void EnableChannelPacking();
+
+            // * Returns and clears the queued updates for
+            //   AtlasUpdateMode::Queued; safe to call from
+            //   any thread
+            std::vector<AtlasUpdate> TakeAtlasUpdates();
+
+            // * While @defer is true, the atlas signals and queued
+            //   updates aren't sent; they're kept in order until
+            //   SendDeferredUpdates is called. Used for glyphs made
+            //   on the prewarm thread so the renderer only gets
+            //   updates on the threads it calls TextManager from
+            void SetDeferUpdates(bool defer);
+            void SendDeferredUpdates();
+
         public:
             ~TextAtlas();
 
@@ -81,24 +193,91 @@ namespace ks
                 shared_ptr<ImageData>
             > signal_new_glyph;
 
+            // atlas index,
+            // dirty rectangles,
+            // staging image for the whole atlas
+            Signal<
+                uint,
+                std::vector<AtlasRect>,
+                shared_ptr<ImageData>
+            > signal_atlas_updated;
+
+            // number of atlases before compaction
+            Signal<uint> signal_atlases_compacted;
+
         private:
+            struct RasterGlyph;
+
             void genGlyph(std::vector<unique_ptr<Font>> const &list_fonts,
                           GlyphInfo const &glyph_info,
                           GlyphImageDesc &glyph);
 
-            std::vector<GlyphImageDesc>::iterator findGlyph(uint font_index,
-                                                   uint glyph_index);
+            void genGlyphs(std::vector<unique_ptr<Font>> const &list_fonts,
+                           std::vector<GlyphInfo> const &list_glyph_info,
+                           GlyphImageDesc * list_glyphs);
 
+            void rasterizeGlyph(FT_Face face,
+                                std::vector<unique_ptr<Font>> const &list_fonts,
+                                GlyphInfo const &glyph_info,
+                                RasterGlyph &raster_glyph) const;
 
-            void assignMissingGlyph(unique_ptr<Font> const &font);
+            void addGlyph(GlyphInfo const &glyph_info,
+                          RasterGlyph &raster_glyph,
+                          GlyphImageDesc &glyph);
+
+            void genGlyphMetrics(std::vector<unique_ptr<Font>> const &list_fonts,
+                                 GlyphInfo const &glyph_info,
+                                 GlyphImageDesc &glyph);
+
+            // * True if glyph 0 of @font can be used as its
+            //   missing glyph (it isn't empty or blank)
+            bool hasMissingGlyph(unique_ptr<Font> const &font) const;
             void genMissingGlyph();
             void addEmptyAtlas();
 
-            // lower bound compare predicate
-            static bool glyphIsLessThanLB(GlyphImageDesc const &glyph,u32 index);
+            // * Writes @glyph_data (the glyph's pixels in the
+            //   SDFEngine's image format) to the atlas and
+            //   channel of @bin (an index into m_list_atlas_bins)
+            void updateAtlas(uint bin,
+                             BinPackRectangle const &glyph_rect,
+                             u8 const * glyph_data);
+
+            // * Throws if any fonts have been added; @setting
+            //   describes what can't be changed anymore
+            void checkNoFonts(std::string const &setting) const;
+
+            uint getAtlasCount() const;
+            uint getAtlasChannelCount() const;
+
+            // * Emits @signal with @args, or keeps it for
+            //   SendDeferredUpdates if updates are deferred
+            template<typename... SignalArgs, typename... Args>
+            void emitSignal(Signal<SignalArgs...> &signal, Args&&... args)
+            {
+                if(m_defer_updates)
+                {
+                    m_list_deferred_updates.push_back(
+                                [&signal,args...]() {
+                                    signal.Emit(args...);
+                                });
+                    return;
+                }
 
-            // upper bound compare predicate
-            static bool glyphIsLessThanUB(u32 index,GlyphImageDesc const &glyph);
+                signal.Emit(std::forward<Args>(args)...);
+            }
+
+            void queueAtlasUpdates(std::vector<AtlasUpdate> list_updates);
+
+            void flushAtlasUpdates();
+
+            void packAtlasImages();
+            unique_ptr<ImageData> copyAtlasImage(uint atlas) const;
+            void emitAtlasImages();
+
+            void compactAtlases(std::vector<unique_ptr<Font>> const &list_fonts);
+
+            bool loadCacheFile(MappedFile const &file,
+                               std::string const &file_path);
 
 
             static const std::string m_log_prefix;
@@ -107,22 +286,145 @@ namespace ks
             uint const m_glyph_res_px;
             uint const m_sdf_offset_px;
 
+            // raster_thread_count
+            // * threads for m_raster_pool, which is created when
+            //   the first font is added; 0 for one per core
+            uint m_raster_thread_count;
+
+            SDFEngine m_sdf_engine;
+            AtlasUpdateMode m_update_mode;
+
+            // max_atlas_count
+            // * atlas budget; 0 if atlases are never compacted
+            uint m_max_atlas_count;
+
+            AtlasPackerType m_packer_type;
+
+            // ft_memory_limit
+            // * FreeTypeMemory limit for the raster threads'
+            //   libraries; 0 for no limit
+            u64 m_ft_memory_limit;
+
+            // bins_per_atlas
+            // * number of packers in m_list_atlas_bins for each
+            //   atlas: one per channel with channel packing and
+            //   1 otherwise
+            uint m_bins_per_atlas;
+
+            // cache_file_path
+            // * empty if the atlases aren't cached
+            std::string m_cache_file_path;
+
+            // keep_atlas_images
+            // * true if m_list_atlas_staging has a copy of
+            //   each atlas
+            bool m_keep_atlas_images;
+
+            // compress_atlas_images
+            // * true if the staging images of the atlases that are
+            //   full are compressed into m_list_atlas_packed
+            bool m_compress_atlas_images;
+
+            // bundle_file
+            // * prebaked atlas bundle waiting for its fonts to be
+            //   added; nullptr once it's been loaded
+            unique_ptr<MappedFile> m_bundle_file;
+            std::string m_bundle_file_path;
+            uint m_bundle_font_count;
+
+            // list_font_hashes
+            // * hash of each font's file data for the cache
+            //   and the bundle
+            std::vector<u64> m_list_font_hashes;
+
+            // list_atlas_rects
+            // * the glyph rectangles in each bin in the order
+            //   they were packed; only kept for the cache, which
+            //   restores the packers by packing them again
+            std::vector<std::vector<AtlasRect>> m_list_atlas_rects;
+
+            // use_stamp
+            // * incremented for each request and saved as the
+            //   last use of the glyphs it returns
+            u32 m_use_stamp;
+
             // missing_glyph
             // * universal 'missing' glyph used when
             //   a character isn't available for a font
             GlyphImageDesc m_missing_glyph;
 
-            // lkup_font_glyph_list
-            // * Glyph lists indexed by font
-            // * Each glyph list is ordered by glyph index
-            using GlyphList = std::vector<GlyphImageDesc>;
-            std::vector<std::vector<GlyphImageDesc>> m_lkup_font_glyph_list;
+            // font_count
+            // * number of fonts added so far, including
+            //   the initial 'invalid' font
+            uint m_font_count;
+
+            // glyph_table
+            // * glyphs that have been generated for all fonts
+            //   keyed by (font index, glyph index)
+            GlyphTable m_glyph_table;
+
+            // metrics_table
+            // * metrics-only glyphs for all fonts that were
+            //   measured but haven't been rasterized
+            GlyphTable m_metrics_table;
+
+            // list_misses
+            // * scratch list of the positions of glyphs that
+            //   weren't in m_glyph_table for a GetGlyphs call
+            std::vector<uint> m_list_misses;
+
+            // raster_glyph, list_raster_glyphs
+            // * scratch glyphs for rasterizing on the calling
+            //   thread and on the RasterPool (one per job); the
+            //   glyphs are kept so their image buffers are
+            //   reused instead of allocated for every glyph
+            unique_ptr<RasterGlyph> m_raster_glyph;
+            std::vector<unique_ptr<RasterGlyph>> m_list_raster_glyphs;
+
+            // raster_pool
+            // * worker threads that rasterize glyphs when there
+            //   are enough misses in a single GetGlyphs call
+            // * nullptr if glyphs are only rasterized on the
+            //   calling thread
+            unique_ptr<RasterPool> m_raster_pool;
 
             // list_atlas_bins
-            // * list of packing bins and images for all glyphs
+            // * the packer for each atlas (see AtlasPackerType),
+            //   or for each channel of each atlas in order with
+            //   channel packing; glyphs are only added to the
+            //   last one
             // * atlases aren't sorted by font or any other
             //   criteria and are created as they fill up
-            std::vector<BinPackShelf> m_list_atlas_bins;
+            std::vector<unique_ptr<AtlasPacker>> m_list_atlas_bins;
+
+            // list_atlas_staging
+            // * a copy of each atlas that new glyph images are
+            //   written to when updates aren't sent per glyph
+            //   or the atlases are cached
+            std::vector<shared_ptr<ImageData>> m_list_atlas_staging;
+
+            // list_atlas_packed
+            // * compressed copies of the atlases that are full;
+            //   an atlas's staging image is released once it's
+            //   been compressed
+            std::vector<std::vector<u8>> m_list_atlas_packed;
+
+            // list_dirty_rects
+            // * (atlas index, glyph rect) for each glyph written
+            //   to a staging image since the last flush
+            std::vector<std::pair<uint,AtlasRect>> m_list_dirty_rects;
+
+            // list_updates
+            // * updates waiting to be taken for
+            //   AtlasUpdateMode::Queued
+            std::mutex m_updates_mutex;
+            std::vector<AtlasUpdate> m_list_updates;
+
+            // defer_updates
+            // * true while signals and queued updates are kept in
+            //   m_list_deferred_updates (see SetDeferUpdates)
+            bool m_defer_updates;
+            std::vector<std::function<void()>> m_list_deferred_updates;
         };
     }
 }
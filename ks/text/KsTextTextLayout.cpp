@@ -0,0 +1,295 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+
+#include <ks/text/KsTextTextLayout.hpp>
+
+namespace ks
+{
+    namespace text
+    {
+        namespace {
+
+            // Returns the leading edge of @span; the edge
+            // where the first character of the span starts
+            sint GetLeadingEdge(ClusterSpan const &span)
+            {
+                return (span.rtl ? span.x1 : span.x0);
+            }
+
+            sint GetTrailingEdge(ClusterSpan const &span)
+            {
+                return (span.rtl ? span.x0 : span.x1);
+            }
+
+            sint GetCaretXForLine(Line const &line,
+                                  uint cluster)
+            {
+                auto const &list_spans = line.list_cluster_spans;
+                auto const &list_logical = line.list_logical_spans;
+
+                if(list_spans.empty())
+                {
+                    return 0;
+                }
+
+                // Find the last span that starts at or before @cluster
+                auto it = std::upper_bound(
+                            list_logical.begin(),
+                            list_logical.end(),
+                            cluster,
+                            [&list_spans](uint cluster, uint span_idx) {
+                                return (cluster < list_spans[span_idx].start);
+                            });
+
+                if(it == list_logical.begin())
+                {
+                    return GetLeadingEdge(list_spans[*it]);
+                }
+
+                ClusterSpan const &span = list_spans[*std::prev(it)];
+
+                // Carets inside a cluster are snapped to the start of
+                // the cluster so they never split a grapheme
+                if(cluster >= span.end)
+                {
+                    return GetTrailingEdge(span);
+                }
+
+                return GetLeadingEdge(span);
+            }
+        }
+
+        // =========================================================== //
+
+        Caret HitTest(std::vector<Line> const &list_lines,
+                      sint x,
+                      sint y)
+        {
+            Caret caret;
+            caret.line = 0;
+            caret.cluster = 0;
+            caret.x = 0;
+
+            if(list_lines.empty())
+            {
+                return caret;
+            }
+
+            // Each line covers the band between the top of
+            // the line (baseline+ascent) and the top of the
+            // next line. Line tops decrease with each line.
+            auto line_it = std::partition_point(
+                        list_lines.begin(),
+                        list_lines.end(),
+                        [y](Line const &line) {
+                            return ((line.baseline_y+line.ascent) >= y);
+                        });
+
+            if(line_it != list_lines.begin())
+            {
+                line_it = std::prev(line_it);
+            }
+
+            Line const &line = *line_it;
+            caret.line = std::distance(list_lines.begin(),line_it);
+            caret.cluster = line.start;
+
+            auto const &list_spans = line.list_cluster_spans;
+            if(list_spans.empty())
+            {
+                return caret;
+            }
+
+            // Find the last span that starts at or before @x
+            auto span_it = std::upper_bound(
+                        list_spans.begin(),
+                        list_spans.end(),
+                        x,
+                        [](sint x, ClusterSpan const &span) {
+                            return (x < span.x0);
+                        });
+
+            if(span_it != list_spans.begin())
+            {
+                span_it = std::prev(span_it);
+            }
+
+            ClusterSpan const &span = *span_it;
+
+            // Pick the closest edge of the span
+            bool const left_half = ((2*x) < (span.x0+span.x1));
+
+            if(left_half)
+            {
+                caret.x = span.x0;
+                caret.cluster = (span.rtl ? span.end : span.start);
+            }
+            else
+            {
+                caret.x = span.x1;
+                caret.cluster = (span.rtl ? span.start : span.end);
+            }
+
+            return caret;
+        }
+
+        uint GetCaretLine(std::vector<Line> const &list_lines,
+                          uint cluster)
+        {
+            if(list_lines.empty())
+            {
+                return 0;
+            }
+
+            // Find the last line that starts at or before @cluster
+            auto line_it = std::partition_point(
+                        list_lines.begin(),
+                        list_lines.end(),
+                        [cluster](Line const &line) {
+                            return (line.start <= cluster);
+                        });
+
+            if(line_it != list_lines.begin())
+            {
+                line_it = std::prev(line_it);
+            }
+
+            // Empty lines don't have a valid range; use
+            // the closest previous line with glyphs
+            while((line_it != list_lines.begin()) &&
+                  line_it->list_cluster_spans.empty())
+            {
+                line_it = std::prev(line_it);
+            }
+
+            return std::distance(list_lines.begin(),line_it);
+        }
+
+        sint CaretX(std::vector<Line> const &list_lines,
+                    uint cluster)
+        {
+            if(list_lines.empty())
+            {
+                return 0;
+            }
+
+            uint const line_idx = GetCaretLine(list_lines,cluster);
+            return GetCaretXForLine(list_lines[line_idx],cluster);
+        }
+
+        std::vector<SelectionRect>
+        SelectionRects(std::vector<Line> const &list_lines,
+                       uint start,
+                       uint end)
+        {
+            std::vector<SelectionRect> list_rects;
+
+            if(list_lines.empty() || (start >= end))
+            {
+                return list_rects;
+            }
+
+            uint const first_line = GetCaretLine(list_lines,start);
+            uint const last_line = GetCaretLine(list_lines,end);
+
+            std::vector<uint> list_selected;
+
+            for(uint i=first_line; i <= last_line; i++)
+            {
+                Line const &line = list_lines[i];
+                auto const &list_spans = line.list_cluster_spans;
+                auto const &list_logical = line.list_logical_spans;
+
+                if(list_spans.empty())
+                {
+                    continue;
+                }
+
+                sint const y0 = line.baseline_y + line.descent;
+                sint const y1 = line.baseline_y + line.ascent;
+
+                // The selected spans are a contiguous range in
+                // logical order: from the first span that ends
+                // after @start to the first span that starts at
+                // or after @end
+                auto const first_it = std::partition_point(
+                            list_logical.begin(),
+                            list_logical.end(),
+                            [&list_spans,start](uint span_idx) {
+                                return (list_spans[span_idx].end <= start);
+                            });
+
+                auto const last_it = std::partition_point(
+                            first_it,
+                            list_logical.end(),
+                            [&list_spans,end](uint span_idx) {
+                                return (list_spans[span_idx].start < end);
+                            });
+
+                if(first_it == last_it)
+                {
+                    continue;
+                }
+
+                // Lines between the first and last line are
+                // selected completely
+                if((first_it == list_logical.begin()) &&
+                   (last_it == list_logical.end()))
+                {
+                    list_rects.push_back(
+                                SelectionRect{
+                                    list_spans.front().x0,y0,
+                                    list_spans.back().x1,y1
+                                });
+                    continue;
+                }
+
+                // Visit the selected spans in visual order and
+                // merge visually adjacent ones
+                list_selected.assign(first_it,last_it);
+                std::sort(list_selected.begin(),list_selected.end());
+
+                for(uint j=0; j < list_selected.size(); j++)
+                {
+                    ClusterSpan const &span = list_spans[list_selected[j]];
+
+                    bool const merge =
+                            (j > 0) &&
+                            (list_selected[j] == list_selected[j-1]+1) &&
+                            (list_rects.back().x1 == span.x0);
+
+                    if(merge)
+                    {
+                        list_rects.back().x1 = span.x1;
+                    }
+                    else
+                    {
+                        list_rects.push_back(
+                                    SelectionRect{
+                                        span.x0,y0,span.x1,y1
+                                    });
+                    }
+                }
+            }
+
+            return list_rects;
+        }
+
+        // =========================================================== //
+    }
+}
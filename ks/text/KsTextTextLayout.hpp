@@ -0,0 +1,95 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_TEXT_TEXT_LAYOUT_HPP
+#define KS_TEXT_TEXT_LAYOUT_HPP
+
+#include <ks/text/KsTextDataTypes.hpp>
+
+namespace ks
+{
+    namespace text
+    {
+        // Queries for lines returned by TextManager::GetGlyphs
+        // * These use the cluster index built for each Line so
+        //   they're O(log n) wrt the number of lines and clusters
+        // * Coordinates are the same as the glyph coordinates for
+        //   each line, with each line offset by Line::baseline_y
+        //   (y increases going up)
+        // * Caret positions are code unit indices into the
+        //   utf16text passed to GetGlyphs and always lie on
+        //   cluster boundaries
+
+        // =========================================================== //
+
+        struct Caret
+        {
+            // index of the line in the list of lines
+            uint line;
+
+            // code unit index of the caret
+            uint cluster;
+
+            // x position of the caret
+            sint x;
+        };
+
+        struct SelectionRect
+        {
+            sint x0;
+            sint y0;
+            sint x1; // x1 is to the right of x0
+            sint y1; // y1 is above y0
+        };
+
+        // =========================================================== //
+
+        // * Returns the caret position closest to (@x,@y)
+        // * Positions above the first line or below the last line
+        //   are clamped to those lines
+        Caret HitTest(std::vector<Line> const &list_lines,
+                      sint x,
+                      sint y);
+
+        // * Returns the index of the line that contains @cluster
+        // * A cluster at a (soft) line break belongs to the start
+        //   of the next line
+        uint GetCaretLine(std::vector<Line> const &list_lines,
+                          uint cluster);
+
+        // * Returns the x position of the caret at @cluster
+        // * Carets inside a cluster that spans multiple code units
+        //   are placed at the start of the cluster
+        sint CaretX(std::vector<Line> const &list_lines,
+                    uint cluster);
+
+        // * Returns the rectangles that cover the logical range
+        //   of code units [@start,@end)
+        // * Bidirectional text may need more than one rectangle
+        //   per line since logical ranges aren't always visually
+        //   contiguous
+        // * Lines that are selected completely get one rectangle
+        //   each without looking at their spans
+        std::vector<SelectionRect>
+        SelectionRects(std::vector<Line> const &list_lines,
+                       uint start,
+                       uint end);
+
+        // =========================================================== //
+    }
+}
+
+#endif // KS_TEXT_TEXT_LAYOUT_HPP
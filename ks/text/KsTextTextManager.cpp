@@ -15,57 +15,265 @@
 */
 
 
+#include <cmath>
 #include <iostream>
 #include <fstream>
+#include <limits>
 
 #include <ks/text/KsTextTextManager.hpp>
-#include <ks/text/KsTextFreeType.hpp>
+#include <ks/text/KsTextFreeTypeMemory.hpp>
 #include <ks/text/KsTextFont.hpp>
+#include <ks/text/KsTextPrewarmWorker.hpp>
 #include <ks/text/KsTextTextAtlas.hpp>
 #include <ks/text/KsTextTextShaper.hpp>
 
+#include <harfbuzz/hb-ot.h>
+
+#include FT_MODULE_H
+
 namespace ks
 {
     namespace text
     {       
         namespace {
-            // FreeType context
-            struct FreeTypeContext
+            // * Loads face 0 of @font's file data sized to
+            //   @glyph_res_px
+            FT_Face LoadFreeTypeFace(FT_Library library,
+                                     Font const &font,
+                                     uint glyph_res_px)
             {
-                FreeTypeContext()
-                {
-                    // load library
-                    FT_Error error = FT_Init_FreeType(&(library));
-                    if(error) {
-                        std::string desc = "FreeTypeContext: "
-                                           "Failed to Init FreeType: ";
-                        desc += GetFreeTypeError(error);
+                std::vector<u8> const &file_data =
+                        *(font.file_data);
+
+                // Load font using FreeType. We only load face 0.
+                FT_Error error;
+
+                // file buff
+                FT_Byte const * file_buff =
+                        static_cast<FT_Byte const *>(&(file_data[0]));
+
+                FT_Long file_size = file_data.size();
+
+                // load face
+                FT_Face face;
+                error = FT_New_Memory_Face(
+                            library,
+                            file_buff,
+                            file_size,
+                            0,
+                            &face);
+
+                if(error) {
+                    std::string desc = "Failed to load face 0 of font: ";
+                    desc += font.name;
+                    desc += GetFreeTypeError(error);
 
-                        throw FreeTypeError(desc);
-                    }
+                    throw FreeTypeError(desc);
                 }
 
-                ~FreeTypeContext()
-                {
-                    FT_Error error;
+                // Force UCS-2 charmap for this font as
+                // recommended by Harfbuzz
+                bool set_charmap=false;
+                for(int n = 0; n < face->num_charmaps; n++) {
+                    FT_UShort platform_id = face->charmaps[n]->platform_id;
+                    FT_UShort encoding_id = face->charmaps[n]->encoding_id;
 
-                    // release freetype
-                    error = FT_Done_FreeType(library);
-                    if(error)
+                    if (((platform_id == 0) && (encoding_id == 3)) ||
+                        ((platform_id == 3) && (encoding_id == 1)))
                     {
-                        std::string desc = "FreeTypeContext: "
-                                           "Failed to close FreeType library: ";
-                        desc += GetFreeTypeError(error);
-
-                        throw FreeTypeError(desc);
+                        error = FT_Set_Charmap(face,face->charmaps[n]);
+                        set_charmap = true;
+                        break;
                     }
                 }
 
-                // * reference to the freetype library
-                FT_Library library;
+                if(!set_charmap || (set_charmap && error)) {
+                    std::string desc = "Failed to set UCS-2 charmap for ";
+                    desc += font.name;
+
+                    FT_Done_Face(face);
+                    throw FreeTypeError(desc);
+                }
+
+                // Set size:
+                // freetype specifies char dimensions in
+                // 1/64th of a point
+                // (point == 1/72 inch)
+                error = FT_Set_Char_Size(face,  // face
+                                         glyph_res_px*64, // width  in 1/64th of points
+                                         glyph_res_px*64, // height in 1/64th of points
+                                         72,    // horizontal dpi
+                                         72);   // vertical dpi
+
+                if(error) {
+                    std::string desc = "Failed to set char size for font ";
+                    desc += font.name;
+                    desc += GetFreeTypeError(error);
+
+                    FT_Done_Face(face);
+                    throw FreeTypeError(desc);
+                }
+
+                return face;
+            }
+
+            // * Advances for HarfBuzz fonts made by CreateOpenTypeFont
+            // * The parent font reads the advance from hmtx in font
+            //   units; it's scaled and rounded the same way FreeType
+            //   and hb-ft scale unhinted advances, so glyphs are
+            //   placed exactly as they are with hb_ft_font_create
+            hb_position_t GetOpenTypeGlyphHAdvance(hb_font_t * hb_font,
+                                                   void * font_data,
+                                                   hb_codepoint_t glyph,
+                                                   void *)
+            {
+                FT_Face const ft_face = static_cast<FT_Face>(font_data);
+
+                FT_Long const advance =
+                        hb_font_get_glyph_h_advance(
+                            hb_font_get_parent(hb_font),glyph);
+
+                // 16.16 like FT_Get_Advance, then 26.6
+                FT_Fixed const v =
+                        FT_MulDiv(advance,ft_face->size->metrics.x_scale,64);
+
+                return ((v + (1 << 9)) >> 10);
+            }
+
+            // * Kerning for HarfBuzz fonts made by CreateOpenTypeFont;
+            //   the same as hb-ft's, which reads the 'kern' table
+            //   without loading any glyphs
+            hb_position_t GetOpenTypeGlyphHKerning(hb_font_t * hb_font,
+                                                   void * font_data,
+                                                   hb_codepoint_t left_glyph,
+                                                   hb_codepoint_t right_glyph,
+                                                   void *)
+            {
+                FT_Face const ft_face = static_cast<FT_Face>(font_data);
+
+                uint x_ppem,y_ppem;
+                hb_font_get_ppem(hb_font,&x_ppem,&y_ppem);
+
+                FT_Kerning_Mode const mode =
+                        (x_ppem) ? FT_KERNING_DEFAULT : FT_KERNING_UNFITTED;
+
+                FT_Vector kerning;
+                if(FT_Get_Kerning(ft_face,left_glyph,right_glyph,mode,&kerning))
+                {
+                    return 0;
+                }
+
+                return kerning.x;
+            }
+
+            hb_font_funcs_t * CreateOpenTypeFontFuncs()
+            {
+                // Everything else is taken from the parent font
+                hb_font_funcs_t * hb_funcs = hb_font_funcs_create();
+
+                hb_font_funcs_set_glyph_h_advance_func(
+                            hb_funcs,GetOpenTypeGlyphHAdvance,NULL,NULL);
+
+                hb_font_funcs_set_glyph_h_kerning_func(
+                            hb_funcs,GetOpenTypeGlyphHKerning,NULL,NULL);
+
+                hb_font_funcs_make_immutable(hb_funcs);
+
+                return hb_funcs;
+            }
+
+            // * Creates a HarfBuzz font for @font that gets glyphs,
+            //   advances and extents from the font data with
+            //   HarfBuzz's OpenType font functions instead of
+            //   loading glyphs from ft_face
+            // * It's scaled the same way hb_ft_font_create scales
+            //   fonts to ft_face
+            hb_font_t * CreateOpenTypeFont(Font const &font)
+            {
+                std::vector<u8> const &file_data = *(font.file_data);
+
+                // The file data outlives the font, so the blob
+                // doesn't need a copy of it
+                hb_blob_t * hb_blob =
+                        hb_blob_create(
+                            reinterpret_cast<char const *>(file_data.data()),
+                            file_data.size(),
+                            HB_MEMORY_MODE_READONLY,
+                            NULL,
+                            NULL);
+
+                hb_face_t * hb_face = hb_face_create(hb_blob,0);
+
+                // The parent is unscaled so its advances are
+                // in font units
+                hb_font_t * hb_ot_font = hb_font_create(hb_face);
+                hb_ot_font_set_funcs(hb_ot_font);
+
+                hb_font_t * hb_font = hb_font_create_sub_font(hb_ot_font);
+
+                hb_font_destroy(hb_ot_font);
+                hb_face_destroy(hb_face);
+                hb_blob_destroy(hb_blob);
+
+                // The funcs are shared by every font and never freed
+                static hb_font_funcs_t * const hb_funcs =
+                        CreateOpenTypeFontFuncs();
+
+                FT_Face const ft_face = font.ft_face;
+                hb_font_set_funcs(hb_font,hb_funcs,ft_face,NULL);
+
+                hb_font_set_scale(
+                            hb_font,
+                            int((u64(ft_face->size->metrics.x_scale) *
+                                 u64(ft_face->units_per_EM) + (1 << 15)) >> 16),
+                            int((u64(ft_face->size->metrics.y_scale) *
+                                 u64(ft_face->units_per_EM) + (1 << 15)) >> 16));
+
+                // Like hb_ft_font_create, the ppem isn't set since
+                // glyphs are shaped without hinting; this also makes
+                // the kerning func use unfitted kerning
+
+                return hb_font;
+            }
+
+            // Glyph image metrics in layout pixels (the
+            // TextManager's glyph_res_px)
+            struct LayoutMetrics
+            {
+                sint bearing_x;
+                sint bearing_y;
+                sint width;
+                sint height;
+
+                // layout pixels per atlas pixel
+                float scale;
             };
 
-            shared_ptr<FreeTypeContext> g_ft_context;
+            LayoutMetrics GetLayoutMetrics(GlyphImageDesc const &glyph_img,
+                                           uint layout_res_px)
+            {
+                LayoutMetrics metrics;
+                metrics.bearing_x = glyph_img.bearing_x;
+                metrics.bearing_y = glyph_img.bearing_y;
+                metrics.width = glyph_img.width;
+                metrics.height = glyph_img.height;
+                metrics.scale = 1.0f;
+
+                // Glyphs from fonts with their own glyph_res_px
+                // are scaled to the resolution the text is
+                // shaped at
+                if((glyph_img.res_px != 0) &&
+                   (glyph_img.res_px != layout_res_px))
+                {
+                    metrics.scale = float(layout_res_px)/glyph_img.res_px;
+                    metrics.bearing_x = std::lround(metrics.bearing_x*metrics.scale);
+                    metrics.bearing_y = std::lround(metrics.bearing_y*metrics.scale);
+                    metrics.width = std::lround(metrics.width*metrics.scale);
+                    metrics.height = std::lround(metrics.height*metrics.scale);
+                }
+
+                return metrics;
+            }
         }
 
         // =========================================================== //
@@ -86,6 +294,86 @@ namespace ks
 
         std::string const TextManager::m_log_prefix = "TextManager: ";
 
+        // =========================================================== //
+
+        // ForegroundLock
+        // * Locks the TextManager for a public call and keeps
+        //   prewarm jobs from starting their next step until
+        //   the call is done
+        // * Sends the atlas updates held back from prewarm
+        //   steps, so they're sent from the calling thread
+        class TextManager::ForegroundLock final
+        {
+        public:
+            ForegroundLock(TextManager const &text_manager) :
+                m_prewarm_worker(*(text_manager.m_prewarm_worker)),
+                m_mutex(text_manager.m_mutex)
+            {
+                m_prewarm_worker.BeginForeground();
+                m_mutex.lock();
+
+                if(text_manager.m_text_atlas)
+                {
+                    text_manager.m_text_atlas->SendDeferredUpdates();
+                }
+            }
+
+            ~ForegroundLock()
+            {
+                m_mutex.unlock();
+                m_prewarm_worker.EndForeground();
+            }
+
+        private:
+            PrewarmWorker &m_prewarm_worker;
+            std::recursive_mutex &m_mutex;
+        };
+
+        // =========================================================== //
+
+        // FreeTypeContext
+        // * The TextManager's FreeType library, used on whichever
+        //   thread holds the TextManager's mutex
+        struct TextManager::FreeTypeContext final
+        {
+            FreeTypeContext()
+            {
+                // load library
+                FT_Error error = memory.NewLibrary(&(library));
+                if(error) {
+                    std::string desc = "FreeTypeContext: "
+                                       "Failed to Init FreeType: ";
+                    desc += GetFreeTypeError(error);
+
+                    throw FreeTypeError(desc);
+                }
+            }
+
+            ~FreeTypeContext()
+            {
+                FT_Error error;
+
+                // release freetype
+                error = FT_Done_Library(library);
+                if(error)
+                {
+                    std::string desc = "FreeTypeContext: "
+                                       "Failed to close FreeType library: ";
+                    desc += GetFreeTypeError(error);
+
+                    throw FreeTypeError(desc);
+                }
+            }
+
+            // * allocator for the library; has to outlive it
+            FreeTypeMemory memory;
+
+            // * reference to the freetype library
+            FT_Library library;
+        };
+
+        // =========================================================== //
+
         TextManager::TextManager(uint atlas_size_px,
                                  uint glyph_res_px,
                                  uint sdf_offset_px) :
@@ -94,14 +382,16 @@ namespace ks
                              glyph_res_px,
                              sdf_offset_px)),
             signal_new_atlas(&(m_text_atlas->signal_new_atlas)),
-            signal_new_glyph(&(m_text_atlas->signal_new_glyph))
+            signal_new_glyph(&(m_text_atlas->signal_new_glyph)),
+            signal_atlas_updated(&(m_text_atlas->signal_atlas_updated)),
+            signal_atlases_compacted(&(m_text_atlas->signal_atlases_compacted))
 
         {
-            // Create the FreeType context if it doesn't already exist
-            if(g_ft_context == nullptr)
-            {
-                g_ft_context = make_shared<FreeTypeContext>();
-            }
+            // Each TextManager has its own FreeType library
+            // so its allocations can be counted and limited
+            m_ft_context = make_unique<FreeTypeContext>();
+
+            m_prewarm_worker = make_unique<PrewarmWorker>();
 
             // We don't init the invalid font w initial atlas
             // here because the corresponding signals can't
@@ -110,69 +400,128 @@ namespace ks
 
         TextManager::~TextManager()
         {
+            // Prewarm jobs use the atlas and the fonts
+            m_prewarm_worker.reset();
+
+            // The atlas' raster threads have faces that use the
+            // font file data, so they have to be closed first
+            m_text_atlas.reset();
+
             cleanUpFonts();
         }
 
-        void TextManager::AddFont(std::string font_name,
-                                  std::string file_path)
+        void TextManager::SetRasterThreadCount(uint raster_thread_count)
         {
-            if(m_list_fonts.empty())
-            {
-                // Create an 'invalid' font (index 0) for missing glyphs
-                auto invalid_font = make_unique<Font>();
-                invalid_font->name = "invalid";
-                m_list_fonts.push_back(std::move(invalid_font));
+            ForegroundLock lock(*this);
+            m_text_atlas->SetRasterThreadCount(raster_thread_count);
+        }
 
-                m_text_atlas->AddFont(invalid_font);
-            }
+        void TextManager::SetSDFEngine(SDFEngine sdf_engine)
+        {
+            ForegroundLock lock(*this);
+            m_text_atlas->SetSDFEngine(sdf_engine);
+        }
 
-            m_list_fonts.push_back(make_unique<Font>());
-            auto& font = m_list_fonts.back();
+        void TextManager::SetAtlasUpdateMode(AtlasUpdateMode update_mode)
+        {
+            ForegroundLock lock(*this);
+            m_text_atlas->SetUpdateMode(update_mode);
+        }
 
-            font->name = font_name;
-            font->file_data = loadFontFile(file_path);
+        void TextManager::SetMaxAtlasCount(uint max_atlas_count)
+        {
+            ForegroundLock lock(*this);
+            m_text_atlas->SetMaxAtlasCount(max_atlas_count);
+        }
 
-            // Load FreeType font face
-            loadFreeTypeFontFace(*font);
+        void TextManager::SetAtlasPackerType(AtlasPackerType packer_type)
+        {
+            ForegroundLock lock(*this);
+            m_text_atlas->SetPackerType(packer_type);
+        }
 
-            // Load HarfBuzz font object
-            font->hb_font = hb_ft_font_create(font->ft_face,NULL);
+        void TextManager::SetAtlasCacheFile(std::string const &file_path)
+        {
+            ForegroundLock lock(*this);
+            m_text_atlas->SetCacheFile(file_path);
+        }
 
-            // Update atlas
-            m_text_atlas->AddFont(font);
+        void TextManager::SetAtlasBundle(std::string const &file_path)
+        {
+            ForegroundLock lock(*this);
+            m_text_atlas->SetBundleFile(file_path);
         }
 
-        void TextManager::AddFont(std::string font_name,
-                                  unique_ptr<std::vector<u8>> file_data)
+        bool TextManager::LoadAtlasCache()
         {
-            if(m_list_fonts.empty())
-            {
-                // Create an 'invalid' font (index 0) for missing glyphs
-                auto invalid_font = make_unique<Font>();
-                invalid_font->name = "invalid";
-                m_list_fonts.push_back(std::move(invalid_font));
+            ForegroundLock lock(*this);
+            return m_text_atlas->LoadCache();
+        }
 
-                m_text_atlas->AddFont(invalid_font);
-            }
+        void TextManager::SaveAtlasCache()
+        {
+            ForegroundLock lock(*this);
+            m_text_atlas->SaveCache();
+        }
 
-            m_list_fonts.push_back(make_unique<Font>());
-            auto& font = m_list_fonts.back();
+        void TextManager::EnableAtlasMirror()
+        {
+            ForegroundLock lock(*this);
+            m_text_atlas->EnableAtlasMirror();
+        }
 
-            font->name = font_name;
-            font->file_data = std::move(file_data);
+        void TextManager::RestoreAtlases()
+        {
+            ForegroundLock lock(*this);
+            m_text_atlas->RestoreAtlases();
+        }
+
+        void TextManager::EnableChannelPacking()
+        {
+            ForegroundLock lock(*this);
+            m_text_atlas->EnableChannelPacking();
+        }
 
-            // Load FreeType font face
-            loadFreeTypeFontFace(*font);
+        void TextManager::EnableOpenTypeFontFuncs()
+        {
+            ForegroundLock lock(*this);
+            m_hb_ot_font_funcs = true;
+        }
 
-            // Load HarfBuzz font object
-            font->hb_font = hb_ft_font_create(font->ft_face,NULL);
+        void TextManager::AddFont(std::string font_name,
+                                  std::string file_path,
+                                  uint glyph_res_px,
+                                  uint sdf_offset_px,
+                                  GlyphImageType image_type)
+        {
+            ForegroundLock lock(*this);
 
-            // Update atlas
-            m_text_atlas->AddFont(font);
+            addFont(font_name,
+                    loadFontFile(file_path),
+                    glyph_res_px,
+                    sdf_offset_px,
+                    image_type);
+        }
+
+        void TextManager::AddFont(std::string font_name,
+                                  unique_ptr<std::vector<u8>> file_data,
+                                  uint glyph_res_px,
+                                  uint sdf_offset_px,
+                                  GlyphImageType image_type)
+        {
+            ForegroundLock lock(*this);
+
+            addFont(font_name,
+                    std::move(file_data),
+                    glyph_res_px,
+                    sdf_offset_px,
+                    image_type);
         }
 
         Hint TextManager::CreateHint(std::string const &prio_fonts)
         {
+            ForegroundLock lock(*this);
+
             if(m_list_fonts.empty())
             {
                 throw NoFontsAvailable();
@@ -246,11 +595,92 @@ namespace ks
                 }
             }
 
+            void BuildClusterIndex(ShapedLine const &shaped_line,
+                                   Line &line)
+            {
+                // Group glyphs that share a cluster into spans. Glyphs
+                // are in visual order and the glyphs for a cluster are
+                // always adjacent so the spans are sorted by x
+                auto const &list_glyph_info = shaped_line.list_glyph_info;
+                auto const &list_glyph_offsets = shaped_line.list_glyph_offsets;
+
+                line.list_cluster_spans.clear();
+                line.list_logical_spans.clear();
+
+                sint pen_x = 0;
+                for(uint i=0; i < list_glyph_info.size(); i++)
+                {
+                    GlyphInfo const &glyph_info = list_glyph_info[i];
+                    sint const advance = list_glyph_offsets[i].advance_x;
+
+                    if(line.list_cluster_spans.empty() ||
+                       line.list_cluster_spans.back().start != glyph_info.cluster)
+                    {
+                        ClusterSpan span;
+                        span.start = glyph_info.cluster;
+                        span.end = glyph_info.cluster;
+                        span.x0 = pen_x;
+                        span.x1 = pen_x;
+                        span.glyph = i;
+                        span.glyph_count = 0;
+                        span.rtl = glyph_info.rtl;
+
+                        line.list_cluster_spans.push_back(span);
+                    }
+
+                    ClusterSpan &span = line.list_cluster_spans.back();
+                    span.x1 += advance;
+                    span.glyph_count++;
+
+                    pen_x += advance;
+                }
+
+                // Sort the spans logically and set the end of each
+                // span to the start of the next logical span
+                auto const &list_spans = line.list_cluster_spans;
+                line.list_logical_spans.resize(list_spans.size());
+
+                for(uint i=0; i < list_spans.size(); i++)
+                {
+                    line.list_logical_spans[i] = i;
+                }
+
+                std::stable_sort(
+                            line.list_logical_spans.begin(),
+                            line.list_logical_spans.end(),
+                            [&list_spans](uint a, uint b) {
+                                return (list_spans[a].start < list_spans[b].start);
+                            });
+
+                auto const &list_logical = line.list_logical_spans;
+                uint const last = list_logical.size()-1;
+                uint end = std::max(line.end,list_spans[list_logical[last]].start+1);
+
+                for(sint i=last; i >= 0; i--)
+                {
+                    ClusterSpan &span = line.list_cluster_spans[list_logical[i]];
+                    if((uint(i) < last) &&
+                       (list_spans[list_logical[i+1]].start != span.start))
+                    {
+                        end = list_spans[list_logical[i+1]].start;
+                    }
+
+                    span.end = end;
+                }
+            }
         }
 
         unique_ptr<std::vector<Line>>
         TextManager::GetGlyphs(std::u16string const &utf16text,
                                Hint const &text_hint)
+        {
+            ForegroundLock lock(*this);
+            return getGlyphs(utf16text,text_hint);
+        }
+
+        unique_ptr<std::vector<Line>>
+        TextManager::getGlyphs(std::u16string const &utf16text,
+                               Hint const &text_hint)
         {
             if(text_hint.list_prio_fonts.empty() &&
                text_hint.list_fallback_fonts.empty())
@@ -264,16 +694,6 @@ namespace ks
                 return list_lines_ptr;
             }
 
-            uint const invalid_font_line_height =
-                    m_text_atlas->GetGlyphResolutionPx() +
-                    (m_text_atlas->GetGlyphResolutionPx()/5);
-
-            sint const invalid_font_ascent =
-                    m_text_atlas->GetGlyphResolutionPx();
-
-            sint const invalid_font_descent = 0;
-
-
             // Shape with TextShaper
             auto list_shaped_lines_ptr =
                     ShapeText(utf16text,
@@ -282,6 +702,11 @@ namespace ks
 
             auto& list_shaped_lines = *list_shaped_lines_ptr;
 
+            uint const layout_res_px = m_text_atlas->GetGlyphResolutionPx();
+
+            // Every line is part of the same atlas request
+            m_text_atlas->BeginRequest(m_list_fonts);
+
             // Create and position glyhps on each line
             list_lines_ptr->resize(list_shaped_lines.size());
             auto& list_lines = *list_lines_ptr;
@@ -321,9 +746,10 @@ namespace ks
 
                     if(i==0)
                     {
-                        line.ascent = invalid_font_ascent;
-                        line.descent = invalid_font_descent;
-                        line.spacing = invalid_font_line_height;
+                        getInvalidFontMetrics(
+                                    line.ascent,
+                                    line.descent,
+                                    line.spacing);
                     }
                     else
                     {
@@ -362,15 +788,26 @@ namespace ks
                     glyph.cluster = shaped_line.list_glyph_info[j].cluster;
 
                     glyph.atlas = glyph_img.atlas;
+                    glyph.channel = glyph_img.channel;
+                    glyph.image_type = glyph_img.image_type;
                     glyph.tex_x = glyph_img.tex_x;
                     glyph.tex_y = glyph_img.tex_y;
                     glyph.sdf_x = glyph_img.sdf_x;
                     glyph.sdf_y = glyph_img.sdf_y;
 
-                    glyph.x0 = pen_x + glyph_offset.offset_x + glyph_img.bearing_x;
-                    glyph.x1 = glyph.x0 + glyph_img.width;
-                    glyph.y1 = glyph_offset.offset_y + glyph_img.bearing_y;
-                    glyph.y0 = glyph.y1 - glyph_img.height;
+                    bool const has_image = (glyph_img.width*glyph_img.height > 0);
+                    glyph.tex_width = has_image ? (glyph_img.width + 2*glyph_img.sdf_x) : 0;
+                    glyph.tex_height = has_image ? (glyph_img.height + 2*glyph_img.sdf_y) : 0;
+
+                    LayoutMetrics const metrics =
+                            GetLayoutMetrics(glyph_img,layout_res_px);
+
+                    glyph.scale = metrics.scale;
+
+                    glyph.x0 = pen_x + glyph_offset.offset_x + metrics.bearing_x;
+                    glyph.x1 = glyph.x0 + metrics.width;
+                    glyph.y1 = glyph_offset.offset_y + metrics.bearing_y;
+                    glyph.y0 = glyph.y1 - metrics.height;
                     glyph.rtl = shaped_line.list_glyph_info[j].rtl;
 
                     pen_x += glyph_offset.advance_x;
@@ -395,6 +832,8 @@ namespace ks
 
                         glyph.sdf_x = 0;
                         glyph.sdf_y = 0;
+                        glyph.tex_width = 0;
+                        glyph.tex_height = 0;
                     }
 
                     // update min,max x,y
@@ -405,35 +844,401 @@ namespace ks
                 }
 
                 // Calculate font metrics from the line
-                line.spacing = 0;
-                line.ascent = 0;
-                line.descent = std::numeric_limits<sint>::max();
-                for(auto font : list_unq_fonts)
+                calcLineFontMetrics(list_unq_fonts,
+                                    line.ascent,
+                                    line.descent,
+                                    line.spacing);
+
+                // Build the hit testing and caret index
+                BuildClusterIndex(shaped_line,line);
+            }
+
+            // Set baselines relative to the first line
+            for(uint i=0; i < list_lines.size(); i++)
+            {
+                list_lines[i].baseline_y = (i==0) ?
+                            0 : (list_lines[i-1].baseline_y-list_lines[i].spacing);
+            }
+
+            return list_lines_ptr;
+        }
+
+        TextMetrics
+        TextManager::MeasureText(std::u16string const &utf16text,
+                                 Hint const &text_hint)
+        {
+            ForegroundLock lock(*this);
+
+            if(text_hint.list_prio_fonts.empty() &&
+               text_hint.list_fallback_fonts.empty())
+            {
+                throw HintInvalid("No fonts specified in Hint");
+            }
+
+            TextMetrics text_metrics;
+            text_metrics.x_min = 0;
+            text_metrics.x_max = 0;
+            text_metrics.y_min = 0;
+            text_metrics.y_max = 0;
+
+            if(utf16text.empty())
+            {
+                return text_metrics;
+            }
+
+            // Shape with TextShaper
+            auto list_shaped_lines_ptr =
+                    ShapeText(utf16text,
+                              m_list_fonts,
+                              text_hint);
+
+            auto& list_shaped_lines = *list_shaped_lines_ptr;
+
+            text_metrics.list_lines.resize(list_shaped_lines.size());
+            auto& list_lines = text_metrics.list_lines;
+
+            text_metrics.x_min = std::numeric_limits<sint>::max();
+            text_metrics.x_max = std::numeric_limits<sint>::min();
+            text_metrics.y_min = std::numeric_limits<sint>::max();
+            text_metrics.y_max = std::numeric_limits<sint>::min();
+
+            std::vector<GlyphImageDesc> list_glyph_imgs;
+            std::vector<uint> list_unq_fonts;
+            sint baseline_y = 0;
+
+            uint const layout_res_px = m_text_atlas->GetGlyphResolutionPx();
+
+            // For each line
+            for(uint i=0; i < list_shaped_lines.size(); i++)
+            {
+                ShapedLine const &shaped_line = list_shaped_lines[i];
+                LineMetrics &line = list_lines[i];
+
+                line.rtl = shaped_line.rtl;
+                line.start = shaped_line.start;
+                line.end = shaped_line.end;
+                line.advance = 0;
+
+                uint const glyph_count =
+                        shaped_line.list_glyph_info.size();
+
+                // Get glyph metrics without rasterizing
+                list_glyph_imgs.clear();
+                m_text_atlas->GetGlyphMetrics(
+                            m_list_fonts,
+                            shaped_line.list_glyph_info,
+                            list_glyph_imgs);
+
+                if(glyph_count == 0)
                 {
-                    // Fix the invalid font height
-                    if(font == 0)
+                    line.start = 0;
+                    line.end = 0;
+                    line.x_min = 0;
+                    line.x_max = 0;
+                    line.y_min = 0;
+                    line.y_max = 0;
+                    line.rtl = false;
+
+                    if(i==0)
                     {
-                        line.ascent = std::max(line.ascent,invalid_font_ascent);
-                        line.descent = std::min(line.descent,invalid_font_descent);
-                        line.spacing = std::max(line.spacing,invalid_font_line_height);
+                        getInvalidFontMetrics(
+                                    line.ascent,
+                                    line.descent,
+                                    line.spacing);
                     }
                     else
                     {
-                        auto const &ft_size_metrics =
-                                m_list_fonts[font]->ft_face->size->metrics;
+                        line.ascent = list_lines[i-1].ascent;
+                        line.descent = list_lines[i-1].descent;
+                        line.spacing = list_lines[i-1].spacing;
+                    }
+                }
+                else
+                {
+                    // Same positioning as GetGlyphs
+                    sint pen_x = 0;
+
+                    line.x_min = std::numeric_limits<sint>::max();
+                    line.x_max = std::numeric_limits<sint>::min();
+                    line.y_min = std::numeric_limits<sint>::max();
+                    line.y_max = std::numeric_limits<sint>::min();
+
+                    list_unq_fonts.clear();
+
+                    // For each glyph
+                    for(uint j=0; j < glyph_count; j++)
+                    {
+                        GlyphImageDesc const &glyph_img =
+                                list_glyph_imgs[j];
+
+                        GlyphOffset const &glyph_offset =
+                                shaped_line.list_glyph_offsets[j];
+
+                        GlyphInfo const &glyph_info =
+                                shaped_line.list_glyph_info[j];
+
+                        LayoutMetrics const metrics =
+                                GetLayoutMetrics(glyph_img,layout_res_px);
+
+                        sint x0 = pen_x + glyph_offset.offset_x + metrics.bearing_x;
+                        sint x1 = x0 + metrics.width;
+                        sint y1 = glyph_offset.offset_y + metrics.bearing_y;
+                        sint y0 = y1 - metrics.height;
+
+                        pen_x += glyph_offset.advance_x;
+
+                        OrderedUniqueInsert<uint>(list_unq_fonts,glyph_img.font);
+
+                        // adjust the glyph width for special characters like space
+                        if(glyph_img.width==0 && glyph_info.zero_width==false)
+                        {
+                            x1 = x0 + glyph_offset.advance_x;
+                            if(x0 > x1)
+                            {
+                                std::swap(x0,x1);
+                            }
+                        }
+
+                        line.y_min = std::min(line.y_min,y0);
+                        line.y_max = std::max(line.y_max,y1);
+                        line.x_min = std::min(line.x_min,x0);
+                        line.x_max = std::max(line.x_max,x1);
+                    }
+
+                    line.advance = pen_x;
+
+                    calcLineFontMetrics(list_unq_fonts,
+                                        line.ascent,
+                                        line.descent,
+                                        line.spacing);
+                }
+
+                // Update the overall bounding box; each
+                // line is placed spacing px below the last
+                if(i > 0)
+                {
+                    baseline_y -= line.spacing;
+                }
+
+                text_metrics.y_min = std::min(text_metrics.y_min,baseline_y+line.descent);
+                text_metrics.y_max = std::max(text_metrics.y_max,baseline_y+line.ascent);
+
+                if(glyph_count > 0)
+                {
+                    text_metrics.x_min = std::min(text_metrics.x_min,line.x_min);
+                    text_metrics.x_max = std::max(text_metrics.x_max,line.x_max);
+                    text_metrics.y_min = std::min(text_metrics.y_min,baseline_y+line.y_min);
+                    text_metrics.y_max = std::max(text_metrics.y_max,baseline_y+line.y_max);
+                }
+            }
+
+            // No glyphs in any line
+            if(text_metrics.x_min > text_metrics.x_max)
+            {
+                text_metrics.x_min = 0;
+                text_metrics.x_max = 0;
+            }
+
+            return text_metrics;
+        }
 
-                        sint font_ascent = ft_size_metrics.ascender/64;
-                        sint font_descent = ft_size_metrics.descender/64;
-                        uint font_line_height = ft_size_metrics.height/64;
+        namespace
+        {
+            // Number of UTF-16 code units (or code points for
+            // ranges) shaped in each prewarm step
+            uint const kPrewarmCharsPerStep = 16;
+
+            void AppendCodePoint(u32 cp, std::u16string &text)
+            {
+                if(cp < 0x10000)
+                {
+                    text.push_back(char16_t(cp));
+                }
+                else
+                {
+                    cp -= 0x10000;
+                    text.push_back(char16_t(0xD800 + (cp >> 10)));
+                    text.push_back(char16_t(0xDC00 + (cp & 0x3FF)));
+                }
+            }
 
-                        line.ascent = std::max(line.ascent,font_ascent);
-                        line.descent = std::min(line.descent,font_descent);
-                        line.spacing = std::max(line.spacing,font_line_height);
+            void SplitPrewarmText(std::u16string const &text,
+                                  std::vector<std::u16string> &list_texts)
+            {
+                // Split after spaces where possible so
+                // words are shaped as they would be
+                uint start = 0;
+                while(start < text.size())
+                {
+                    uint end = std::min<uint>(start+kPrewarmCharsPerStep,
+                                              text.size());
+
+                    if(end < text.size())
+                    {
+                        uint split = end;
+                        while((split > start) && (text[split-1] != u' '))
+                        {
+                            split--;
+                        }
+
+                        if(split > start)
+                        {
+                            end = split;
+                        }
+                        else if((text[end-1] >= 0xD800) && (text[end-1] < 0xDC00))
+                        {
+                            // Don't split a surrogate pair
+                            end--;
+                        }
                     }
+
+                    list_texts.push_back(text.substr(start,end-start));
+                    start = end;
                 }
             }
+        }
 
-            return list_lines_ptr;
+        uint TextManager::Prewarm(std::string const &font_names,
+                                  std::vector<std::u16string> const &list_texts,
+                                  sint priority)
+        {
+            auto list_split_texts = make_shared<std::vector<std::u16string>>();
+            for(auto const &text : list_texts)
+            {
+                SplitPrewarmText(text,*list_split_texts);
+            }
+
+            return addPrewarmJob(CreateHint(font_names),
+                                 list_split_texts,
+                                 priority);
+        }
+
+        uint TextManager::Prewarm(std::string const &font_names,
+                                  std::vector<std::pair<u32,u32>> const &list_ranges,
+                                  sint priority)
+        {
+            // Code points are separated by spaces so
+            // they're shaped on their own
+            auto list_split_texts = make_shared<std::vector<std::u16string>>();
+            std::u16string text;
+            uint char_count = 0;
+
+            for(auto const &range : list_ranges)
+            {
+                for(u32 cp=range.first; cp <= std::min<u32>(range.second,0x10FFFF); cp++)
+                {
+                    if((cp >= 0xD800) && (cp <= 0xDFFF))
+                    {
+                        continue;
+                    }
+
+                    AppendCodePoint(cp,text);
+                    text.push_back(u' ');
+
+                    if(++char_count == kPrewarmCharsPerStep)
+                    {
+                        list_split_texts->push_back(std::move(text));
+                        text.clear();
+                        char_count = 0;
+                    }
+                }
+            }
+
+            if(!text.empty())
+            {
+                list_split_texts->push_back(std::move(text));
+            }
+
+            return addPrewarmJob(CreateHint(font_names),
+                                 list_split_texts,
+                                 priority);
+        }
+
+        uint TextManager::addPrewarmJob(Hint const &hint,
+                                        shared_ptr<std::vector<std::u16string>> list_texts,
+                                        sint priority)
+        {
+            Hint prewarm_hint = hint;
+            prewarm_hint.max_line_width_px = std::numeric_limits<uint>::max();
+
+            // The step is copied by the worker, so the
+            // position is shared between the copies
+            auto next_text = make_shared<uint>(0);
+
+            return m_prewarm_worker->AddJob(
+                        [this,prewarm_hint,list_texts,next_text]() {
+                            std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+                            if((*next_text >= list_texts->size()) ||
+                               m_text_atlas->IsAtlasBudgetFull())
+                            {
+                                return false;
+                            }
+
+                            // Updates are held until the next foreground
+                            // call so they aren't sent from this thread
+                            m_text_atlas->SetDeferUpdates(true);
+                            try
+                            {
+                                getGlyphs((*list_texts)[(*next_text)++],prewarm_hint);
+                            }
+                            catch(...)
+                            {
+                                m_text_atlas->SetDeferUpdates(false);
+                                throw;
+                            }
+                            m_text_atlas->SetDeferUpdates(false);
+
+                            return (*next_text < list_texts->size());
+                        },
+                        priority);
+        }
+
+        void TextManager::CancelPrewarm(uint job_id)
+        {
+            m_prewarm_worker->CancelJob(job_id);
+        }
+
+        void TextManager::CancelPrewarm()
+        {
+            m_prewarm_worker->CancelAllJobs();
+        }
+
+        void TextManager::WaitForPrewarm()
+        {
+            m_prewarm_worker->WaitForJobs();
+
+            // Sends the updates held back from the jobs
+            ForegroundLock lock(*this);
+        }
+
+        std::vector<AtlasUpdate> TextManager::TakeAtlasUpdates()
+        {
+            return m_text_atlas->TakeAtlasUpdates();
+        }
+
+        std::vector<AtlasOccupancy> TextManager::GetAtlasOccupancy() const
+        {
+            ForegroundLock lock(*this);
+            return m_text_atlas->GetAtlasOccupancy();
+        }
+
+        FreeTypeMemoryStats TextManager::GetFreeTypeMemoryStats() const
+        {
+            ForegroundLock lock(*this);
+
+            FreeTypeMemoryStats stats;
+            m_ft_context->memory.AddStats(stats);
+            m_text_atlas->AddFreeTypeMemoryStats(stats);
+
+            return stats;
+        }
+
+        void TextManager::SetFreeTypeMemoryLimit(u64 max_bytes)
+        {
+            ForegroundLock lock(*this);
+            m_ft_context->memory.SetLimit(max_bytes);
+            m_text_atlas->SetFreeTypeMemoryLimit(max_bytes);
         }
 
         std::u16string TextManager::ConvertStringUTF8ToUTF16(std::string const &utf8text)
@@ -451,6 +1256,105 @@ namespace ks
             return text::ConvertStringUTF32ToUTF8(utf32text);
         }
 
+        void TextManager::ConvertStringUTF8ToUTF16(std::string const &utf8text,
+                                                   std::u16string &utf16text)
+        {
+            text::ConvertStringUTF8ToUTF16(utf8text,utf16text);
+        }
+
+        void TextManager::ConvertStringUTF16ToUTF8(std::u16string const &utf16text,
+                                                   std::string &utf8text)
+        {
+            text::ConvertStringUTF16ToUTF8(utf16text,utf8text);
+        }
+
+        void TextManager::ConvertStringUTF32ToUTF8(std::u32string const &utf32text,
+                                                   std::string &utf8text)
+        {
+            text::ConvertStringUTF32ToUTF8(utf32text,utf8text);
+        }
+
+        void TextManager::addFont(std::string font_name,
+                                  unique_ptr<std::vector<u8>> file_data,
+                                  uint glyph_res_px,
+                                  uint sdf_offset_px,
+                                  GlyphImageType image_type)
+        {
+            if(m_list_fonts.empty())
+            {
+                // Create an 'invalid' font (index 0) for missing glyphs
+                auto invalid_font = make_unique<Font>();
+                invalid_font->name = "invalid";
+                invalid_font->glyph_res_px = m_text_atlas->GetGlyphResolutionPx();
+                invalid_font->sdf_offset_px = m_text_atlas->GetSDFOffsetPx();
+                m_list_fonts.push_back(std::move(invalid_font));
+
+                m_text_atlas->AddFont(invalid_font);
+            }
+
+            m_list_fonts.push_back(make_unique<Font>());
+            auto& font = m_list_fonts.back();
+
+            font->name = font_name;
+            font->file_data = std::move(file_data);
+            font->glyph_res_px = (glyph_res_px > 0) ?
+                        glyph_res_px : m_text_atlas->GetGlyphResolutionPx();
+            font->sdf_offset_px = (sdf_offset_px > 0) ?
+                        sdf_offset_px : m_text_atlas->GetSDFOffsetPx();
+            font->image_type = image_type;
+
+            // Bitmaps don't need any space for a distance field
+            if(image_type == GlyphImageType::Bitmap)
+            {
+                font->sdf_offset_px = 0;
+            }
+
+            // What FreeType allocates for the font's faces (and
+            // for the atlas' missing glyph) is counted for it
+            FreeTypeMemory::Scope ft_scope(m_ft_context->memory,
+                                           m_list_fonts.size()-1);
+
+            try
+            {
+                // Load FreeType font face
+                loadFreeTypeFontFace(*font);
+
+                // Load HarfBuzz font object
+                font->hb_ot_funcs = m_hb_ot_font_funcs;
+                font->hb_font = (font->hb_ot_funcs) ?
+                            CreateOpenTypeFont(*font) :
+                            hb_ft_font_create(font->ft_face,NULL);
+
+                // Update atlas; this doesn't change the atlas
+                // if it throws
+                m_text_atlas->AddFont(font);
+            }
+            catch(...)
+            {
+                // * Loading fails if FreeType runs out of memory
+                //   (see SetFreeTypeMemoryLimit); the font is
+                //   removed so it isn't used or cleaned up later
+                if(font->hb_font)
+                {
+                    hb_font_destroy(font->hb_font);
+                }
+
+                if(font->ft_raster_face &&
+                   (font->ft_raster_face != font->ft_face))
+                {
+                    FT_Done_Face(font->ft_raster_face);
+                }
+
+                if(font->ft_face)
+                {
+                    FT_Done_Face(font->ft_face);
+                }
+
+                m_list_fonts.pop_back();
+                throw;
+            }
+        }
+
         void TextManager::cleanUpFonts()
         {
             FT_Error error;
@@ -463,6 +1367,20 @@ namespace ks
                 }
 
                 // Clean up FreeType font faces
+                if(font->ft_raster_face != font->ft_face)
+                {
+                    error = FT_Done_Face(font->ft_raster_face);
+                    if(error)
+                    {
+                        std::string desc = m_log_prefix;
+                        desc += "Failed to close font face: ";
+                        desc += font->name;
+                        desc += GetFreeTypeError(error);
+
+                        throw FreeTypeError(desc);
+                    }
+                }
+
                 error = FT_Done_Face(font->ft_face);
                 if(error)
                 {
@@ -479,81 +1397,72 @@ namespace ks
             }
         }
 
-        void TextManager::loadFreeTypeFontFace(Font& font)
+        void TextManager::calcLineFontMetrics(std::vector<uint> const &list_unq_fonts,
+                                              sint &ascent,
+                                              sint &descent,
+                                              uint &spacing) const
         {
-            std::vector<u8> const &file_data =
-                    *(font.file_data);
-
-            // Load font using FreeType. We only load face 0.
-            FT_Error error;
-
-            // file buff
-            FT_Byte const * file_buff =
-                    static_cast<FT_Byte const *>(&(file_data[0]));
-
-            FT_Long file_size = file_data.size();
-
-            // load face
-            FT_Face &face = font.ft_face;
-            error = FT_New_Memory_Face(
-                        g_ft_context->library,
-                        file_buff,
-                        file_size,
-                        0,
-                        &face);
-
-            if(error) {
-                std::string desc = "Failed to load face 0 of font: ";
-                desc += font.name;
-                desc += GetFreeTypeError(error);
-
-                throw FreeTypeError(desc);
-            }
+            // Font metric values are the absolute maximum
+            // value for each font used in the line
+            spacing = 0;
+            ascent = 0;
+            descent = std::numeric_limits<sint>::max();
 
-            // Force UCS-2 charmap for this font as
-            // recommended by Harfbuzz
-            bool set_charmap=false;
-            for(int n = 0; n < face->num_charmaps; n++) {
-                FT_UShort platform_id = face->charmaps[n]->platform_id;
-                FT_UShort encoding_id = face->charmaps[n]->encoding_id;
+            for(auto font : list_unq_fonts)
+            {
+                sint font_ascent;
+                sint font_descent;
+                uint font_line_height;
 
-                if (((platform_id == 0) && (encoding_id == 3)) ||
-                    ((platform_id == 3) && (encoding_id == 1)))
+                // Fix the invalid font height
+                if(font == 0)
                 {
-                    error = FT_Set_Charmap(face,face->charmaps[n]);
-                    set_charmap = true;
-                    break;
+                    getInvalidFontMetrics(font_ascent,
+                                          font_descent,
+                                          font_line_height);
                 }
-            }
+                else
+                {
+                    auto const &ft_size_metrics =
+                            m_list_fonts[font]->ft_face->size->metrics;
 
-            if(!set_charmap || (set_charmap && error)) {
-                std::string desc = "Failed to set UCS-2 charmap for ";
-                desc += font.name;
+                    font_ascent = ft_size_metrics.ascender/64;
+                    font_descent = ft_size_metrics.descender/64;
+                    font_line_height = ft_size_metrics.height/64;
+                }
 
-                throw FreeTypeError(desc);
+                ascent = std::max(ascent,font_ascent);
+                descent = std::min(descent,font_descent);
+                spacing = std::max(spacing,font_line_height);
             }
+        }
 
-            // Set size:
-            // freetype specifies char dimensions in
-            // 1/64th of a point
-            // (point == 1/72 inch)
-
-            auto const glyph_res_px =
-                    m_text_atlas->GetGlyphResolutionPx();
-
-            error = FT_Set_Char_Size(face,  // face
-                                     glyph_res_px*64, // width  in 1/64th of points
-                                     glyph_res_px*64, // height in 1/64th of points
-                                     72,    // horizontal dpi
-                                     72);   // vertical dpi
+        void TextManager::getInvalidFontMetrics(sint &ascent,
+                                                sint &descent,
+                                                uint &spacing) const
+        {
+            uint const glyph_res_px = m_text_atlas->GetGlyphResolutionPx();
 
-            if(error) {
-                std::string desc = "Failed to set char size for font ";
-                desc += font.name;
-                desc += GetFreeTypeError(error);
+            ascent = glyph_res_px;
+            descent = 0;
+            spacing = glyph_res_px + (glyph_res_px/5);
+        }
 
-                throw FreeTypeError(desc);
-            }
+        void TextManager::loadFreeTypeFontFace(Font& font)
+        {
+            // The face used for shaping and layout is always at
+            // the TextManager's resolution; glyph images are
+            // rasterized from a second face if the font has its
+            // own resolution
+            FT_Library const library = m_ft_context->library;
+
+            font.ft_face =
+                    LoadFreeTypeFace(
+                        library,font,m_text_atlas->GetGlyphResolutionPx());
+
+            font.ft_raster_face =
+                    (font.glyph_res_px == m_text_atlas->GetGlyphResolutionPx()) ?
+                        font.ft_face : LoadFreeTypeFace(library,font,font.glyph_res_px);
 
             LOG.Info() << m_log_prefix << "Loaded font "
                        << font.name;
@@ -17,12 +17,16 @@
 #ifndef KS_TEXT_TEXT_MANAGER_HPP
 #define KS_TEXT_TEXT_MANAGER_HPP
 
+#include <mutex>
+
 #include <glm/gtc/type_precision.hpp>
 
 #include <ks/KsSignal.hpp>
 #include <ks/KsException.hpp>
+#include <ks/text/KsTextAtlasPacker.hpp>
 #include <ks/text/KsTextDataTypes.hpp>
 #include <ks/text/KsTextGlyphDesc.hpp>
+#include <ks/text/KsTextSDF.hpp>
 
 namespace ks
 {
@@ -68,6 +72,7 @@ namespace ks
         // =========================================================== //
 
         class TextAtlas;
+        class PrewarmWorker;
         struct Font;
 
         class TextManager
@@ -92,11 +97,130 @@ namespace ks
 
             ~TextManager();
 
+            // * Sets the number of threads used to rasterize new
+            //   glyphs when a GetGlyphs call needs several of them;
+            //   0 uses one thread per core (the default) and 1
+            //   rasterizes every glyph on the calling thread
+            // * Must be called before any fonts are added
+            void SetRasterThreadCount(uint raster_thread_count);
+
+            // * Sets the SDFEngine used to generate the distance
+            //   field for each glyph image (SDFEngine::EDTAA3 by
+            //   default); glyph images are RGBA8 for
+            //   SDFEngine::OutlineMSDF and R8 otherwise
+            // * Must be called before any fonts are added
+            void SetSDFEngine(SDFEngine sdf_engine);
+
+            // * Selects how new glyph images are sent to the
+            //   renderer (AtlasUpdateMode::PerGlyph by default,
+            //   see AtlasUpdateMode)
+            // * Must be called before any fonts are added
+            void SetAtlasUpdateMode(AtlasUpdateMode update_mode);
+
+            // * Limits the number of atlases; when a GetGlyphs call
+            //   starts with more atlases than this, the least
+            //   recently used glyphs are evicted and the rest are
+            //   repacked (see signal_atlases_compacted). 0 means
+            //   no limit (the default)
+            // * Must be called before any fonts are added
+            void SetMaxAtlasCount(uint max_atlas_count);
+
+            // * Selects how glyphs are packed into each atlas
+            //   (AtlasPackerType::Shelf by default, see
+            //   AtlasPackerType)
+            // * Must be called before any fonts are added
+            void SetAtlasPackerType(AtlasPackerType packer_type);
+
+            // * Keeps a copy of each atlas image so the atlases
+            //   can be saved to @file_path with SaveAtlasCache
+            //   and loaded on the next start with LoadAtlasCache
+            // * Must be called before any fonts are added
+            void SetAtlasCacheFile(std::string const &file_path);
+
+            // * Loads the atlases from the cache file if it was
+            //   saved with the same font files (in the same order)
+            //   and atlas settings; returns false otherwise
+            // * Call after adding fonts and before GetGlyphs.
+            //   Each atlas is sent as a single image with
+            //   signal_new_atlas followed by signal_new_glyph,
+            //   signal_atlas_updated or a queued update (for the
+            //   whole atlas) depending on the AtlasUpdateMode
+            bool LoadAtlasCache();
+
+            // * Writes the atlases to the cache file; the file
+            //   is replaced only once it's completely written
+            void SaveAtlasCache();
+
+            // * Maps an atlas bundle made by ks_text_prebake that's
+            //   loaded as soon as the fonts it was baked with have
+            //   been added (in the same order), so the glyphs in it
+            //   are never rasterized. The atlas and font settings
+            //   have to match the ones it was baked with
+            // * Must be called before any fonts are added
+            void SetAtlasBundle(std::string const &file_path);
+
+            // * Keeps a copy of each atlas image in memory so the
+            //   atlases can be sent again with RestoreAtlases; full
+            //   atlases are kept compressed
+            // * Must be called before any fonts are added
+            void EnableAtlasMirror();
+
+            // * Sends every atlas again, ie. after the graphics
+            //   context was lost, without rasterizing any glyphs.
+            //   Each atlas is sent the same way as LoadAtlasCache
+            //   but signal_atlases_compacted isn't emitted since
+            //   the glyphs don't move
+            // * Needs EnableAtlasMirror, a cache file or an
+            //   AtlasUpdateMode other than PerGlyph
+            void RestoreAtlases();
+
+            // * Packs glyphs into the four channels of RGBA8 atlases
+            //   (see Glyph::channel) so there are about a quarter as
+            //   many atlases, and fewer of them per line; the shader
+            //   samples the glyph's channel as the distance
+            // * Atlas images and updates are RGBA8. Updates sent with
+            //   signal_new_glyph cover every channel of the glyph's
+            //   rectangle, so they can't be blended per channel
+            // * Only for single channel SDFEngines; must be called
+            //   before any fonts are added
+            void EnableChannelPacking();
+
+            // * Fonts added after this call are shaped with HarfBuzz's
+            //   OpenType font functions, which read glyph indices and
+            //   advances directly from the font's cmap and hmtx
+            //   tables, instead of going through FreeType (which
+            //   loads each glyph for its advance)
+            // * Advances are scaled and 'kern' table kerning is read
+            //   the same way as with FreeType, so glyphs are placed
+            //   the same either way; the only difference is that
+            //   characters outside of the BMP are mapped with the
+            //   font's full cmap instead of FreeType's UCS-2 one
+            void EnableOpenTypeFontFuncs();
+
+            // * @glyph_res_px and @sdf_offset_px set the resolution
+            //   this font's glyph images are rasterized at and the
+            //   sdf offset around them; 0 uses the TextManager's
+            //   settings. Dense scripts like CJK need more
+            //   resolution while icons and Latin text can use less
+            // * Text is always laid out at the TextManager's
+            //   glyph_res_px; glyphs rasterized at a different
+            //   resolution are scaled (see Glyph::scale)
+            // * @image_type GlyphImageType::Bitmap stores hinted
+            //   coverage bitmaps instead of distance fields for
+            //   small text; @sdf_offset_px is ignored. To use both
+            //   for the same font, add it twice with different
+            //   names so each gets its own glyphs
             void AddFont(std::string font_name,
-                         std::string file_path);
+                         std::string file_path,
+                         uint glyph_res_px=0,
+                         uint sdf_offset_px=0,
+                         GlyphImageType image_type=GlyphImageType::SDF);
 
             void AddFont(std::string font_name,
-                         unique_ptr<std::vector<u8>> file_data);
+                         unique_ptr<std::vector<u8>> file_data,
+                         uint glyph_res_px=0,
+                         uint sdf_offset_px=0,
+                         GlyphImageType image_type=GlyphImageType::SDF);
 
             Hint CreateHint(std::string const &list_prio_fonts="");
 
@@ -104,6 +228,68 @@ namespace ks
             GetGlyphs(std::u16string const &utf16text,
                       Hint const &text_hint);
 
+            // * Shapes and measures @utf16text without rasterizing
+            //   any glyphs; the lines, advances and bounding boxes
+            //   are the same as the ones from GetGlyphs
+            // * The atlas isn't modified and no signals are
+            //   emitted, so layout code can call this repeatedly
+            //   before any text is drawn
+            TextMetrics
+            MeasureText(std::u16string const &utf16text,
+                        Hint const &text_hint);
+
+            // * Shapes and rasterizes @list_texts with the fonts
+            //   in @font_names (a comma-separated list, as for
+            //   CreateHint) on a background thread so the glyphs
+            //   are already in the atlas when they're requested
+            // * Jobs with a higher @priority are run first. Work
+            //   is done a few words at a time and pauses while
+            //   any other TextManager call is running
+            // * Prewarming stops once the atlas budget (see
+            //   SetMaxAtlasCount) is reached
+            // * Atlas signals and queued updates for prewarmed
+            //   glyphs aren't sent from the prewarm thread; they're
+            //   held until the next TextManager call (or
+            //   WaitForPrewarm) and sent from its thread
+            // * Returns an id for CancelPrewarm
+            uint Prewarm(std::string const &font_names,
+                         std::vector<std::u16string> const &list_texts,
+                         sint priority=0);
+
+            // * Same as above for every code point in each
+            //   [first,last] range of @list_ranges
+            uint Prewarm(std::string const &font_names,
+                         std::vector<std::pair<u32,u32>> const &list_ranges,
+                         sint priority=0);
+
+            // * Stops a prewarm job; glyphs that were already
+            //   generated stay in the atlas
+            void CancelPrewarm(uint job_id);
+            void CancelPrewarm();
+
+            // * Blocks until every prewarm job is done or
+            //   cancelled; don't call from a TextManager slot
+            void WaitForPrewarm();
+
+            // * Returns and clears the updates collected with
+            //   AtlasUpdateMode::Queued; safe to call from the
+            //   render thread while GetGlyphs runs on another
+            std::vector<AtlasUpdate> TakeAtlasUpdates();
+
+            // * Occupancy and fragmentation of each atlas
+            std::vector<AtlasOccupancy> GetAtlasOccupancy() const;
+
+            // * What FreeType has allocated for this TextManager,
+            //   in total and for each font (see FreeTypeMemoryStats)
+            FreeTypeMemoryStats GetFreeTypeMemoryStats() const;
+
+            // * Limits the bytes each of this TextManager's FreeType
+            //   libraries (its own and one per raster thread) can
+            //   have allocated; 0 means no limit
+            // * Loading a face or glyph that would go over the limit
+            //   throws FreeTypeError from the call that needed it
+            void SetFreeTypeMemoryLimit(u64 max_bytes);
+
             static std::u16string
             ConvertStringUTF8ToUTF16(std::string const &utf8text);
 
@@ -113,6 +299,20 @@ namespace ks
             static std::string
             ConvertStringUTF32ToUTF8(std::u32string const &utf32text);
 
+            // * These write the result to the second argument,
+            //   reusing its memory
+            static void
+            ConvertStringUTF8ToUTF16(std::string const &utf8text,
+                                     std::u16string &utf16text);
+
+            static void
+            ConvertStringUTF16ToUTF8(std::u16string const &utf16text,
+                                     std::string &utf8text);
+
+            static void
+            ConvertStringUTF32ToUTF8(std::u32string const &utf32text,
+                                     std::string &utf8text);
+
             // uint: atlas index
             Signal<uint,uint> * const signal_new_atlas;
 
@@ -125,16 +325,92 @@ namespace ks
                 shared_ptr<ImageData>
             > * const signal_new_glyph;
 
+            // Emitted once per atlas at the end of each GetGlyphs
+            // or AddFont call with AtlasUpdateMode::Batched
+            // uint: atlas index,
+            // std::vector<AtlasRect>: dirty rectangles,
+            // shared_ptr<ImageData>: the whole atlas image
+            // * the atlas image keeps changing as glyphs are
+            //   added, so it should only be read by directly
+            //   connected slots; use AtlasUpdateMode::Queued
+            //   to upload from another thread
+            Signal<
+                uint,
+                std::vector<AtlasRect>,
+                shared_ptr<ImageData>
+            > * const signal_atlas_updated;
+
+            // Emitted when the atlases are compacted, before any
+            // glyphs are added to the new atlases, and when they
+            // are replaced by LoadAtlasCache
+            // uint: number of atlases before compaction
+            // * every atlas is released and the atlas indices
+            //   start over at 0 with signal_new_atlas; Lines
+            //   from earlier GetGlyphs calls have to be requested
+            //   again since their glyphs may have moved
+            // * queued updates that weren't taken are dropped
+            Signal<uint> * const signal_atlases_compacted;
+
 
         private:
+            class ForegroundLock;
+            struct FreeTypeContext;
+
+            unique_ptr<std::vector<Line>>
+            getGlyphs(std::u16string const &utf16text,
+                      Hint const &text_hint);
+
+            uint addPrewarmJob(Hint const &hint,
+                               shared_ptr<std::vector<std::u16string>> list_texts,
+                               sint priority);
+
             void initFreeType();
+            void addFont(std::string font_name,
+                         unique_ptr<std::vector<u8>> file_data,
+                         uint glyph_res_px,
+                         uint sdf_offset_px,
+                         GlyphImageType image_type);
+
             void loadFreeTypeFontFace(Font& font);
             void cleanUpFreeType();
             void cleanUpFonts();
 
+            void calcLineFontMetrics(std::vector<uint> const &list_unq_fonts,
+                                     sint &ascent,
+                                     sint &descent,
+                                     uint &spacing) const;
+
+            void getInvalidFontMetrics(sint &ascent,
+                                       sint &descent,
+                                       uint &spacing) const;
+
             unique_ptr<std::vector<u8>> loadFontFile(std::string file_path);
 
+            // ft_context
+            // * FreeType library for the fonts' faces; released
+            //   after the fonts
+            unique_ptr<FreeTypeContext> m_ft_context;
+
             std::vector<unique_ptr<Font>> m_list_fonts;
+
+            // mutex
+            // * held by every call that uses the fonts or the
+            //   atlas so prewarm jobs can run in the background
+            // * TakeAtlasUpdates and CancelPrewarm don't take it;
+            //   they're synchronized by the atlas and the
+            //   PrewarmWorker. WaitForPrewarm takes it after the
+            //   jobs are done
+            mutable std::recursive_mutex m_mutex;
+
+            // prewarm_worker
+            // * created with the TextManager so ForegroundLock can
+            //   read it without holding m_mutex; its thread isn't
+            //   started until the first Prewarm call
+            unique_ptr<PrewarmWorker> m_prewarm_worker;
+
+            // * Whether fonts are added with HarfBuzz's OpenType
+            //   font functions (see EnableOpenTypeFontFuncs)
+            bool m_hb_ot_font_funcs{false};
         };
     }
 }
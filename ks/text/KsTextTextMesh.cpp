@@ -0,0 +1,351 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define KS_TEXT_TEXT_MESH_SSE2
+#include <emmintrin.h>
+#endif
+
+#include <ks/text/KsTextTextMesh.hpp>
+
+namespace ks
+{
+    namespace text
+    {
+        namespace {
+
+            bool HasQuad(Glyph const &glyph)
+            {
+                return ((glyph.tex_width > 0) && (glyph.tex_height > 0));
+            }
+
+            bool IsInBatch(Glyph const &glyph, TextDrawBatch const &batch)
+            {
+                return ((glyph.atlas == batch.atlas) &&
+                        (glyph.image_type == batch.image_type) &&
+                        (glyph.scale == batch.scale));
+            }
+
+            // * Sets @batch to the index of the batch for @glyph
+            //   and returns true if there's one
+            // * Text usually only has a few batches and runs of
+            //   glyphs in the same one, so @batch is checked first
+            bool FindBatch(Glyph const &glyph,
+                           std::vector<TextDrawBatch> const &list_batches,
+                           uint &batch)
+            {
+                if((batch < list_batches.size()) &&
+                   IsInBatch(glyph,list_batches[batch]))
+                {
+                    return true;
+                }
+
+                for(uint i=0; i < list_batches.size(); i++)
+                {
+                    if(IsInBatch(glyph,list_batches[i]))
+                    {
+                        batch = i;
+                        return true;
+                    }
+                }
+
+                return false;
+            }
+
+            // * Calls @write_quad(glyph,offset_x,offset_y,quad) for
+            //   every quad in @list_lines, where quad is the quad's
+            //   position in the output after sorting by batch
+            template<typename WriteQuad>
+            void WriteQuads(std::vector<Line> const &list_lines,
+                            TextManager::Alignment alignment,
+                            sint width,
+                            std::vector<TextDrawBatch> &list_batches,
+                            WriteQuad write_quad)
+            {
+                list_batches.clear();
+
+                // Count the quads in each batch
+                uint last_batch = 0;
+                for(auto const &line : list_lines)
+                {
+                    for(auto const &glyph : line.list_glyphs)
+                    {
+                        if(!HasQuad(glyph))
+                        {
+                            continue;
+                        }
+
+                        if(!FindBatch(glyph,list_batches,last_batch))
+                        {
+                            list_batches.push_back(
+                                        TextDrawBatch{
+                                            glyph.atlas,
+                                            glyph.image_type,
+                                            glyph.scale,
+                                            0,
+                                            0
+                                        });
+
+                            last_batch = list_batches.size()-1;
+                        }
+
+                        list_batches[last_batch].count++;
+                    }
+                }
+
+                if(list_batches.empty())
+                {
+                    return;
+                }
+
+                // Batches are sorted by atlas so the texture changes
+                // as little as possible; count is used as a cursor
+                // for the next quad in each batch
+                std::stable_sort(
+                            list_batches.begin(),
+                            list_batches.end(),
+                            [](TextDrawBatch const &a, TextDrawBatch const &b) {
+                                return (a.atlas < b.atlas);
+                            });
+
+                uint first = 0;
+                for(auto &batch : list_batches)
+                {
+                    batch.first = first;
+                    first += batch.count;
+                    batch.count = 0;
+                }
+
+                last_batch = 0;
+                for(auto const &line : list_lines)
+                {
+                    float const offset_x =
+                            GetAlignmentOffset(line,alignment,width);
+
+                    float const offset_y = line.baseline_y;
+
+                    for(auto const &glyph : line.list_glyphs)
+                    {
+                        if(!HasQuad(glyph))
+                        {
+                            continue;
+                        }
+
+                        FindBatch(glyph,list_batches,last_batch);
+                        TextDrawBatch &batch = list_batches[last_batch];
+
+                        write_quad(glyph,offset_x,offset_y,batch.first+batch.count);
+                        batch.count++;
+                    }
+                }
+            }
+
+            // * The top left corner of the quad is at (x0,y1) moved
+            //   out by the sdf offset, and the quad is the image
+            //   scaled by Glyph::scale
+            void WriteQuadVertices(Glyph const &glyph,
+                                   float offset_x,
+                                   float offset_y,
+                                   TextVertex * list_vertices)
+            {
+                u32 const s0 = glyph.tex_x;
+                u32 const s1 = glyph.tex_x+glyph.tex_width;
+                u32 const t0 = glyph.tex_y;
+                u32 const t1 = glyph.tex_y+glyph.tex_height;
+
+#ifdef KS_TEXT_TEXT_MESH_SSE2
+                // (left,top,right,bottom)
+                __m128 const quad =
+                        _mm_add_ps(
+                            _mm_set_ps(glyph.y1+offset_y,
+                                       glyph.x0+offset_x,
+                                       glyph.y1+offset_y,
+                                       glyph.x0+offset_x),
+                            _mm_mul_ps(
+                                _mm_set_ps(float(glyph.sdf_y)-glyph.tex_height,
+                                           float(glyph.tex_width)-glyph.sdf_x,
+                                           float(glyph.sdf_y),
+                                           -float(glyph.sdf_x)),
+                                _mm_set1_ps(glyph.scale)));
+
+                // Each vertex is a pair of floats followed by the
+                // texture coordinates and the channel
+                __m128i const tl_bl =
+                        _mm_castps_si128(
+                            _mm_shuffle_ps(quad,quad,_MM_SHUFFLE(3,0,1,0)));
+
+                __m128i const br_tr =
+                        _mm_castps_si128(
+                            _mm_shuffle_ps(quad,quad,_MM_SHUFFLE(1,2,3,2)));
+
+                int const channel = glyph.channel;
+
+                __m128i const tex_tl_bl =
+                        _mm_set_epi32(channel,s0 | (t1 << 16),
+                                      channel,s0 | (t0 << 16));
+
+                __m128i const tex_br_tr =
+                        _mm_set_epi32(channel,s1 | (t0 << 16),
+                                      channel,s1 | (t1 << 16));
+
+                __m128i * dst = reinterpret_cast<__m128i*>(list_vertices);
+                _mm_storeu_si128(dst+0,_mm_unpacklo_epi64(tl_bl,tex_tl_bl));
+                _mm_storeu_si128(dst+1,_mm_unpackhi_epi64(tl_bl,tex_tl_bl));
+                _mm_storeu_si128(dst+2,_mm_unpacklo_epi64(br_tr,tex_br_tr));
+                _mm_storeu_si128(dst+3,_mm_unpackhi_epi64(br_tr,tex_br_tr));
+#else
+                // Same operations as the SSE2 version so
+                // the results are identical
+                float const x = glyph.x0+offset_x;
+                float const y = glyph.y1+offset_y;
+
+                float const left = x + (-float(glyph.sdf_x))*glyph.scale;
+                float const top = y + float(glyph.sdf_y)*glyph.scale;
+                float const right = x + (float(glyph.tex_width)-glyph.sdf_x)*glyph.scale;
+                float const bottom = y + (float(glyph.sdf_y)-glyph.tex_height)*glyph.scale;
+
+                u16 const channel = glyph.channel;
+
+                list_vertices[0] = TextVertex{left,top,u16(s0),u16(t0),channel,0};
+                list_vertices[1] = TextVertex{left,bottom,u16(s0),u16(t1),channel,0};
+                list_vertices[2] = TextVertex{right,bottom,u16(s1),u16(t1),channel,0};
+                list_vertices[3] = TextVertex{right,top,u16(s1),u16(t0),channel,0};
+#endif
+            }
+
+            template<typename Index>
+            void WriteIndices(uint quad_count, Index * list_indices)
+            {
+                for(uint i=0; i < quad_count; i++)
+                {
+                    Index const vx = i*4;
+                    list_indices[0] = vx;
+                    list_indices[1] = vx+1;
+                    list_indices[2] = vx+2;
+                    list_indices[3] = vx;
+                    list_indices[4] = vx+2;
+                    list_indices[5] = vx+3;
+                    list_indices += 6;
+                }
+            }
+        }
+
+        // =========================================================== //
+
+        uint GetQuadCount(std::vector<Line> const &list_lines)
+        {
+            uint count = 0;
+            for(auto const &line : list_lines)
+            {
+                for(auto const &glyph : line.list_glyphs)
+                {
+                    count += HasQuad(glyph) ? 1 : 0;
+                }
+            }
+
+            return count;
+        }
+
+        sint GetAlignmentOffset(Line const &line,
+                                TextManager::Alignment alignment,
+                                sint width)
+        {
+            auto const &list_spans = line.list_cluster_spans;
+            if(list_spans.empty())
+            {
+                return 0;
+            }
+
+            // Spans are in visual order
+            sint const x_start = list_spans.front().x0;
+            sint const x_end = list_spans.back().x1;
+
+            if(alignment == TextManager::Alignment::Right)
+            {
+                return (width-x_end);
+            }
+
+            if(alignment == TextManager::Alignment::Center)
+            {
+                return ((width-(x_end-x_start))/2 - x_start);
+            }
+
+            return -x_start;
+        }
+
+        void WriteVertices(std::vector<Line> const &list_lines,
+                           TextManager::Alignment alignment,
+                           sint width,
+                           TextVertex * list_vertices,
+                           std::vector<TextDrawBatch> &list_batches)
+        {
+            WriteQuads(list_lines,
+                       alignment,
+                       width,
+                       list_batches,
+                       [list_vertices](Glyph const &glyph,
+                                       float offset_x,
+                                       float offset_y,
+                                       uint quad) {
+                           WriteQuadVertices(glyph,
+                                             offset_x,
+                                             offset_y,
+                                             list_vertices+quad*4);
+                       });
+        }
+
+        void WriteInstances(std::vector<Line> const &list_lines,
+                            TextManager::Alignment alignment,
+                            sint width,
+                            GlyphInstance * list_instances,
+                            std::vector<TextDrawBatch> &list_batches)
+        {
+            WriteQuads(list_lines,
+                       alignment,
+                       width,
+                       list_batches,
+                       [list_instances](Glyph const &glyph,
+                                        float offset_x,
+                                        float offset_y,
+                                        uint quad) {
+                           GlyphInstance &instance = list_instances[quad];
+                           instance.x = (glyph.x0+offset_x) + (-float(glyph.sdf_x))*glyph.scale;
+                           instance.y = (glyph.y1+offset_y) + float(glyph.sdf_y)*glyph.scale;
+                           instance.tex_x = glyph.tex_x;
+                           instance.tex_y = glyph.tex_y;
+                           instance.tex_width =
+                                   (glyph.tex_width & kGlyphInstanceWidthMask) |
+                                   (glyph.channel << kGlyphInstanceChannelShift);
+                           instance.tex_height = glyph.tex_height;
+                       });
+        }
+
+        void WriteQuadIndices(uint quad_count, u16 * list_indices)
+        {
+            WriteIndices(quad_count,list_indices);
+        }
+
+        void WriteQuadIndices(uint quad_count, u32 * list_indices)
+        {
+            WriteIndices(quad_count,list_indices);
+        }
+
+        // =========================================================== //
+    }
+}
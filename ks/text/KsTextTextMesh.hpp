@@ -0,0 +1,143 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_TEXT_TEXT_MESH_HPP
+#define KS_TEXT_TEXT_MESH_HPP
+
+#include <ks/text/KsTextDataTypes.hpp>
+#include <ks/text/KsTextTextManager.hpp>
+
+namespace ks
+{
+    namespace text
+    {
+        // Draw buffers for lines returned by TextManager::GetGlyphs
+        // * Every glyph with an image (Glyph::tex_width > 0) is a
+        //   quad, written either as four TextVertex or as one
+        //   GlyphInstance to memory provided by the caller (ie. a
+        //   mapped vertex buffer)
+        // * Quads are grouped into TextDrawBatches; the quads in
+        //   a batch are contiguous and can be drawn with one call
+        // * Positions are in layout pixels with the baseline of
+        //   the first line at y=0 (y increases going up); each
+        //   line is moved to its baseline and aligned
+        // * Texture coordinates are in atlas pixels, so shaders
+        //   divide them by the atlas size
+
+        // =========================================================== //
+
+        // TextVertex (16 bytes)
+        // * Quads are written as top left, bottom left, bottom
+        //   right and top right (counter-clockwise)
+        struct TextVertex
+        {
+            float x;
+            float y;
+
+            u16 tex_x;
+            u16 tex_y;
+
+            // channel of the atlas with the glyph's image
+            // (see Glyph::channel)
+            u16 channel;
+            u16 padding;
+        };
+
+        // GlyphInstance (16 bytes)
+        // * A glyph for instanced drawing; the vertex shader
+        //   expands it to a quad with the top left corner at
+        //   (x,y) that's the image size times the batch's scale
+        struct GlyphInstance
+        {
+            // top left corner of the quad
+            float x;
+            float y;
+
+            // top left corner of the image in its atlas
+            u16 tex_x;
+            u16 tex_y;
+
+            // * size of the image in its atlas
+            // * the top two bits of tex_width are the atlas
+            //   channel (see kGlyphInstanceChannelShift)
+            u16 tex_width;
+            u16 tex_height;
+        };
+
+        uint const kGlyphInstanceChannelShift = 14;
+        u16 const kGlyphInstanceWidthMask = 0x3FFF;
+
+        struct TextDrawBatch
+        {
+            uint atlas;
+
+            // * Batches are also split by image type and scale
+            //   since they change the shader or its uniforms
+            GlyphImageType image_type;
+            float scale;
+
+            // * The batch's quads are [first,first+count); that's
+            //   vertices [first*4,(first+count)*4), indices
+            //   [first*6,(first+count)*6) or instances
+            //   [first,first+count)
+            uint first;
+            uint count;
+        };
+
+        // =========================================================== //
+
+        // * Returns the number of quads in @list_lines
+        uint GetQuadCount(std::vector<Line> const &list_lines);
+
+        // * Returns the x offset that aligns @line within
+        //   [0,@width] using the pen extents of its clusters
+        // * Glyph positions (and the positions used by the
+        //   KsTextTextLayout queries) don't include this offset
+        sint GetAlignmentOffset(Line const &line,
+                                TextManager::Alignment alignment,
+                                sint width);
+
+        // * Writes GetQuadCount(@list_lines)*4 vertices to
+        //   @list_vertices sorted by batch, and replaces the
+        //   contents of @list_batches
+        void WriteVertices(std::vector<Line> const &list_lines,
+                           TextManager::Alignment alignment,
+                           sint width,
+                           TextVertex * list_vertices,
+                           std::vector<TextDrawBatch> &list_batches);
+
+        // * Writes GetQuadCount(@list_lines) instances to
+        //   @list_instances sorted by batch, and replaces the
+        //   contents of @list_batches
+        void WriteInstances(std::vector<Line> const &list_lines,
+                            TextManager::Alignment alignment,
+                            sint width,
+                            GlyphInstance * list_instances,
+                            std::vector<TextDrawBatch> &list_batches);
+
+        // * Writes @quad_count*6 indices for two triangles
+        //   per quad of vertices written by WriteVertices
+        // * The indices only depend on the number of quads,
+        //   so one index buffer can be shared by all text
+        // * 16-bit indices can address up to 16384 quads
+        void WriteQuadIndices(uint quad_count, u16 * list_indices);
+        void WriteQuadIndices(uint quad_count, u32 * list_indices);
+
+        // =========================================================== //
+    }
+}
+
+#endif // KS_TEXT_TEXT_MESH_HPP
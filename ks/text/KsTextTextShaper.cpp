@@ -16,19 +16,28 @@
 
 #include <sstream>
 #include <algorithm>
+#include <cstring>
+#include <limits>
 
-#include <icu/common/unicode/unistr.h>
+#ifndef KS_TEXT_NO_ICU
 #include <icu/common/unicode/ubidi.h>
 #include <icu/common/unicode/uscript.h>
-#include <icu/common/unicode/schriter.h>
 #include <icu/extra/scrptrun.h>
+#endif
 
 #include <unibreak/linebreak.h>
 
+#include <harfbuzz/hb-ot.h>
+
 #include <ks/KsLog.hpp>
 #include <ks/text/KsTextTextShaper.hpp>
-#include <ks/text/KsTextFreeType.hpp>
+#include <ks/text/KsTextFreeTypeMemory.hpp>
 #include <ks/text/KsTextFont.hpp>
+#include <ks/text/KsTextUnicode.hpp>
+
+#include FT_ADVANCES_H
+#include FT_TRUETYPE_TABLES_H
+#include FT_TRUETYPE_TAGS_H
 
 namespace ks
 {
@@ -132,7 +141,7 @@ namespace ks
             //   data required for shaping a single text string
             struct ParagraphDesc
             {
-                icu::UnicodeString utf16text;
+                std::u16string utf16text;
 
                 // The number of UTF-16 code units. Each code point
                 // is encoded with either one or two 16-bit code units
@@ -221,9 +230,8 @@ namespace ks
                              Hint const &text_hint,
                              ParagraphDesc &para)
             {
-                // StringCharacterIterator iterates through the
-                // string by codepoint not code units
-                icu::StringCharacterIterator utf16_cp_it(para.utf16text);
+                char16_t const * utf16buff = para.utf16text.data();
+                uint const length = para.num_codeunits;
 
                 // Get the font index for each glyph
                 std::vector<uint> list_glyph_fonts;
@@ -234,22 +242,10 @@ namespace ks
                     // If the FontSearch mode is Explicit, we only search
                     // the specified font and set a missing glyph if no
                     // corresponding character exists
-                    sint prev_index = -1;
-                    while(utf16_cp_it.hasNext())
-                    {
-                        sint curr_index = utf16_cp_it.getIndex();
-                        sint codepoint_sz = curr_index-prev_index;
-                        prev_index = curr_index;
-
-                        // Need this to increment
-                        u32 const codepoint = utf16_cp_it.next32PostInc();
-                        (void)codepoint;
-
-                        list_glyph_fonts.insert(
-                                    list_glyph_fonts.end(),
-                                    codepoint_sz,
-                                    text_hint.list_prio_fonts[0]);
-                    }
+                    list_glyph_fonts.insert(
+                                list_glyph_fonts.end(),
+                                length,
+                                text_hint.list_prio_fonts[0]);
                 }
                 else
                 {
@@ -259,14 +255,13 @@ namespace ks
 
                     // If the FontSearch mode is Fallback, we search through
                     // all fonts to find a match for each glyph
-                    sint prev_index = -1;
-                    while(utf16_cp_it.hasNext())
+                    uint i=0;
+                    while(i < length)
                     {
-                        sint curr_index = utf16_cp_it.getIndex();
-                        sint codepoint_sz = curr_index-prev_index;
-                        prev_index = curr_index;
-
-                        u32 const unicode = utf16_cp_it.next32PostInc();
+                        // Each code point is one or two code units
+                        uint const prev_i = i;
+                        u32 const unicode = NextCodePoint(utf16buff,length,i);
+                        uint const codepoint_sz = i-prev_i;
 
                         FT_UInt glyph_index = 0;
 
@@ -367,6 +362,7 @@ namespace ks
 
             // =========================================================== //
 
+#ifndef KS_TEXT_NO_ICU
             hb_script_t IcuScriptToHB(UScriptCode script)
             {
                 if (script == USCRIPT_INVALID_CODE) {
@@ -388,10 +384,11 @@ namespace ks
                 // getScriptStart/End return indices for the utf16text,
                 // buffer so they represent code units
 
-                para.list_script_runs.reserve(para.utf16text.length());
+                para.list_script_runs.reserve(para.num_codeunits);
 
-                icu_extra::ScriptRun script_run(para.utf16text.getBuffer(),
-                                                para.utf16text.length());
+                icu_extra::ScriptRun script_run(
+                            reinterpret_cast<UChar const *>(para.utf16text.data()),
+                            para.num_codeunits);
 
                 while(script_run.next())
                 {
@@ -422,7 +419,7 @@ namespace ks
                     overall_dirn = (dirn_hint == HB_DIRECTION_LTR) ? 0 : 1;
                 }
 
-                s32 const length = para.utf16text.length();
+                s32 const length = para.num_codeunits;
                 UErrorCode error = U_ZERO_ERROR;
                 UBiDi * bidi = ubidi_openSized(length,  // max text length
                                                0,       // max num. of runs (0 == auto)
@@ -443,7 +440,7 @@ namespace ks
                 // divide the text into direction runs using
                 // the unicode bidi algorithm
                 ubidi_setPara(bidi,
-                              para.utf16text.getBuffer(),
+                              reinterpret_cast<UChar const *>(para.utf16text.data()),
                               length,
                               overall_dirn,
                               NULL,
@@ -491,6 +488,43 @@ namespace ks
                 ubidi_close(bidi);
             }
 
+#else
+            void ItemizeScript(ParagraphDesc &para)
+            {
+                auto const list_items =
+                        ItemizeScripts(para.utf16text.data(),
+                                       para.num_codeunits);
+
+                para.list_script_runs.reserve(list_items.size());
+                for(auto const &item : list_items)
+                {
+                    para.list_script_runs.push_back(
+                                ScriptLangRun(item.start,
+                                              item.end,
+                                              item.script));
+                }
+            }
+
+            // =========================================================== //
+
+            void ItemizeDirection(ParagraphDesc &para,
+                                  hb_direction_t const dirn_hint)
+            {
+                auto const list_items =
+                        ItemizeBidi(para.utf16text.data(),
+                                    para.num_codeunits,
+                                    dirn_hint);
+
+                para.list_dirn_runs.reserve(list_items.size());
+                for(auto const &item : list_items)
+                {
+                    para.list_dirn_runs.push_back(
+                                DirectionRun(item.start,
+                                             item.end,
+                                             item.dirn));
+                }
+            }
+#endif
             // =========================================================== //
 
             void MergeRuns(ParagraphDesc &para)
@@ -609,19 +643,504 @@ namespace ks
 
             // =========================================================== //
 
+            // Simple shaping
+            // * Runs in scripts that don't need any reordering or
+            //   contextual forms can be shaped directly from the
+            //   font's cmap, hmtx and kern tables when the font has
+            //   no GSUB or GPOS lookups for the script
+            // * This mirrors what HarfBuzz does for such runs (the
+            //   default shaper with hb_ft callbacks) so the results
+            //   are identical; anything that would take a different
+            //   path in HarfBuzz makes the run fall back to it
+
+            bool IsSimpleScript(hb_script_t script)
+            {
+                switch(script)
+                {
+                    case HB_SCRIPT_COMMON:
+                    case HB_SCRIPT_LATIN:
+                    case HB_SCRIPT_GREEK:
+                    case HB_SCRIPT_CYRILLIC:
+                    case HB_SCRIPT_HAN:
+                    case HB_SCRIPT_HIRAGANA:
+                    case HB_SCRIPT_KATAKANA:
+                    case HB_SCRIPT_BOPOMOFO:
+                        return true;
+                    default:
+                        return false;
+                }
+            }
+
+            // Same set of default ignorable codepoints that
+            // HarfBuzz hides or zeroes while shaping
+            bool IsDefaultIgnorable(u32 cp)
+            {
+                if(cp < 0x00AD) {
+                    return false;
+                }
+
+                return ((cp == 0x00AD) ||
+                        (cp == 0x034F) ||
+                        (cp == 0x061C) ||
+                        (cp >= 0x17B4 && cp <= 0x17B5) ||
+                        (cp >= 0x180B && cp <= 0x180E) ||
+                        (cp >= 0x200B && cp <= 0x200F) ||
+                        (cp >= 0x202A && cp <= 0x202E) ||
+                        (cp >= 0x2060 && cp <= 0x206F) ||
+                        (cp >= 0xFE00 && cp <= 0xFE0F) ||
+                        (cp == 0xFEFF) ||
+                        (cp >= 0xFFF0 && cp <= 0xFFF8) ||
+                        (cp >= 0x1BCA0 && cp <= 0x1BCA3) ||
+                        (cp >= 0x1D173 && cp <= 0x1D17A) ||
+                        (cp >= 0xE0000 && cp <= 0xE0FFF));
+            }
+
+            void LoadKernPairs(FT_Face ft_face,
+                               hb_font_t * hb_font,
+                               SimpleShapingTables &tables)
+            {
+                // Collect the pairs from the 'kern' subtables that
+                // FreeType uses (MS version 0, horizontal format 0).
+                // The values are taken from FT_Get_Kerning so they
+                // match what hb_ft returns exactly.
+                FT_ULong length = 0;
+                if(FT_Load_Sfnt_Table(ft_face,TTAG_kern,0,NULL,&length) ||
+                   (length < 4))
+                {
+                    // FreeType reports kerning but we can't read it
+                    tables.valid = false;
+                    return;
+                }
+
+                std::vector<u8> list_data(length);
+                if(FT_Load_Sfnt_Table(ft_face,TTAG_kern,0,
+                                      list_data.data(),&length))
+                {
+                    tables.valid = false;
+                    return;
+                }
+
+                auto read_u16 = [&list_data](size_t i) -> u32 {
+                    return ((u32(list_data[i]) << 8) | list_data[i+1]);
+                };
+
+                if(read_u16(0) != 0)
+                {
+                    tables.valid = false;
+                    return;
+                }
+
+                std::vector<u32> list_keys;
+                u32 const num_subtables = read_u16(2);
+                size_t offset = 4;
+
+                for(u32 i=0; i < num_subtables; i++)
+                {
+                    if(offset+6 > length)
+                    {
+                        break;
+                    }
+
+                    size_t const subtable_length = read_u16(offset+2);
+                    u32 const coverage = read_u16(offset+4);
+                    size_t const next_offset = offset+subtable_length;
+
+                    // The same check FreeType uses; horizontal
+                    // format 0 subtables with no flags other than
+                    // the override flag
+                    if(((coverage & ~8u) == 0x0001) &&
+                       (offset+14 <= length))
+                    {
+                        u32 const num_pairs = read_u16(offset+6);
+                        size_t pair_offset = offset+14;
+
+                        for(u32 j=0; j < num_pairs; j++)
+                        {
+                            if(pair_offset+6 > length)
+                            {
+                                break;
+                            }
+
+                            list_keys.push_back(
+                                        (read_u16(pair_offset) << 16) |
+                                        read_u16(pair_offset+2));
+
+                            pair_offset += 6;
+                        }
+                    }
+
+                    if(subtable_length == 0)
+                    {
+                        break;
+                    }
+                    offset = next_offset;
+                }
+
+                std::sort(list_keys.begin(),list_keys.end());
+                list_keys.erase(std::unique(list_keys.begin(),list_keys.end()),
+                                list_keys.end());
+
+                // hb_ft picks the kerning mode based on
+                // whether or not the hb_font has its ppem set
+                uint x_ppem,y_ppem;
+                hb_font_get_ppem(hb_font,&x_ppem,&y_ppem);
+
+                FT_Kerning_Mode const mode =
+                        (x_ppem) ? FT_KERNING_DEFAULT : FT_KERNING_UNFITTED;
+
+                tables.list_kern_pairs.reserve(list_keys.size());
+                for(u32 key : list_keys)
+                {
+                    FT_Vector kerning;
+                    if(FT_Get_Kerning(ft_face,key >> 16,key & 0xFFFF,
+                                      mode,&kerning) != 0)
+                    {
+                        continue;
+                    }
+
+                    if(kerning.x != 0)
+                    {
+                        tables.list_kern_pairs.emplace_back(
+                                    key,static_cast<s32>(kerning.x));
+                    }
+                }
+            }
+
+            SimpleShapingTables& GetSimpleShapingTables(Font &font)
+            {
+                if(font.simple_shaping_tables)
+                {
+                    return *(font.simple_shaping_tables);
+                }
+
+                font.simple_shaping_tables =
+                        make_unique<SimpleShapingTables>();
+
+                SimpleShapingTables &tables =
+                        *(font.simple_shaping_tables);
+
+                hb_face_t * hb_face = hb_font_get_face(font.hb_font);
+
+                tables.valid = true;
+                tables.has_glyph_classes =
+                        hb_ot_layout_has_glyph_classes(hb_face);
+
+                tables.fallback_kern =
+                        !hb_ot_layout_has_positioning(hb_face);
+
+                return tables;
+            }
+
+            void LoadAdvancesAndKerning(Font &font,
+                                        SimpleShapingTables &tables)
+            {
+                FT_Face ft_face = font.ft_face;
+
+                if(font.hb_ot_funcs)
+                {
+                    // The hb_font reads advances from hmtx, which
+                    // is cheap enough to do for every glyph
+                    tables.list_advances.resize(ft_face->num_glyphs);
+                    for(uint i=0; i < tables.list_advances.size(); i++)
+                    {
+                        tables.list_advances[i] =
+                                hb_font_get_glyph_h_advance(font.hb_font,i);
+                    }
+                }
+                else
+                {
+                    // Advances are calculated the same way as
+                    // hb_ft_get_glyph_h_advance
+                    std::vector<FT_Fixed> list_ft_advances(ft_face->num_glyphs);
+                    if(FT_Get_Advances(ft_face,0,ft_face->num_glyphs,
+                                       FT_LOAD_DEFAULT | FT_LOAD_NO_HINTING,
+                                       list_ft_advances.data()))
+                    {
+                        tables.valid = false;
+                        return;
+                    }
+
+                    tables.list_advances.reserve(list_ft_advances.size());
+                    for(FT_Fixed advance : list_ft_advances)
+                    {
+                        tables.list_advances.push_back(
+                                    static_cast<s32>((advance + (1<<9)) >> 10));
+                    }
+                }
+
+                if(tables.fallback_kern && FT_HAS_KERNING(ft_face))
+                {
+                    LoadKernPairs(ft_face,font.hb_font,tables);
+                }
+            }
+
+            bool IsSimpleShapingAllowed(Font const &font,
+                                        SimpleShapingTables &tables,
+                                        hb_script_t script)
+            {
+                for(auto const &script_check : tables.list_scripts)
+                {
+                    if(script_check.first == script)
+                    {
+                        return script_check.second;
+                    }
+                }
+
+                // Get the same plan hb_shape would use for the
+                // run and check that it doesn't have any lookups
+                hb_segment_properties_t props =
+                        HB_SEGMENT_PROPERTIES_DEFAULT;
+
+                props.direction = HB_DIRECTION_LTR;
+                props.script = script;
+
+                hb_face_t * hb_face = hb_font_get_face(font.hb_font);
+                hb_shape_plan_t * hb_plan =
+                        hb_shape_plan_create_cached(
+                            hb_face,&props,NULL,0,NULL);
+
+                hb_set_t * hb_gsub_lookups = hb_set_create();
+                hb_set_t * hb_gpos_lookups = hb_set_create();
+
+                hb_ot_shape_plan_collect_lookups(
+                            hb_plan,HB_OT_TAG_GSUB,hb_gsub_lookups);
+
+                hb_ot_shape_plan_collect_lookups(
+                            hb_plan,HB_OT_TAG_GPOS,hb_gpos_lookups);
+
+                bool const allowed =
+                        hb_set_is_empty(hb_gsub_lookups) &&
+                        hb_set_is_empty(hb_gpos_lookups);
+
+                hb_set_destroy(hb_gsub_lookups);
+                hb_set_destroy(hb_gpos_lookups);
+                hb_shape_plan_destroy(hb_plan);
+
+                tables.list_scripts.emplace_back(script,allowed);
+
+                return allowed;
+            }
+
+            u32 GetGlyphIndex(Font const &font,
+                              SimpleShapingTables &tables,
+                              u32 cp)
+            {
+                auto &list_pages = tables.list_cmap_pages;
+
+                u32 const page = cp >> 8;
+                if(page >= list_pages.size())
+                {
+                    list_pages.resize(page+1);
+                }
+
+                if(!list_pages[page])
+                {
+                    list_pages[page] = make_unique<std::vector<u32>>(
+                                256,std::numeric_limits<u32>::max());
+                }
+
+                u32 &glyph = (*list_pages[page])[cp & 0xFF];
+                if(glyph == std::numeric_limits<u32>::max())
+                {
+                    // Same lookup as the hb_font's get_glyph func
+                    if(font.hb_ot_funcs)
+                    {
+                        hb_codepoint_t hb_glyph = 0;
+                        hb_font_get_glyph(font.hb_font,cp,0,&hb_glyph);
+                        glyph = hb_glyph;
+                    }
+                    else
+                    {
+                        glyph = FT_Get_Char_Index(font.ft_face,cp);
+                    }
+                }
+
+                return glyph;
+            }
+
+            s32 GetKerning(SimpleShapingTables const &tables,
+                           u32 left_glyph,
+                           u32 right_glyph)
+            {
+                u32 const key = (left_glyph << 16) | right_glyph;
+
+                auto it = std::lower_bound(
+                            tables.list_kern_pairs.begin(),
+                            tables.list_kern_pairs.end(),
+                            key,
+                            [](std::pair<u32,s32> const &pair, u32 key) {
+                                return (pair.first < key);
+                            });
+
+                if((it == tables.list_kern_pairs.end()) ||
+                   (it->first != key))
+                {
+                    return 0;
+                }
+
+                return it->second;
+            }
+
+            // * Shapes the code units [@start,@end) of @run using
+            //   the simple shaping tables for its font
+            // * Returns false without shaping anything if the run
+            //   needs to be shaped by HarfBuzz instead
+            bool ShapeRunSimple(Font &font,
+                                TextRun const &run,
+                                char16_t const * utf16buff,
+                                u32 const start,
+                                u32 const end,
+                                std::vector<hb_glyph_info_t> &list_glyph_info,
+                                std::vector<hb_glyph_position_t> &list_glyph_pos)
+            {
+                list_glyph_info.clear();
+                list_glyph_pos.clear();
+
+                if((run.dirn != HB_DIRECTION_LTR) ||
+                   !IsSimpleScript(run.script))
+                {
+                    return false;
+                }
+
+                SimpleShapingTables &tables = GetSimpleShapingTables(font);
+
+                if(!tables.valid ||
+                   !IsSimpleShapingAllowed(font,tables,run.script))
+                {
+                    return false;
+                }
+
+                // Only load metrics for fonts that are used
+                // with simple shaping
+                if(tables.list_advances.empty())
+                {
+                    LoadAdvancesAndKerning(font,tables);
+                    if(!tables.valid)
+                    {
+                        return false;
+                    }
+                }
+
+                hb_unicode_funcs_t * hb_ufuncs =
+                        hb_unicode_funcs_get_default();
+
+                hb_face_t * hb_face = hb_font_get_face(font.hb_font);
+
+                for(u32 i=start; i < end; i++)
+                {
+                    u32 const cluster = i;
+                    u32 cp = utf16buff[i];
+
+                    if(IsSurrogate(cp))
+                    {
+                        // HarfBuzz replaces unpaired surrogates
+                        if(!IsLeadSurrogate(cp) || (i+1 == end) ||
+                           !IsTrailSurrogate(utf16buff[i+1]))
+                        {
+                            return false;
+                        }
+
+                        cp = GetSupplementary(cp,utf16buff[i+1]);
+                        i++;
+                    }
+
+                    if(IsDefaultIgnorable(cp))
+                    {
+                        return false;
+                    }
+
+                    hb_unicode_general_category_t const category =
+                            hb_unicode_general_category(hb_ufuncs,cp);
+
+                    // Marks and format characters may be decomposed,
+                    // composed, reordered or merged into clusters
+                    if((category == HB_UNICODE_GENERAL_CATEGORY_SPACING_MARK) ||
+                       (category == HB_UNICODE_GENERAL_CATEGORY_ENCLOSING_MARK) ||
+                       (category == HB_UNICODE_GENERAL_CATEGORY_NON_SPACING_MARK) ||
+                       (category == HB_UNICODE_GENERAL_CATEGORY_FORMAT))
+                    {
+                        return false;
+                    }
+
+                    u32 const glyph = GetGlyphIndex(font,tables,cp);
+
+                    // Missing glyphs may be replaced with a
+                    // decomposition or another character
+                    if((glyph == 0) &&
+                       (category != HB_UNICODE_GENERAL_CATEGORY_CONTROL))
+                    {
+                        return false;
+                    }
+
+                    if(glyph >= tables.list_advances.size())
+                    {
+                        return false;
+                    }
+
+                    // HarfBuzz zeroes the advance of glyphs that
+                    // GDEF marks and skips them when kerning
+                    if(tables.has_glyph_classes &&
+                       (hb_ot_layout_get_glyph_class(hb_face,glyph) ==
+                        HB_OT_LAYOUT_GLYPH_CLASS_MARK))
+                    {
+                        return false;
+                    }
+
+                    hb_glyph_info_t glyph_info;
+                    memset(&glyph_info,0,sizeof(hb_glyph_info_t));
+                    glyph_info.codepoint = glyph;
+                    glyph_info.cluster = cluster;
+
+                    hb_glyph_position_t glyph_pos;
+                    memset(&glyph_pos,0,sizeof(hb_glyph_position_t));
+                    glyph_pos.x_advance = tables.list_advances[glyph];
+
+                    list_glyph_info.push_back(glyph_info);
+                    list_glyph_pos.push_back(glyph_pos);
+                }
+
+                // Apply kerning the same way as HarfBuzz's fallback
+                // kerning; the value is split between both glyphs
+                if(tables.fallback_kern && !tables.list_kern_pairs.empty())
+                {
+                    for(uint i=1; i < list_glyph_info.size(); i++)
+                    {
+                        s32 const kerning =
+                                GetKerning(tables,
+                                           list_glyph_info[i-1].codepoint,
+                                           list_glyph_info[i].codepoint);
+
+                        if(kerning != 0)
+                        {
+                            s32 const kern1 = kerning >> 1;
+                            s32 const kern2 = kerning - kern1;
+                            list_glyph_pos[i-1].x_advance += kern1;
+                            list_glyph_pos[i].x_advance += kern2;
+                            list_glyph_pos[i].x_offset += kern2;
+                        }
+                    }
+                }
+
+                return true;
+            }
+
+            // =========================================================== //
+
             void ShapeLine(std::vector<unique_ptr<Font>> const &list_fonts,
                            Hint const &text_hint,
                            ParagraphDesc &para,
                            u32 const line_idx)
             {
-                (void)text_hint;
-
                 hb_buffer_t * hb_buff = hb_buffer_create();
                 ShapedLine &line = (*(para.list_lines))[line_idx];
                 line.list_glyph_info.clear();
                 line.list_glyph_offsets.clear();
 
-                auto const utf16buff = para.utf16text.getBuffer();
+                auto const utf16buff = para.utf16text.data();
+
+                // output for runs shaped without HarfBuzz
+                std::vector<hb_glyph_info_t> list_simple_glyph_info;
+                std::vector<hb_glyph_position_t> list_simple_glyph_pos;
 
                 // direction mapper
                 std::array<u8,10> lkup_hb_direction{
@@ -644,29 +1163,58 @@ namespace ks
                     u32 start_idx  = std::max(line.start,run_it->start);
                     u32 end_idx    = std::min(line.end,run_it->end);
 
-                    // prepare harfbuzz
-                    hb_buffer_clear_contents(hb_buff);
-                    hb_buffer_set_script(hb_buff,run_it->script);
-                    hb_buffer_set_direction(hb_buff,run_it->dirn);
-
-                    hb_buffer_add_utf16(hb_buff,
-                                        para.utf16text.getBuffer(),
-                                        para.utf16text.length(),
-                                        start_idx,
-                                        end_idx - start_idx);
-
-                    // shape!
-                    hb_shape(list_fonts[run_it->font]->hb_font,
-                             hb_buff,NULL,0);
-
-                    uint const glyph_count =
-                            hb_buffer_get_length(hb_buff);
-
-                    hb_glyph_info_t * hb_list_glyph_info =
-                            hb_buffer_get_glyph_infos(hb_buff,NULL);
-
-                    hb_glyph_position_t * hb_list_glyph_pos =
-                            hb_buffer_get_glyph_positions(hb_buff,NULL);
+                    uint glyph_count;
+                    hb_glyph_info_t * hb_list_glyph_info;
+                    hb_glyph_position_t * hb_list_glyph_pos;
+
+                    // Try shaping the run without HarfBuzz first
+                    bool const shaped_simple =
+                            text_hint.simple_shaping &&
+                            ShapeRunSimple(*(list_fonts[run_it->font]),
+                                           *run_it,
+                                           utf16buff,
+                                           start_idx,
+                                           end_idx,
+                                           list_simple_glyph_info,
+                                           list_simple_glyph_pos);
+
+                    if(shaped_simple)
+                    {
+                        glyph_count = list_simple_glyph_info.size();
+                        hb_list_glyph_info = list_simple_glyph_info.data();
+                        hb_list_glyph_pos = list_simple_glyph_pos.data();
+                    }
+                    else
+                    {
+                        // prepare harfbuzz
+                        hb_buffer_clear_contents(hb_buff);
+                        hb_buffer_set_script(hb_buff,run_it->script);
+                        hb_buffer_set_direction(hb_buff,run_it->dirn);
+
+                        hb_buffer_add_utf16(hb_buff,
+                                            reinterpret_cast<uint16_t const *>(
+                                                para.utf16text.data()),
+                                            para.num_codeunits,
+                                            start_idx,
+                                            end_idx - start_idx);
+
+                        // shape! (FreeType loads glyphs for their
+                        // advances, which are counted for the font)
+                        FreeTypeMemory::Scope ft_scope(
+                                    list_fonts[run_it->font]->ft_face,
+                                    run_it->font);
+
+                        hb_shape(list_fonts[run_it->font]->hb_font,
+                                 hb_buff,NULL,0);
+
+                        glyph_count = hb_buffer_get_length(hb_buff);
+
+                        hb_list_glyph_info =
+                                hb_buffer_get_glyph_infos(hb_buff,NULL);
+
+                        hb_list_glyph_pos =
+                                hb_buffer_get_glyph_positions(hb_buff,NULL);
+                    }
 
                     line.list_glyph_info.reserve(glyph_count);
                     line.list_glyph_offsets.reserve(glyph_count);
@@ -727,6 +1275,195 @@ namespace ks
 
             // =========================================================== //
 
+            void ShapeElideGlyphs(Font &font)
+            {
+                // Shape '...' directly with this font; there's no
+                // need to itemize such a simple string
+                hb_buffer_t * hb_buff = hb_buffer_create();
+                hb_buffer_set_script(hb_buff,HB_SCRIPT_LATIN);
+                hb_buffer_set_direction(hb_buff,HB_DIRECTION_LTR);
+                hb_buffer_add_utf8(hb_buff,"...",-1,0,-1);
+
+                hb_shape(font.hb_font,hb_buff,NULL,0);
+
+                uint const glyph_count =
+                        hb_buffer_get_length(hb_buff);
+
+                hb_glyph_info_t * hb_list_glyph_info =
+                        hb_buffer_get_glyph_infos(hb_buff,NULL);
+
+                hb_glyph_position_t * hb_list_glyph_pos =
+                        hb_buffer_get_glyph_positions(hb_buff,NULL);
+
+                font.list_elide_glyph_info.clear();
+                font.list_elide_glyph_offsets.clear();
+                font.elide_advance = 0;
+
+                for(uint i=0; i < glyph_count; i++)
+                {
+                    GlyphInfo glyph_info;
+                    glyph_info.index = hb_list_glyph_info[i].codepoint;
+                    glyph_info.cluster = 0; // set when the glyphs are used
+                    glyph_info.font = 0;    // ...
+                    glyph_info.zero_width = false;
+                    glyph_info.rtl = false;
+
+                    GlyphOffset glyph_offset;
+                    glyph_offset.advance_x = hb_list_glyph_pos[i].x_advance/64;
+                    glyph_offset.advance_y = hb_list_glyph_pos[i].y_advance/64;
+                    glyph_offset.offset_x  = hb_list_glyph_pos[i].x_offset/64;
+                    glyph_offset.offset_y  = hb_list_glyph_pos[i].y_offset/64;
+
+                    font.list_elide_glyph_info.push_back(glyph_info);
+                    font.list_elide_glyph_offsets.push_back(glyph_offset);
+                    font.elide_advance += glyph_offset.advance_x;
+                }
+
+                hb_buffer_destroy(hb_buff);
+
+                font.elide_shaped = true;
+            }
+
+            // =========================================================== //
+
+            void ElideLine(std::vector<unique_ptr<Font>> const &list_fonts,
+                           Hint const &text_hint,
+                           ShapedLine &line,
+                           bool const force)
+            {
+                // Elides @line so that it and the trailing '...'
+                // fit within @max_line_width_px. If @force is set,
+                // the '...' is added even if the line already fits
+                // (ie. when there are more lines that aren't shown)
+                auto& list_glyph_info = line.list_glyph_info;
+                auto& list_glyph_offsets = line.list_glyph_offsets;
+
+                if(force)
+                {
+                    // Don't keep any trailing line break characters
+                    while(!list_glyph_info.empty() &&
+                          list_glyph_info.back().zero_width)
+                    {
+                        line.end = std::max(
+                                    line.start,
+                                    std::min(line.end,
+                                             list_glyph_info.back().cluster));
+
+                        list_glyph_info.pop_back();
+                        list_glyph_offsets.pop_back();
+                    }
+                }
+
+                s64 combined_adv=0;
+                for(auto const &glyph_offset : list_glyph_offsets)
+                {
+                    combined_adv += glyph_offset.advance_x;
+                }
+
+                s64 const max_width = text_hint.max_line_width_px;
+
+                if(!force && (combined_adv <= max_width))
+                {
+                    return;
+                }
+
+                // The '...' uses the font of the glyph at the end
+                // of the line (or the first hinted font if there's
+                // nothing left on the line)
+                uint elide_font;
+                if(!list_glyph_info.empty())
+                {
+                    elide_font = list_glyph_info.back().font;
+                }
+                else if(!text_hint.list_prio_fonts.empty())
+                {
+                    elide_font = text_hint.list_prio_fonts[0];
+                }
+                else
+                {
+                    elide_font = text_hint.list_fallback_fonts[0];
+                }
+
+                Font &font = *(list_fonts[elide_font]);
+                if(!font.elide_shaped)
+                {
+                    ShapeElideGlyphs(font);
+                }
+
+                // Scan backwards from the end of the line until
+                // there's enough space to add the '...'. We only cut
+                // at cluster boundaries so clusters aren't split
+                s64 const elide_space = font.elide_advance;
+                sint cut = list_glyph_info.size();
+
+                while(cut > 0)
+                {
+                    if(combined_adv + elide_space <= max_width)
+                    {
+                        bool const cluster_boundary =
+                                (cut == sint(list_glyph_info.size())) ||
+                                (list_glyph_info[cut-1].cluster !=
+                                 list_glyph_info[cut].cluster);
+
+                        if(cluster_boundary)
+                        {
+                            break;
+                        }
+                    }
+
+                    cut--;
+                    combined_adv -= list_glyph_offsets[cut].advance_x;
+                }
+
+                if(combined_adv + elide_space > max_width)
+                {
+                    // Remove all glyphs as there isn't any space
+                    // to show anything
+                    line.start = 0;
+                    line.end = 0;
+
+                    list_glyph_info.clear();
+                    list_glyph_offsets.clear();
+                    return;
+                }
+
+                // Set the new line ending to the first
+                // character that was removed
+                if(cut < sint(list_glyph_info.size()))
+                {
+                    uint end = line.end;
+                    for(uint i=cut; i < list_glyph_info.size(); i++)
+                    {
+                        end = std::min(end,list_glyph_info[i].cluster);
+                    }
+
+                    line.end = std::max(line.start,end);
+
+                    list_glyph_info.erase(
+                                std::next(list_glyph_info.begin(),cut),
+                                list_glyph_info.end());
+
+                    list_glyph_offsets.erase(
+                                std::next(list_glyph_offsets.begin(),cut),
+                                list_glyph_offsets.end());
+                }
+
+                // Add the '...' glyphs
+                for(auto glyph_info : font.list_elide_glyph_info)
+                {
+                    glyph_info.font = elide_font;
+                    glyph_info.cluster = line.end;
+                    list_glyph_info.push_back(glyph_info);
+                }
+
+                list_glyph_offsets.insert(
+                            list_glyph_offsets.end(),
+                            font.list_elide_glyph_offsets.begin(),
+                            font.list_elide_glyph_offsets.end());
+            }
+
+            // =========================================================== //
+
             void FindLineBreaks(ParagraphDesc& para)
             {
                 static bool init_libunibreak = false;
@@ -743,7 +1480,7 @@ namespace ks
                 // use utf16 here as well.
                 utf16_t const * utf16text_data =
                         reinterpret_cast<utf16_t const *>(
-                            para.utf16text.getBuffer());
+                            para.utf16text.data());
 
                 char const * lang = ""; // default to no language
                 auto const num_cu = para.num_codeunits;
@@ -883,37 +1620,49 @@ namespace ks
 
         std::u16string ConvertStringUTF8ToUTF16(std::string const &utf8text)
         {
-            icu::UnicodeString icu_string = icu::UnicodeString::fromUTF8(utf8text);
-            return std::u16string(
-                        reinterpret_cast<const char16_t*>(icu_string.getBuffer()),
-                        icu_string.length());
+            std::u16string utf16text;
+            AppendUTF8AsUTF16(utf8text.data(),utf8text.size(),utf16text);
+
+            return utf16text;
         }
 
         std::string ConvertStringUTF16ToUTF8(std::u16string const &utf16text)
         {
-            UChar const * data = reinterpret_cast<UChar const *>(utf16text.data());
-            icu::UnicodeString icu_string = icu::UnicodeString(data,utf16text.size());
             std::string utf8text;
-            icu_string.toUTF8String(utf8text);
+            AppendUTF16AsUTF8(utf16text.data(),utf16text.size(),utf8text);
 
             return utf8text;
         }
 
         std::string ConvertStringUTF32ToUTF8(std::u32string const &utf32text)
         {
-            // This cast should be okay because the max unicode
-            // code point is 1,114,112, far below max<int32_t>
-            UChar32 const * data = reinterpret_cast<UChar32 const *>(utf32text.data());
-
-            icu::UnicodeString icu_string =
-                    icu::UnicodeString::fromUTF32(data,utf32text.size());
-
             std::string utf8text;
-            icu_string.toUTF8String(utf8text);
+            AppendUTF32AsUTF8(utf32text.data(),utf32text.size(),utf8text);
 
             return utf8text;
         }
 
+        void ConvertStringUTF8ToUTF16(std::string const &utf8text,
+                                      std::u16string &utf16text)
+        {
+            utf16text.clear();
+            AppendUTF8AsUTF16(utf8text.data(),utf8text.size(),utf16text);
+        }
+
+        void ConvertStringUTF16ToUTF8(std::u16string const &utf16text,
+                                      std::string &utf8text)
+        {
+            utf8text.clear();
+            AppendUTF16AsUTF8(utf16text.data(),utf16text.size(),utf8text);
+        }
+
+        void ConvertStringUTF32ToUTF8(std::u32string const &utf32text,
+                                      std::string &utf8text)
+        {
+            utf8text.clear();
+            AppendUTF32AsUTF8(utf32text.data(),utf32text.size(),utf8text);
+        }
+
         // =========================================================== //
 
         unique_ptr<std::vector<ShapedLine>>
@@ -921,15 +1670,11 @@ namespace ks
                   std::vector<unique_ptr<Font>> const &list_fonts,
                   Hint const &text_hint)
         {
-            icu::UnicodeString icu_string(
-                        true,
-                        reinterpret_cast<const UChar *>(utf16text.data()),
-                        utf16text.size());
-
             ParagraphDesc para;
-            para.utf16text.fastCopyFrom(icu_string);
-            para.num_codeunits = para.utf16text.length();
-            para.num_codepoints = para.utf16text.countChar32();
+            para.utf16text = utf16text;
+            para.num_codeunits = para.utf16text.size();
+            para.num_codepoints = CountCodePoints(para.utf16text.data(),
+                                                  para.num_codeunits);
             para.list_lines = make_unique<std::vector<ShapedLine>>();
 
 //            if(text_hint.direction != Hint::Direction::Multiple &&
@@ -957,107 +1702,17 @@ namespace ks
             // Shape the first line
             ShapeLine(list_fonts,text_hint,para,0);
 
-            if(text_hint.elide)
+            if(text_hint.elide && (text_hint.max_lines <= 1))
             {
-                // Check if we can return early
-                if(text_hint.max_line_width_px ==
+                // Single line elide; the text isn't broken
+                // into lines at all
+                if(text_hint.max_line_width_px !=
                         std::numeric_limits<uint>::max())
                 {
-                    return std::move(para.list_lines);
-                }
-
-                ShapedLine& line = para.list_lines->back();
-                uint combined_adv=0;
-
-                // For each glyph
-                for(uint i=0; i < line.list_glyph_info.size(); i++)
-                {
-                    combined_adv += line.list_glyph_offsets[i].advance_x;
-                    if(combined_adv >= text_hint.max_line_width_px)
-                    {
-                        // See how much space we need for the set
-                        // of elide characters '...'
-                        Hint elide_text_hint = text_hint;
-                        elide_text_hint.list_prio_fonts.clear();
-                        elide_text_hint.list_fallback_fonts.clear();
-                        elide_text_hint.list_prio_fonts.push_back(
-                                    line.list_glyph_info[i].font);
-
-                        elide_text_hint.font_search =
-                                Hint::FontSearch::Explicit;
-
-                        elide_text_hint.max_line_width_px =
-                                std::numeric_limits<uint>::max();
-
-                        elide_text_hint.elide = false;
-
-                        auto elide_list_lines_ptr =
-                                ShapeText(
-                                    ConvertStringUTF8ToUTF16("..."),
-                                    list_fonts,
-                                    elide_text_hint);
-
-                        uint elide_glyphs_adv=0;
-                        ShapedLine& elide_line = elide_list_lines_ptr->front();
-                        for(auto& elide_glyph : elide_line.list_glyph_offsets)
-                        {
-                            elide_glyphs_adv += elide_glyph.advance_x;
-                        }
-
-                        // Start removing glyphs until there's enough
-                        // space to add the '...'
-                        uint elide_space = elide_glyphs_adv; // times some k factor
-                        bool space_avail = false;
-
-                        for(sint j=i; j >= 0; j--)
-                        {
-                            combined_adv -= line.list_glyph_offsets[j].advance_x;
-                            if((text_hint.max_line_width_px - combined_adv) > elide_space)
-                            {
-                                space_avail = true;
-
-                                // Remove glyphs >= index j
-                                auto it_info_e0 = std::next(line.list_glyph_info.begin(),j);
-                                auto it_info_e1 = line.list_glyph_info.end();
-                                line.list_glyph_info.erase(it_info_e0,it_info_e1);
-
-                                auto it_offsets_e0 = std::next(line.list_glyph_offsets.begin(),j);
-                                auto it_offsets_e1 = line.list_glyph_offsets.end();
-                                line.list_glyph_offsets.erase(it_offsets_e0,it_offsets_e1);
-
-                                // Set new line ending
-                                line.end = line.list_glyph_info.back().cluster;
-
-                                break;
-                            }
-                        }
-
-                        if(!space_avail)
-                        {
-                            // Remove all glyphs as there isn't any space
-                            // to show anything
-                            line.start = 0;
-                            line.end = 0;
-
-                            line.list_glyph_info.clear();
-                            line.list_glyph_offsets.clear();
-                        }
-                        else
-                        {
-                            // Manually add the '...' glyphs
-                            line.list_glyph_info.insert(
-                                        line.list_glyph_info.end(),
-                                        elide_line.list_glyph_info.begin(),
-                                        elide_line.list_glyph_info.end());
-
-                            line.list_glyph_offsets.insert(
-                                        line.list_glyph_offsets.end(),
-                                        elide_line.list_glyph_offsets.begin(),
-                                        elide_line.list_glyph_offsets.end());
-                        }
-
-                        break;
-                    }
+                    ElideLine(list_fonts,
+                              text_hint,
+                              para.list_lines->back(),
+                              false);
                 }
             }
             else
@@ -1095,6 +1750,14 @@ namespace ks
 
                 for(uint i = 0; i < para.list_lines->size(); i++)
                 {
+                    // When eliding, there's no need to break any
+                    // lines past the last visible line
+                    if(text_hint.elide &&
+                       (para.list_lines->size() > text_hint.max_lines))
+                    {
+                        break;
+                    }
+
                     ShapedLine& line = para.list_lines->back();
 
                     uint combined_adv = 0;
@@ -1127,6 +1790,24 @@ namespace ks
                         }
                     }
                 }
+
+                if(text_hint.elide)
+                {
+                    // Elide the last visible line if there's more text
+                    // than lines available (or if it's too long)
+                    bool const more_lines =
+                            (para.list_lines->size() > text_hint.max_lines);
+
+                    if(more_lines)
+                    {
+                        para.list_lines->resize(text_hint.max_lines);
+                    }
+
+                    ElideLine(list_fonts,
+                              text_hint,
+                              para.list_lines->back(),
+                              more_lines);
+                }
             }
 
             if(para.list_dirn_runs[0].dirn == HB_DIRECTION_LTR)
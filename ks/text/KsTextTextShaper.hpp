@@ -74,9 +74,9 @@ namespace ks
         // * We don't use the stl because libstdc++ has a bug in
         //   codecvt_utf8_utf16 and it requires detecting endianness
         //   at compile time (?)
-        // * Since we use ICU to do script detection and bidi, we
-        //   may as well do the conversion with it too since this
-        //   way everything will match up
+        // * The conversion is done with KsTextUnicode, which handles
+        //   malformed input the same way ICU does so everything
+        //   matches up with script detection and bidi
         std::u16string ConvertStringUTF8ToUTF16(std::string const &utf8text);
 
         std::string ConvertStringUTF16ToUTF8(std::u16string const &utf16text);
@@ -84,6 +84,18 @@ namespace ks
         // * Helper function that converts a UTF32 string to UTF8
         std::string ConvertStringUTF32ToUTF8(std::u32string const &utf32text);
 
+        // * Same as above but the result is written to the second
+        //   argument, reusing its memory, so converting many strings
+        //   with the same output string doesn't allocate each time
+        void ConvertStringUTF8ToUTF16(std::string const &utf8text,
+                                      std::u16string &utf16text);
+
+        void ConvertStringUTF16ToUTF8(std::u16string const &utf16text,
+                                      std::string &utf8text);
+
+        void ConvertStringUTF32ToUTF8(std::u32string const &utf32text,
+                                      std::string &utf8text);
+
         // ShapeText
         // * This function shapes @utf16text and returns the
         //   result in a list of ShapedLines that can be used
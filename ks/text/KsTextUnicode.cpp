@@ -0,0 +1,2016 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define KS_TEXT_UNICODE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include <ks/text/KsTextUnicode.hpp>
+
+#include <harfbuzz/hb-ucdn/ucdn.h>
+
+namespace ks
+{
+    namespace text
+    {
+        namespace {
+
+            // =========================================================== //
+
+            // Transcoding helpers
+            // * Output is written straight into memory that's already
+            //   sized for the worst case, or into a buffer on the stack
+            // * Runs of ASCII are copied with SSE2 where it's
+            //   available and eight bytes at a time otherwise
+
+            u32 const kReplacementChar = 0xFFFD;
+
+            // Smallest value for each UTF-8 trail byte count
+            u32 const kUTF8MinValue[4] = { 0, 0x80, 0x800, 0x10000 };
+
+            // * Copies the ASCII characters at the start of @src to
+            //   @dst and returns the number of characters copied
+            std::size_t CopyASCIIAsUTF16(u8 const * src,
+                                         std::size_t const length,
+                                         char16_t * dst)
+            {
+                std::size_t i = 0;
+
+#ifdef KS_TEXT_UNICODE_SSE2
+                __m128i const zero = _mm_setzero_si128();
+                for(; i+16 <= length; i+=16)
+                {
+                    __m128i const v = _mm_loadu_si128(
+                                reinterpret_cast<__m128i const *>(src+i));
+
+                    if(_mm_movemask_epi8(v) != 0)
+                    {
+                        break;
+                    }
+
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst+i),
+                                     _mm_unpacklo_epi8(v,zero));
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst+i+8),
+                                     _mm_unpackhi_epi8(v,zero));
+                }
+#else
+                for(; i+8 <= length; i+=8)
+                {
+                    u64 word;
+                    std::memcpy(&word,src+i,8);
+                    if(word & 0x8080808080808080ull)
+                    {
+                        break;
+                    }
+
+                    for(uint j=0; j < 8; j++)
+                    {
+                        dst[i+j] = src[i+j];
+                    }
+                }
+#endif
+
+                for(; (i < length) && (src[i] < 0x80); i++)
+                {
+                    dst[i] = src[i];
+                }
+
+                return i;
+            }
+
+            // * Copies the ASCII characters at the start of @src to
+            //   @dst and returns the number of characters copied
+            std::size_t CopyASCIIAsUTF8(char16_t const * src,
+                                        std::size_t const length,
+                                        char * dst)
+            {
+                std::size_t i = 0;
+
+#ifdef KS_TEXT_UNICODE_SSE2
+                __m128i const non_ascii = _mm_set1_epi16(
+                            static_cast<short>(0xFF80));
+
+                for(; i+16 <= length; i+=16)
+                {
+                    __m128i const lo = _mm_loadu_si128(
+                                reinterpret_cast<__m128i const *>(src+i));
+                    __m128i const hi = _mm_loadu_si128(
+                                reinterpret_cast<__m128i const *>(src+i+8));
+
+                    __m128i const test = _mm_and_si128(
+                                _mm_or_si128(lo,hi),non_ascii);
+
+                    if(_mm_movemask_epi8(
+                           _mm_cmpeq_epi16(test,_mm_setzero_si128())) != 0xFFFF)
+                    {
+                        break;
+                    }
+
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst+i),
+                                     _mm_packus_epi16(lo,hi));
+                }
+#else
+                for(; i+4 <= length; i+=4)
+                {
+                    u64 word;
+                    std::memcpy(&word,src+i,8);
+                    if(word & 0xFF80FF80FF80FF80ull)
+                    {
+                        break;
+                    }
+
+                    for(uint j=0; j < 4; j++)
+                    {
+                        dst[i+j] = static_cast<char>(src[i+j]);
+                    }
+                }
+#endif
+
+                for(; (i < length) && (src[i] < 0x80); i++)
+                {
+                    dst[i] = static_cast<char>(src[i]);
+                }
+
+                return i;
+            }
+
+#ifdef KS_TEXT_UNICODE_SSE2
+            // * Decodes the 16 bytes at @src to @dst if they start
+            //   with five valid three byte sequences and returns the
+            //   number of bytes decoded (15); returns 0 otherwise
+            // * Two byte sequences are left to the scalar loop, which
+            //   is faster for them since they're usually mixed with
+            //   ASCII spaces and punctuation
+            std::size_t DecodeUTF8BlockAsUTF16(u8 const * src,
+                                               char16_t * &dst)
+            {
+                __m128i const v = _mm_loadu_si128(
+                            reinterpret_cast<__m128i const *>(src));
+
+                uint const trail_mask =
+                        _mm_movemask_epi8(
+                            _mm_cmpeq_epi8(
+                                _mm_and_si128(v,_mm_set1_epi8(char(0xC0))),
+                                _mm_set1_epi8(char(0x80))));
+
+                uint const lead3_mask =
+                        _mm_movemask_epi8(
+                            _mm_cmpeq_epi8(
+                                _mm_and_si128(v,_mm_set1_epi8(char(0xF0))),
+                                _mm_set1_epi8(char(0xE0))));
+
+                if(((lead3_mask & 0x7FFF) == 0x1249) &&
+                   ((trail_mask & 0x7FFF) == 0x6DB6))
+                {
+                    // Each lead byte and the two trail bytes after it
+                    __m128i const v1 = _mm_srli_si128(v,1);
+                    __m128i const v2 = _mm_srli_si128(v,2);
+
+                    // Rule out overlong forms (0xE0 followed by a trail
+                    // byte below 0xA0) and surrogates (0xED followed by
+                    // one from 0xA0); as signed bytes, trail bytes below
+                    // 0xA0 are below -96
+                    __m128i const low_trail1 =
+                            _mm_cmplt_epi8(v1,_mm_set1_epi8(-96));
+
+                    __m128i const invalid =
+                            _mm_or_si128(
+                                _mm_and_si128(
+                                    _mm_cmpeq_epi8(v,_mm_set1_epi8(char(0xE0))),
+                                    low_trail1),
+                                _mm_andnot_si128(
+                                    low_trail1,
+                                    _mm_cmpeq_epi8(v,_mm_set1_epi8(char(0xED)))));
+
+                    if(_mm_movemask_epi8(invalid) & 0x1249)
+                    {
+                        return 0;
+                    }
+
+                    // The high and low byte of the code point that
+                    // starts at each byte
+                    __m128i const hi =
+                            _mm_or_si128(
+                                _mm_slli_epi16(
+                                    _mm_and_si128(v,_mm_set1_epi8(0x0F)),4),
+                                _mm_and_si128(
+                                    _mm_srli_epi16(v1,2),_mm_set1_epi8(0x0F)));
+
+                    __m128i const lo =
+                            _mm_or_si128(
+                                _mm_slli_epi16(
+                                    _mm_and_si128(v1,_mm_set1_epi8(0x03)),6),
+                                _mm_and_si128(v2,_mm_set1_epi8(0x3F)));
+
+                    __m128i const cp_lo = _mm_unpacklo_epi8(lo,hi);
+                    __m128i const cp_hi = _mm_unpackhi_epi8(lo,hi);
+
+                    dst[0] = static_cast<char16_t>(_mm_extract_epi16(cp_lo,0));
+                    dst[1] = static_cast<char16_t>(_mm_extract_epi16(cp_lo,3));
+                    dst[2] = static_cast<char16_t>(_mm_extract_epi16(cp_lo,6));
+                    dst[3] = static_cast<char16_t>(_mm_extract_epi16(cp_hi,1));
+                    dst[4] = static_cast<char16_t>(_mm_extract_epi16(cp_hi,4));
+                    dst += 5;
+
+                    return 15;
+                }
+
+                return 0;
+            }
+#endif
+
+            // * Decodes the UTF-8 sequence that starts at @start,
+            //   which must not be ASCII, into @c and returns the
+            //   index of the next sequence
+            // * An invalid sequence and the trail bytes its lead byte
+            //   calls for (5 and 6 byte forms included) are decoded
+            //   as one U+FFFD, the same as ICU
+            std::size_t DecodeUTF8(u8 const * s,
+                                   std::size_t const length,
+                                   std::size_t const start,
+                                   u32 &c)
+            {
+                std::size_t i = start;
+                c = s[i++];
+
+                uint trail_count =
+                        (c < 0xC0) ? 0 :
+                        (c < 0xE0) ? 1 :
+                        (c < 0xF0) ? 2 :
+                        (c < 0xF8) ? 3 :
+                        (c < 0xFC) ? 4 :
+                        (c < 0xFE) ? 5 : 0;
+
+                if(i+trail_count <= length)
+                {
+                    if((trail_count > 0) && (trail_count < 4))
+                    {
+                        c &= ((1 << (6-trail_count))-1);
+
+                        bool valid = true;
+                        for(uint j=trail_count; j > 0; j--)
+                        {
+                            u8 const trail = s[i++]-0x80;
+                            c = (c << 6) | trail;
+
+                            // Rule out trail bytes outside [0x80,0xBF],
+                            // values above U+10FFFF and surrogates
+                            if((trail > 0x3F) ||
+                               ((j == 3) && (c >= 0x110)) ||
+                               ((j == 2) && ((c & 0xFFE0) == 0x360)))
+                            {
+                                valid = false;
+                                break;
+                            }
+                        }
+
+                        // Rule out overlong forms
+                        if(valid && (c >= kUTF8MinValue[trail_count]))
+                        {
+                            return i;
+                        }
+                    }
+                }
+                else
+                {
+                    trail_count = length-i;
+                }
+
+                i = start+1;
+                while((trail_count > 0) && (i < length) &&
+                      ((s[i] & 0xC0) == 0x80))
+                {
+                    i++;
+                    trail_count--;
+                }
+
+                c = kReplacementChar;
+                return i;
+            }
+
+            char16_t * WriteCodePointAsUTF16(u32 const c,
+                                             char16_t * dst)
+            {
+                if(c < 0x10000)
+                {
+                    *dst++ = static_cast<char16_t>(c);
+                }
+                else
+                {
+                    *dst++ = static_cast<char16_t>(0xD7C0 + (c >> 10));
+                    *dst++ = static_cast<char16_t>(0xDC00 | (c & 0x3FF));
+                }
+
+                return dst;
+            }
+
+            char * WriteCodePointAsUTF8(u32 const c,
+                                        char * dst)
+            {
+                if(c < 0x80)
+                {
+                    *dst++ = static_cast<char>(c);
+                }
+                else if(c < 0x800)
+                {
+                    *dst++ = static_cast<char>(0xC0 | (c >> 6));
+                    *dst++ = static_cast<char>(0x80 | (c & 0x3F));
+                }
+                else if(c < 0x10000)
+                {
+                    *dst++ = static_cast<char>(0xE0 | (c >> 12));
+                    *dst++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+                    *dst++ = static_cast<char>(0x80 | (c & 0x3F));
+                }
+                else
+                {
+                    *dst++ = static_cast<char>(0xF0 | (c >> 18));
+                    *dst++ = static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+                    *dst++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+                    *dst++ = static_cast<char>(0x80 | (c & 0x3F));
+                }
+
+                return dst;
+            }
+
+            // =========================================================== //
+
+            // Bidi helpers
+
+            // Bidi classes (UAX #44), same values as UCDN
+            enum BidiClass : u8
+            {
+                L   = UCDN_BIDI_CLASS_L,
+                LRE = UCDN_BIDI_CLASS_LRE,
+                LRO = UCDN_BIDI_CLASS_LRO,
+                R   = UCDN_BIDI_CLASS_R,
+                AL  = UCDN_BIDI_CLASS_AL,
+                RLE = UCDN_BIDI_CLASS_RLE,
+                RLO = UCDN_BIDI_CLASS_RLO,
+                PDF = UCDN_BIDI_CLASS_PDF,
+                EN  = UCDN_BIDI_CLASS_EN,
+                ES  = UCDN_BIDI_CLASS_ES,
+                ET  = UCDN_BIDI_CLASS_ET,
+                AN  = UCDN_BIDI_CLASS_AN,
+                CS  = UCDN_BIDI_CLASS_CS,
+                NSM = UCDN_BIDI_CLASS_NSM,
+                BN  = UCDN_BIDI_CLASS_BN,
+                B   = UCDN_BIDI_CLASS_B,
+                S   = UCDN_BIDI_CLASS_S,
+                WS  = UCDN_BIDI_CLASS_WS,
+                ON  = UCDN_BIDI_CLASS_ON,
+                LRI = UCDN_BIDI_CLASS_LRI,
+                RLI = UCDN_BIDI_CLASS_RLI,
+                FSI = UCDN_BIDI_CLASS_FSI,
+                PDI = UCDN_BIDI_CLASS_PDI,
+                NONE = 0xFF
+            };
+
+            // Max explicit embedding depth (BD2)
+            u8 const kMaxDepth = 125;
+
+            // Max number of bracket pairs tracked per
+            // isolating run sequence (BD16)
+            uint const kMaxBracketStack = 63;
+
+            inline u32 ClassMask(u8 cls)
+            {
+                return (1u << cls);
+            }
+
+            u32 const kMaskExplicit =
+                    ClassMask(LRE) | ClassMask(RLE) |
+                    ClassMask(LRO) | ClassMask(RLO) |
+                    ClassMask(PDF);
+
+            u32 const kMaskRemoved =
+                    kMaskExplicit | ClassMask(BN);
+
+            u32 const kMaskIsolateInitiator =
+                    ClassMask(LRI) | ClassMask(RLI) | ClassMask(FSI);
+
+            u32 const kMaskIsolate =
+                    kMaskIsolateInitiator | ClassMask(PDI);
+
+            u32 const kMaskSeparator =
+                    ClassMask(B) | ClassMask(S);
+
+            // Classes reset to the paragraph level by L1 when
+            // they're at the end of a line or before a separator
+            u32 const kMaskTrailing =
+                    kMaskSeparator | ClassMask(WS) |
+                    kMaskRemoved | kMaskIsolate;
+
+            // Neutral and isolate formatting classes (N1, N2)
+            u32 const kMaskNeutral =
+                    kMaskSeparator | ClassMask(WS) |
+                    ClassMask(ON) | kMaskIsolate;
+
+            inline bool IsClass(u8 cls, u32 mask)
+            {
+                return ((ClassMask(cls) & mask) != 0);
+            }
+
+            // Returns the strong direction of @cls for N0 to N2,
+            // where numbers are treated as R, or NONE
+            inline u8 GetStrongDirn(u8 cls)
+            {
+                if(cls == L) {
+                    return L;
+                }
+                if((cls == R) || (cls == AL) || (cls == EN) || (cls == AN)) {
+                    return R;
+                }
+                return NONE;
+            }
+
+            inline u8 GetDirnForLevel(u8 level)
+            {
+                return ((level & 1) ? R : L);
+            }
+
+            // * Returns L or R if text with the classes in @mask
+            //   is unidirectional and NONE if it's mixed
+            // * @mask should include the direction of each
+            //   paragraph level
+            // * Like ICU, text is unidirectional if it has no
+            //   characters of the opposite direction, even if
+            //   the rules would resolve some characters (like
+            //   those after an LRI) to a higher level
+            u8 GetDirnFromMask(u32 const mask)
+            {
+                u32 const mask_rtl =
+                        ClassMask(R) | ClassMask(AL) |
+                        ClassMask(RLE) | ClassMask(RLO) |
+                        ClassMask(RLI);
+
+                u32 const mask_ltr =
+                        ClassMask(L) | ClassMask(EN) |
+                        ClassMask(AN) | ClassMask(LRE) |
+                        ClassMask(LRO) | ClassMask(LRI);
+
+                // Neutrals next to AN may resolve to R
+                u32 const mask_possible_neutral =
+                        ClassMask(ON) | ClassMask(CS) |
+                        ClassMask(ES) | ClassMask(ET) |
+                        kMaskTrailing;
+
+                if(((mask & mask_rtl) == 0) &&
+                   (((mask & ClassMask(AN)) == 0) ||
+                    ((mask & mask_possible_neutral) == 0)))
+                {
+                    return L;
+                }
+
+                if((mask & mask_ltr) == 0)
+                {
+                    return R;
+                }
+
+                return NONE;
+            }
+
+            // Bracket pairs are characters with the Ps or Pe general
+            // category that are mirrored; the pair of a bracket is
+            // its mirrored character. U+2329 and U+232A are
+            // canonically equivalent to U+3008 and U+3009.
+            u32 GetCanonicalBracket(u32 c)
+            {
+                if(c == 0x2329) {
+                    return 0x3008;
+                }
+                if(c == 0x232A) {
+                    return 0x3009;
+                }
+                return c;
+            }
+
+            // Returns 1 for opening brackets, 2 for closing
+            // brackets and 0 otherwise
+            uint GetBracketType(u32 c)
+            {
+                if(c < 0x28) {
+                    return 0;
+                }
+
+                int const category = ucdn_get_general_category(c);
+                if((category != UCDN_GENERAL_CATEGORY_PS) &&
+                   (category != UCDN_GENERAL_CATEGORY_PE))
+                {
+                    return 0;
+                }
+
+                if(!ucdn_get_mirrored(c) || (ucdn_mirror(c) == c))
+                {
+                    return 0;
+                }
+
+                return ((category == UCDN_GENERAL_CATEGORY_PS) ? 1 : 2);
+            }
+
+            struct BidiParagraph
+            {
+                uint start;
+                uint end;
+                u8 level;
+
+                // Level used for the direction of the last strong
+                // character at the start of the paragraph (W2, W7
+                // and N0) and for the embedding direction in N0.
+                // This is the paragraph level except for text without
+                // explicit formatting characters, where ICU uses the
+                // level of the previous paragraph.
+                u8 context_level;
+            };
+
+            struct BidiData
+            {
+                char16_t const * text;
+                uint length;
+
+                // Bidi class for each code unit. The lead surrogate
+                // of a supplementary character is set to BN and the
+                // trail surrogate has the character's class. FSIs
+                // are set to LRI or RLI once they're resolved.
+                std::vector<u8> list_classes;
+
+                // Resolved class for each code unit
+                std::vector<u8> list_types;
+
+                // Embedding level for each code unit
+                std::vector<u8> list_levels;
+
+                // Embedding level for each code unit after X1 to X8
+                std::vector<u8> list_explicit_levels;
+
+                // Index of the matching PDI for each isolate
+                // initiator, or length if there isn't one
+                std::vector<uint> list_matching_pdi;
+
+                // Whether or not each PDI has an initiator
+                std::vector<bool> list_matched_pdi;
+
+                std::vector<BidiParagraph> list_paras;
+
+                // Classes seen while resolving explicit levels,
+                // which ICU uses to decide whether text with
+                // explicit formatting characters is mixed
+                u32 explicit_mask;
+            };
+
+            u32 GetClassMask(BidiData const &data)
+            {
+                u32 mask = 0;
+                for(u8 const cls : data.list_classes)
+                {
+                    mask |= ClassMask(cls);
+                }
+
+                for(auto const &para : data.list_paras)
+                {
+                    mask |= ClassMask(GetDirnForLevel(para.level));
+                }
+
+                return mask;
+            }
+
+            // Returns the direction of the first strong character
+            // in [@start,@end) skipping isolates (P2, P3); returns
+            // NONE if there aren't any
+            u8 GetFirstStrongDirn(BidiData const &data,
+                                  uint const start,
+                                  uint const end)
+            {
+                uint isolate_depth = 0;
+
+                for(uint i=start; i < end; i++)
+                {
+                    u8 const cls = data.list_classes[i];
+
+                    if(IsClass(cls,kMaskIsolateInitiator))
+                    {
+                        isolate_depth++;
+                    }
+                    else if(cls == PDI)
+                    {
+                        if(isolate_depth > 0)
+                        {
+                            isolate_depth--;
+                        }
+                    }
+                    else if(cls == B)
+                    {
+                        break;
+                    }
+                    else if(isolate_depth == 0)
+                    {
+                        if(cls == L)
+                        {
+                            return L;
+                        }
+                        if((cls == R) || (cls == AL))
+                        {
+                            return R;
+                        }
+                    }
+                }
+
+                return NONE;
+            }
+
+            void FindParagraphs(BidiData &data,
+                                hb_direction_t const dirn_hint)
+            {
+                uint start = 0;
+                for(uint i=0; i < data.length; i++)
+                {
+                    if(data.list_classes[i] != B)
+                    {
+                        continue;
+                    }
+
+                    // CR LF is a single paragraph separator
+                    if((data.text[i] == 0x0D) && (i+1 < data.length) &&
+                       (data.text[i+1] == 0x0A))
+                    {
+                        continue;
+                    }
+
+                    data.list_paras.push_back(BidiParagraph{start,i+1,0,0});
+                    start = i+1;
+                }
+
+                if((start < data.length) || data.list_paras.empty())
+                {
+                    data.list_paras.push_back(
+                                BidiParagraph{start,data.length,0,0});
+                }
+
+                for(auto &para : data.list_paras)
+                {
+                    if(dirn_hint == HB_DIRECTION_INVALID)
+                    {
+                        u8 const dirn = GetFirstStrongDirn(
+                                    data,para.start,para.end);
+
+                        para.level = (dirn == R) ? 1 : 0;
+                    }
+                    else
+                    {
+                        para.level = (dirn_hint == HB_DIRECTION_RTL) ? 1 : 0;
+                    }
+                }
+            }
+
+            void FindMatchingPDIs(BidiData &data,
+                                  BidiParagraph const &para)
+            {
+                // BD9
+                std::vector<uint> list_open;
+
+                for(uint i=para.start; i < para.end; i++)
+                {
+                    u8 const cls = data.list_classes[i];
+
+                    if(IsClass(cls,kMaskIsolateInitiator))
+                    {
+                        list_open.push_back(i);
+                    }
+                    else if((cls == PDI) && !list_open.empty())
+                    {
+                        data.list_matching_pdi[list_open.back()] = i;
+                        data.list_matched_pdi[i] = true;
+                        list_open.pop_back();
+                    }
+                }
+            }
+
+            // * Returns the classes the FSIs in @para resolved to
+            //   for the unidirectional check
+            // * Like ICU, an FSI without a strong character that's
+            //   cut off by a paragraph separator isn't counted
+            u32 ResolveFirstStrongIsolates(BidiData &data,
+                                           BidiParagraph const &para)
+            {
+                // X5c
+                u32 mask = 0;
+                for(uint i=para.start; i < para.end; i++)
+                {
+                    if(data.list_classes[i] != FSI)
+                    {
+                        continue;
+                    }
+
+                    uint const pdi = data.list_matching_pdi[i];
+                    uint const end = std::min(pdi,para.end);
+
+                    u8 const dirn = GetFirstStrongDirn(data,i+1,end);
+                    data.list_classes[i] = (dirn == R) ? RLI : LRI;
+
+                    if((dirn != NONE) || (pdi < para.end) ||
+                       (para.end == data.length))
+                    {
+                        mask |= ClassMask(data.list_classes[i]);
+                    }
+                }
+
+                return mask;
+            }
+
+            void ResolveExplicitLevels(BidiData &data,
+                                       BidiParagraph const &para)
+            {
+                // X1 to X8
+                struct Status
+                {
+                    u8 level;
+                    u8 override;
+                    bool isolate;
+                };
+
+                std::vector<Status> list_stack;
+                list_stack.reserve(kMaxDepth+2);
+                list_stack.push_back(Status{para.level,NONE,false});
+
+                uint overflow_isolates = 0;
+                uint overflow_embeddings = 0;
+                uint valid_isolates = 0;
+
+                auto &list_classes = data.list_classes;
+                auto &list_types = data.list_types;
+                auto &list_levels = data.list_levels;
+
+                // level of the last character that isn't an
+                // embedding or override character or BN
+                u8 prev_level = para.level;
+                u32 &mask = data.explicit_mask;
+
+                for(uint i=para.start; i < para.end; i++)
+                {
+                    u8 const cls = list_classes[i];
+                    Status const &top = list_stack.back();
+
+                    switch(cls)
+                    {
+                        case RLE:
+                        case LRE:
+                        case RLO:
+                        case LRO:
+                        {
+                            // X2 to X5
+                            bool const rtl = ((cls == RLE) || (cls == RLO));
+                            u8 const level = (rtl) ?
+                                        ((top.level+1) | 1) :
+                                        ((top.level+2) & ~1);
+
+                            list_levels[i] = top.level;
+                            mask |= ClassMask(BN);
+
+                            if((level <= kMaxDepth) &&
+                               (overflow_isolates == 0) &&
+                               (overflow_embeddings == 0))
+                            {
+                                u8 const override =
+                                        (cls == RLO) ? R :
+                                        (cls == LRO) ? L : NONE;
+
+                                list_stack.push_back(
+                                            Status{level,override,false});
+                            }
+                            else if(overflow_isolates == 0)
+                            {
+                                overflow_embeddings++;
+                            }
+                            break;
+                        }
+                        case RLI:
+                        case LRI:
+                        {
+                            // X5a, X5b
+                            list_levels[i] = top.level;
+                            if(top.override != NONE)
+                            {
+                                list_types[i] = top.override;
+                            }
+
+                            mask |= ClassMask(ON);
+                            mask |= ClassMask(GetDirnForLevel(top.level));
+                            prev_level = top.level;
+
+                            u8 const level = (cls == RLI) ?
+                                        ((top.level+1) | 1) :
+                                        ((top.level+2) & ~1);
+
+                            if((level <= kMaxDepth) &&
+                               (overflow_isolates == 0) &&
+                               (overflow_embeddings == 0))
+                            {
+                                mask |= ClassMask(cls);
+                                valid_isolates++;
+                                list_stack.push_back(
+                                            Status{level,NONE,true});
+                            }
+                            else
+                            {
+                                overflow_isolates++;
+                            }
+                            break;
+                        }
+                        case PDI:
+                        {
+                            // X6a
+                            if(overflow_isolates > 0)
+                            {
+                                overflow_isolates--;
+                            }
+                            else if(valid_isolates > 0)
+                            {
+                                mask |= ClassMask(PDI);
+                                overflow_embeddings = 0;
+                                while(!list_stack.back().isolate)
+                                {
+                                    list_stack.pop_back();
+                                }
+                                list_stack.pop_back();
+                                valid_isolates--;
+                            }
+
+                            Status const &curr = list_stack.back();
+                            list_levels[i] = curr.level;
+                            if(curr.override != NONE)
+                            {
+                                list_types[i] = curr.override;
+                            }
+
+                            mask |= ClassMask(ON);
+                            mask |= ClassMask(GetDirnForLevel(curr.level));
+                            prev_level = curr.level;
+                            break;
+                        }
+                        case PDF:
+                        {
+                            // X7
+                            list_levels[i] = top.level;
+                            mask |= ClassMask(BN);
+
+                            if(overflow_isolates > 0)
+                            {
+                                // nothing
+                            }
+                            else if(overflow_embeddings > 0)
+                            {
+                                overflow_embeddings--;
+                            }
+                            else if(!top.isolate && (list_stack.size() >= 2))
+                            {
+                                list_stack.pop_back();
+                            }
+                            break;
+                        }
+                        case B:
+                        {
+                            // X8
+                            list_levels[i] = para.level;
+                            mask |= ClassMask(B);
+                            break;
+                        }
+                        case BN:
+                        {
+                            // X9 (removed)
+                            list_levels[i] = top.level;
+                            mask |= ClassMask(BN);
+                            break;
+                        }
+                        default:
+                        {
+                            // X6
+                            list_levels[i] = top.level;
+
+                            // A change in level counts as an embedding
+                            // or override of that direction
+                            if(top.level != prev_level)
+                            {
+                                bool const rtl = (top.level & 1);
+                                if(top.override != NONE)
+                                {
+                                    mask |= ClassMask((rtl) ? RLO : LRO);
+                                }
+                                else
+                                {
+                                    mask |= ClassMask((rtl) ? RLE : LRE);
+                                }
+                                prev_level = top.level;
+                            }
+
+                            if((top.override != NONE) &&
+                               (cls != S) && (cls != WS) && (cls != ON))
+                            {
+                                mask |= ClassMask(top.override);
+                            }
+                            else
+                            {
+                                mask |= ClassMask(cls);
+                            }
+
+                            if(top.override != NONE)
+                            {
+                                list_types[i] = top.override;
+                            }
+                            break;
+                        }
+                    }
+                }
+            }
+
+            void ResolveBracketPairs(BidiData &data,
+                                     std::vector<uint> const &list_seq,
+                                     std::vector<u8> &list_t,
+                                     u8 const context,
+                                     u8 const level)
+            {
+                // N0
+                struct BracketOpen
+                {
+                    u32 pair;
+                    uint pos;
+                };
+
+                std::vector<BracketOpen> list_stack;
+                std::vector<std::pair<uint,uint>> list_pairs;
+
+                // BD16
+                // * Like ICU, brackets are paired even if their
+                //   direction was set by an override
+                for(uint k=0; k < list_seq.size(); k++)
+                {
+                    if((list_t[k] != ON) &&
+                       (data.list_classes[list_seq[k]] != ON))
+                    {
+                        continue;
+                    }
+
+                    u32 const c = data.text[list_seq[k]];
+                    uint const type = GetBracketType(c);
+
+                    if(type == 1)
+                    {
+                        if(list_stack.size() == kMaxBracketStack)
+                        {
+                            break;
+                        }
+
+                        list_stack.push_back(
+                                    BracketOpen{
+                                        GetCanonicalBracket(ucdn_mirror(c)),k});
+                    }
+                    else if(type == 2)
+                    {
+                        u32 const canonical = GetCanonicalBracket(c);
+
+                        for(uint j=list_stack.size(); j > 0; j--)
+                        {
+                            if(list_stack[j-1].pair == canonical)
+                            {
+                                list_pairs.emplace_back(list_stack[j-1].pos,k);
+                                list_stack.resize(j-1);
+                                break;
+                            }
+                        }
+                    }
+                }
+
+                std::sort(list_pairs.begin(),list_pairs.end());
+
+                u8 const embedding_dirn = GetDirnForLevel(level);
+
+                for(auto const &pair : list_pairs)
+                {
+                    bool found_embedding = false;
+                    bool found_opposite = false;
+
+                    for(uint k=pair.first+1; k < pair.second; k++)
+                    {
+                        u8 const dirn = GetStrongDirn(list_t[k]);
+                        if(dirn == embedding_dirn)
+                        {
+                            found_embedding = true;
+                            break;
+                        }
+                        if(dirn != NONE)
+                        {
+                            found_opposite = true;
+                        }
+                    }
+
+                    u8 dirn = NONE;
+
+                    if(found_embedding)
+                    {
+                        dirn = embedding_dirn;
+                    }
+                    else if(found_opposite)
+                    {
+                        // * NSMs are skipped like they are for W7
+                        u8 context_dirn = context;
+                        for(uint k=pair.first; k > 0; k--)
+                        {
+                            if(data.list_types[list_seq[k-1]] == NSM)
+                            {
+                                continue;
+                            }
+
+                            u8 const prev_dirn = GetStrongDirn(list_t[k-1]);
+                            if(prev_dirn != NONE)
+                            {
+                                context_dirn = prev_dirn;
+                                break;
+                            }
+                        }
+
+                        dirn = (context_dirn != embedding_dirn) ?
+                                    context_dirn : embedding_dirn;
+                    }
+
+                    if(dirn != NONE)
+                    {
+                        list_t[pair.first] = dirn;
+                        list_t[pair.second] = dirn;
+                    }
+                }
+            }
+
+            void ResolveSequence(BidiData &data,
+                                 BidiParagraph const &para,
+                                 std::vector<uint> const &list_seq)
+            {
+                auto const &list_classes = data.list_classes;
+                auto const &list_explicit_levels = data.list_explicit_levels;
+                auto &list_levels = data.list_levels;
+
+                uint const first = list_seq.front();
+                uint const last = list_seq.back();
+                u8 const level = list_explicit_levels[first];
+
+                // sos and eos (X10)
+                // * Like ICU, the character before the sequence is
+                //   only limited to the paragraph if it immediately
+                //   follows the paragraph separator
+                u8 prev_level = para.level;
+                if((first > 0) && (list_classes[first-1] != B))
+                {
+                    for(uint i=first; i > 0; i--)
+                    {
+                        if(!IsClass(list_classes[i-1],kMaskRemoved))
+                        {
+                            prev_level = list_explicit_levels[i-1];
+                            break;
+                        }
+                    }
+                }
+
+                u8 next_level = para.level;
+                if(!IsClass(list_classes[last],kMaskIsolateInitiator))
+                {
+                    for(uint i=last+1; i < para.end; i++)
+                    {
+                        if(!IsClass(list_classes[i],kMaskRemoved))
+                        {
+                            next_level = list_explicit_levels[i];
+                            break;
+                        }
+                    }
+                }
+
+                u8 const sos = GetDirnForLevel(std::max(level,prev_level));
+                u8 const eos = GetDirnForLevel(std::max(level,next_level));
+
+                // The last strong direction before the sequence, used
+                // for W2, W7 and N0
+                // * Unlike sos, this is limited to the paragraph
+                u8 context_level = para.context_level;
+                if(context_level == para.level)
+                {
+                    for(uint i=first; i > para.start; i--)
+                    {
+                        if(!IsClass(list_classes[i-1],kMaskRemoved))
+                        {
+                            context_level = list_explicit_levels[i-1];
+                            break;
+                        }
+                    }
+                    context_level = std::max(level,context_level);
+                }
+
+                u8 const context = GetDirnForLevel(context_level);
+
+                uint const count = list_seq.size();
+                std::vector<u8> list_t(count);
+                for(uint k=0; k < count; k++)
+                {
+                    list_t[k] = data.list_types[list_seq[k]];
+                }
+
+                // W1
+                for(uint k=0; k < count; k++)
+                {
+                    if(list_t[k] == NSM)
+                    {
+                        if(k == 0)
+                        {
+                            list_t[k] = sos;
+                        }
+                        else if(IsClass(list_t[k-1],kMaskIsolate))
+                        {
+                            list_t[k] = ON;
+                        }
+                        else
+                        {
+                            list_t[k] = list_t[k-1];
+                        }
+                    }
+                }
+
+                // W2, W3
+                u8 last_strong = context;
+                for(uint k=0; k < count; k++)
+                {
+                    u8 const t = list_t[k];
+                    if((t == L) || (t == R) || (t == AL))
+                    {
+                        last_strong = t;
+                    }
+                    else if((t == EN) && (last_strong == AL))
+                    {
+                        list_t[k] = AN;
+                    }
+                }
+
+                for(uint k=0; k < count; k++)
+                {
+                    if(list_t[k] == AL)
+                    {
+                        list_t[k] = R;
+                    }
+                }
+
+                // W4
+                for(uint k=1; k+1 < count; k++)
+                {
+                    u8 const t = list_t[k];
+                    u8 const prev = list_t[k-1];
+                    u8 const next = list_t[k+1];
+
+                    if((t == ES) && (prev == EN) && (next == EN))
+                    {
+                        list_t[k] = EN;
+                    }
+                    else if((t == CS) && (prev == next) &&
+                            ((prev == EN) || (prev == AN)))
+                    {
+                        list_t[k] = prev;
+                    }
+                }
+
+                // W5
+                for(uint k=0; k < count; k++)
+                {
+                    if(list_t[k] != ET)
+                    {
+                        continue;
+                    }
+
+                    uint end = k;
+                    while((end < count) && (list_t[end] == ET))
+                    {
+                        end++;
+                    }
+
+                    bool const adjacent_en =
+                            ((k > 0) && (list_t[k-1] == EN)) ||
+                            ((end < count) && (list_t[end] == EN));
+
+                    if(adjacent_en)
+                    {
+                        std::fill(list_t.begin()+k,list_t.begin()+end,EN);
+                    }
+
+                    k = end;
+                }
+
+                // W6
+                for(uint k=0; k < count; k++)
+                {
+                    u8 const t = list_t[k];
+                    if((t == ES) || (t == ET) || (t == CS))
+                    {
+                        list_t[k] = ON;
+                    }
+                }
+
+                // W7
+                // * Like ICU, an NSM that took its direction from
+                //   sos in W1 doesn't count as a strong character
+                last_strong = context;
+                for(uint k=0; k < count; k++)
+                {
+                    u8 const t = list_t[k];
+                    if(((t == L) || (t == R)) &&
+                       (data.list_types[list_seq[k]] != NSM))
+                    {
+                        last_strong = t;
+                    }
+                    else if((t == EN) && (last_strong == L))
+                    {
+                        list_t[k] = L;
+                    }
+                }
+
+                // N0
+                // * Like ICU, a paragraph without explicit formatting
+                //   characters takes the embedding direction for N0
+                //   from its context level
+                ResolveBracketPairs(data,list_seq,list_t,context,
+                                    (para.context_level != para.level) ?
+                                        para.context_level : level);
+
+                // N1, N2
+                u8 const embedding_dirn = GetDirnForLevel(level);
+                for(uint k=0; k < count; k++)
+                {
+                    if(!IsClass(list_t[k],kMaskNeutral))
+                    {
+                        continue;
+                    }
+
+                    uint end = k;
+                    while((end < count) && IsClass(list_t[end],kMaskNeutral))
+                    {
+                        end++;
+                    }
+
+                    u8 const prev_dirn =
+                            (k == 0) ? sos : GetStrongDirn(list_t[k-1]);
+
+                    u8 const next_dirn =
+                            (end == count) ? eos : GetStrongDirn(list_t[end]);
+
+                    u8 const dirn = (prev_dirn == next_dirn) ?
+                                prev_dirn : embedding_dirn;
+
+                    std::fill(list_t.begin()+k,list_t.begin()+end,dirn);
+
+                    k = end;
+                }
+
+                // I1, I2
+                for(uint k=0; k < count; k++)
+                {
+                    u8 &char_level = list_levels[list_seq[k]];
+                    u8 const t = list_t[k];
+
+                    if((char_level & 1) == 0)
+                    {
+                        if(t == R)
+                        {
+                            char_level += 1;
+                        }
+                        else if((t == AN) || (t == EN))
+                        {
+                            char_level += 2;
+                        }
+                    }
+                    else if((t == L) || (t == EN) || (t == AN))
+                    {
+                        char_level += 1;
+                    }
+                }
+            }
+
+            void ResolveParagraph(BidiData &data,
+                                  BidiParagraph const &para)
+            {
+                auto const &list_classes = data.list_classes;
+                auto const &list_levels = data.list_explicit_levels;
+
+                // Level runs (BD7), ignoring characters removed by X9
+                std::vector<std::pair<uint,uint>> list_runs;
+                std::vector<uint> lkup_run_for_start(
+                            para.end-para.start,
+                            std::numeric_limits<uint>::max());
+
+                for(uint i=para.start; i < para.end; i++)
+                {
+                    if(IsClass(list_classes[i],kMaskRemoved))
+                    {
+                        continue;
+                    }
+
+                    if(list_runs.empty() ||
+                       (list_levels[list_runs.back().second] != list_levels[i]))
+                    {
+                        lkup_run_for_start[i-para.start] = list_runs.size();
+                        list_runs.emplace_back(i,i);
+                    }
+                    else
+                    {
+                        list_runs.back().second = i;
+                    }
+                }
+
+                // Isolating run sequences (BD13)
+                std::vector<uint> list_seq;
+                for(auto const &run : list_runs)
+                {
+                    // Runs that start with a matched PDI are
+                    // part of the sequence of their initiator
+                    if((list_classes[run.first] == PDI) &&
+                       data.list_matched_pdi[run.first])
+                    {
+                        continue;
+                    }
+
+                    list_seq.clear();
+
+                    auto const * curr_run = &run;
+                    while(true)
+                    {
+                        for(uint i=curr_run->first; i <= curr_run->second; i++)
+                        {
+                            if(!IsClass(list_classes[i],kMaskRemoved))
+                            {
+                                list_seq.push_back(i);
+                            }
+                        }
+
+                        uint const last = curr_run->second;
+                        if(!IsClass(list_classes[last],kMaskIsolateInitiator))
+                        {
+                            break;
+                        }
+
+                        uint const pdi = data.list_matching_pdi[last];
+                        if(pdi >= para.end)
+                        {
+                            break;
+                        }
+
+                        uint const run_idx = lkup_run_for_start[pdi-para.start];
+                        if(run_idx >= list_runs.size())
+                        {
+                            break;
+                        }
+
+                        curr_run = &(list_runs[run_idx]);
+                    }
+
+                    ResolveSequence(data,para,list_seq);
+                }
+            }
+
+            void ResetWhitespaceLevels(BidiData &data)
+            {
+                // L1
+                // * Separators and any trailing whitespace or
+                //   isolate formatting characters before separators
+                //   or the end of the text are set to the paragraph
+                //   level
+                // * Characters removed by X9 take the level of the
+                //   character after them
+                auto const &list_classes = data.list_classes;
+                auto &list_levels = data.list_levels;
+
+                uint para_idx = data.list_paras.size()-1;
+                auto get_para_level = [&](uint i) -> u8 {
+                    while(i < data.list_paras[para_idx].start)
+                    {
+                        para_idx--;
+                    }
+                    return data.list_paras[para_idx].level;
+                };
+
+                uint i = data.length;
+                while(i > 0)
+                {
+                    while((i > 0) && IsClass(list_classes[i-1],kMaskTrailing))
+                    {
+                        i--;
+                        list_levels[i] = get_para_level(i);
+                    }
+
+                    while(i > 0)
+                    {
+                        i--;
+                        u8 const cls = list_classes[i];
+                        if(IsClass(cls,kMaskRemoved))
+                        {
+                            list_levels[i] = list_levels[i+1];
+                        }
+                        else if(IsClass(cls,kMaskSeparator))
+                        {
+                            list_levels[i] = get_para_level(i);
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        // =========================================================== //
+
+        uint CountCodePoints(char16_t const * utf16text,
+                             uint const length)
+        {
+            uint count = 0;
+            uint i = 0;
+            while(i < length)
+            {
+                NextCodePoint(utf16text,length,i);
+                count++;
+            }
+
+            return count;
+        }
+
+        // =========================================================== //
+
+        void AppendUTF8AsUTF16(char const * utf8text,
+                               std::size_t const length,
+                               std::u16string &utf16text)
+        {
+            u8 const * s = reinterpret_cast<u8 const *>(utf8text);
+
+            // * The text is decoded into a buffer on the stack that's
+            //   appended to the output whenever it fills up
+            // * Sizing the output up front would mean resizing it,
+            //   and resize fills it one code unit at a time, which
+            //   takes longer than decoding most non ASCII text
+            std::size_t const kUnitBufferSize = 4096;
+            char16_t list_units[kUnitBufferSize];
+
+            // Each step below writes at most this many code units
+            std::size_t const kMaxStepUnits = 16;
+
+            char16_t * const dst_begin = list_units;
+            char16_t * const dst_end = list_units+kUnitBufferSize;
+            char16_t * dst = dst_begin;
+            std::size_t i = 0;
+
+            while(i < length)
+            {
+                if(std::size_t(dst_end-dst) < kMaxStepUnits)
+                {
+                    utf16text.append(dst_begin,dst-dst_begin);
+                    dst = dst_begin;
+                }
+
+                // Decode characters without checking the length of
+                // the text or the buffer until one isn't a valid 1,
+                // 2 or 3 byte sequence; each one reads at most three
+                // bytes and writes one code unit
+                std::size_t const max_count =
+                        std::min<std::size_t>(dst_end-dst,(length-i)/3);
+
+#ifdef KS_TEXT_UNICODE_SSE2
+                bool decode_block = false;
+#endif
+                std::size_t count = max_count;
+                for(; count > 0; count--)
+                {
+                    u32 const lead = s[i];
+                    if(lead < 0x80)
+                    {
+                        // Longer runs of ASCII are copied below
+                        if(s[i+1] < 0x80)
+                        {
+                            break;
+                        }
+
+                        *dst++ = static_cast<char16_t>(lead);
+                        i++;
+                        continue;
+                    }
+
+                    u32 const trail1 = s[i+1] ^ 0x80;
+                    if(lead < 0xE0)
+                    {
+                        if((lead < 0xC2) || (trail1 >= 0x40))
+                        {
+                            break;
+                        }
+
+                        *dst++ = static_cast<char16_t>(
+                                    ((lead & 0x1F) << 6) | trail1);
+                        i += 2;
+                    }
+                    else if(lead < 0xF0)
+                    {
+                        u32 const trail2 = s[i+2] ^ 0x80;
+                        u32 const c = ((lead & 0x0F) << 12) |
+                                      (trail1 << 6) | trail2;
+
+                        if(((trail1 | trail2) >= 0x40) ||
+                           (c < 0x800) || IsSurrogate(c))
+                        {
+                            break;
+                        }
+
+                        *dst++ = static_cast<char16_t>(c);
+                        i += 3;
+#ifdef KS_TEXT_UNICODE_SSE2
+                        // Go back to decoding blocks if another three
+                        // byte sequence follows; the text doesn't have
+                        // to be terminated so i can be at its end
+                        if((i < length) && ((s[i] & 0xF0) == 0xE0))
+                        {
+                            decode_block = true;
+                            break;
+                        }
+#endif
+                    }
+                    else
+                    {
+                        break;
+                    }
+                }
+
+                if(i == length)
+                {
+                    break;
+                }
+
+#ifdef KS_TEXT_UNICODE_SSE2
+                if(decode_block)
+                {
+                    // Decode runs of three byte sequences (CJK)
+                    // a block at a time
+                    while((i+16 <= length) &&
+                          (std::size_t(dst_end-dst) >= kMaxStepUnits))
+                    {
+                        std::size_t const block_length =
+                                DecodeUTF8BlockAsUTF16(s+i,dst);
+
+                        if(block_length == 0)
+                        {
+                            break;
+                        }
+
+                        i += block_length;
+                    }
+
+                    continue;
+                }
+#endif
+                if((count == 0) && (max_count > 0))
+                {
+                    continue;
+                }
+
+                if(s[i] < 0x80)
+                {
+                    std::size_t const ascii_count =
+                            CopyASCIIAsUTF16(
+                                s+i,
+                                std::min<std::size_t>(length-i,dst_end-dst),
+                                dst);
+
+                    i += ascii_count;
+                    dst += ascii_count;
+                    continue;
+                }
+
+                // Four byte and invalid sequences and the end
+                // of the text are decoded one at a time
+                u32 c;
+                i = DecodeUTF8(s,length,i,c);
+                dst = WriteCodePointAsUTF16(c,dst);
+            }
+
+            utf16text.append(dst_begin,dst-dst_begin);
+        }
+
+        void AppendUTF16AsUTF8(char16_t const * utf16text,
+                               std::size_t const length,
+                               std::string &utf8text)
+        {
+            // Each code unit produces at most three bytes
+            std::size_t const offset = utf8text.size();
+            utf8text.resize(offset+length*3);
+
+            char * const dst_begin = &utf8text[0]+offset;
+            char * dst = dst_begin;
+            std::size_t i = 0;
+
+            while(i < length)
+            {
+                std::size_t const ascii_count =
+                        CopyASCIIAsUTF8(utf16text+i,length-i,dst);
+
+                i += ascii_count;
+                dst += ascii_count;
+
+                while((i < length) && (utf16text[i] >= 0x80))
+                {
+                    u32 c = utf16text[i++];
+                    if(c < 0x800)
+                    {
+                        *dst++ = static_cast<char>(0xC0 | (c >> 6));
+                        *dst++ = static_cast<char>(0x80 | (c & 0x3F));
+                        continue;
+                    }
+
+                    if(IsSurrogate(c))
+                    {
+                        if(IsLeadSurrogate(c) && (i < length) &&
+                           IsTrailSurrogate(utf16text[i]))
+                        {
+                            c = GetSupplementary(c,utf16text[i++]);
+                        }
+                        else
+                        {
+                            c = kReplacementChar;
+                        }
+                    }
+
+                    dst = WriteCodePointAsUTF8(c,dst);
+                }
+            }
+
+            utf8text.resize(offset+(dst-dst_begin));
+        }
+
+        void AppendUTF32AsUTF8(char32_t const * utf32text,
+                               std::size_t const length,
+                               std::string &utf8text)
+        {
+            std::size_t const offset = utf8text.size();
+            utf8text.resize(offset+length*4);
+
+            char * const dst_begin = &utf8text[0]+offset;
+            char * dst = dst_begin;
+
+            for(std::size_t i=0; i < length; i++)
+            {
+                u32 c = utf32text[i];
+                if(IsSurrogate(c) || (c > 0x10FFFF))
+                {
+                    c = kReplacementChar;
+                }
+
+                dst = WriteCodePointAsUTF8(c,dst);
+            }
+
+            utf8text.resize(offset+(dst-dst_begin));
+        }
+
+        // =========================================================== //
+
+        std::vector<ScriptItem>
+        ItemizeScripts(char16_t const * utf16text,
+                       uint const length)
+        {
+            // This follows ICU's ScriptRun (icu/extra/scrptrun.cpp)
+            // with script data from HarfBuzz
+
+            // Sorted list of paired punctuation; even indices
+            // are opening characters
+            static u32 const list_paired_chars[] = {
+                0x0028, 0x0029, // ascii paired punctuation
+                0x003c, 0x003e,
+                0x005b, 0x005d,
+                0x007b, 0x007d,
+                0x00ab, 0x00bb, // guillemets
+                0x2018, 0x2019, // general punctuation
+                0x201c, 0x201d,
+                0x2039, 0x203a,
+                0x3008, 0x3009, // chinese paired punctuation
+                0x300a, 0x300b,
+                0x300c, 0x300d,
+                0x300e, 0x300f,
+                0x3010, 0x3011,
+                0x3014, 0x3015,
+                0x3016, 0x3017,
+                0x3018, 0x3019,
+                0x301a, 0x301b
+            };
+
+            auto const paired_chars_end =
+                    std::end(list_paired_chars);
+
+            auto get_pair_index = [&](u32 c) -> sint {
+                auto it = std::lower_bound(
+                            std::begin(list_paired_chars),
+                            paired_chars_end,c);
+
+                if((it == paired_chars_end) || (*it != c)) {
+                    return -1;
+                }
+                return std::distance(std::begin(list_paired_chars),it);
+            };
+
+            auto is_common = [](hb_script_t script) -> bool {
+                return ((script == HB_SCRIPT_COMMON) ||
+                        (script == HB_SCRIPT_INHERITED));
+            };
+
+            struct ParenEntry
+            {
+                sint pair_index;
+                hb_script_t script;
+            };
+
+            hb_unicode_funcs_t * hb_ufuncs = hb_unicode_funcs_get_default();
+
+            std::vector<ScriptItem> list_items;
+            std::vector<ParenEntry> list_parens;
+
+            uint end = 0;
+            while(end < length)
+            {
+                ScriptItem item;
+                item.start = end;
+                item.script = HB_SCRIPT_COMMON;
+
+                // index of the first paren pushed in this run
+                sint start_sp = static_cast<sint>(list_parens.size())-1;
+
+                while(end < length)
+                {
+                    uint next = end;
+                    u32 const c = NextCodePoint(utf16text,length,next);
+
+                    hb_script_t script = hb_unicode_script(hb_ufuncs,c);
+                    sint const pair_index = get_pair_index(c);
+
+                    // Opening characters are pushed onto the stack and
+                    // closing characters use the script of their match
+                    if(pair_index >= 0)
+                    {
+                        if((pair_index & 1) == 0)
+                        {
+                            list_parens.push_back(
+                                        ParenEntry{pair_index,item.script});
+                        }
+                        else if(!list_parens.empty())
+                        {
+                            sint const open_index = pair_index & ~1;
+                            while(!list_parens.empty() &&
+                                  (list_parens.back().pair_index != open_index))
+                            {
+                                list_parens.pop_back();
+                            }
+
+                            sint const sp = static_cast<sint>(list_parens.size())-1;
+                            start_sp = std::min(start_sp,sp);
+
+                            if(!list_parens.empty())
+                            {
+                                script = list_parens.back().script;
+                            }
+                        }
+                    }
+
+                    bool const same_script =
+                            is_common(item.script) || is_common(script) ||
+                            (item.script == script);
+
+                    if(!same_script)
+                    {
+                        break;
+                    }
+
+                    if(is_common(item.script) && !is_common(script))
+                    {
+                        item.script = script;
+
+                        // Fix the parens pushed before the
+                        // script of the run was known
+                        sint const sp = static_cast<sint>(list_parens.size())-1;
+                        while(start_sp < sp)
+                        {
+                            start_sp++;
+                            list_parens[start_sp].script = script;
+                        }
+                    }
+
+                    // Pop closing characters
+                    if((pair_index >= 0) && ((pair_index & 1) != 0) &&
+                       !list_parens.empty())
+                    {
+                        list_parens.pop_back();
+                        start_sp = std::max(start_sp-1,-1);
+                    }
+
+                    end = next;
+                }
+
+                item.end = end;
+                list_items.push_back(item);
+            }
+
+            return list_items;
+        }
+
+        // =========================================================== //
+
+        std::vector<BidiItem>
+        ItemizeBidi(char16_t const * utf16text,
+                    uint const length,
+                    hb_direction_t const dirn_hint)
+        {
+            std::vector<BidiItem> list_items;
+
+            if(length == 0)
+            {
+                hb_direction_t const dirn =
+                        (dirn_hint == HB_DIRECTION_RTL) ?
+                            HB_DIRECTION_RTL : HB_DIRECTION_LTR;
+
+                list_items.push_back(BidiItem{0,0,dirn});
+                return list_items;
+            }
+
+            BidiData data;
+            data.text = utf16text;
+            data.length = length;
+            data.list_classes.resize(length);
+            data.list_levels.resize(length,0);
+            data.list_matching_pdi.resize(length,length);
+            data.list_matched_pdi.resize(length,false);
+
+            uint i=0;
+            while(i < length)
+            {
+                uint const start = i;
+                u32 const c = NextCodePoint(utf16text,length,i);
+                if(i-start == 2)
+                {
+                    data.list_classes[start] = BN;
+                }
+                data.list_classes[i-1] = ucdn_get_bidi_class(c);
+            }
+
+            FindParagraphs(data,dirn_hint);
+
+            u32 mask = GetClassMask(data);
+
+            for(auto const &para : data.list_paras)
+            {
+                FindMatchingPDIs(data,para);
+                mask |= ResolveFirstStrongIsolates(data,para);
+            }
+
+            // Like ICU, skip resolving levels if the text is
+            // unidirectional. If the text has explicit formatting
+            // characters, check again once they've been applied.
+            u8 dirn = GetDirnFromMask(mask);
+
+            if(dirn == NONE)
+            {
+                data.list_types = data.list_classes;
+                data.explicit_mask = 0;
+
+                bool const has_explicit =
+                        ((mask & (kMaskExplicit | kMaskIsolate)) != 0);
+
+                for(uint j=0; j < data.list_paras.size(); j++)
+                {
+                    auto &para = data.list_paras[j];
+                    para.context_level = para.level;
+                    if(!has_explicit && (j > 0))
+                    {
+                        para.context_level = data.list_paras[j-1].level;
+                    }
+
+                    ResolveExplicitLevels(data,para);
+                }
+
+                data.list_explicit_levels = data.list_levels;
+
+                for(auto const &para : data.list_paras)
+                {
+                    ResolveParagraph(data,para);
+                }
+
+                if(has_explicit)
+                {
+                    u32 const mask_embedding =
+                            ClassMask(NSM) | ClassMask(ON) |
+                            ClassMask(CS) | ClassMask(ES) |
+                            ClassMask(ET) | kMaskTrailing;
+
+                    if(data.explicit_mask & mask_embedding)
+                    {
+                        data.explicit_mask |= ClassMask(
+                                    GetDirnForLevel(data.list_paras[0].level));
+                    }
+
+                    dirn = GetDirnFromMask(data.explicit_mask);
+                }
+            }
+
+            if(dirn != NONE)
+            {
+                list_items.push_back(
+                            BidiItem{
+                                0,
+                                length,
+                                (dirn == R) ?
+                                    HB_DIRECTION_RTL : HB_DIRECTION_LTR
+                            });
+
+                return list_items;
+            }
+
+            ResetWhitespaceLevels(data);
+
+            // Split into runs with the same level and reorder
+            // the runs (L2)
+            auto const &list_levels = data.list_levels;
+
+            struct LevelRun
+            {
+                uint start;
+                uint end;
+                u8 level;
+            };
+
+            std::vector<LevelRun> list_runs;
+            u8 min_level = 0xFF;
+            u8 max_level = 0;
+
+            for(uint i=0; i < length; i++)
+            {
+                u8 const level = list_levels[i];
+                if(list_runs.empty() || (list_runs.back().level != level))
+                {
+                    list_runs.push_back(LevelRun{i,i+1,level});
+                    min_level = std::min(min_level,level);
+                    max_level = std::max(max_level,level);
+                }
+                else
+                {
+                    list_runs.back().end = i+1;
+                }
+            }
+
+            u8 const lowest_odd_level = min_level | 1;
+            for(u8 level=max_level; level >= lowest_odd_level; level--)
+            {
+                auto it = list_runs.begin();
+                while(it != list_runs.end())
+                {
+                    if(it->level < level)
+                    {
+                        ++it;
+                        continue;
+                    }
+
+                    auto seq_end = it;
+                    while((seq_end != list_runs.end()) &&
+                          (seq_end->level >= level))
+                    {
+                        ++seq_end;
+                    }
+
+                    std::reverse(it,seq_end);
+                    it = seq_end;
+                }
+            }
+
+            list_items.reserve(list_runs.size());
+            for(auto const &run : list_runs)
+            {
+                list_items.push_back(
+                            BidiItem{
+                                run.start,
+                                run.end,
+                                (run.level & 1) ?
+                                    HB_DIRECTION_RTL : HB_DIRECTION_LTR
+                            });
+            }
+
+            return list_items;
+        }
+
+        // =========================================================== //
+    }
+}
@@ -0,0 +1,151 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef KS_TEXT_UNICODE_HPP
+#define KS_TEXT_UNICODE_HPP
+
+#include <string>
+#include <vector>
+
+#include <ks/KsGlobal.hpp>
+
+#include <harfbuzz/hb.h>
+
+namespace ks
+{
+    namespace text
+    {
+        // Unicode helpers that don't depend on ICU
+        // * Character properties come from the UCDN tables
+        //   bundled with HarfBuzz
+        // * The TextShaper uses these instead of ICU when
+        //   ks_text is built with KS_TEXT_NO_ICU (see ks_text.pri)
+        // * The results are meant to match what the TextShaper
+        //   gets from ICU for the same text
+
+        // =========================================================== //
+
+        // UTF-16
+
+        inline bool IsLeadSurrogate(u32 c)
+        {
+            return ((c & 0xFFFFFC00) == 0xD800);
+        }
+
+        inline bool IsTrailSurrogate(u32 c)
+        {
+            return ((c & 0xFFFFFC00) == 0xDC00);
+        }
+
+        inline bool IsSurrogate(u32 c)
+        {
+            return ((c & 0xFFFFF800) == 0xD800);
+        }
+
+        inline u32 GetSupplementary(u32 lead, u32 trail)
+        {
+            return (((lead-0xD800) << 10) + (trail-0xDC00) + 0x10000);
+        }
+
+        // * Returns the code point that starts at @i and moves
+        //   @i to the start of the next code point
+        // * Unpaired surrogates are returned as they are
+        inline u32 NextCodePoint(char16_t const * utf16text,
+                                 uint const length,
+                                 uint &i)
+        {
+            u32 c = utf16text[i++];
+            if(IsLeadSurrogate(c) && (i < length) &&
+               IsTrailSurrogate(utf16text[i]))
+            {
+                c = GetSupplementary(c,utf16text[i++]);
+            }
+
+            return c;
+        }
+
+        // * Returns the number of code points in @utf16text;
+        //   unpaired surrogates count as one code point each
+        uint CountCodePoints(char16_t const * utf16text,
+                             uint const length);
+
+        // =========================================================== //
+
+        // Transcoding
+        // * Converted text is appended to the output string
+        // * Malformed input (invalid UTF-8 sequences, unpaired
+        //   surrogates, out of range code points) is replaced
+        //   with U+FFFD; for UTF-8, an invalid sequence and the
+        //   trail bytes its lead byte calls for are replaced with
+        //   one U+FFFD, which is what ICU does
+
+        void AppendUTF8AsUTF16(char const * utf8text,
+                               std::size_t const length,
+                               std::u16string &utf16text);
+
+        void AppendUTF16AsUTF8(char16_t const * utf16text,
+                               std::size_t const length,
+                               std::string &utf8text);
+
+        void AppendUTF32AsUTF8(char32_t const * utf32text,
+                               std::size_t const length,
+                               std::string &utf8text);
+
+        // =========================================================== //
+
+        // Itemization
+        // * start and end are code unit indices into the
+        //   utf16 text that was itemized
+
+        struct ScriptItem
+        {
+            uint start;
+            uint end;
+            hb_script_t script;
+        };
+
+        struct BidiItem
+        {
+            uint start;
+            uint end;
+            hb_direction_t dirn;
+        };
+
+        // * Splits @utf16text into runs of the same script
+        // * Common and Inherited characters are merged with the
+        //   surrounding run, and closing brackets take the
+        //   script of their opening bracket
+        std::vector<ScriptItem>
+        ItemizeScripts(char16_t const * utf16text,
+                       uint const length);
+
+        // * Splits @utf16text into runs of the same direction
+        //   using the Unicode Bidirectional Algorithm (UAX #9)
+        //   and returns them in visual order
+        // * @dirn_hint sets the direction of every paragraph in
+        //   the text; if it's HB_DIRECTION_INVALID, the direction
+        //   of each paragraph is set by its first strong character
+        //   (or LTR if there are no strong characters)
+        std::vector<BidiItem>
+        ItemizeBidi(char16_t const * utf16text,
+                    uint const length,
+                    hb_direction_t const dirn_hint);
+
+        // =========================================================== //
+    }
+}
+
+#endif // KS_TEXT_UNICODE_HPP
@@ -0,0 +1,300 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <cstring>
+#include <random>
+
+#include <ks/KsLog.hpp>
+#include <ks/shared/KsImage.hpp>
+#include <ks/text/KsTextTextManager.hpp>
+
+// Soak test for the atlas budget. Random multilingual strings
+// are requested from a TextManager with a small atlas budget
+// and from one without a budget. The test fails if:
+// * the budgeted manager ever has more than one atlas over
+//   its budget (a single request can go over the budget
+//   until the next request compacts the atlases)
+// * the atlases are never compacted
+// * any glyph returned by the budgeted manager has different
+//   pixels than the same glyph from the unbudgeted one
+//
+// The budgeted manager also keeps an atlas mirror; its atlas
+// textures are periodically thrown away (as if the graphics
+// context was lost) and restored from the mirror.
+//
+// A second budgeted manager packs glyphs into the channels
+// of RGBA atlases and is checked the same way.
+
+namespace test
+{
+    using namespace ks;
+
+    uint const kAtlasSizePx = 256;
+    uint const kMaxAtlasCount = 3;
+    uint const kRequestCount = 1000;
+    uint const kCharsPerRequest = 32;
+    uint const kRestoreInterval = 97;
+
+    // * Mirrors the atlas textures a renderer would keep
+    //   using the signals from a TextManager
+    class AtlasMirror
+    {
+    public:
+        AtlasMirror(text::TextManager &text_manager,
+                    uint channel_count=1) :
+            channels(channel_count),
+            peak_atlas_count(0),
+            compaction_count(0)
+        {
+            text_manager.signal_new_atlas->Connect(
+                        [this](uint atlas, uint size_px) {
+                            list_atlases.resize(atlas+1);
+                            list_atlases[atlas].assign(size_px*size_px*channels,0);
+                            peak_atlas_count = std::max<uint>(
+                                        peak_atlas_count,list_atlases.size());
+                        });
+
+            text_manager.signal_new_glyph->Connect(
+                        [this](uint atlas,
+                               glm::u16vec2 offset,
+                               shared_ptr<ImageData> image) {
+                            std::vector<u8> &list_pixels = list_atlases[atlas];
+                            for(uint y=0; y < image->height; y++)
+                            {
+                                std::memcpy(&(list_pixels[((offset.y+y)*kAtlasSizePx + offset.x)*channels]),
+                                            &((*image->data)[y*image->width*channels]),
+                                            image->width*channels);
+                            }
+                        });
+
+            text_manager.signal_atlases_compacted->Connect(
+                        [this](uint) {
+                            list_atlases.clear();
+                            compaction_count++;
+                        });
+        }
+
+        bool GetGlyphImage(text::Glyph const &glyph,
+                           std::vector<u8> &list_pixels) const
+        {
+            if(glyph.atlas >= list_atlases.size())
+            {
+                return false;
+            }
+
+            list_pixels.clear();
+            for(uint y=0; y < glyph.tex_height; y++)
+            {
+                u8 const * row = list_atlases[glyph.atlas].data() +
+                        ((glyph.tex_y+y)*kAtlasSizePx + glyph.tex_x)*channels +
+                        glyph.channel;
+
+                for(uint x=0; x < glyph.tex_width; x++)
+                {
+                    list_pixels.push_back(row[x*channels]);
+                }
+            }
+
+            return true;
+        }
+
+        uint const channels;
+        std::vector<std::vector<u8>> list_atlases;
+        uint peak_atlas_count;
+        uint compaction_count;
+    };
+
+    std::u16string CreateText(std::mt19937 &rng)
+    {
+        // Mostly ASCII with a long tail from other scripts
+        static std::vector<std::pair<char16_t,char16_t>> const list_ranges = {
+            {0x00A1,0x017F}, // Latin-1 and Latin Extended-A
+            {0x0391,0x03C9}, // Greek
+            {0x0410,0x044F}, // Cyrillic
+            {0x0531,0x0556}, // Armenian
+            {0x10D0,0x10F0}, // Georgian
+            {0x2190,0x21FF}, // Arrows
+            {0x2200,0x22FF}, // Math operators
+            {0x2500,0x257F}  // Box drawing
+        };
+
+        std::u16string text;
+        for(uint i=0; i < kCharsPerRequest; i++)
+        {
+            if(rng()%2 == 0)
+            {
+                text.push_back(char16_t(0x21 + rng()%94));
+                continue;
+            }
+
+            auto const &range = list_ranges[rng()%list_ranges.size()];
+            text.push_back(char16_t(range.first + rng()%(range.second-range.first+1)));
+        }
+
+        return text;
+    }
+
+    // * Returns the number of glyphs in @list_lines that don't
+    //   match the same glyphs in @list_lines_ref
+    uint CompareGlyphs(std::vector<text::Line> const &list_lines,
+                       AtlasMirror const &mirror,
+                       std::vector<text::Line> const &list_lines_ref,
+                       AtlasMirror const &mirror_ref)
+    {
+        std::vector<u8> list_pixels;
+        std::vector<u8> list_pixels_ref;
+
+        uint failures = 0;
+        for(uint l=0; l < list_lines.size(); l++)
+        {
+            auto const &list_glyphs = list_lines[l].list_glyphs;
+            auto const &list_glyphs_ref = list_lines_ref[l].list_glyphs;
+
+            for(uint g=0; g < list_glyphs.size(); g++)
+            {
+                if(list_glyphs[g].tex_width == 0)
+                {
+                    // No image
+                    continue;
+                }
+
+                if(!mirror.GetGlyphImage(list_glyphs[g],list_pixels) ||
+                   !mirror_ref.GetGlyphImage(list_glyphs_ref[g],list_pixels_ref) ||
+                   (list_pixels != list_pixels_ref))
+                {
+                    failures++;
+                }
+            }
+        }
+
+        return failures;
+    }
+}
+
+// ============================================================= //
+// ============================================================= //
+
+int main(int argc, char* argv[])
+{
+    using namespace ks;
+
+    std::string font_path = "/home/preet/Dev/FiraSans-Regular.ttf";
+    if(argc > 1)
+    {
+        font_path = argv[1];
+    }
+
+    text::TextManager tm_budget(test::kAtlasSizePx,24,4);
+    text::TextManager tm_packed(test::kAtlasSizePx,24,4);
+    text::TextManager tm_ref(test::kAtlasSizePx,24,4);
+
+    tm_budget.SetMaxAtlasCount(test::kMaxAtlasCount);
+    tm_packed.SetMaxAtlasCount(test::kMaxAtlasCount);
+
+    test::AtlasMirror mirror_budget(tm_budget);
+    test::AtlasMirror mirror_packed(tm_packed,4);
+    test::AtlasMirror mirror_ref(tm_ref);
+
+    tm_budget.EnableAtlasMirror();
+    tm_packed.EnableAtlasMirror();
+    tm_packed.EnableChannelPacking();
+
+    tm_budget.AddFont("font",font_path);
+    tm_packed.AddFont("font",font_path);
+    tm_ref.AddFont("font",font_path);
+
+    auto const hint_budget = tm_budget.CreateHint("font");
+    auto const hint_packed = tm_packed.CreateHint("font");
+    auto const hint_ref = tm_ref.CreateHint("font");
+
+    std::mt19937 rng(1);
+
+    uint failures = 0;
+    for(uint i=0; i < test::kRequestCount; i++)
+    {
+        std::u16string const text = test::CreateText(rng);
+
+        if((i+1)%test::kRestoreInterval == 0)
+        {
+            mirror_budget.list_atlases.clear();
+            tm_budget.RestoreAtlases();
+
+            mirror_packed.list_atlases.clear();
+            tm_packed.RestoreAtlases();
+        }
+
+        auto const list_lines_budget = tm_budget.GetGlyphs(text,hint_budget);
+        auto const list_lines_packed = tm_packed.GetGlyphs(text,hint_packed);
+        auto const list_lines_ref = tm_ref.GetGlyphs(text,hint_ref);
+
+        for(auto const mirror : { &mirror_budget, &mirror_packed })
+        {
+            if(mirror->list_atlases.size() > test::kMaxAtlasCount+1)
+            {
+                LOG.Error() << "TestTextAtlasBudget: request " << i << ": "
+                            << mirror->list_atlases.size() << " atlases";
+                failures++;
+            }
+        }
+
+        uint const budget_failures =
+                test::CompareGlyphs(*list_lines_budget,mirror_budget,
+                                    *list_lines_ref,mirror_ref);
+
+        uint const packed_failures =
+                test::CompareGlyphs(*list_lines_packed,mirror_packed,
+                                    *list_lines_ref,mirror_ref);
+
+        if(budget_failures+packed_failures > 0)
+        {
+            LOG.Error() << "TestTextAtlasBudget: request " << i << ": "
+                        << budget_failures << " glyphs (and "
+                        << packed_failures << " channel packed glyphs) "
+                           "don't match";
+            failures += budget_failures+packed_failures;
+        }
+    }
+
+    LOG.Info() << "TestTextAtlasBudget: peak atlases: "
+               << mirror_budget.peak_atlas_count << " (budget "
+               << test::kMaxAtlasCount << ", unlimited "
+               << mirror_ref.peak_atlas_count << "), compactions: "
+               << mirror_budget.compaction_count;
+
+    LOG.Info() << "TestTextAtlasBudget: channel packed: peak atlases: "
+               << mirror_packed.peak_atlas_count << ", compactions: "
+               << mirror_packed.compaction_count;
+
+    if((mirror_budget.compaction_count == 0) ||
+       (mirror_packed.compaction_count == 0))
+    {
+        LOG.Error() << "TestTextAtlasBudget: atlases were never compacted";
+        failures++;
+    }
+
+    if(failures > 0)
+    {
+        LOG.Error() << "TestTextAtlasBudget: " << failures << " failures";
+        return 1;
+    }
+
+    LOG.Info() << "TestTextAtlasBudget: Glyphs matched";
+    return 0;
+}
+
+
+// ============================================================= //
+// ============================================================= //
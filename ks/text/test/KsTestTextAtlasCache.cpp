@@ -0,0 +1,531 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include <ks/KsLog.hpp>
+#include <ks/shared/KsImage.hpp>
+#include <ks/text/KsTextTextManager.hpp>
+#include <ks/text/KsTextAtlasCache.hpp>
+
+// Checks the atlas cache file without drawing anything:
+// * Atlases saved with SaveAtlasCache and loaded by another
+//   TextManager with LoadAtlasCache have the same pixels, and
+//   GetGlyphs returns the same glyphs without adding any, for
+//   every AtlasUpdateMode
+// * LoadAtlasCache returns false for a cache saved with a
+//   different sdf_offset_px, packer or font
+// * A cache file used as a bundle with SetAtlasBundle is
+//   loaded once the fonts it was saved with are added, and
+//   is ignored (glyphs are rasterized as usual) when they're
+//   different fonts
+// * LoadAtlasCache returns false for truncated files, files
+//   with a flipped bit and files from another version. Build
+//   with KS_TEXT_ATLAS_CACHE_NO_MMAP and AddressSanitizer to
+//   check that these aren't read out of bounds; the files
+//   are then read into buffers of their exact size
+
+namespace test
+{
+    using namespace ks;
+
+    uint g_errors = 0;
+
+    uint const kAtlasSizePx = 512;
+    uint const kGlyphResPx = 24;
+    uint const kSDFOffsetPx = 4;
+
+    std::string const kCachePath = "KsTestTextAtlasCache.bin";
+
+    std::u16string const kText =
+            u"The quick brown fox jumps over the lazy dog 0123456789 "
+            u"\u0391\u03B8\u03AE\u03BD\u03B1 "  // Greek
+            u"\u041C\u043E\u0441\u043A\u0432\u0430"; // Cyrillic
+
+    void Check(bool ok,
+               std::string const &desc,
+               std::string const &what)
+    {
+        if(!ok)
+        {
+            LOG.Error() << "TestTextAtlasCache: Failed: "
+                        << desc << ": " << what;
+            g_errors++;
+        }
+    }
+
+    // * Mirrors the atlas textures a renderer would keep
+    //   using the signals and queued updates from a
+    //   TextManager with any AtlasUpdateMode
+    class AtlasMirror
+    {
+    public:
+        AtlasMirror(text::TextManager &text_manager) :
+            update_count(0),
+            m_text_manager(text_manager)
+        {
+            text_manager.signal_new_atlas->Connect(
+                        [this](uint atlas, uint size_px) {
+                            list_atlases.resize(atlas+1);
+                            list_atlases[atlas].assign(size_px*size_px,0);
+                        });
+
+            text_manager.signal_new_glyph->Connect(
+                        [this](uint atlas,
+                               glm::u16vec2 offset,
+                               shared_ptr<ImageData> image) {
+                            text::AtlasRect const rect{
+                                offset.x,
+                                offset.y,
+                                u16(image->width),
+                                u16(image->height)
+                            };
+
+                            copyRect(atlas,rect,*image,0,0);
+                        });
+
+            text_manager.signal_atlas_updated->Connect(
+                        [this](uint atlas,
+                               std::vector<text::AtlasRect> list_rects,
+                               shared_ptr<ImageData> image) {
+                            for(auto const &rect : list_rects)
+                            {
+                                copyRect(atlas,rect,*image,rect.x,rect.y);
+                            }
+                        });
+
+            text_manager.signal_atlases_compacted->Connect(
+                        [this](uint) {
+                            list_atlases.clear();
+                        });
+        }
+
+        // * Applies the updates queued with
+        //   AtlasUpdateMode::Queued
+        void TakeAtlasUpdates()
+        {
+            for(auto const &update : m_text_manager.TakeAtlasUpdates())
+            {
+                copyRect(update.atlas,update.rect,*update.image,0,0);
+            }
+        }
+
+        std::vector<std::vector<u8>> list_atlases;
+        uint update_count;
+
+    private:
+        // * Copies @rect from @image, starting at
+        //   (@image_x,@image_y), into @atlas
+        void copyRect(uint atlas,
+                      text::AtlasRect const &rect,
+                      ImageData const &image,
+                      uint image_x,
+                      uint image_y)
+        {
+            update_count++;
+
+            if(atlas >= list_atlases.size())
+            {
+                return;
+            }
+
+            for(uint y=0; y < rect.height; y++)
+            {
+                std::memcpy(&(list_atlases[atlas][(rect.y+y)*kAtlasSizePx + rect.x]),
+                            &((*image.data)[(image_y+y)*image.width + image_x]),
+                            rect.width);
+            }
+        }
+
+        text::TextManager &m_text_manager;
+    };
+
+    bool SameGlyphs(std::vector<text::Line> const &list_lines_a,
+                    std::vector<text::Line> const &list_lines_b)
+    {
+        if(list_lines_a.size() != list_lines_b.size())
+        {
+            return false;
+        }
+
+        for(uint l=0; l < list_lines_a.size(); l++)
+        {
+            auto const &list_glyphs_a = list_lines_a[l].list_glyphs;
+            auto const &list_glyphs_b = list_lines_b[l].list_glyphs;
+
+            if(list_glyphs_a.size() != list_glyphs_b.size())
+            {
+                return false;
+            }
+
+            for(uint g=0; g < list_glyphs_a.size(); g++)
+            {
+                auto const &a = list_glyphs_a[g];
+                auto const &b = list_glyphs_b[g];
+
+                if((a.atlas != b.atlas) ||
+                   (a.channel != b.channel) ||
+                   (a.tex_x != b.tex_x) ||
+                   (a.tex_y != b.tex_y) ||
+                   (a.sdf_x != b.sdf_x) ||
+                   (a.sdf_y != b.sdf_y) ||
+                   (a.tex_width != b.tex_width) ||
+                   (a.tex_height != b.tex_height) ||
+                   (a.x0 != b.x0) || (a.y0 != b.y0) ||
+                   (a.x1 != b.x1) || (a.y1 != b.y1))
+                {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    std::vector<u8> ReadFile(std::string const &file_path)
+    {
+        std::ifstream ifs(file_path,std::ios::in | std::ios::binary);
+
+        return std::vector<u8>{
+            std::istreambuf_iterator<char>(ifs),
+            std::istreambuf_iterator<char>()};
+    }
+
+    void WriteFile(std::string const &file_path,
+                   std::vector<u8> const &list_data)
+    {
+        std::ofstream ofs(file_path,std::ios::out | std::ios::binary);
+        ofs.write(reinterpret_cast<char const*>(list_data.data()),
+                  list_data.size());
+    }
+
+    // * Saves a cache for kText with the default settings
+    //   and returns the file's contents
+    std::vector<u8> SaveCache(std::string const &font_path)
+    {
+        text::TextManager text_manager(kAtlasSizePx,kGlyphResPx,kSDFOffsetPx);
+        text_manager.SetAtlasCacheFile(kCachePath);
+        text_manager.AddFont("font",font_path);
+        text_manager.GetGlyphs(kText,text_manager.CreateHint("font"));
+        text_manager.SaveAtlasCache();
+
+        return ReadFile(kCachePath);
+    }
+
+    // * Tries to load the cache with the default settings and
+    //   checks that GetGlyphs works either way
+    bool LoadCache(std::string const &font_path)
+    {
+        text::TextManager text_manager(kAtlasSizePx,kGlyphResPx,kSDFOffsetPx);
+        text_manager.SetAtlasCacheFile(kCachePath);
+        text_manager.AddFont("font",font_path);
+
+        bool const loaded = text_manager.LoadAtlasCache();
+
+        auto const list_lines =
+                text_manager.GetGlyphs(kText,text_manager.CreateHint("font"));
+
+        Check(!list_lines->empty(),"LoadCache",
+              "Expected glyphs after loading the cache");
+
+        return loaded;
+    }
+
+    void TestRoundTrip(std::string const &font_path,
+                       text::AtlasUpdateMode update_mode,
+                       std::string const &mode_name)
+    {
+        std::string const desc = "Round trip ("+mode_name+")";
+
+        std::remove(kCachePath.c_str());
+
+        text::TextManager tm_save(kAtlasSizePx,kGlyphResPx,kSDFOffsetPx);
+        tm_save.SetAtlasUpdateMode(update_mode);
+        tm_save.SetAtlasCacheFile(kCachePath);
+        AtlasMirror mirror_save(tm_save);
+        tm_save.AddFont("font",font_path);
+
+        auto const list_lines_save =
+                tm_save.GetGlyphs(kText,tm_save.CreateHint("font"));
+
+        mirror_save.TakeAtlasUpdates();
+        tm_save.SaveAtlasCache();
+
+        text::TextManager tm_load(kAtlasSizePx,kGlyphResPx,kSDFOffsetPx);
+        tm_load.SetAtlasUpdateMode(update_mode);
+        tm_load.SetAtlasCacheFile(kCachePath);
+        AtlasMirror mirror_load(tm_load);
+        tm_load.AddFont("font",font_path);
+
+        Check(tm_load.LoadAtlasCache(),desc,"Failed to load the cache");
+        mirror_load.TakeAtlasUpdates();
+
+        Check(!mirror_save.list_atlases.empty() &&
+              (mirror_load.list_atlases == mirror_save.list_atlases),desc,
+              "Loaded atlas pixels don't match the saved ones");
+
+        mirror_load.update_count = 0;
+        auto const list_lines_load =
+                tm_load.GetGlyphs(kText,tm_load.CreateHint("font"));
+
+        mirror_load.TakeAtlasUpdates();
+
+        Check(SameGlyphs(*list_lines_load,*list_lines_save),desc,
+              "Glyphs from the loaded cache don't match");
+
+        Check(mirror_load.update_count == 0,desc,
+              "GetGlyphs added glyphs that should have been loaded");
+    }
+
+    void TestMismatch(std::string const &font_path,
+                      std::string const &other_font_path)
+    {
+        std::string const desc = "Mismatch";
+
+        SaveCache(font_path);
+
+        Check(LoadCache(font_path),desc,
+              "Failed to load the cache with the same settings");
+
+        {
+            text::TextManager text_manager(kAtlasSizePx,kGlyphResPx,kSDFOffsetPx+1);
+            text_manager.SetAtlasCacheFile(kCachePath);
+            text_manager.AddFont("font",font_path);
+
+            Check(!text_manager.LoadAtlasCache(),desc,
+                  "Loaded a cache saved with another sdf_offset_px");
+        }
+
+        {
+            text::TextManager text_manager(kAtlasSizePx,kGlyphResPx,kSDFOffsetPx);
+            text_manager.SetAtlasPackerType(text::AtlasPackerType::Skyline);
+            text_manager.SetAtlasCacheFile(kCachePath);
+            text_manager.AddFont("font",font_path);
+
+            Check(!text_manager.LoadAtlasCache(),desc,
+                  "Loaded a cache saved with another packer");
+        }
+
+        Check(!LoadCache(other_font_path),desc,
+              "Loaded a cache saved with another font");
+    }
+
+    void TestBundle(std::string const &font_path,
+                    std::string const &other_font_path)
+    {
+        std::string const desc = "Bundle";
+
+        // Bundles are cache files; ks_text_prebake
+        // saves them with SaveAtlasCache too
+        text::TextManager tm_save(kAtlasSizePx,kGlyphResPx,kSDFOffsetPx);
+        tm_save.SetAtlasCacheFile(kCachePath);
+        AtlasMirror mirror_save(tm_save);
+        tm_save.AddFont("font",font_path);
+        tm_save.AddFont("other",other_font_path);
+
+        auto const list_lines_save =
+                tm_save.GetGlyphs(kText,tm_save.CreateHint("font"));
+
+        auto const list_lines_other_save =
+                tm_save.GetGlyphs(kText,tm_save.CreateHint("other"));
+
+        tm_save.SaveAtlasCache();
+
+        // Loaded when the second font is added
+        {
+            text::TextManager tm_bundle(kAtlasSizePx,kGlyphResPx,kSDFOffsetPx);
+            tm_bundle.SetAtlasBundle(kCachePath);
+            AtlasMirror mirror_bundle(tm_bundle);
+            tm_bundle.AddFont("font",font_path);
+            tm_bundle.AddFont("other",other_font_path);
+
+            Check(mirror_bundle.list_atlases == mirror_save.list_atlases,desc,
+                  "Atlas pixels from the bundle don't match the saved ones");
+
+            mirror_bundle.update_count = 0;
+
+            auto const list_lines =
+                    tm_bundle.GetGlyphs(kText,tm_bundle.CreateHint("font"));
+
+            auto const list_lines_other =
+                    tm_bundle.GetGlyphs(kText,tm_bundle.CreateHint("other"));
+
+            Check(SameGlyphs(*list_lines,*list_lines_save) &&
+                  SameGlyphs(*list_lines_other,*list_lines_other_save),desc,
+                  "Glyphs from the bundle don't match");
+
+            Check(mirror_bundle.update_count == 0,desc,
+                  "GetGlyphs added glyphs that are in the bundle");
+        }
+
+        // The fonts are added in the other order, so the bundle
+        // doesn't match and the glyphs have to be the same as
+        // the ones from a TextManager without the bundle
+        {
+            text::TextManager tm_bundle(kAtlasSizePx,kGlyphResPx,kSDFOffsetPx);
+            tm_bundle.SetAtlasBundle(kCachePath);
+            AtlasMirror mirror_bundle(tm_bundle);
+            tm_bundle.AddFont("other",other_font_path);
+            tm_bundle.AddFont("font",font_path);
+
+            text::TextManager tm_ref(kAtlasSizePx,kGlyphResPx,kSDFOffsetPx);
+            AtlasMirror mirror_ref(tm_ref);
+            tm_ref.AddFont("other",other_font_path);
+            tm_ref.AddFont("font",font_path);
+
+            auto const list_lines =
+                    tm_bundle.GetGlyphs(kText,tm_bundle.CreateHint("font"));
+
+            auto const list_lines_ref =
+                    tm_ref.GetGlyphs(kText,tm_ref.CreateHint("font"));
+
+            Check(SameGlyphs(*list_lines,*list_lines_ref),desc,
+                  "Glyphs with a bundle for other fonts don't match");
+
+            Check(mirror_bundle.list_atlases == mirror_ref.list_atlases,desc,
+                  "Atlas pixels with a bundle for other fonts don't match");
+        }
+    }
+
+    void TestCorruptFiles(std::string const &font_path)
+    {
+        std::string const desc = "Corrupt files";
+
+        std::vector<u8> const list_data = SaveCache(font_path);
+        size_t const header_size = sizeof(text::AtlasCacheHeader);
+
+        Check(list_data.size() > header_size,desc,"Failed to save the cache");
+        if(list_data.size() <= header_size)
+        {
+            return;
+        }
+
+        auto check_corrupt_file = [&](std::vector<u8> const &list_file,
+                                      std::string const &what) {
+            WriteFile(kCachePath,list_file);
+            Check(!LoadCache(font_path),desc,"Loaded "+what);
+        };
+
+        // Truncated
+        std::vector<size_t> const list_sizes = {
+            0,
+            1,
+            header_size-1,
+            header_size,
+            header_size+1,
+            list_data.size()/2,
+            list_data.size()-1
+        };
+
+        for(size_t const size : list_sizes)
+        {
+            check_corrupt_file(
+                        std::vector<u8>(list_data.begin(),list_data.begin()+size),
+                        "a file truncated to "+ks::ToString(size)+" bytes");
+        }
+
+        // Longer
+        std::vector<u8> list_longer = list_data;
+        list_longer.push_back(0);
+        check_corrupt_file(list_longer,"a file with an extra byte");
+
+        // A flipped bit in every byte of the header and
+        // in bytes spread through the rest of the file
+        std::vector<size_t> list_offsets;
+        for(size_t i=0; i < header_size; i++)
+        {
+            list_offsets.push_back(i);
+        }
+
+        size_t const body_size = list_data.size()-header_size;
+        for(size_t i=0; i < 64; i++)
+        {
+            list_offsets.push_back(header_size + i*body_size/64);
+        }
+        list_offsets.push_back(list_data.size()-1);
+
+        for(size_t const offset : list_offsets)
+        {
+            std::vector<u8> list_flipped = list_data;
+            list_flipped[offset] ^= (1 << (offset%8));
+
+            check_corrupt_file(list_flipped,
+                               "a file with a flipped bit at "+
+                               ks::ToString(offset));
+        }
+
+        // Another version
+        for(u32 const version : { text::kAtlasCacheVersion-1,
+                                  text::kAtlasCacheVersion+1 })
+        {
+            std::vector<u8> list_version = list_data;
+
+            text::AtlasCacheHeader header;
+            std::memcpy(&header,list_version.data(),header_size);
+            header.version = version;
+            std::memcpy(list_version.data(),&header,header_size);
+
+            check_corrupt_file(list_version,
+                               "a file with version "+ks::ToString(version));
+        }
+
+        // The original still loads
+        WriteFile(kCachePath,list_data);
+        Check(LoadCache(font_path),desc,"Failed to load the original file");
+    }
+}
+
+// ============================================================= //
+// ============================================================= //
+
+int main(int argc, char* argv[])
+{
+    std::string font_path = "/home/preet/Dev/DejaVuSans.ttf";
+    std::string other_font_path = "/home/preet/Dev/DejaVuSerif.ttf";
+    if(argc > 2)
+    {
+        font_path = argv[1];
+        other_font_path = argv[2];
+    }
+
+    using ks::text::AtlasUpdateMode;
+
+    test::TestRoundTrip(font_path,AtlasUpdateMode::PerGlyph,"PerGlyph");
+    test::TestRoundTrip(font_path,AtlasUpdateMode::Batched,"Batched");
+    test::TestRoundTrip(font_path,AtlasUpdateMode::Queued,"Queued");
+    test::TestMismatch(font_path,other_font_path);
+    test::TestBundle(font_path,other_font_path);
+    test::TestCorruptFiles(font_path);
+
+    std::remove(test::kCachePath.c_str());
+
+    if(test::g_errors > 0)
+    {
+        ks::LOG.Error() << "TestTextAtlasCache: " << test::g_errors
+                        << " errors";
+        return 1;
+    }
+
+    ks::LOG.Info() << "TestTextAtlasCache: All checks passed";
+    return 0;
+}
+
+
+// ============================================================= //
+// ============================================================= //
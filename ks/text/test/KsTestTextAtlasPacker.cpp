@@ -0,0 +1,257 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <chrono>
+#include <random>
+
+#include <ks/KsLog.hpp>
+#include <ks/text/KsTextAtlasPacker.hpp>
+#include <ks/text/KsTextFreeType.hpp>
+
+// Packs the glyph images of the fonts passed as arguments
+// (sized the way TextAtlas sizes them) with each packer and
+// reports the number of atlases, the average occupancy and
+// fragmentation and how long packing took. Glyphs are packed
+// in two orders: by font and glyph index, and shuffled across
+// all fonts to mimic mixed text.
+//
+// Every packer has to keep its rectangles inside the atlas
+// without overlapping, and Skyline and MaxRects can't use
+// more atlases than Shelf.
+
+namespace test
+{
+    using namespace ks;
+
+    uint const kAtlasSizePx = 1024;
+    uint const kGlyphResPx = 32;
+    uint const kSDFOffsetPx = 4;
+    uint const kSpacingPx = 1;
+
+    struct PackResult
+    {
+        uint atlas_count{0};
+        double occupancy{0};
+        double fragmentation{0};
+        double time_ms{0};
+        bool valid{true};
+    };
+
+    void AddGlyphSizes(FT_Library library,
+                       std::string const &font_path,
+                       std::vector<BinPackRectangle> &list_rects)
+    {
+        FT_Face face;
+        if(FT_New_Face(library,font_path.c_str(),0,&face) ||
+           FT_Set_Char_Size(face,kGlyphResPx*64,kGlyphResPx*64,72,72))
+        {
+            LOG.Error() << "TestTextAtlasPacker: Failed to load " << font_path;
+            return;
+        }
+
+        for(FT_Long index=0; index < face->num_glyphs; index++)
+        {
+            if(FT_Load_Glyph(face,index,FT_LOAD_DEFAULT))
+            {
+                continue;
+            }
+
+            FT_Glyph_Metrics const &metrics = face->glyph->metrics;
+            uint const width_px = metrics.width/64;
+            uint const height_px = metrics.height/64;
+            if((width_px == 0) || (height_px == 0))
+            {
+                continue;
+            }
+
+            BinPackRectangle rect;
+            rect.width = width_px + 2*kSDFOffsetPx;
+            rect.height = height_px + 2*kSDFOffsetPx;
+            list_rects.push_back(rect);
+        }
+
+        FT_Done_Face(face);
+    }
+
+    PackResult Pack(text::AtlasPackerType type,
+                    std::vector<BinPackRectangle> list_rects)
+    {
+        PackResult result;
+        std::vector<unique_ptr<text::AtlasPacker>> list_packers;
+        std::vector<uint> list_rect_atlases;
+
+        // Same as TextAtlas: only the last atlas is tried
+        auto const start = std::chrono::steady_clock::now();
+        for(auto &rect : list_rects)
+        {
+            if(list_packers.empty() || !list_packers.back()->AddRectangle(rect))
+            {
+                list_packers.push_back(
+                            text::CreateAtlasPacker(
+                                type,kAtlasSizePx,kAtlasSizePx,kSpacingPx));
+
+                list_packers.back()->AddRectangle(rect);
+            }
+
+            list_rect_atlases.push_back(list_packers.size()-1);
+        }
+        auto const end = std::chrono::steady_clock::now();
+        result.time_ms = std::chrono::duration<double,std::milli>(end-start).count();
+        result.atlas_count = list_packers.size();
+
+        // Every atlas except the last one is full
+        for(uint i=0; i+1 < list_packers.size(); i++)
+        {
+            text::AtlasOccupancy const occupancy = list_packers[i]->GetOccupancy();
+            result.occupancy += occupancy.occupancy;
+            result.fragmentation += occupancy.fragmentation;
+        }
+
+        if(list_packers.size() > 1)
+        {
+            result.occupancy /= (list_packers.size()-1);
+            result.fragmentation /= (list_packers.size()-1);
+        }
+
+        // Check that the rectangles are in bounds and
+        // don't overlap
+        std::vector<std::vector<bool>> list_used(
+                    list_packers.size(),
+                    std::vector<bool>(kAtlasSizePx*kAtlasSizePx,false));
+
+        for(uint i=0; i < list_rects.size(); i++)
+        {
+            BinPackRectangle const &rect = list_rects[i];
+            if((rect.x + rect.width > kAtlasSizePx) ||
+               (rect.y + rect.height > kAtlasSizePx))
+            {
+                result.valid = false;
+                break;
+            }
+
+            std::vector<bool> &used = list_used[list_rect_atlases[i]];
+            for(uint y=rect.y; y < rect.y+rect.height; y++)
+            {
+                for(uint x=rect.x; x < rect.x+rect.width; x++)
+                {
+                    result.valid = result.valid && !used[y*kAtlasSizePx + x];
+                    used[y*kAtlasSizePx + x] = true;
+                }
+            }
+        }
+
+        return result;
+    }
+
+    uint TestGlyphSet(std::string const &name,
+                      std::vector<BinPackRectangle> const &list_rects)
+    {
+        struct PackerDesc
+        {
+            text::AtlasPackerType type;
+            std::string name;
+            PackResult result;
+        };
+
+        std::vector<PackerDesc> list_packers = {
+            { text::AtlasPackerType::Shelf, "Shelf", {} },
+            { text::AtlasPackerType::Skyline, "Skyline", {} },
+            { text::AtlasPackerType::MaxRects, "MaxRects", {} }
+        };
+
+        LOG.Info() << "TestTextAtlasPacker: " << name
+                   << " (" << list_rects.size() << " glyphs)";
+
+        uint failures = 0;
+        for(auto &desc : list_packers)
+        {
+            desc.result = Pack(desc.type,list_rects);
+
+            LOG.Info() << "TestTextAtlasPacker: " << desc.name << ": "
+                       << desc.result.atlas_count << " atlases, "
+                       << "occupancy " << 100.0*desc.result.occupancy << "%, "
+                       << "fragmentation " << 100.0*desc.result.fragmentation << "%, "
+                       << desc.result.time_ms << "ms";
+
+            if(!desc.result.valid)
+            {
+                LOG.Error() << "TestTextAtlasPacker: " << desc.name
+                            << " placed overlapping or out of bounds glyphs";
+                failures++;
+            }
+
+            if(desc.result.atlas_count > list_packers[0].result.atlas_count)
+            {
+                LOG.Error() << "TestTextAtlasPacker: " << desc.name
+                            << " used more atlases than Shelf";
+                failures++;
+            }
+        }
+
+        return failures;
+    }
+}
+
+// ============================================================= //
+// ============================================================= //
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> list_font_paths;
+    for(int i=1; i < argc; i++)
+    {
+        list_font_paths.push_back(argv[i]);
+    }
+
+    if(list_font_paths.empty())
+    {
+        list_font_paths.push_back("/home/preet/Dev/FiraSans-Regular.ttf");
+    }
+
+    FT_Library library;
+    if(FT_Init_FreeType(&library))
+    {
+        ks::LOG.Error() << "TestTextAtlasPacker: Failed to init FreeType";
+        return 1;
+    }
+
+    std::vector<ks::BinPackRectangle> list_rects;
+    for(auto const &font_path : list_font_paths)
+    {
+        test::AddGlyphSizes(library,font_path,list_rects);
+    }
+
+    FT_Done_FreeType(library);
+
+    ks::uint failures = test::TestGlyphSet("by font",list_rects);
+
+    std::mt19937 rng(1);
+    std::shuffle(list_rects.begin(),list_rects.end(),rng);
+    failures += test::TestGlyphSet("shuffled",list_rects);
+
+    if(failures > 0)
+    {
+        ks::LOG.Error() << "TestTextAtlasPacker: " << failures << " failures";
+        return 1;
+    }
+
+    ks::LOG.Info() << "TestTextAtlasPacker: Packers matched";
+    return 0;
+}
+
+
+// ============================================================= //
+// ============================================================= //
@@ -0,0 +1,304 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <cstring>
+#include <random>
+
+#include <ks/KsLog.hpp>
+#include <ks/shared/KsImage.hpp>
+#include <ks/text/KsTextTextManager.hpp>
+
+// Checks that every AtlasUpdateMode gives a renderer the same
+// atlases without drawing anything. The same random strings
+// are requested from a TextManager for each mode, and after
+// each request the atlases rebuilt from its updates (applied
+// to blank images) have to match the PerGlyph ones byte for
+// byte:
+// * Queued: the updates from TakeAtlasUpdates
+// * Batched: the dirty rectangles from signal_atlas_updated
+//
+// This is done with the default settings and again with
+// channel packing and an atlas budget, so atlases are
+// compacted along the way.
+
+namespace test
+{
+    using namespace ks;
+
+    uint g_errors = 0;
+
+    uint const kAtlasSizePx = 256;
+    uint const kRequestCount = 200;
+    uint const kCharsPerRequest = 24;
+
+    void Check(bool ok,
+               std::string const &desc,
+               std::string const &what)
+    {
+        if(!ok)
+        {
+            LOG.Error() << "TestTextAtlasUpdates: Failed: "
+                        << desc << ": " << what;
+            g_errors++;
+        }
+    }
+
+    // * Mirrors the atlas textures a renderer would keep
+    //   using the signals and queued updates from a
+    //   TextManager with any AtlasUpdateMode
+    class AtlasMirror
+    {
+    public:
+        AtlasMirror(text::TextManager &text_manager,
+                    uint channel_count) :
+            channels(channel_count),
+            compaction_count(0),
+            m_text_manager(text_manager)
+        {
+            text_manager.signal_new_atlas->Connect(
+                        [this](uint atlas, uint size_px) {
+                            list_atlases.resize(atlas+1);
+                            list_atlases[atlas].assign(size_px*size_px*channels,0);
+                        });
+
+            text_manager.signal_new_glyph->Connect(
+                        [this](uint atlas,
+                               glm::u16vec2 offset,
+                               shared_ptr<ImageData> image) {
+                            text::AtlasRect const rect{
+                                offset.x,
+                                offset.y,
+                                u16(image->width),
+                                u16(image->height)
+                            };
+
+                            copyRect(atlas,rect,*image,0,0);
+                        });
+
+            text_manager.signal_atlas_updated->Connect(
+                        [this](uint atlas,
+                               std::vector<text::AtlasRect> list_rects,
+                               shared_ptr<ImageData> image) {
+                            for(auto const &rect : list_rects)
+                            {
+                                copyRect(atlas,rect,*image,rect.x,rect.y);
+                            }
+                        });
+
+            text_manager.signal_atlases_compacted->Connect(
+                        [this](uint) {
+                            list_atlases.clear();
+                            compaction_count++;
+                        });
+        }
+
+        // * Applies the updates queued with
+        //   AtlasUpdateMode::Queued
+        void TakeAtlasUpdates()
+        {
+            for(auto const &update : m_text_manager.TakeAtlasUpdates())
+            {
+                copyRect(update.atlas,update.rect,*update.image,0,0);
+            }
+        }
+
+        uint const channels;
+        std::vector<std::vector<u8>> list_atlases;
+        uint compaction_count;
+
+    private:
+        // * Copies @rect from @image, starting at
+        //   (@image_x,@image_y), into @atlas
+        void copyRect(uint atlas,
+                      text::AtlasRect const &rect,
+                      ImageData const &image,
+                      uint image_x,
+                      uint image_y)
+        {
+            if(atlas >= list_atlases.size())
+            {
+                LOG.Error() << "TestTextAtlasUpdates: Update for atlas "
+                            << atlas << " before signal_new_atlas";
+                g_errors++;
+                return;
+            }
+
+            for(uint y=0; y < rect.height; y++)
+            {
+                std::memcpy(&(list_atlases[atlas][((rect.y+y)*kAtlasSizePx + rect.x)*channels]),
+                            &((*image.data)[((image_y+y)*image.width + image_x)*channels]),
+                            rect.width*channels);
+            }
+        }
+
+        text::TextManager &m_text_manager;
+    };
+
+    std::u16string CreateText(std::mt19937 &rng)
+    {
+        // Mostly ASCII with a long tail from other scripts
+        static std::vector<std::pair<char16_t,char16_t>> const list_ranges = {
+            {0x00A1,0x017F}, // Latin-1 and Latin Extended-A
+            {0x0391,0x03C9}, // Greek
+            {0x0410,0x044F}, // Cyrillic
+            {0x2190,0x21FF}, // Arrows
+            {0x2200,0x22FF}  // Math operators
+        };
+
+        std::u16string text;
+        for(uint i=0; i < kCharsPerRequest; i++)
+        {
+            if(rng()%2 == 0)
+            {
+                text.push_back(char16_t(0x21 + rng()%94));
+                continue;
+            }
+
+            auto const &range = list_ranges[rng()%list_ranges.size()];
+            text.push_back(char16_t(range.first + rng()%(range.second-range.first+1)));
+        }
+
+        return text;
+    }
+
+    void TestUpdateModes(std::string const &font_path,
+                         bool channel_packing,
+                         uint max_atlas_count)
+    {
+        std::string const desc =
+                std::string(channel_packing ? "Channel packing" : "Default")+
+                ", max atlas count "+ks::ToString(max_atlas_count);
+
+        uint const channels = channel_packing ? 4 : 1;
+
+        std::vector<text::AtlasUpdateMode> const list_modes = {
+            text::AtlasUpdateMode::PerGlyph,
+            text::AtlasUpdateMode::Queued,
+            text::AtlasUpdateMode::Batched
+        };
+
+        std::vector<unique_ptr<text::TextManager>> list_text_managers;
+        std::vector<unique_ptr<AtlasMirror>> list_mirrors;
+        std::vector<text::Hint> list_hints;
+
+        for(auto const mode : list_modes)
+        {
+            list_text_managers.push_back(
+                        make_unique<text::TextManager>(kAtlasSizePx,24,4));
+
+            text::TextManager &text_manager = *(list_text_managers.back());
+            text_manager.SetAtlasUpdateMode(mode);
+            text_manager.SetMaxAtlasCount(max_atlas_count);
+            if(channel_packing)
+            {
+                text_manager.EnableChannelPacking();
+            }
+
+            list_mirrors.push_back(
+                        make_unique<AtlasMirror>(text_manager,channels));
+
+            text_manager.AddFont("font",font_path);
+            list_hints.push_back(text_manager.CreateHint("font"));
+        }
+
+        std::mt19937 rng(1);
+
+        for(uint i=0; i < kRequestCount; i++)
+        {
+            std::u16string const text = CreateText(rng);
+
+            std::vector<unique_ptr<std::vector<text::Line>>> list_lines;
+            for(uint m=0; m < list_modes.size(); m++)
+            {
+                list_lines.push_back(
+                            list_text_managers[m]->GetGlyphs(text,list_hints[m]));
+
+                list_mirrors[m]->TakeAtlasUpdates();
+            }
+
+            auto const &mirror_ref = *(list_mirrors[0]);
+            auto const &list_glyphs_ref = list_lines[0]->front().list_glyphs;
+
+            for(uint m=1; m < list_modes.size(); m++)
+            {
+                std::string const mode_desc =
+                        desc+", "+(m == 1 ? "Queued" : "Batched")+
+                        ", request "+ks::ToString(i);
+
+                // The glyphs are placed the same way
+                // regardless of the update mode
+                auto const &list_glyphs = list_lines[m]->front().list_glyphs;
+                bool same_glyphs = (list_glyphs.size() == list_glyphs_ref.size());
+                for(uint g=0; same_glyphs && (g < list_glyphs.size()); g++)
+                {
+                    same_glyphs =
+                            (list_glyphs[g].atlas == list_glyphs_ref[g].atlas) &&
+                            (list_glyphs[g].channel == list_glyphs_ref[g].channel) &&
+                            (list_glyphs[g].tex_x == list_glyphs_ref[g].tex_x) &&
+                            (list_glyphs[g].tex_y == list_glyphs_ref[g].tex_y);
+                }
+
+                Check(same_glyphs,mode_desc,
+                      "Glyphs don't match the PerGlyph glyphs");
+
+                Check(list_mirrors[m]->list_atlases == mirror_ref.list_atlases,
+                      mode_desc,"Atlases don't match the PerGlyph atlases");
+            }
+
+            if(g_errors > 0)
+            {
+                // Later requests would fail the same way
+                return;
+            }
+        }
+
+        Check(!list_mirrors[0]->list_atlases.empty(),desc,
+              "Expected atlases");
+
+        Check((max_atlas_count == 0) ||
+              (list_mirrors[0]->compaction_count > 0),desc,
+              "Expected the atlases to be compacted");
+    }
+}
+
+// ============================================================= //
+// ============================================================= //
+
+int main(int argc, char* argv[])
+{
+    std::string font_path = "/home/preet/Dev/DejaVuSans.ttf";
+    if(argc > 1)
+    {
+        font_path = argv[1];
+    }
+
+    test::TestUpdateModes(font_path,false,0);
+    test::TestUpdateModes(font_path,true,1);
+
+    if(test::g_errors > 0)
+    {
+        ks::LOG.Error() << "TestTextAtlasUpdates: " << test::g_errors
+                        << " errors";
+        return 1;
+    }
+
+    ks::LOG.Info() << "TestTextAtlasUpdates: All checks passed";
+    return 0;
+}
+
+
+// ============================================================= //
+// ============================================================= //
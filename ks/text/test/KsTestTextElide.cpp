@@ -0,0 +1,345 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <limits>
+#include <map>
+
+#include <ks/KsLog.hpp>
+#include <ks/text/KsTextTextManager.hpp>
+
+// Checks eliding (Hint::elide) without drawing anything; these
+// are the cases KsTestTextLayout shows:
+// * With max_lines=2, text that needs more lines is cut to
+//   exactly two lines and the second one ends with the same
+//   glyphs as '...' shaped on its own
+// * The cut never lands inside a cluster. The text's clusters
+//   have several glyphs (base characters with combining marks,
+//   and Lao syllables where a glyph after the first advances)
+//   and it's elided at many widths with one and two lines
+// * Elided lines advance no further than max_line_width_px
+
+namespace test
+{
+    using namespace ks;
+
+    uint g_errors = 0;
+
+    uint const kGlyphResPx = 24;
+
+    void Check(bool ok,
+               std::string const &desc,
+               std::string const &what)
+    {
+        if(!ok)
+        {
+            LOG.Error() << "TestTextElide: Failed: "
+                        << desc << ": " << what;
+            g_errors++;
+        }
+    }
+
+    // * Returns the glyphs for '...' shaped without eliding
+    std::vector<text::Glyph> GetEllipsis(text::TextManager &text_manager,
+                                         text::Hint text_hint)
+    {
+        text_hint.elide = false;
+        text_hint.max_line_width_px = std::numeric_limits<uint>::max();
+
+        auto const list_lines = text_manager.GetGlyphs(u"...",text_hint);
+        return list_lines->front().list_glyphs;
+    }
+
+    // * Returns true if @line ends with @list_ellipsis; the
+    //   ellipsis glyphs have to have the same images and
+    //   spacing but can be anywhere on the line
+    bool EndsWithEllipsis(text::Line const &line,
+                          std::vector<text::Glyph> const &list_ellipsis)
+    {
+        auto const &list_glyphs = line.list_glyphs;
+        if(list_ellipsis.empty() ||
+           (list_glyphs.size() < list_ellipsis.size()))
+        {
+            return false;
+        }
+
+        uint const first = list_glyphs.size()-list_ellipsis.size();
+        sint const dx = list_glyphs[first].x0-list_ellipsis[0].x0;
+
+        for(uint i=0; i < list_ellipsis.size(); i++)
+        {
+            text::Glyph const &a = list_glyphs[first+i];
+            text::Glyph const &b = list_ellipsis[i];
+
+            if((a.atlas != b.atlas) ||
+               (a.tex_x != b.tex_x) ||
+               (a.tex_y != b.tex_y) ||
+               (a.x0-b.x0 != dx) ||
+               (a.x1-b.x1 != dx) ||
+               (a.y0 != b.y0) ||
+               (a.y1 != b.y1) ||
+               (a.cluster != line.end))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // * Returns the number of glyphs in each cluster
+    //   of @utf16text shaped on a single line
+    std::map<uint,uint> GetClusterGlyphCounts(text::TextManager &text_manager,
+                                              text::Hint text_hint,
+                                              std::u16string const &utf16text)
+    {
+        text_hint.elide = false;
+        text_hint.max_line_width_px = std::numeric_limits<uint>::max();
+
+        auto const list_lines = text_manager.GetGlyphs(utf16text,text_hint);
+
+        std::map<uint,uint> list_counts;
+        for(auto const &line : *list_lines)
+        {
+            for(auto const &glyph : line.list_glyphs)
+            {
+                list_counts[glyph.cluster]++;
+            }
+        }
+
+        return list_counts;
+    }
+
+    // * Checks that every cluster before the ellipsis on
+    //   @line has all of its glyphs
+    bool IsCutAtCluster(text::Line const &line,
+                        uint ellipsis_glyph_count,
+                        std::map<uint,uint> const &list_cluster_counts)
+    {
+        if(line.list_glyphs.size() < ellipsis_glyph_count)
+        {
+            return false;
+        }
+
+        std::map<uint,uint> list_counts;
+        for(uint i=0; i < line.list_glyphs.size()-ellipsis_glyph_count; i++)
+        {
+            uint const cluster = line.list_glyphs[i].cluster;
+            if((cluster < line.start) || (cluster >= line.end))
+            {
+                return false;
+            }
+
+            list_counts[cluster]++;
+        }
+
+        for(auto const &count : list_counts)
+        {
+            auto it = list_cluster_counts.find(count.first);
+            if((it == list_cluster_counts.end()) ||
+               (it->second != count.second))
+            {
+                return false;
+            }
+        }
+
+        // Every cluster in [start,end) was kept
+        for(auto const &count : list_cluster_counts)
+        {
+            if((count.first >= line.start) &&
+               (count.first < line.end) &&
+               (list_counts.count(count.first) == 0))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void TestMaxLines(text::TextManager &text_manager,
+                      text::Hint text_hint)
+    {
+        std::string const desc = "Max lines";
+
+        std::u16string const text =
+                u"This text shows multiple lines being elided when there "
+                u"is more text than the maximum number of lines can fit, "
+                u"so the last visible line ends with an ellipsis";
+
+        text_hint.elide = true;
+        text_hint.max_lines = 2;
+        text_hint.max_line_width_px = kGlyphResPx*12;
+
+        std::vector<text::Glyph> const list_ellipsis =
+                GetEllipsis(text_manager,text_hint);
+
+        auto const list_lines = text_manager.GetGlyphs(text,text_hint);
+
+        Check(list_lines->size() == 2,desc,
+              "Expected 2 lines, got "+ks::ToString(list_lines->size()));
+
+        if(list_lines->size() != 2)
+        {
+            return;
+        }
+
+        Check(!EndsWithEllipsis((*list_lines)[0],list_ellipsis),desc,
+              "The first line ends with an ellipsis");
+
+        Check(EndsWithEllipsis((*list_lines)[1],list_ellipsis),desc,
+              "The second line doesn't end with the ellipsis");
+
+        Check((*list_lines)[1].end < text.size(),desc,
+              "Expected the second line to end before the text");
+
+        // Text that fits isn't elided
+        text_hint.max_lines = 8;
+        auto const list_all_lines = text_manager.GetGlyphs(text,text_hint);
+
+        Check(list_all_lines->size() > 2,desc,
+              "Expected the text to need more than 2 lines");
+
+        Check(!EndsWithEllipsis(list_all_lines->back(),list_ellipsis) &&
+              (list_all_lines->back().end == text.size()),desc,
+              "Text that fits was elided");
+    }
+
+    void TestClusters(text::TextManager &text_manager,
+                      text::Hint text_hint,
+                      uint max_lines)
+    {
+        std::string const desc =
+                "Clusters ("+ks::ToString(max_lines)+" lines)";
+
+        // * q, x and z with a combining acute, dot below or
+        //   tilde; none of these have precomposed forms and
+        //   the marks don't advance
+        // * Lao consonants with the vowel sign AM, which is
+        //   shaped as a mark and a vowel that advances, so a
+        //   cut between glyphs can fall inside the cluster
+        std::u16string text;
+        std::u16string const list_bases = u"qxz";
+        std::u16string const list_marks = u"\u0301\u0323\u0303";
+        std::u16string const list_lao_bases = u"\u0E81\u0E82\u0E84";
+        for(uint i=0; i < 60; i++)
+        {
+            if(i%2 == 0)
+            {
+                text.push_back(list_bases[(i/2)%list_bases.size()]);
+                text.push_back(list_marks[(i/6)%list_marks.size()]);
+            }
+            else
+            {
+                text.push_back(list_lao_bases[(i/2)%list_lao_bases.size()]);
+                text.push_back(u'\u0EB3');
+            }
+
+            if(i%7 == 6)
+            {
+                text.push_back(u' ');
+            }
+        }
+
+        text_hint.elide = true;
+        text_hint.max_lines = max_lines;
+
+        std::vector<text::Glyph> const list_ellipsis =
+                GetEllipsis(text_manager,text_hint);
+
+        std::map<uint,uint> const list_cluster_counts =
+                GetClusterGlyphCounts(text_manager,text_hint,text);
+
+        bool has_mark_clusters = false;
+        for(auto const &count : list_cluster_counts)
+        {
+            has_mark_clusters |= (count.second > 1);
+        }
+
+        Check(has_mark_clusters,desc,
+              "Expected clusters with more than one glyph");
+
+        for(uint width=kGlyphResPx*2; width <= kGlyphResPx*16; width += 3)
+        {
+            text_hint.max_line_width_px = width;
+
+            auto const list_lines = text_manager.GetGlyphs(text,text_hint);
+            std::string const width_desc = desc+", width "+ks::ToString(width);
+
+            Check(!list_lines->empty() &&
+                  (list_lines->size() <= max_lines),width_desc,
+                  "Expected at most "+ks::ToString(max_lines)+" lines, got "+
+                  ks::ToString(list_lines->size()));
+
+            if(list_lines->empty())
+            {
+                continue;
+            }
+
+            text::Line const &line = list_lines->back();
+            if(line.list_glyphs.empty())
+            {
+                // Too narrow for anything
+                continue;
+            }
+
+            Check(EndsWithEllipsis(line,list_ellipsis),width_desc,
+                  "The last line doesn't end with the ellipsis");
+
+            Check(IsCutAtCluster(line,list_ellipsis.size(),list_cluster_counts),
+                  width_desc,"The line was cut inside a cluster");
+
+            // The cluster spans end at the line's advance
+            Check(!line.list_cluster_spans.empty() &&
+                  (line.list_cluster_spans.back().x1 <= sint(width)),width_desc,
+                  "The elided line is wider than the max width");
+        }
+    }
+}
+
+// ============================================================= //
+// ============================================================= //
+
+int main(int argc, char* argv[])
+{
+    std::string font_path = "/home/preet/Dev/DejaVuSans.ttf";
+    if(argc > 1)
+    {
+        font_path = argv[1];
+    }
+
+    ks::text::TextManager text_manager(1024,test::kGlyphResPx,4);
+    text_manager.AddFont("font",font_path);
+
+    ks::text::Hint const text_hint = text_manager.CreateHint("font");
+
+    test::TestMaxLines(text_manager,text_hint);
+    test::TestClusters(text_manager,text_hint,1);
+    test::TestClusters(text_manager,text_hint,2);
+
+    if(test::g_errors > 0)
+    {
+        ks::LOG.Error() << "TestTextElide: " << test::g_errors
+                        << " errors";
+        return 1;
+    }
+
+    ks::LOG.Info() << "TestTextElide: All checks passed";
+    return 0;
+}
+
+
+// ============================================================= //
+// ============================================================= //
@@ -0,0 +1,373 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <fstream>
+#include <iterator>
+
+#include <ks/KsLog.hpp>
+#include <ks/text/KsTextTextManager.hpp>
+#include <ks/text/KsTextFreeType.hpp>
+#include <ks/text/KsTextFreeTypeMemory.hpp>
+
+#include FT_MODULE_H
+
+// Checks the FreeType memory limit and counters:
+// * AddFont throws FreeTypeError when its faces would go over
+//   the limit, and the failed font doesn't stay allocated or
+//   keep its index. This is checked with a limit that fails
+//   before the faces are loaded and with one that fails after,
+//   when the atlas renders the font's missing glyph
+// * GetGlyphs throws FreeTypeError when rasterizing new glyphs
+//   would go over the limit, with and without raster threads,
+//   and works again once the limit is removed
+// * The bytes counted for a font go back down when its faces
+//   are released. A TextManager only releases its fonts when
+//   it's destroyed, so this is checked with a FreeTypeMemory
+//   and faces loaded directly.
+
+namespace test
+{
+    using namespace ks;
+
+    uint g_errors = 0;
+
+    void Check(bool ok,
+               std::string const &desc,
+               std::string const &what)
+    {
+        if(!ok)
+        {
+            LOG.Error() << "TestTextFreeTypeMemory: Failed: "
+                        << desc << ": " << what;
+            g_errors++;
+        }
+    }
+
+    u64 GetFontBytes(text::FreeTypeMemoryStats const &stats,
+                     uint font)
+    {
+        return (font < stats.list_font_bytes.size()) ?
+                    stats.list_font_bytes[font] : 0;
+    }
+
+    void TestAddFont(std::string const &font_path)
+    {
+        std::string const desc = "AddFont";
+
+        text::TextManager text_manager(512,24,4);
+
+        text::FreeTypeMemoryStats const stats_before =
+                text_manager.GetFreeTypeMemoryStats();
+
+        // No new allocations are allowed
+        text_manager.SetFreeTypeMemoryLimit(1);
+
+        bool threw = false;
+        try
+        {
+            text_manager.AddFont("font",font_path);
+        }
+        catch(FreeTypeError const &)
+        {
+            threw = true;
+        }
+
+        Check(threw,desc,"Expected FreeTypeError with a small limit");
+
+        text::FreeTypeMemoryStats const stats_failed =
+                text_manager.GetFreeTypeMemoryStats();
+
+        Check(stats_failed.failed_alloc_count > 0,desc,
+              "Expected failed allocations");
+
+        Check(stats_failed.bytes_in_use == stats_before.bytes_in_use,desc,
+              "Bytes in use changed after the failed font: "+
+              ks::ToString(stats_before.bytes_in_use)+" to "+
+              ks::ToString(stats_failed.bytes_in_use));
+
+        // The font loads once the limit is removed and gets
+        // the index the failed font would have had
+        text_manager.SetFreeTypeMemoryLimit(0);
+        text_manager.AddFont("font",font_path);
+
+        text::FreeTypeMemoryStats const stats_added =
+                text_manager.GetFreeTypeMemoryStats();
+
+        Check(GetFontBytes(stats_added,1) > 0,desc,
+              "Expected bytes counted for font 1");
+
+        Check(GetFontBytes(stats_added,2) == 0,desc,
+              "Expected no bytes counted for font 2");
+
+        auto const list_lines =
+                text_manager.GetGlyphs(u"abc",
+                                       text_manager.CreateHint("font"));
+
+        Check(!list_lines->empty() &&
+              (list_lines->front().list_glyphs.size() == 3),desc,
+              "Expected three glyphs after adding the font");
+    }
+
+    // * Adds the font with a limit of @extra_bytes more than
+    //   what's in use before; returns false and sets @error if
+    //   AddFont throws
+    bool TryAddFont(std::string const &font_path,
+                    u64 extra_bytes,
+                    std::string &error)
+    {
+        text::TextManager text_manager(512,24,4);
+        text_manager.SetRasterThreadCount(1);
+
+        text_manager.SetFreeTypeMemoryLimit(
+                    text_manager.GetFreeTypeMemoryStats().bytes_in_use+
+                    extra_bytes);
+
+        try
+        {
+            text_manager.AddFont("font",font_path);
+        }
+        catch(FreeTypeError const &e)
+        {
+            error = e.what();
+            return false;
+        }
+
+        return true;
+    }
+
+    void TestAddFontMissingGlyph(std::string const &font_path)
+    {
+        std::string const desc = "AddFont missing glyph";
+
+        // Find the smallest limit AddFont works with; the last
+        // allocation it makes is for the missing glyph's bitmap,
+        // after the font's faces have been loaded
+        std::string error;
+        u64 min_bytes = 0;
+        u64 max_bytes = 64*1024*1024;
+        while(max_bytes-min_bytes > 1)
+        {
+            u64 const bytes = (min_bytes+max_bytes)/2;
+            if(TryAddFont(font_path,bytes,error))
+            {
+                max_bytes = bytes;
+            }
+            else
+            {
+                min_bytes = bytes;
+            }
+        }
+
+        text::TextManager text_manager(512,24,4);
+        text_manager.SetRasterThreadCount(1);
+
+        text_manager.SetFreeTypeMemoryLimit(
+                    text_manager.GetFreeTypeMemoryStats().bytes_in_use+
+                    max_bytes-1);
+
+        bool threw = false;
+        try
+        {
+            text_manager.AddFont("font",font_path);
+        }
+        catch(FreeTypeError const &e)
+        {
+            threw = true;
+            error = e.what();
+        }
+
+        Check(threw && (error.find("missing glyph") != std::string::npos),
+              desc,"Expected the missing glyph to fail: "+error);
+
+        // Nothing from the failed font is left in the fonts, the
+        // atlas or the raster pool: the font added next is font 1
+        // and gets its missing glyph
+        // * The failed font's faces are released, so the bytes in
+        //   use are the same as for a TextManager that added the
+        //   font once. Bytes in use can't be compared with the ones
+        //   from before the failed font since the TrueType driver
+        //   keeps the context it made to load the missing glyph
+        text_manager.SetFreeTypeMemoryLimit(0);
+        text_manager.AddFont("font",font_path);
+
+        text::TextManager text_manager_ref(512,24,4);
+        text_manager_ref.SetRasterThreadCount(1);
+        text_manager_ref.AddFont("font",font_path);
+
+        text::FreeTypeMemoryStats const stats_added =
+                text_manager.GetFreeTypeMemoryStats();
+
+        text::FreeTypeMemoryStats const stats_ref =
+                text_manager_ref.GetFreeTypeMemoryStats();
+
+        Check(stats_added.bytes_in_use == stats_ref.bytes_in_use,desc,
+              "Bytes in use after adding the font again: "+
+              ks::ToString(stats_added.bytes_in_use)+", expected "+
+              ks::ToString(stats_ref.bytes_in_use));
+
+        Check((GetFontBytes(stats_added,1) > 0) &&
+              (GetFontBytes(stats_added,2) == 0),desc,
+              "Expected the font to be font 1");
+
+        // U+E000 isn't in the font
+        auto const list_lines =
+                text_manager.GetGlyphs(u"ab\uE000",
+                                       text_manager.CreateHint("font"));
+
+        Check(!list_lines->empty() &&
+              (list_lines->front().list_glyphs.size() == 3),desc,
+              "Expected three glyphs after adding the font");
+    }
+
+    void TestGetGlyphs(std::string const &font_path,
+                       uint raster_thread_count)
+    {
+        std::string const desc =
+                "GetGlyphs with "+ks::ToString(raster_thread_count)+
+                " raster threads";
+
+        text::TextManager text_manager(512,24,4);
+        text_manager.SetRasterThreadCount(raster_thread_count);
+        text_manager.AddFont("font",font_path);
+
+        text::Hint const text_hint = text_manager.CreateHint("font");
+
+        // Glyphs already in the atlas don't need FreeType
+        text_manager.GetGlyphs(u"abc",text_hint);
+        text_manager.SetFreeTypeMemoryLimit(1);
+        text_manager.GetGlyphs(u"abc",text_hint);
+
+        bool threw = false;
+        try
+        {
+            text_manager.GetGlyphs(u"xyz",text_hint);
+        }
+        catch(FreeTypeError const &)
+        {
+            threw = true;
+        }
+
+        Check(threw,desc,"Expected FreeTypeError with a small limit");
+
+        Check(text_manager.GetFreeTypeMemoryStats().failed_alloc_count > 0,
+              desc,"Expected failed allocations");
+
+        text_manager.SetFreeTypeMemoryLimit(0);
+
+        auto const list_lines =
+                text_manager.GetGlyphs(u"xyz",text_hint);
+
+        Check(!list_lines->empty() &&
+              (list_lines->front().list_glyphs.size() == 3),desc,
+              "Expected three glyphs after removing the limit");
+    }
+
+    void TestFontBytes(std::string const &font_path)
+    {
+        std::string const desc = "Font bytes";
+
+        std::ifstream ifs_font_file(font_path,
+                                    std::ios::in | std::ios::binary);
+
+        std::vector<u8> const file_data{
+            std::istreambuf_iterator<char>(ifs_font_file),
+            std::istreambuf_iterator<char>()};
+
+        text::FreeTypeMemory memory;
+
+        FT_Library library;
+        Check(memory.NewLibrary(&library) == 0,desc,
+              "Failed to create a library");
+
+        auto load_face = [&](uint font) {
+            text::FreeTypeMemory::Scope scope(memory,font);
+
+            FT_Face face = nullptr;
+            FT_New_Memory_Face(library,
+                               file_data.data(),
+                               file_data.size(),
+                               0,&face);
+            return face;
+        };
+
+        auto get_stats = [&]() {
+            text::FreeTypeMemoryStats stats;
+            memory.AddStats(stats);
+            return stats;
+        };
+
+        FT_Face face1 = load_face(1);
+        FT_Face face2 = load_face(2);
+        Check(face1 && face2,desc,"Failed to load faces");
+
+        text::FreeTypeMemoryStats const stats_loaded = get_stats();
+        Check(GetFontBytes(stats_loaded,1) > 0,desc,
+              "Expected bytes counted for font 1");
+        Check(GetFontBytes(stats_loaded,2) > 0,desc,
+              "Expected bytes counted for font 2");
+
+        FT_Done_Face(face1);
+
+        text::FreeTypeMemoryStats const stats_released = get_stats();
+        Check(GetFontBytes(stats_released,1) == 0,desc,
+              "Bytes still counted for font 1 after releasing it: "+
+              ks::ToString(GetFontBytes(stats_released,1)));
+        Check(GetFontBytes(stats_released,2) ==
+              GetFontBytes(stats_loaded,2),desc,
+              "Bytes counted for font 2 changed");
+        Check(stats_released.bytes_in_use ==
+              stats_loaded.bytes_in_use-GetFontBytes(stats_loaded,1),desc,
+              "Bytes in use didn't go down by font 1's bytes");
+
+        FT_Done_Face(face2);
+        Check(GetFontBytes(get_stats(),2) == 0,desc,
+              "Bytes still counted for font 2 after releasing it");
+
+        FT_Done_Library(library);
+    }
+}
+
+// ============================================================= //
+// ============================================================= //
+
+int main(int argc, char* argv[])
+{
+    std::string font_path = "/home/preet/Dev/DejaVuSans.ttf";
+    if(argc > 1)
+    {
+        font_path = argv[1];
+    }
+
+    test::TestAddFont(font_path);
+    test::TestAddFontMissingGlyph(font_path);
+    test::TestGetGlyphs(font_path,0);
+    test::TestGetGlyphs(font_path,2);
+    test::TestFontBytes(font_path);
+
+    if(test::g_errors > 0)
+    {
+        ks::LOG.Error() << "TestTextFreeTypeMemory: " << test::g_errors
+                        << " errors";
+        return 1;
+    }
+
+    ks::LOG.Info() << "TestTextFreeTypeMemory: All checks passed";
+    return 0;
+}
+
+
+// ============================================================= //
+// ============================================================= //
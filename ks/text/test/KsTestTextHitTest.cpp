@@ -0,0 +1,440 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <limits>
+
+#include <ks/KsLog.hpp>
+#include <ks/text/KsTextTextManager.hpp>
+#include <ks/text/KsTextTextLayout.hpp>
+
+// Checks the layout queries in KsTextTextLayout.hpp (HitTest,
+// GetCaretLine, CaretX and SelectionRects) for left-to-right,
+// right-to-left, mixed direction and multi-line text. Results
+// are compared against the cluster spans of each line directly
+// and against linear searches through them. Fonts are passed
+// as arguments and used as a fallback list; they should cover
+// Latin and Hebrew.
+
+namespace test
+{
+    using namespace ks;
+
+    struct TestText
+    {
+        std::string desc;
+        std::string text;
+        text::Hint::Direction direction;
+        uint max_line_width_px;
+    };
+
+    uint g_errors = 0;
+
+    void Check(bool ok,
+               std::string const &desc,
+               std::string const &what)
+    {
+        if(!ok)
+        {
+            LOG.Error() << "TestTextHitTest: Failed: "
+                        << desc << ": " << what;
+            g_errors++;
+        }
+    }
+
+    // * Linear search version of SelectionRects: every span of
+    //   every line is checked, and spans that are selected and
+    //   visually adjacent are merged; lines that are selected
+    //   completely are one rectangle
+    std::vector<text::SelectionRect>
+    LinearSelectionRects(std::vector<text::Line> const &list_lines,
+                         uint start,
+                         uint end)
+    {
+        std::vector<text::SelectionRect> list_rects;
+
+        if(start >= end)
+        {
+            return list_rects;
+        }
+
+        for(auto const &line : list_lines)
+        {
+            auto const &list_spans = line.list_cluster_spans;
+
+            sint const y0 = line.baseline_y + line.descent;
+            sint const y1 = line.baseline_y + line.ascent;
+
+            uint selected_count = 0;
+            for(auto const &span : list_spans)
+            {
+                if((span.start < end) && (span.end > start))
+                {
+                    selected_count++;
+                }
+            }
+
+            if(selected_count == 0)
+            {
+                continue;
+            }
+
+            if(selected_count == list_spans.size())
+            {
+                list_rects.push_back(
+                            text::SelectionRect{
+                                list_spans.front().x0,y0,
+                                list_spans.back().x1,y1
+                            });
+                continue;
+            }
+
+            bool merge = false;
+            for(auto const &span : list_spans)
+            {
+                if(!((span.start < end) && (span.end > start)))
+                {
+                    merge = false;
+                    continue;
+                }
+
+                if(merge && (list_rects.back().x1 == span.x0))
+                {
+                    list_rects.back().x1 = span.x1;
+                }
+                else
+                {
+                    list_rects.push_back(
+                                text::SelectionRect{
+                                    span.x0,y0,span.x1,y1
+                                });
+                }
+
+                merge = true;
+            }
+        }
+
+        return list_rects;
+    }
+
+    bool IsSameRects(std::vector<text::SelectionRect> const &list_a,
+                     std::vector<text::SelectionRect> const &list_b)
+    {
+        if(list_a.size() != list_b.size())
+        {
+            return false;
+        }
+
+        for(uint i=0; i < list_a.size(); i++)
+        {
+            if((list_a[i].x0 != list_b[i].x0) ||
+               (list_a[i].y0 != list_b[i].y0) ||
+               (list_a[i].x1 != list_b[i].x1) ||
+               (list_a[i].y1 != list_b[i].y1))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void TestCarets(std::vector<text::Line> const &list_lines,
+                    std::string const &desc)
+    {
+        for(uint i=0; i < list_lines.size(); i++)
+        {
+            text::Line const &line = list_lines[i];
+            if(line.list_cluster_spans.empty())
+            {
+                continue;
+            }
+
+            Check(text::GetCaretLine(list_lines,line.start) == i,
+                  desc,"GetCaretLine at the start of line "+
+                  ks::ToString(i));
+
+            for(auto const &span : line.list_cluster_spans)
+            {
+                std::string const at =
+                        " at cluster "+ks::ToString(span.start);
+
+                Check(text::GetCaretLine(list_lines,span.start) == i,
+                      desc,"GetCaretLine"+at);
+
+                // The caret at the start of a cluster is on the
+                // cluster's leading edge
+                sint const leading_x = span.rtl ? span.x1 : span.x0;
+                Check(text::CaretX(list_lines,span.start) == leading_x,
+                      desc,"CaretX"+at);
+
+                // Carets inside a cluster snap to its start
+                for(uint c=span.start+1; c < span.end; c++)
+                {
+                    Check(text::CaretX(list_lines,c) == leading_x,
+                          desc,"CaretX inside the cluster"+at);
+                }
+            }
+
+            // The caret after the logically last cluster of the
+            // last line is on that cluster's trailing edge
+            if(i+1 == list_lines.size())
+            {
+                text::ClusterSpan const &last_span =
+                        line.list_cluster_spans[
+                            line.list_logical_spans.back()];
+
+                sint const trailing_x =
+                        last_span.rtl ? last_span.x0 : last_span.x1;
+
+                Check(text::CaretX(list_lines,last_span.end) == trailing_x,
+                      desc,"CaretX at the end of the text");
+            }
+        }
+    }
+
+    void TestHitTests(std::vector<text::Line> const &list_lines,
+                      std::string const &desc)
+    {
+        for(uint i=0; i < list_lines.size(); i++)
+        {
+            text::Line const &line = list_lines[i];
+            sint const y = line.baseline_y;
+
+            for(auto const &span : line.list_cluster_spans)
+            {
+                std::string const at =
+                        " at cluster "+ks::ToString(span.start);
+
+                // Just inside each edge of the cluster
+                if(span.x1-span.x0 < 4)
+                {
+                    continue;
+                }
+
+                text::Caret const left =
+                        text::HitTest(list_lines,span.x0+1,y);
+
+                Check((left.line == i) &&
+                      (left.x == span.x0) &&
+                      (left.cluster == (span.rtl ? span.end : span.start)),
+                      desc,"HitTest on the left edge"+at);
+
+                text::Caret const right =
+                        text::HitTest(list_lines,span.x1-1,y);
+
+                Check((right.line == i) &&
+                      (right.x == span.x1) &&
+                      (right.cluster == (span.rtl ? span.start : span.end)),
+                      desc,"HitTest on the right edge"+at);
+            }
+        }
+
+        // Positions above the first line and below the
+        // last line are clamped to those lines
+        text::Line const &first = list_lines.front();
+        text::Line const &last = list_lines.back();
+
+        Check(text::HitTest(list_lines,0,first.baseline_y+
+                            first.ascent+100).line == 0,
+              desc,"HitTest above the first line");
+
+        Check(text::HitTest(list_lines,0,last.baseline_y+
+                            last.descent-100).line ==
+              list_lines.size()-1,
+              desc,"HitTest below the last line");
+    }
+
+    void TestSelections(std::vector<text::Line> const &list_lines,
+                        std::u16string const &utf16text,
+                        std::string const &desc)
+    {
+        // Every range between code units, which covers ranges
+        // that start and end inside clusters too
+        uint const length = utf16text.size();
+
+        for(uint start=0; start <= length; start++)
+        {
+            for(uint end=start; end <= length; end++)
+            {
+                auto const list_rects =
+                        text::SelectionRects(list_lines,start,end);
+
+                auto const list_linear_rects =
+                        LinearSelectionRects(list_lines,start,end);
+
+                if(!IsSameRects(list_rects,list_linear_rects))
+                {
+                    Check(false,desc,"SelectionRects ["+
+                          ks::ToString(start)+","+
+                          ks::ToString(end)+")");
+                }
+            }
+        }
+    }
+
+    void TestLayout(text::TextManager &text_manager,
+                    std::string const &font_list,
+                    TestText const &test_text)
+    {
+        text::Hint text_hint = text_manager.CreateHint(font_list);
+        text_hint.script = text::Hint::Script::Multiple;
+        text_hint.direction = test_text.direction;
+        text_hint.max_line_width_px = test_text.max_line_width_px;
+
+        std::u16string const utf16text =
+                text::TextManager::ConvertStringUTF8ToUTF16(
+                    test_text.text);
+
+        auto const list_lines_ptr =
+                text_manager.GetGlyphs(utf16text,text_hint);
+
+        auto const &list_lines = *list_lines_ptr;
+
+        if(list_lines.empty())
+        {
+            Check(false,test_text.desc,"No lines");
+            return;
+        }
+
+        TestCarets(list_lines,test_text.desc);
+        TestHitTests(list_lines,test_text.desc);
+        TestSelections(list_lines,utf16text,test_text.desc);
+    }
+
+    void TestMixedSelection(text::TextManager &text_manager,
+                            std::string const &font_list)
+    {
+        // "abc " then three Hebrew letters, which are shown
+        // right to left after the space: selecting the "c",
+        // the space and the first Hebrew letter (the right
+        // most one) gives two separate rectangles
+        text::Hint text_hint = text_manager.CreateHint(font_list);
+        text_hint.script = text::Hint::Script::Multiple;
+        text_hint.direction = text::Hint::Direction::Multiple;
+
+        std::u16string const utf16text =
+                u"abc אבג";
+
+        auto const list_lines_ptr =
+                text_manager.GetGlyphs(utf16text,text_hint);
+
+        auto const list_rects =
+                text::SelectionRects(*list_lines_ptr,2,5);
+
+        Check(list_rects.size() == 2,"mixed selection",
+              "Expected two rectangles, got "+
+              ks::ToString(list_rects.size()));
+
+        if(list_rects.size() == 2)
+        {
+            Check(list_rects[0].x1 < list_rects[1].x0,"mixed selection",
+                  "Expected a gap between the rectangles");
+        }
+
+        // The whole text is one rectangle
+        Check(text::SelectionRects(*list_lines_ptr,0,7).size() == 1,
+              "mixed selection","Expected one rectangle for all text");
+    }
+}
+
+// ============================================================= //
+// ============================================================= //
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> list_font_paths;
+    for(int i=1; i < argc; i++)
+    {
+        list_font_paths.push_back(argv[i]);
+    }
+
+    if(list_font_paths.empty())
+    {
+        list_font_paths.push_back("/home/preet/Dev/DejaVuSans.ttf");
+    }
+
+    ks::text::TextManager text_manager(1024,24,4);
+
+    std::string font_list;
+    for(auto const &font_path : list_font_paths)
+    {
+        text_manager.AddFont(font_path,font_path);
+
+        if(!font_list.empty())
+        {
+            font_list += ",";
+        }
+        font_list += font_path;
+    }
+
+    using Direction = ks::text::Hint::Direction;
+
+    std::vector<test::TestText> const list_test_texts = {
+        {
+            "ltr",
+            u8"The quick brown fox jumps",
+            Direction::LeftToRight,
+            std::numeric_limits<ks::uint>::max()
+        },
+        {
+            "rtl",
+            u8"שלום עולם",
+            Direction::RightToLeft,
+            std::numeric_limits<ks::uint>::max()
+        },
+        {
+            "bidi",
+            u8"abc אבג def דה 123 ǵh",
+            Direction::Multiple,
+            std::numeric_limits<ks::uint>::max()
+        },
+        {
+            "multi-line lf",
+            u8"first line\nsecond אב line\n\nlast",
+            Direction::Multiple,
+            std::numeric_limits<ks::uint>::max()
+        },
+        {
+            "multi-line width",
+            u8"text that is broken into lines by width "
+            u8"שלום עולם with "
+            u8"some hebrew in the middle of it",
+            Direction::Multiple,
+            24*8
+        }
+    };
+
+    for(auto const &test_text : list_test_texts)
+    {
+        test::TestLayout(text_manager,font_list,test_text);
+    }
+
+    test::TestMixedSelection(text_manager,font_list);
+
+    if(test::g_errors > 0)
+    {
+        ks::LOG.Error() << "TestTextHitTest: " << test::g_errors
+                        << " errors";
+        return 1;
+    }
+
+    ks::LOG.Info() << "TestTextHitTest: All results matched";
+    return 0;
+}
+
+
+// ============================================================= //
+// ============================================================= //
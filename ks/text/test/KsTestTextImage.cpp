@@ -0,0 +1,258 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include <ks/KsLog.hpp>
+#include <ks/shared/KsImage.hpp>
+#include <ks/text/KsTextImageRenderer.hpp>
+
+// Renders a paragraph with RenderTextImage and compares it with
+// a reference image:
+//
+//   KsTestTextImage <font> [<reference.pam>]
+//
+// The reference image is written if it doesn't exist yet. The
+// test also fails if:
+// * nothing is drawn
+// * the image changes with the number of threads
+// * the image changes when glyphs are packed into the channels
+//   of RGBA atlases
+
+namespace test
+{
+    using namespace ks;
+
+    uint const kAtlasSizePx = 512;
+    uint const kImageWidth = 640;
+    uint const kImageHeight = 240;
+
+    // * Per channel difference from the reference image that's
+    //   allowed for floating point differences between builds
+    uint const kMaxDiff = 2;
+
+    std::u16string const kText =
+            u"The quick brown fox jumps over the lazy dog. "
+            u"Sphinx of black quartz, judge my vow! "
+            u"Съешь же ещё этих мягких французских булок, да выпей чаю. "
+            u"0123456789 (){}[] @#$%&*";
+
+    // * Keeps the atlas images from a TextManager in
+    //   AtlasUpdateMode::Batched
+    class AtlasImages
+    {
+    public:
+        AtlasImages(text::TextManager &text_manager, uint channels) :
+            m_channels(channels)
+        {
+            text_manager.signal_atlas_updated->Connect(
+                        [this](uint atlas,
+                               std::vector<text::AtlasRect>,
+                               shared_ptr<ImageData> image) {
+                            m_list_images.resize(
+                                        std::max<uint>(m_list_images.size(),atlas+1));
+                            m_list_images[atlas] = image;
+                        });
+        }
+
+        std::vector<text::AtlasImage> GetAtlasImages() const
+        {
+            std::vector<text::AtlasImage> list_atlases;
+            for(auto const &image : m_list_images)
+            {
+                list_atlases.push_back(
+                            text::AtlasImage{
+                                image ? image->data->data() : nullptr,
+                                kAtlasSizePx,
+                                m_channels
+                            });
+            }
+
+            return list_atlases;
+        }
+
+    private:
+        uint m_channels;
+        std::vector<shared_ptr<ImageData>> m_list_images;
+    };
+
+    std::vector<u8> Render(std::vector<text::Line> const &list_lines,
+                           AtlasImages const &atlas_images,
+                           uint thread_count)
+    {
+        // Opaque white background
+        std::vector<u8> list_pixels(kImageWidth*kImageHeight*4,255);
+
+        text::TextImageParams params;
+        params.x = 20;
+        params.y = 40;
+        params.alignment = text::TextManager::Alignment::Center;
+        params.width = kImageWidth-40;
+        params.color = glm::u8vec4(20,40,160,255);
+        params.thread_count = thread_count;
+
+        text::RenderTextImage(list_lines,
+                              atlas_images.GetAtlasImages(),
+                              params,
+                              list_pixels.data(),
+                              kImageWidth,
+                              kImageHeight,
+                              kImageWidth*4);
+
+        return list_pixels;
+    }
+
+    void WriteImage(std::string const &file_path,
+                    std::vector<u8> const &list_pixels)
+    {
+        std::ofstream ofs(file_path,std::ios::out | std::ios::binary);
+        ofs << "P7\nWIDTH " << kImageWidth
+            << "\nHEIGHT " << kImageHeight
+            << "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+
+        ofs.write(reinterpret_cast<char const *>(list_pixels.data()),
+                  list_pixels.size());
+    }
+
+    bool ReadImage(std::string const &file_path,
+                   std::vector<u8> &list_pixels)
+    {
+        std::ifstream ifs(file_path,std::ios::in | std::ios::binary);
+        if(!ifs.is_open())
+        {
+            return false;
+        }
+
+        std::string line;
+        while(std::getline(ifs,line) && (line != "ENDHDR"))
+        {}
+
+        list_pixels.resize(kImageWidth*kImageHeight*4);
+        ifs.read(reinterpret_cast<char*>(list_pixels.data()),
+                 list_pixels.size());
+
+        return bool(ifs);
+    }
+}
+
+// ============================================================= //
+// ============================================================= //
+
+int main(int argc, char* argv[])
+{
+    using namespace ks;
+
+    std::string font_path = "/home/preet/Dev/FiraSans-Regular.ttf";
+    if(argc > 1)
+    {
+        font_path = argv[1];
+    }
+
+    text::TextManager tm(test::kAtlasSizePx,32,4);
+    tm.SetRasterThreadCount(1);
+    tm.SetAtlasUpdateMode(text::AtlasUpdateMode::Batched);
+
+    text::TextManager tm_packed(test::kAtlasSizePx,32,4);
+    tm_packed.SetRasterThreadCount(1);
+    tm_packed.SetAtlasUpdateMode(text::AtlasUpdateMode::Batched);
+    tm_packed.EnableChannelPacking();
+
+    test::AtlasImages atlas_images(tm,1);
+    test::AtlasImages atlas_images_packed(tm_packed,4);
+
+    tm.AddFont("font",font_path);
+    tm_packed.AddFont("font",font_path);
+
+    text::Hint hint = tm.CreateHint("font");
+    hint.max_line_width_px = test::kImageWidth-40;
+
+    text::Hint hint_packed = tm_packed.CreateHint("font");
+    hint_packed.max_line_width_px = hint.max_line_width_px;
+
+    auto const list_lines = tm.GetGlyphs(test::kText,hint);
+    auto const list_lines_packed = tm_packed.GetGlyphs(test::kText,hint_packed);
+
+    uint failures = 0;
+
+    auto const list_pixels = test::Render(*list_lines,atlas_images,1);
+
+    uint ink_count = 0;
+    for(uint i=0; i < list_pixels.size(); i+=4)
+    {
+        ink_count += (list_pixels[i] != 255) ? 1 : 0;
+    }
+
+    if(ink_count == 0)
+    {
+        LOG.Error() << "TestTextImage: Nothing was drawn";
+        failures++;
+    }
+
+    if(test::Render(*list_lines,atlas_images,4) != list_pixels)
+    {
+        LOG.Error() << "TestTextImage: Image changed with 4 threads";
+        failures++;
+    }
+
+    if(test::Render(*list_lines_packed,atlas_images_packed,1) != list_pixels)
+    {
+        LOG.Error() << "TestTextImage: Image changed with channel packing";
+        failures++;
+    }
+
+    if(argc > 2)
+    {
+        std::vector<u8> list_ref_pixels;
+        if(!test::ReadImage(argv[2],list_ref_pixels))
+        {
+            test::WriteImage(argv[2],list_pixels);
+            LOG.Info() << "TestTextImage: Wrote reference image " << argv[2];
+        }
+        else
+        {
+            uint diff_count = 0;
+            for(uint i=0; i < list_pixels.size(); i++)
+            {
+                if(uint(std::abs(int(list_pixels[i])-list_ref_pixels[i])) > test::kMaxDiff)
+                {
+                    diff_count++;
+                }
+            }
+
+            if(diff_count > 0)
+            {
+                LOG.Error() << "TestTextImage: " << diff_count
+                            << " values differ from the reference image";
+                failures++;
+            }
+        }
+    }
+
+    if(failures > 0)
+    {
+        LOG.Error() << "TestTextImage: " << failures << " failures";
+        return 1;
+    }
+
+    LOG.Info() << "TestTextImage: Images matched (" << ink_count << " pixels drawn)";
+    return 0;
+}
+
+
+// ============================================================= //
+// ============================================================= //
@@ -24,6 +24,7 @@
 #include <ks/shared/KsImage.hpp>
 
 #include <ks/text/KsTextTextManager.hpp>
+#include <ks/text/KsTextTextMesh.hpp>
 
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -360,6 +361,22 @@ namespace test
                             m_text_hint);
 
                 createTextRenderData(*list_lines_ptr,glm::u8vec4{160,210,250,255});
+                m_baseline_y += spacing;
+
+
+                // Elided text with multiple lines
+                m_text_hint.max_lines = 2;
+
+                s = u8"This text shows multiple lines being elided when there "
+                      "is more text than the maximum number of lines can fit, "
+                      "so the last visible line ends with an ellipsis";
+
+                list_lines_ptr =
+                        m_text_manager->GetGlyphs(
+                            text::TextManager::ConvertStringUTF8ToUTF16(s),
+                            m_text_hint);
+
+                createTextRenderData(*list_lines_ptr,glm::u8vec4{210,250,160,255});
 
 
                 m_setup = true;
@@ -457,91 +474,51 @@ namespace test
                     m_camera.GetProjMatrix()*
                     m_camera.GetViewMatrix();
 
+            // Quads are in layout coordinates (y up) relative
+            // to the first baseline; the scene's y goes down
+            std::vector<text::TextVertex> list_quads(
+                        text::GetQuadCount(list_lines)*4);
+
+            std::vector<text::TextDrawBatch> list_batches;
+            text::WriteVertices(list_lines,
+                                text::TextManager::Alignment::Left,
+                                0,
+                                list_quads.data(),
+                                list_batches);
+
+            float const baseline_y = list_lines.empty() ?
+                        m_baseline_y : (m_baseline_y+list_lines[0].spacing);
+
             for(auto const &line : list_lines)
             {
                 m_baseline_y += line.spacing;
+            }
 
-                for(text::Glyph const &glyph : line.list_glyphs)
-                {
-                    // Original glyph dimensions (without any SDF
-                    // borders)
-                    uint const o_glyph_width = glyph.x1-glyph.x0;
-                    uint const o_glyph_height= glyph.y1-glyph.y0;
-
-                    if(o_glyph_width==0 || o_glyph_height==0)
-                    {
-                        continue;
-                    }
-
-                    uint const glyph_width = o_glyph_width + (2*glyph.sdf_x);
-                    uint const glyph_height= o_glyph_height + (2*glyph.sdf_y);
-
-                    float x0 = (glyph.x0-glyph.sdf_x);
-                    float x1 = (glyph.x1+glyph.sdf_x);
-                    float y0 = m_baseline_y-(glyph.y0-glyph.sdf_y);
-                    float y1 = m_baseline_y-(glyph.y1+glyph.sdf_y);
-
-                    float s0 = glyph.tex_x*k_div_atlas;
-                    float s1 = (glyph.tex_x+glyph_width)*k_div_atlas;
-
-                    // tex_y must be flipped
-                    float t0 = glyph.tex_y*k_div_atlas;
-                    float t1 = (glyph.tex_y+glyph_height)*k_div_atlas;
-
-                    // BL
-                    gl::Buffer::PushElement<Vertex>(
-                                *list_vx,
-                                Vertex{
-                                    m4_pv*glm::vec4{x0,y0,0,1},
-                                    glm::vec2{s0,t1},
-                                    color
-                                });
-
-                    // TR
-                    gl::Buffer::PushElement<Vertex>(
-                                *list_vx,
-                                Vertex{
-                                    m4_pv*glm::vec4{x1,y1,0,1},
-                                    glm::vec2{s1,t0},
-                                    color
-                                });
-
-                    // TL
-                    gl::Buffer::PushElement<Vertex>(
-                                *list_vx,
-                                Vertex{
-                                    m4_pv*glm::vec4{x0,y1,0,1},
-                                    glm::vec2{s0,t0},
-                                    color
-                                });
-
-                    // BL
-                    gl::Buffer::PushElement<Vertex>(
-                                *list_vx,
-                                Vertex{
-                                    m4_pv*glm::vec4{x0,y0,0,1},
-                                    glm::vec2{s0,t1},
-                                    color
-                                });
-
-                    // BR
-                    gl::Buffer::PushElement<Vertex>(
-                                *list_vx,
-                                Vertex{
-                                    m4_pv*glm::vec4{x1,y0,0,1},
-                                    glm::vec2{s1,t1},
-                                    color
-                                });
-
-                    // TR
-                    gl::Buffer::PushElement<Vertex>(
-                                *list_vx,
-                                Vertex{
-                                    m4_pv*glm::vec4{x1,y1,0,1},
-                                    glm::vec2{s1,t0},
-                                    color
-                                });
-                }
+            auto push_vertex = [&](text::TextVertex const &vx) {
+                gl::Buffer::PushElement<Vertex>(
+                            *list_vx,
+                            Vertex{
+                                m4_pv*glm::vec4{vx.x,baseline_y-vx.y,0,1},
+                                glm::vec2{vx.tex_x*k_div_atlas,
+                                          vx.tex_y*k_div_atlas},
+                                color
+                            });
+            };
+
+            // Every atlas is drawn with the first atlas's
+            // texture, so this only works for a single atlas
+            for(uint i=0; i < list_quads.size(); i+=4)
+            {
+                // TL, BL, BR, TR
+                text::TextVertex const * quad = &(list_quads[i]);
+
+                push_vertex(quad[1]);
+                push_vertex(quad[3]);
+                push_vertex(quad[0]);
+
+                push_vertex(quad[1]);
+                push_vertex(quad[2]);
+                push_vertex(quad[3]);
             }
 
             // Create the entity
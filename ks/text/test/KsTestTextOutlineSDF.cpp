@@ -0,0 +1,387 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <chrono>
+#include <cmath>
+
+#include <ks/KsLog.hpp>
+#include <ks/text/KsTextFreeType.hpp>
+#include <ks/text/KsTextOutlineSDF.hpp>
+#include <ks/text/KsTextSDF.hpp>
+
+#include FT_OUTLINE_H
+
+// Checks how well glyph shapes are reconstructed from their
+// distance fields when they're magnified. Each glyph in the
+// fonts passed as arguments is transformed at a low glyph
+// resolution and then sampled (bilinear, thresholded at the
+// edge value) at the resolution of a reference bitmap. The
+// percentage of reference pixels that end up on the wrong
+// side of the edge is reported for each engine; reference
+// pixels that are only partly covered are skipped so small
+// differences in edge placement don't count.
+//
+// At each glyph resolution, SDFEngine::Outline has to be at
+// least as accurate as SDFEngine::EDTAA3 and
+// SDFEngine::OutlineMSDF at least as accurate as
+// SDFEngine::Outline.
+
+namespace test
+{
+    using namespace ks;
+
+    uint const kPadPx = 4;
+    uint const kRefResPx = 128;
+
+    struct SDFImage
+    {
+        // * Position of the top left corner in pixels
+        //   at the glyph resolution (y up)
+        int left;
+        int top;
+        uint width;
+        uint height;
+        uint channels;
+        std::vector<u8> list_pixels;
+    };
+
+    struct Bitmap
+    {
+        int left;
+        int top;
+        uint width;
+        uint height;
+        std::vector<u8> list_pixels;
+    };
+
+    struct EngineResult
+    {
+        double time_ms{0};
+        u64 error_count{0};
+    };
+
+    bool LoadGlyph(FT_Face face, uint res_px, FT_UInt index, bool render)
+    {
+        if(FT_Set_Char_Size(face,res_px*64,res_px*64,72,72))
+        {
+            return false;
+        }
+
+        // Hinting changes the outline at each size, so
+        // it's disabled to compare different sizes
+        FT_Int32 const flags = FT_LOAD_NO_HINTING | FT_LOAD_NO_BITMAP |
+                (render ? FT_LOAD_RENDER : 0);
+
+        return (FT_Load_Glyph(face,index,flags) == 0) &&
+               (face->glyph->format == (render ? FT_GLYPH_FORMAT_BITMAP :
+                                                 FT_GLYPH_FORMAT_OUTLINE));
+    }
+
+    Bitmap GetBitmap(FT_GlyphSlot slot)
+    {
+        FT_Bitmap const &bitmap = slot->bitmap;
+
+        Bitmap result;
+        result.left = slot->bitmap_left;
+        result.top = slot->bitmap_top;
+        result.width = bitmap.width;
+        result.height = bitmap.rows;
+        result.list_pixels.resize(result.width*result.height);
+
+        for(uint r=0; r < result.height; r++)
+        {
+            int const row = (bitmap.pitch > 0) ? r : (result.height-1-r);
+            u8 const * src = bitmap.buffer + row*std::abs(bitmap.pitch);
+            std::copy(src,src+result.width,&(result.list_pixels[r*result.width]));
+        }
+
+        return result;
+    }
+
+    bool MakeSDF(FT_Face face,
+                 FT_UInt index,
+                 uint res_px,
+                 text::SDFEngine engine,
+                 SDFImage &image,
+                 double &time_ms)
+    {
+        bool const use_outline = text::SDFEngineUsesOutline(engine);
+        if(!LoadGlyph(face,res_px,index,!use_outline))
+        {
+            return false;
+        }
+
+        image.channels = text::GetSDFChannelCount(engine);
+
+        if(use_outline)
+        {
+            // Same bounds as the rendered bitmap
+            FT_BBox cbox;
+            FT_Outline_Get_CBox(&(face->glyph->outline),&cbox);
+            int const x_min = std::floor(cbox.xMin/64.0);
+            int const y_max = std::ceil(cbox.yMax/64.0);
+            int const x_max = std::ceil(cbox.xMax/64.0);
+            int const y_min = std::floor(cbox.yMin/64.0);
+
+            image.left = x_min - kPadPx;
+            image.top = y_max + kPadPx;
+            image.width = (x_max-x_min) + 2*kPadPx;
+            image.height = (y_max-y_min) + 2*kPadPx;
+            image.list_pixels.assign(image.width*image.height*image.channels,0);
+
+            auto const start = std::chrono::steady_clock::now();
+            text::MakeOutlineDistanceMap(engine,
+                                         &(face->glyph->outline),
+                                         image.left*64,
+                                         image.top*64,
+                                         image.list_pixels.data(),
+                                         image.width,
+                                         image.height);
+            auto const end = std::chrono::steady_clock::now();
+            time_ms += std::chrono::duration<double,std::milli>(end-start).count();
+            return true;
+        }
+
+        Bitmap const bitmap = GetBitmap(face->glyph);
+
+        image.left = bitmap.left - kPadPx;
+        image.top = bitmap.top + kPadPx;
+        image.width = bitmap.width + 2*kPadPx;
+        image.height = bitmap.height + 2*kPadPx;
+        image.list_pixels.assign(image.width*image.height,0);
+
+        for(uint r=0; r < bitmap.height; r++)
+        {
+            std::copy(&(bitmap.list_pixels[r*bitmap.width]),
+                      &(bitmap.list_pixels[r*bitmap.width])+bitmap.width,
+                      &(image.list_pixels[(r+kPadPx)*image.width + kPadPx]));
+        }
+
+        auto const start = std::chrono::steady_clock::now();
+        text::MakeDistanceMap(engine,
+                              image.list_pixels.data(),
+                              image.width,
+                              image.height,
+                              kPadPx);
+        auto const end = std::chrono::steady_clock::now();
+        time_ms += std::chrono::duration<double,std::milli>(end-start).count();
+        return true;
+    }
+
+    float SampleChannel(SDFImage const &image, float u, float v, uint channel)
+    {
+        int const x0 = std::floor(u);
+        int const y0 = std::floor(v);
+        float const fx = u-x0;
+        float const fy = v-y0;
+
+        auto get = [&](int x, int y) -> float {
+            if((x < 0) || (y < 0) || (x >= int(image.width)) || (y >= int(image.height)))
+            {
+                return 0.0f;
+            }
+            return image.list_pixels[(y*image.width + x)*image.channels + channel];
+        };
+
+        float const top = get(x0,y0)*(1.0f-fx) + get(x0+1,y0)*fx;
+        float const bottom = get(x0,y0+1)*(1.0f-fx) + get(x0+1,y0+1)*fx;
+        return top*(1.0f-fy) + bottom*fy;
+    }
+
+    bool SampleInside(SDFImage const &image, float u, float v)
+    {
+        if(image.channels == 1)
+        {
+            return SampleChannel(image,u,v,0) > 127.5f;
+        }
+
+        float const r = SampleChannel(image,u,v,0);
+        float const g = SampleChannel(image,u,v,1);
+        float const b = SampleChannel(image,u,v,2);
+        float const median = std::max(std::min(r,g),std::min(std::max(r,g),b));
+        return median > 127.5f;
+    }
+
+    // * Number of pixels in @ref where @image, scaled up
+    //   from @res_px, is on the wrong side of the edge
+    u64 CountErrors(Bitmap const &ref, SDFImage const &image, uint res_px)
+    {
+        float const scale = float(res_px)/kRefResPx;
+
+        u64 errors = 0;
+        for(uint y=0; y < ref.height; y++)
+        {
+            for(uint x=0; x < ref.width; x++)
+            {
+                float const gx = (ref.left + x + 0.5f)*scale;
+                float const gy = (ref.top - (y + 0.5f))*scale;
+                float const u = gx - image.left - 0.5f;
+                float const v = image.top - gy - 0.5f;
+
+                u8 const coverage = ref.list_pixels[y*ref.width + x];
+                if((coverage > 32) && (coverage < 224))
+                {
+                    continue;
+                }
+
+                bool const ref_inside = (coverage >= 128);
+                errors += (SampleInside(image,u,v) != ref_inside);
+            }
+        }
+
+        return errors;
+    }
+
+    uint TestFont(FT_Library library,
+                  std::string const &font_path)
+    {
+        FT_Face face;
+        if(FT_New_Face(library,font_path.c_str(),0,&face))
+        {
+            LOG.Error() << "TestTextOutlineSDF: Failed to load " << font_path;
+            return 1;
+        }
+
+        struct EngineDesc
+        {
+            text::SDFEngine engine;
+            uint res_px;
+            std::string name;
+            EngineResult result;
+        };
+
+        // Groups of EDTAA3, Outline and OutlineMSDF
+        // at each glyph resolution
+        std::vector<EngineDesc> list_engines;
+        for(uint res_px : {32,16})
+        {
+            list_engines.push_back({text::SDFEngine::EDTAA3,res_px,"EDTAA3",{}});
+            list_engines.push_back({text::SDFEngine::Outline,res_px,"Outline",{}});
+            list_engines.push_back({text::SDFEngine::OutlineMSDF,res_px,"OutlineMSDF",{}});
+        }
+
+        u64 glyph_count = 0;
+        u64 ref_pixel_count = 0;
+        SDFImage image;
+
+        for(FT_Long index=0; index < face->num_glyphs; index++)
+        {
+            if(!LoadGlyph(face,kRefResPx,index,true))
+            {
+                continue;
+            }
+
+            Bitmap const ref = GetBitmap(face->glyph);
+            if(ref.width*ref.height == 0)
+            {
+                continue;
+            }
+
+            glyph_count++;
+            for(u8 const p : ref.list_pixels)
+            {
+                ref_pixel_count += (p >= 128);
+            }
+
+            for(auto &desc : list_engines)
+            {
+                if(MakeSDF(face,index,desc.res_px,desc.engine,image,
+                           desc.result.time_ms))
+                {
+                    desc.result.error_count += CountErrors(ref,image,desc.res_px);
+                }
+            }
+        }
+
+        FT_Done_Face(face);
+
+        LOG.Info() << "TestTextOutlineSDF: " << font_path
+                   << " (" << glyph_count << " glyphs)";
+
+        for(auto const &desc : list_engines)
+        {
+            LOG.Info() << "TestTextOutlineSDF: " << desc.name
+                       << " at " << desc.res_px << "px: "
+                       << desc.result.time_ms << "ms, "
+                       << "wrong pixels at " << kRefResPx << "px: "
+                       << 100.0*desc.result.error_count/ref_pixel_count << "%";
+        }
+
+        // Each engine against the previous one in its group
+        uint failures = 0;
+        for(uint i=0; i < list_engines.size(); i++)
+        {
+            if(((i%3) != 0) &&
+               (list_engines[i].result.error_count >
+                list_engines[i-1].result.error_count))
+            {
+                LOG.Error() << "TestTextOutlineSDF: "
+                            << list_engines[i].name
+                            << " at " << list_engines[i].res_px << "px"
+                            << " is less accurate than "
+                            << list_engines[i-1].name;
+                failures++;
+            }
+        }
+
+        return failures;
+    }
+}
+
+// ============================================================= //
+// ============================================================= //
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> list_font_paths;
+    for(int i=1; i < argc; i++)
+    {
+        list_font_paths.push_back(argv[i]);
+    }
+
+    if(list_font_paths.empty())
+    {
+        list_font_paths.push_back("/home/preet/Dev/FiraSans-Regular.ttf");
+    }
+
+    FT_Library library;
+    if(FT_Init_FreeType(&library))
+    {
+        ks::LOG.Error() << "TestTextOutlineSDF: Failed to init FreeType";
+        return 1;
+    }
+
+    ks::uint failures = 0;
+    for(auto const &font_path : list_font_paths)
+    {
+        failures += test::TestFont(library,font_path);
+    }
+
+    FT_Done_FreeType(library);
+
+    if(failures > 0)
+    {
+        ks::LOG.Error() << "TestTextOutlineSDF: " << failures << " failures";
+        return 1;
+    }
+
+    ks::LOG.Info() << "TestTextOutlineSDF: Outline engines matched";
+    return 0;
+}
+
+
+// ============================================================= //
+// ============================================================= //
@@ -0,0 +1,282 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <thread>
+
+#include <ks/KsLog.hpp>
+#include <ks/text/KsTextTextManager.hpp>
+
+// Checks prewarming without drawing anything:
+// * Glyphs from a prewarm job are in the atlas once the job
+//   is done, so GetGlyphs for the same text doesn't add any.
+//   The prewarmed glyphs' signals are sent from the thread
+//   that calls the TextManager, not the prewarm thread
+// * CancelPrewarm stops a job before it's done, leaves other
+//   jobs alone, and WaitForPrewarm still returns
+// * Prewarming stops once the atlas budget is reached and
+//   doesn't compact the atlases
+
+namespace test
+{
+    using namespace ks;
+
+    uint g_errors = 0;
+
+    void Check(bool ok,
+               std::string const &desc,
+               std::string const &what)
+    {
+        if(!ok)
+        {
+            LOG.Error() << "TestTextPrewarm: Failed: "
+                        << desc << ": " << what;
+            g_errors++;
+        }
+    }
+
+    // Enough glyphs that prewarming them takes a while
+    std::vector<std::pair<u32,u32>> const list_large_ranges = {
+        {0x0021,0x024F}, // Latin
+        {0x0370,0x03FF}, // Greek
+        {0x0400,0x04FF}, // Cyrillic
+        {0x2190,0x22FF}, // Arrows and math operators
+        {0x2500,0x25FF}  // Box drawing and shapes
+    };
+
+    // * Counts the signals from a TextManager and the ones
+    //   that weren't sent from the thread it was created on
+    class SignalCounter
+    {
+    public:
+        SignalCounter(text::TextManager &text_manager) :
+            thread_id(std::this_thread::get_id()),
+            new_atlas_count(0),
+            new_glyph_count(0),
+            compaction_count(0),
+            other_thread_count(0)
+        {
+            text_manager.signal_new_atlas->Connect(
+                        [this](uint,uint) {
+                            new_atlas_count++;
+                            checkThread();
+                        });
+
+            text_manager.signal_new_glyph->Connect(
+                        [this](uint,glm::u16vec2,shared_ptr<ImageData>) {
+                            new_glyph_count++;
+                            checkThread();
+                        });
+
+            text_manager.signal_atlases_compacted->Connect(
+                        [this](uint) {
+                            compaction_count++;
+                            checkThread();
+                        });
+        }
+
+        std::thread::id const thread_id;
+        uint new_atlas_count;
+        uint new_glyph_count;
+        uint compaction_count;
+        uint other_thread_count;
+
+    private:
+        void checkThread()
+        {
+            if(std::this_thread::get_id() != thread_id)
+            {
+                other_thread_count++;
+            }
+        }
+    };
+
+    // * Returns the number of glyphs a prewarm job for
+    //   @list_ranges adds when it isn't cancelled
+    uint GetPrewarmGlyphCount(std::string const &font_path,
+                              std::vector<std::pair<u32,u32>> const &list_ranges)
+    {
+        text::TextManager text_manager(512,24,4);
+        SignalCounter counter(text_manager);
+        text_manager.AddFont("font",font_path);
+
+        counter.new_glyph_count = 0;
+        text_manager.Prewarm("font",list_ranges);
+        text_manager.WaitForPrewarm();
+
+        return counter.new_glyph_count;
+    }
+
+    void TestPrewarmedGlyphs(std::string const &font_path)
+    {
+        std::string const desc = "Prewarmed glyphs";
+
+        std::u16string const text =
+                u"The quick brown fox jumps over the lazy dog";
+
+        text::TextManager text_manager(512,24,4);
+        SignalCounter counter(text_manager);
+        text_manager.AddFont("font",font_path);
+
+        counter.new_glyph_count = 0;
+        text_manager.Prewarm("font",std::vector<std::u16string>{text});
+        text_manager.WaitForPrewarm();
+
+        Check(counter.new_glyph_count > 0,desc,
+              "Expected glyphs from the prewarm job");
+
+        Check(counter.other_thread_count == 0,desc,
+              ks::ToString(counter.other_thread_count)+
+              " signals were sent from the prewarm thread");
+
+        counter.new_glyph_count = 0;
+        auto const list_lines =
+                text_manager.GetGlyphs(text,text_manager.CreateHint("font"));
+
+        Check(!list_lines->empty(),desc,"Expected glyphs for the text");
+
+        Check(counter.new_glyph_count == 0,desc,
+              "GetGlyphs added "+ks::ToString(counter.new_glyph_count)+
+              " glyphs that should have been prewarmed");
+    }
+
+    void TestCancelPrewarm(std::string const &font_path,
+                           uint full_glyph_count)
+    {
+        std::string const desc = "CancelPrewarm";
+
+        std::u16string const text = u"abcdefghijklmnopqrstuvwxyz";
+
+        text::TextManager text_manager(512,24,4);
+        SignalCounter counter(text_manager);
+        text_manager.AddFont("font",font_path);
+
+        // Cancelling one job leaves the other running
+        counter.new_glyph_count = 0;
+        uint const large_job =
+                text_manager.Prewarm("font",list_large_ranges);
+
+        text_manager.Prewarm("font",std::vector<std::u16string>{text});
+        text_manager.CancelPrewarm(large_job);
+        text_manager.WaitForPrewarm();
+
+        Check(counter.new_glyph_count < full_glyph_count,desc,
+              "Expected the cancelled job to stop early: "+
+              ks::ToString(counter.new_glyph_count)+" of "+
+              ks::ToString(full_glyph_count)+" glyphs");
+
+        counter.new_glyph_count = 0;
+        text_manager.GetGlyphs(text,text_manager.CreateHint("font"));
+
+        Check(counter.new_glyph_count == 0,desc,
+              "Expected the job that wasn't cancelled to finish");
+
+        // Cancelling every job
+        counter.new_glyph_count = 0;
+        text_manager.Prewarm("font",list_large_ranges);
+        text_manager.Prewarm("font",list_large_ranges,1);
+        text_manager.CancelPrewarm();
+        text_manager.WaitForPrewarm();
+
+        Check(counter.new_glyph_count < full_glyph_count,desc,
+              "Expected the cancelled jobs to stop early: "+
+              ks::ToString(counter.new_glyph_count)+" of "+
+              ks::ToString(full_glyph_count)+" glyphs");
+
+        Check(counter.other_thread_count == 0,desc,
+              ks::ToString(counter.other_thread_count)+
+              " signals were sent from the prewarm thread");
+    }
+
+    void TestAtlasBudget(std::string const &font_path,
+                         uint full_glyph_count)
+    {
+        std::string const desc = "Atlas budget";
+
+        uint const max_atlas_count = 2;
+
+        text::TextManager text_manager(256,24,4);
+        text_manager.SetMaxAtlasCount(max_atlas_count);
+        SignalCounter counter(text_manager);
+        text_manager.AddFont("font",font_path);
+
+        counter.new_glyph_count = 0;
+        text_manager.Prewarm("font",list_large_ranges);
+        text_manager.WaitForPrewarm();
+
+        // Each step checks the budget before it starts, so the
+        // last one can go over it; the next GetGlyphs compacts
+        uint const atlas_count = text_manager.GetAtlasOccupancy().size();
+
+        Check(atlas_count >= max_atlas_count,desc,
+              "Expected the budget to be reached: "+
+              ks::ToString(atlas_count)+" atlases");
+
+        Check(counter.new_glyph_count < full_glyph_count,desc,
+              "Expected prewarming to stop at the budget: "+
+              ks::ToString(counter.new_glyph_count)+" of "+
+              ks::ToString(full_glyph_count)+" glyphs");
+
+        Check(counter.compaction_count == 0,desc,
+              "Prewarming compacted the atlases");
+
+        // Another job doesn't do anything once the budget is full
+        counter.new_glyph_count = 0;
+        counter.new_atlas_count = 0;
+        text_manager.Prewarm("font",std::vector<std::u16string>{u"\u0416\u0436"});
+        text_manager.WaitForPrewarm();
+
+        Check((counter.new_glyph_count == 0) &&
+              (counter.new_atlas_count == 0) &&
+              (counter.compaction_count == 0),desc,
+              "Expected a job started at the budget to do nothing");
+    }
+}
+
+// ============================================================= //
+// ============================================================= //
+
+int main(int argc, char* argv[])
+{
+    std::string font_path = "/home/preet/Dev/DejaVuSans.ttf";
+    if(argc > 1)
+    {
+        font_path = argv[1];
+    }
+
+    uint const full_glyph_count =
+            test::GetPrewarmGlyphCount(font_path,test::list_large_ranges);
+
+    ks::LOG.Info() << "TestTextPrewarm: " << full_glyph_count
+                   << " glyphs without cancelling";
+
+    test::TestPrewarmedGlyphs(font_path);
+    test::TestCancelPrewarm(font_path,full_glyph_count);
+    test::TestAtlasBudget(font_path,full_glyph_count);
+
+    if(test::g_errors > 0)
+    {
+        ks::LOG.Error() << "TestTextPrewarm: " << test::g_errors
+                        << " errors";
+        return 1;
+    }
+
+    ks::LOG.Info() << "TestTextPrewarm: All checks passed";
+    return 0;
+}
+
+
+// ============================================================= //
+// ============================================================= //
@@ -0,0 +1,279 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <chrono>
+#include <fstream>
+
+#include <ks/KsLog.hpp>
+#include <ks/text/KsTextFreeType.hpp>
+#include <ks/text/KsTextSDF.hpp>
+
+// Compares the distance fields from each SDFEngine against
+// SDFEngine::EDTAA3 (make_distance_map) for every glyph in
+// the fonts passed as arguments and reports how long each
+// engine took. SDFEngine::Fast has to be within 1 of EDTAA3
+// everywhere; SDFEngine::FastBanded has to be within 1 of
+// EDTAA3 wherever EDTAA3 is within the band.
+
+namespace test
+{
+    using namespace ks;
+
+    struct GlyphBitmap
+    {
+        uint width;
+        uint height;
+        std::vector<u8> list_pixels;
+    };
+
+    struct EngineResult
+    {
+        double time_ms{0};
+        uint max_error{0};
+        u64 sum_error{0};
+        u64 pixel_count{0};
+        u64 diff_count{0};
+    };
+
+    // * Renders every glyph in the font at @glyph_res_px and
+    //   pads each one by @sdf_offset_px the same way TextAtlas
+    //   does before it applies the SDF transform
+    std::vector<GlyphBitmap> RenderGlyphs(FT_Library library,
+                                          std::string const &font_path,
+                                          uint glyph_res_px,
+                                          uint sdf_offset_px)
+    {
+        std::vector<GlyphBitmap> list_bitmaps;
+
+        FT_Face face;
+        if(FT_New_Face(library,font_path.c_str(),0,&face) ||
+           FT_Set_Char_Size(face,glyph_res_px*64,glyph_res_px*64,72,72))
+        {
+            LOG.Error() << "TestTextSDF: Failed to load " << font_path;
+            return list_bitmaps;
+        }
+
+        for(FT_Long index=0; index < face->num_glyphs; index++)
+        {
+            if(FT_Load_Glyph(face,index,FT_LOAD_RENDER))
+            {
+                continue;
+            }
+
+            FT_Bitmap const &bitmap = face->glyph->bitmap;
+            if((bitmap.width == 0) || (bitmap.rows == 0))
+            {
+                continue;
+            }
+
+            GlyphBitmap glyph;
+            glyph.width = bitmap.width + 2*sdf_offset_px;
+            glyph.height = bitmap.rows + 2*sdf_offset_px;
+            glyph.list_pixels.resize(glyph.width*glyph.height,0);
+
+            for(uint r=0; r < uint(bitmap.rows); r++)
+            {
+                int const row = (bitmap.pitch > 0) ? r : (bitmap.rows-1-r);
+                u8 const * src = bitmap.buffer + row*std::abs(bitmap.pitch);
+                u8 * dst = &(glyph.list_pixels[
+                        (r+sdf_offset_px)*glyph.width + sdf_offset_px]);
+
+                std::copy(src,src+bitmap.width,dst);
+            }
+
+            list_bitmaps.push_back(std::move(glyph));
+        }
+
+        FT_Done_Face(face);
+
+        return list_bitmaps;
+    }
+
+    std::vector<std::vector<u8>>
+    RunEngine(text::SDFEngine engine,
+              std::vector<GlyphBitmap> const &list_bitmaps,
+              uint sdf_offset_px,
+              double &time_ms)
+    {
+        std::vector<std::vector<u8>> list_sdfs;
+        list_sdfs.reserve(list_bitmaps.size());
+        for(auto const &glyph : list_bitmaps)
+        {
+            list_sdfs.push_back(glyph.list_pixels);
+        }
+
+        auto const start = std::chrono::steady_clock::now();
+        for(uint i=0; i < list_bitmaps.size(); i++)
+        {
+            text::MakeDistanceMap(engine,
+                                  list_sdfs[i].data(),
+                                  list_bitmaps[i].width,
+                                  list_bitmaps[i].height,
+                                  sdf_offset_px);
+        }
+        auto const end = std::chrono::steady_clock::now();
+
+        time_ms = std::chrono::duration<double,std::milli>(
+                    end-start).count();
+
+        return list_sdfs;
+    }
+
+    EngineResult CompareEngine(text::SDFEngine engine,
+                               std::vector<GlyphBitmap> const &list_bitmaps,
+                               std::vector<std::vector<u8>> const &list_ref_sdfs,
+                               uint sdf_offset_px)
+    {
+        EngineResult result;
+
+        auto const list_sdfs =
+                RunEngine(engine,list_bitmaps,sdf_offset_px,result.time_ms);
+
+        // Reference values further than the band from an edge
+        // are clamped by FastBanded, so they aren't compared
+        sint const band =
+                (engine == text::SDFEngine::FastBanded) ?
+                    sint(sdf_offset_px*16) : 255;
+
+        for(uint i=0; i < list_sdfs.size(); i++)
+        {
+            for(uint j=0; j < list_sdfs[i].size(); j++)
+            {
+                sint const ref = list_ref_sdfs[i][j];
+                if(std::abs(ref-127) > band)
+                {
+                    continue;
+                }
+
+                uint const error = std::abs(ref-sint(list_sdfs[i][j]));
+                result.max_error = std::max(result.max_error,error);
+                result.sum_error += error;
+                result.pixel_count++;
+                result.diff_count += (error > 0);
+            }
+        }
+
+        return result;
+    }
+
+    uint TestFont(FT_Library library,
+                  std::string const &font_path,
+                  uint glyph_res_px,
+                  uint sdf_offset_px)
+    {
+        auto const list_bitmaps =
+                RenderGlyphs(library,font_path,glyph_res_px,sdf_offset_px);
+
+        if(list_bitmaps.empty())
+        {
+            return 1;
+        }
+
+        double ref_time_ms;
+        auto const list_ref_sdfs =
+                RunEngine(text::SDFEngine::EDTAA3,
+                          list_bitmaps,
+                          sdf_offset_px,
+                          ref_time_ms);
+
+        LOG.Info() << "TestTextSDF: " << font_path
+                   << " (" << glyph_res_px << "px, "
+                   << list_bitmaps.size() << " glyphs): "
+                   << "EDTAA3: " << ref_time_ms << "ms";
+
+        uint failures = 0;
+
+        std::vector<std::pair<text::SDFEngine,std::string>> const list_engines = {
+            { text::SDFEngine::Fast, "Fast" },
+            { text::SDFEngine::FastBanded, "FastBanded" }
+        };
+
+        for(auto const &engine : list_engines)
+        {
+            EngineResult const result =
+                    CompareEngine(engine.first,
+                                  list_bitmaps,
+                                  list_ref_sdfs,
+                                  sdf_offset_px);
+
+            LOG.Info() << "TestTextSDF: " << engine.second << ": "
+                       << result.time_ms << "ms ("
+                       << ref_time_ms/result.time_ms << "x), "
+                       << "max error: " << result.max_error << ", "
+                       << "mean error: "
+                       << double(result.sum_error)/result.pixel_count << ", "
+                       << "pixels that differ: "
+                       << 100.0*result.diff_count/result.pixel_count << "%";
+
+            if(result.max_error > 1)
+            {
+                LOG.Error() << "TestTextSDF: " << engine.second
+                            << ": error is too large";
+                failures++;
+            }
+        }
+
+        return failures;
+    }
+}
+
+// ============================================================= //
+// ============================================================= //
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> list_font_paths;
+    for(int i=1; i < argc; i++)
+    {
+        list_font_paths.push_back(argv[i]);
+    }
+
+    if(list_font_paths.empty())
+    {
+        list_font_paths.push_back("/home/preet/Dev/FiraSans-Regular.ttf");
+    }
+
+    FT_Library library;
+    if(FT_Init_FreeType(&library))
+    {
+        ks::LOG.Error() << "TestTextSDF: Failed to init FreeType";
+        return 1;
+    }
+
+    ks::uint failures = 0;
+    for(auto const &font_path : list_font_paths)
+    {
+        for(ks::uint glyph_res_px : {16,32,64})
+        {
+            failures += test::TestFont(library,font_path,glyph_res_px,4);
+        }
+    }
+
+    FT_Done_FreeType(library);
+
+    if(failures > 0)
+    {
+        ks::LOG.Error() << "TestTextSDF: " << failures << " failures";
+        return 1;
+    }
+
+    ks::LOG.Info() << "TestTextSDF: All engines matched";
+    return 0;
+}
+
+
+// ============================================================= //
+// ============================================================= //
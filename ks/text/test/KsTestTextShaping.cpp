@@ -0,0 +1,413 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <chrono>
+#include <limits>
+
+#include <ks/KsLog.hpp>
+#include <ks/text/KsTextTextManager.hpp>
+
+// Validates simple shaping (Hint::simple_shaping) against
+// HarfBuzz by shaping a corpus of text both ways and checking
+// that the glyphs are identical. Fonts are passed as arguments;
+// fonts without GSUB/GPOS tables (or with only a 'kern' table)
+// exercise the simple shaping path the most.
+//
+// The corpus is also shaped with HarfBuzz's OpenType font funcs
+// (TextManager::EnableOpenTypeFontFuncs), which has to give the
+// same glyphs as hb-ft, and the time taken to measure a line is
+// logged for each way of shaping.
+//
+// MeasureText is checked against GetGlyphs: each line's range,
+// advance, bounding box and font metrics and the overall
+// bounding box have to match, and measuring the corpus can't
+// emit any atlas signals.
+
+namespace test
+{
+    using namespace ks;
+
+    std::vector<std::string> const list_corpus = {
+        u8"This text shows a single line",
+        u8"The quick brown fox jumps over the lazy dog. 0123456789",
+        u8"AV AW AY LT LV LW LY PA TA Te To Tr Tu Tw Ty VA Va Ve Vo WA Wa",
+        u8"!\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~",
+        u8"Καλημέρα κόσμε, ΑΥΤΟ ΤΟ ΒΑΖΟ",
+        u8"Съешь же ещё этих мягких французских булок, да выпей чаю",
+        u8"漢字とひらがなとカタカナ、ㄅㄆㄇㄈ。中文",
+        u8"tabs\tand\nnew\r\nlines\n\n",
+        u8"combining e\u0301, soft\u00ADhyphen, zero\u200Bwidth, \U0001F600",
+        u8"\u2003em space, \u2011 nb hyphen, ﬁ ligature",
+        u8"mixed العربية and עברית with latin",
+        u8"text that is long enough that it has to be broken "
+        u8"into several lines to fit within the line width"
+    };
+
+    bool IsSameGlyph(text::Glyph const &a, text::Glyph const &b)
+    {
+        return ((a.cluster == b.cluster) &&
+                (a.atlas == b.atlas) &&
+                (a.tex_x == b.tex_x) &&
+                (a.tex_y == b.tex_y) &&
+                (a.sdf_x == b.sdf_x) &&
+                (a.sdf_y == b.sdf_y) &&
+                (a.x0 == b.x0) &&
+                (a.y0 == b.y0) &&
+                (a.x1 == b.x1) &&
+                (a.y1 == b.y1) &&
+                (a.rtl == b.rtl));
+    }
+
+    bool IsSameLines(std::vector<text::Line> const &list_a,
+                     std::vector<text::Line> const &list_b)
+    {
+        if(list_a.size() != list_b.size())
+        {
+            return false;
+        }
+
+        for(uint i=0; i < list_a.size(); i++)
+        {
+            text::Line const &a = list_a[i];
+            text::Line const &b = list_b[i];
+
+            if((a.start != b.start) ||
+               (a.end != b.end) ||
+               (a.list_glyphs.size() != b.list_glyphs.size()))
+            {
+                return false;
+            }
+
+            for(uint j=0; j < a.list_glyphs.size(); j++)
+            {
+                if(!IsSameGlyph(a.list_glyphs[j],b.list_glyphs[j]))
+                {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    bool IsSameMetrics(text::TextMetrics const &metrics,
+                       std::vector<text::Line> const &list_lines)
+    {
+        if(metrics.list_lines.size() != list_lines.size())
+        {
+            return false;
+        }
+
+        sint x_min = std::numeric_limits<sint>::max();
+        sint x_max = std::numeric_limits<sint>::min();
+        sint y_min = std::numeric_limits<sint>::max();
+        sint y_max = std::numeric_limits<sint>::min();
+
+        for(uint i=0; i < list_lines.size(); i++)
+        {
+            text::LineMetrics const &a = metrics.list_lines[i];
+            text::Line const &b = list_lines[i];
+
+            // The cluster spans are laid out with the same
+            // pen as the glyphs, starting at 0
+            sint const advance = b.list_cluster_spans.empty() ?
+                        0 : b.list_cluster_spans.back().x1;
+
+            if((a.start != b.start) ||
+               (a.end != b.end) ||
+               (a.advance != advance) ||
+               (a.x_min != b.x_min) ||
+               (a.x_max != b.x_max) ||
+               (a.y_min != b.y_min) ||
+               (a.y_max != b.y_max) ||
+               (a.ascent != b.ascent) ||
+               (a.descent != b.descent) ||
+               (a.spacing != b.spacing) ||
+               (a.rtl != b.rtl))
+            {
+                return false;
+            }
+
+            y_min = std::min(y_min,b.baseline_y+b.descent);
+            y_max = std::max(y_max,b.baseline_y+b.ascent);
+
+            if(!b.list_glyphs.empty())
+            {
+                x_min = std::min(x_min,b.x_min);
+                x_max = std::max(x_max,b.x_max);
+                y_min = std::min(y_min,b.baseline_y+b.y_min);
+                y_max = std::max(y_max,b.baseline_y+b.y_max);
+            }
+        }
+
+        if(x_min > x_max)
+        {
+            x_min = 0;
+            x_max = 0;
+        }
+
+        return ((metrics.x_min == x_min) &&
+                (metrics.x_max == x_max) &&
+                (metrics.y_min == y_min) &&
+                (metrics.y_max == y_max));
+    }
+
+    // * Returns the number of texts in the corpus that
+    //   MeasureText doesn't measure the same as GetGlyphs,
+    //   plus one if it emitted any atlas signals
+    uint TestMeasureText(std::string const &font_path,
+                         uint glyph_res_px,
+                         bool simple_shaping)
+    {
+        text::TextManager text_manager(1024,glyph_res_px,4);
+        text_manager.AddFont(font_path,font_path);
+
+        uint signal_count = 0;
+        text_manager.signal_new_atlas->Connect(
+                    [&](uint,uint) { signal_count++; });
+        text_manager.signal_new_glyph->Connect(
+                    [&](uint,glm::u16vec2,shared_ptr<ImageData>) {
+                        signal_count++;
+                    });
+        text_manager.signal_atlas_updated->Connect(
+                    [&](uint,std::vector<text::AtlasRect>,shared_ptr<ImageData>) {
+                        signal_count++;
+                    });
+        text_manager.signal_atlases_compacted->Connect(
+                    [&](uint) { signal_count++; });
+
+        text::Hint text_hint = text_manager.CreateHint(font_path);
+        text_hint.max_line_width_px = glyph_res_px*20;
+        text_hint.simple_shaping = simple_shaping;
+
+        std::string const desc =
+                font_path + " (" + ks::ToString(glyph_res_px) + "px" +
+                (simple_shaping ? ", simple" : "") + ")";
+
+        // Measure everything before any glyphs are rasterized
+        std::vector<text::TextMetrics> list_metrics;
+        for(auto const &text : list_corpus)
+        {
+            list_metrics.push_back(
+                        text_manager.MeasureText(
+                            text::TextManager::ConvertStringUTF8ToUTF16(text),
+                            text_hint));
+        }
+
+        uint mismatches = 0;
+        if(signal_count > 0)
+        {
+            LOG.Error() << "TestTextShaping: MeasureText emitted "
+                        << signal_count << " atlas signals: " << desc;
+            mismatches++;
+        }
+
+        for(uint i=0; i < list_corpus.size(); i++)
+        {
+            auto const list_lines =
+                    text_manager.GetGlyphs(
+                        text::TextManager::ConvertStringUTF8ToUTF16(
+                            list_corpus[i]),
+                        text_hint);
+
+            if(!IsSameMetrics(list_metrics[i],*list_lines))
+            {
+                LOG.Error() << "TestTextShaping: MeasureText mismatch: "
+                            << desc << ": " << list_corpus[i];
+                mismatches++;
+            }
+        }
+
+        return mismatches;
+    }
+
+    double TimeMeasureText(text::TextManager &text_manager,
+                           text::Hint const &text_hint,
+                           std::u16string const &utf16text)
+    {
+        uint const iterations = 1000;
+
+        auto const start = std::chrono::steady_clock::now();
+        for(uint i=0; i < iterations; i++)
+        {
+            text_manager.MeasureText(utf16text,text_hint);
+        }
+        auto const end = std::chrono::steady_clock::now();
+
+        return std::chrono::duration<double,std::micro>(
+                    end-start).count()/iterations;
+    }
+
+    // * Returns the number of mismatches between simple
+    //   shaping and HarfBuzz for each text in the corpus
+    uint TestSimpleShaping(text::TextManager &text_manager,
+                           text::Hint text_hint,
+                           std::string const &desc)
+    {
+        uint mismatches = 0;
+
+        for(auto const &text : list_corpus)
+        {
+            std::u16string const utf16text =
+                    text::TextManager::ConvertStringUTF8ToUTF16(text);
+
+            text_hint.simple_shaping = false;
+            auto list_hb_lines =
+                    text_manager.GetGlyphs(utf16text,text_hint);
+
+            text_hint.simple_shaping = true;
+            auto list_simple_lines =
+                    text_manager.GetGlyphs(utf16text,text_hint);
+
+            if(!IsSameLines(*list_hb_lines,*list_simple_lines))
+            {
+                LOG.Error() << "TestTextShaping: Mismatch: "
+                            << desc << ": " << text;
+                mismatches++;
+            }
+        }
+
+        return mismatches;
+    }
+
+    uint TestFont(std::string const &font_path,
+                  uint glyph_res_px)
+    {
+        text::TextManager text_manager(1024,glyph_res_px,4);
+        text_manager.AddFont(font_path,font_path);
+
+        text::TextManager ot_text_manager(1024,glyph_res_px,4);
+        ot_text_manager.EnableOpenTypeFontFuncs();
+        ot_text_manager.AddFont(font_path,font_path);
+
+        text::Hint text_hint = text_manager.CreateHint(font_path);
+        text_hint.max_line_width_px = glyph_res_px*20;
+
+        text::Hint ot_text_hint = ot_text_manager.CreateHint(font_path);
+        ot_text_hint.max_line_width_px = text_hint.max_line_width_px;
+
+        std::string const desc =
+                font_path + " (" + ks::ToString(glyph_res_px) + "px)";
+
+        uint mismatches = 0;
+
+        // Compare hb-ft with the OpenType font funcs first, while
+        // both atlases are empty, so glyphs are added to them in
+        // the same order
+        text_hint.simple_shaping = false;
+        ot_text_hint.simple_shaping = false;
+
+        for(auto const &text : list_corpus)
+        {
+            std::u16string const utf16text =
+                    text::TextManager::ConvertStringUTF8ToUTF16(text);
+
+            // The OpenType font funcs map characters outside of
+            // the BMP with the font's full cmap, which FreeType's
+            // UCS-2 charmap doesn't cover, so those texts differ
+            bool has_surrogates = false;
+            for(char16_t c : utf16text)
+            {
+                has_surrogates |= ((c >= 0xD800) && (c <= 0xDFFF));
+            }
+
+            if(has_surrogates)
+            {
+                continue;
+            }
+
+            auto list_ft_lines =
+                    text_manager.GetGlyphs(utf16text,text_hint);
+
+            auto list_ot_lines =
+                    ot_text_manager.GetGlyphs(utf16text,ot_text_hint);
+
+            if(!IsSameLines(*list_ft_lines,*list_ot_lines))
+            {
+                LOG.Error() << "TestTextShaping: Mismatch: "
+                            << desc << " ft/ot: " << text;
+                mismatches++;
+            }
+        }
+
+        mismatches += TestSimpleShaping(text_manager,text_hint,desc);
+        mismatches += TestSimpleShaping(ot_text_manager,ot_text_hint,desc+" ot");
+
+        mismatches += TestMeasureText(font_path,glyph_res_px,false);
+        mismatches += TestMeasureText(font_path,glyph_res_px,true);
+
+        std::u16string const utf16text =
+                text::TextManager::ConvertStringUTF8ToUTF16(
+                    list_corpus[1]);
+
+        double const hb_us =
+                TimeMeasureText(text_manager,text_hint,utf16text);
+
+        double const hb_ot_us =
+                TimeMeasureText(ot_text_manager,ot_text_hint,utf16text);
+
+        text_hint.simple_shaping = true;
+        double const simple_us =
+                TimeMeasureText(text_manager,text_hint,utf16text);
+
+        LOG.Info() << "TestTextShaping: " << desc << ": "
+                   << "harfbuzz: " << hb_us << "us, "
+                   << "harfbuzz ot: " << hb_ot_us << "us, "
+                   << "simple: " << simple_us << "us";
+
+        return mismatches;
+    }
+}
+
+// ============================================================= //
+// ============================================================= //
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> list_font_paths;
+    for(int i=1; i < argc; i++)
+    {
+        list_font_paths.push_back(argv[i]);
+    }
+
+    if(list_font_paths.empty())
+    {
+        list_font_paths.push_back("/home/preet/Dev/FiraSans-Regular.ttf");
+    }
+
+    ks::uint mismatches = 0;
+    for(auto const &font_path : list_font_paths)
+    {
+        for(ks::uint glyph_res_px : {12,24,32})
+        {
+            mismatches += test::TestFont(font_path,glyph_res_px);
+        }
+    }
+
+    if(mismatches > 0)
+    {
+        ks::LOG.Error() << "TestTextShaping: " << mismatches
+                        << " mismatches";
+        return 1;
+    }
+
+    ks::LOG.Info() << "TestTextShaping: All glyphs matched";
+    return 0;
+}
+
+
+// ============================================================= //
+// ============================================================= //
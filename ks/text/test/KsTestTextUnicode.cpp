@@ -0,0 +1,422 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <memory>
+#include <random>
+
+#include <icu/common/unicode/unistr.h>
+#include <icu/common/unicode/ubidi.h>
+#include <icu/common/unicode/uscript.h>
+#include <icu/extra/scrptrun.h>
+
+#include <ks/KsLog.hpp>
+#include <ks/text/KsTextUnicode.hpp>
+
+// Conformance test for KsTextUnicode, which replaces ICU when
+// ks_text is built with KS_TEXT_NO_ICU. This has to be built
+// with ICU; it runs a corpus of text and randomly generated
+// strings through both ICU and KsTextUnicode and checks that
+// the bidi runs, script runs and UTF conversions match.
+
+namespace test
+{
+    using namespace ks;
+
+    std::vector<std::string> const list_corpus = {
+        u8"",
+        u8"This text shows a single line",
+        u8"Καλημέρα κόσμε, Съешь же ещё этих мягких булок",
+        u8"漢字とひらがなとカタカナ、ㄅㄆㄇㄈ。中文 (中文) 「かな」",
+        u8"tabs\tand\nnew\r\nlines\n\n",
+        u8"combining é, soft\u00ADhyphen, zero\u200Bwidth, \U0001F600 \U00020000",
+        u8"mixed العربية and עברית with latin",
+        u8"עברית (with [brackets] and numbers 123) עברית",
+        u8"العربية ١٢٣ 456 - 7.8 (abc) ،!",
+        u8"abc \u202Bעברית abc\u202C def \u202Eabc\u202C",
+        u8"abc \u2067עברית (abc)\u2069 def \u2068עברית\u2069 \u2066xyz\u2069",
+        u8"\u2069 unmatched \u202C pdf \u2067 and isolate",
+        u8"עברית\nlatin\r\nالعربية\u2029latin",
+        u8"1+2=3 $4.50 5% -6 #7 עברית 8/9 10:30",
+        u8"a (b [c {d) e] f} g «h» ‹i› “j” 〈k〉 【l】",
+        u8"(ab) [עב] {א b} ab)cd(ef",
+        u8"Ελληνικά (English) Русский [中文] (العربية)"
+    };
+
+    // Characters used to build random strings for the bidi and
+    // script comparisons. These are restricted to characters
+    // whose properties are the same in ICU's data and UCDN's.
+    // U+2329 and U+232A are left out since ICU can pair them with
+    // U+3008 and U+3009 after discarding an unresolved pair.
+    std::vector<char32_t> const list_pool = {
+        'a', 'b', 'Z', '0', '5', ' ', '\t', '\n', '\r',
+        '(', ')', '[', ']', '{', '}', '<', '>', '+', '-',
+        '.', ',', ':', '/', '#', '$', '%', '!', '"',
+        0x00A0, 0x00AB, 0x00BB, 0x00AD, 0x0300, 0x0301,
+        0x0391, 0x03B1, 0x0410, 0x0430,
+        0x05D0, 0x05D1, 0x05B0, 0x05BE,
+        0x0627, 0x0628, 0x064B, 0x060C, 0x06F1,
+        0x0600, 0x200B, 0x200C, 0x200D, 0x200E, 0x200F,
+        0x2018, 0x2019, 0x201C, 0x201D, 0x2039, 0x203A,
+        0x2028, 0x2029, 0x202A, 0x202B, 0x202C, 0x202D, 0x202E,
+        0x2066, 0x2067, 0x2068, 0x2069,
+        0x3001, 0x3008, 0x3009, 0x300C, 0x300D, 0x3042, 0x30A2,
+        0x4E2D, 0xFEFF, 0xFF08, 0xFF09,
+        0x1D400, 0x1F600, 0x20000, 0xD800, 0xDC00
+    };
+
+    // ============================================================= //
+
+    std::u16string ToUTF16(std::u32string const &utf32text)
+    {
+        std::u16string utf16text;
+        for(char32_t c : utf32text)
+        {
+            if(c < 0x10000)
+            {
+                utf16text.push_back(c);
+            }
+            else
+            {
+                utf16text.push_back(0xD7C0 + (c >> 10));
+                utf16text.push_back(0xDC00 | (c & 0x3FF));
+            }
+        }
+        return utf16text;
+    }
+
+    std::string ToHexString(std::u16string const &utf16text)
+    {
+        std::string hex;
+        char buff[8];
+        for(char16_t c : utf16text)
+        {
+            snprintf(buff,sizeof(buff),"%04X ",static_cast<uint>(c));
+            hex += buff;
+        }
+        return hex;
+    }
+
+    // ============================================================= //
+
+    std::vector<text::BidiItem>
+    IcuItemizeBidi(std::u16string const &utf16text)
+    {
+        std::vector<text::BidiItem> list_items;
+        s32 const length = utf16text.size();
+
+        UErrorCode error = U_ZERO_ERROR;
+        UBiDi * bidi = ubidi_openSized(length,0,&error);
+
+        ubidi_setPara(bidi,
+                      reinterpret_cast<UChar const *>(utf16text.data()),
+                      length,
+                      UBIDI_DEFAULT_LTR,
+                      NULL,
+                      &error);
+
+        s32 const count = ubidi_countRuns(bidi,&error);
+        for(s32 i=0; i < count; i++)
+        {
+            s32 start,run_length;
+            UBiDiDirection direction =
+                    ubidi_getVisualRun(bidi,i,&start,&run_length);
+
+            list_items.push_back(
+                        text::BidiItem{
+                            uint(start),
+                            uint(start+run_length),
+                            (direction == UBIDI_RTL) ?
+                                HB_DIRECTION_RTL : HB_DIRECTION_LTR
+                        });
+        }
+
+        if(list_items.empty())
+        {
+            list_items.push_back(text::BidiItem{0,0,HB_DIRECTION_LTR});
+        }
+
+        ubidi_close(bidi);
+
+        return list_items;
+    }
+
+    std::vector<text::ScriptItem>
+    IcuItemizeScripts(std::u16string const &utf16text)
+    {
+        std::vector<text::ScriptItem> list_items;
+
+        icu_extra::ScriptRun script_run(
+                    reinterpret_cast<UChar const *>(utf16text.data()),
+                    utf16text.size());
+
+        while(script_run.next())
+        {
+            list_items.push_back(
+                        text::ScriptItem{
+                            uint(script_run.getScriptStart()),
+                            uint(script_run.getScriptEnd()),
+                            hb_script_from_string(
+                                uscript_getShortName(
+                                    script_run.getScriptCode()),-1)
+                        });
+        }
+
+        return list_items;
+    }
+
+    // ============================================================= //
+
+    uint TestBidi(std::u16string const &utf16text)
+    {
+        auto const list_icu = IcuItemizeBidi(utf16text);
+        auto const list_ks = text::ItemizeBidi(utf16text.data(),
+                                               utf16text.size(),
+                                               HB_DIRECTION_INVALID);
+
+        bool match = (list_icu.size() == list_ks.size());
+        for(uint i=0; match && i < list_icu.size(); i++)
+        {
+            match = ((list_icu[i].start == list_ks[i].start) &&
+                     (list_icu[i].end == list_ks[i].end) &&
+                     (list_icu[i].dirn == list_ks[i].dirn));
+        }
+
+        if(!match)
+        {
+            LOG.Error() << "TestTextUnicode: Bidi mismatch: "
+                        << ToHexString(utf16text);
+            return 1;
+        }
+
+        return 0;
+    }
+
+    uint TestScripts(std::u16string const &utf16text)
+    {
+        auto const list_icu = IcuItemizeScripts(utf16text);
+        auto const list_ks = text::ItemizeScripts(utf16text.data(),
+                                                  utf16text.size());
+
+        bool match = (list_icu.size() == list_ks.size());
+        for(uint i=0; match && i < list_icu.size(); i++)
+        {
+            match = ((list_icu[i].start == list_ks[i].start) &&
+                     (list_icu[i].end == list_ks[i].end) &&
+                     (list_icu[i].script == list_ks[i].script));
+        }
+
+        if(!match)
+        {
+            LOG.Error() << "TestTextUnicode: Script mismatch: "
+                        << ToHexString(utf16text);
+            return 1;
+        }
+
+        return 0;
+    }
+
+    uint TestConversions(std::string const &utf8text,
+                         std::u16string const &utf16text,
+                         std::u32string const &utf32text)
+    {
+        uint mismatches = 0;
+
+        // UTF-8 to UTF-16
+        icu::UnicodeString icu_from_utf8 =
+                icu::UnicodeString::fromUTF8(utf8text);
+
+        // The text is copied into an exactly sized buffer without
+        // a terminator so reads past its end can be caught (ie. by
+        // AddressSanitizer)
+        std::unique_ptr<char[]> const utf8buff(new char[utf8text.size()]);
+        std::copy(utf8text.begin(),utf8text.end(),utf8buff.get());
+
+        std::u16string ks_from_utf8;
+        text::AppendUTF8AsUTF16(utf8buff.get(),utf8text.size(),ks_from_utf8);
+
+        if(std::u16string(
+                reinterpret_cast<char16_t const *>(icu_from_utf8.getBuffer()),
+                icu_from_utf8.length()) != ks_from_utf8)
+        {
+            LOG.Error() << "TestTextUnicode: UTF-8 to UTF-16 mismatch";
+            mismatches++;
+        }
+
+        // UTF-16 to UTF-8
+        std::string icu_from_utf16;
+        icu::UnicodeString(
+                    reinterpret_cast<UChar const *>(utf16text.data()),
+                    utf16text.size()).toUTF8String(icu_from_utf16);
+
+        std::string ks_from_utf16;
+        text::AppendUTF16AsUTF8(utf16text.data(),utf16text.size(),ks_from_utf16);
+
+        if(icu_from_utf16 != ks_from_utf16)
+        {
+            LOG.Error() << "TestTextUnicode: UTF-16 to UTF-8 mismatch: "
+                        << ToHexString(utf16text);
+            mismatches++;
+        }
+
+        // UTF-32 to UTF-8
+        std::string icu_from_utf32;
+        icu::UnicodeString::fromUTF32(
+                    reinterpret_cast<UChar32 const *>(utf32text.data()),
+                    utf32text.size()).toUTF8String(icu_from_utf32);
+
+        std::string ks_from_utf32;
+        text::AppendUTF32AsUTF8(utf32text.data(),utf32text.size(),ks_from_utf32);
+
+        if(icu_from_utf32 != ks_from_utf32)
+        {
+            LOG.Error() << "TestTextUnicode: UTF-32 to UTF-8 mismatch";
+            mismatches++;
+        }
+
+        // Code point count
+        if(icu::UnicodeString(
+               reinterpret_cast<UChar const *>(utf16text.data()),
+               utf16text.size()).countChar32() !=
+           s32(text::CountCodePoints(utf16text.data(),utf16text.size())))
+        {
+            LOG.Error() << "TestTextUnicode: Code point count mismatch";
+            mismatches++;
+        }
+
+        return mismatches;
+    }
+
+    uint TestText(std::u16string const &utf16text)
+    {
+        return (TestBidi(utf16text) + TestScripts(utf16text));
+    }
+}
+
+// ============================================================= //
+// ============================================================= //
+
+int main(int argc, char* argv[])
+{
+    using namespace test;
+
+    ks::uint iterations = 20000;
+    if(argc > 1)
+    {
+        iterations = std::stoul(argv[1]);
+    }
+
+    ks::uint mismatches = 0;
+
+    // Corpus
+    for(auto const &utf8text : list_corpus)
+    {
+        icu::UnicodeString icu_string =
+                icu::UnicodeString::fromUTF8(utf8text);
+
+        std::u16string const utf16text(
+                    reinterpret_cast<char16_t const *>(icu_string.getBuffer()),
+                    icu_string.length());
+
+        mismatches += TestText(utf16text);
+        mismatches += TestConversions(utf8text,utf16text,U"");
+    }
+
+    // Texts that end with a three byte sequence, which the
+    // UTF-8 decoder looks past to see if another one follows
+    std::vector<std::string> const list_cjk_texts = {
+        u8"\u4E2D",
+        u8"\u4E2D\u6587",
+        u8"a\u4E2D",
+        u8"\u00E9\u4E2D",
+        u8"\u4E2D\u6587\u4E2D\u6587\u4E2D\u6587\u4E2D\u6587"
+        u8"\u4E2D\u6587\u4E2D\u6587\u4E2D\u6587\u4E2D\u6587"
+    };
+
+    for(auto const &utf8text : list_cjk_texts)
+    {
+        mismatches += TestConversions(utf8text,u"",U"");
+    }
+
+    // Random strings
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<ks::uint> length_dist(0,24);
+    std::uniform_int_distribution<ks::uint> pool_dist(0,list_pool.size()-1);
+    std::uniform_int_distribution<ks::uint> byte_dist(0,255);
+    std::uniform_int_distribution<ks::uint> cp_dist(0,0x11FFFF);
+
+    for(ks::uint i=0; i < iterations; i++)
+    {
+        ks::uint const length = length_dist(rng);
+
+        std::u32string utf32text;
+        for(ks::uint j=0; j < length; j++)
+        {
+            utf32text.push_back(list_pool[pool_dist(rng)]);
+        }
+
+        mismatches += TestText(ToUTF16(utf32text));
+
+        // Conversions with malformed input
+        std::string utf8text;
+        std::u16string utf16text;
+        std::u32string random_utf32text;
+        for(ks::uint j=0; j < length; j++)
+        {
+            utf8text.push_back(static_cast<char>(byte_dist(rng)));
+            utf16text.push_back(static_cast<char16_t>(
+                                    (byte_dist(rng) < 64) ?
+                                        0xD800+byte_dist(rng)*8 :
+                                        cp_dist(rng) & 0xFFFF));
+            random_utf32text.push_back(cp_dist(rng));
+        }
+
+        mismatches += TestConversions(utf8text,utf16text,random_utf32text);
+
+        // Mostly ASCII text, which takes the fast paths
+        std::u32string ascii_utf32text;
+        for(ks::uint j=0; j < length*4; j++)
+        {
+            ascii_utf32text.push_back((byte_dist(rng) < 16) ?
+                                          list_pool[pool_dist(rng)] :
+                                          0x20 + byte_dist(rng)%0x5F);
+        }
+
+        std::u16string const ascii_utf16text = ToUTF16(ascii_utf32text);
+        std::string ascii_utf8text;
+        icu::UnicodeString(
+                    reinterpret_cast<UChar const *>(ascii_utf16text.data()),
+                    ascii_utf16text.size()).toUTF8String(ascii_utf8text);
+
+        mismatches += TestConversions(ascii_utf8text,
+                                      ascii_utf16text,
+                                      ascii_utf32text);
+    }
+
+    if(mismatches > 0)
+    {
+        ks::LOG.Error() << "TestTextUnicode: " << mismatches
+                        << " mismatches";
+        return 1;
+    }
+
+    ks::LOG.Info() << "TestTextUnicode: All results matched";
+    return 0;
+}
+
+
+// ============================================================= //
+// ============================================================= //
@@ -1154,6 +1154,12 @@ resolveExplicitLevels(UBiDi *pBiDi, UErrorCode *pErrorCode) {
         int32_t overflowIsolateCount=0;
         int32_t overflowEmbeddingCount=0;
         int32_t validIsolateCount=0;
+        /* valid isolate initiators that haven't been matched by a PDI,
+           across paragraphs: resolveImplicitLevels() can keep an
+           isolates[] entry for each of them, so isolates[] has to be
+           sized by this count rather than by validIsolateCount (which
+           is reset at each paragraph separator) */
+        int32_t pendingIsolateCount=0;
         BracketData bracketData;
         bracketInit(pBiDi, &bracketData);
         stack[0]=level;     /* initialize base entry to para level, no override, no isolate */
@@ -1234,8 +1240,9 @@ resolveExplicitLevels(UBiDi *pBiDi, UErrorCode *pErrorCode) {
                     flags|=DIRPROP_FLAG(dirProp);
                     lastCcPos=i;
                     validIsolateCount++;
-                    if(validIsolateCount>pBiDi->isolateCount)
-                        pBiDi->isolateCount=validIsolateCount;
+                    pendingIsolateCount++;
+                    if(pendingIsolateCount>pBiDi->isolateCount)
+                        pBiDi->isolateCount=pendingIsolateCount;
                     embeddingLevel=newLevel;
                     /* we can increment stackLast without checking because newLevel
                        will exceed UBIDI_MAX_EXPLICIT_LEVEL before stackLast overflows */
@@ -1268,6 +1275,7 @@ resolveExplicitLevels(UBiDi *pBiDi, UErrorCode *pErrorCode) {
                         stackLast--;                /* until the last isolate entry */
                     stackLast--;                    /* pop also the last isolate entry */
                     validIsolateCount--;
+                    pendingIsolateCount--;
                     bracketProcessPDI(&bracketData);
                 } else
                     /* make it WS so that it is handled by adjustWSLevels() */
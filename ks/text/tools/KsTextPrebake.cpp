@@ -0,0 +1,438 @@
+/*
+   Copyright (C) 2015-2016 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+#include <ks/KsLog.hpp>
+#include <ks/text/KsTextTextManager.hpp>
+
+// ks_text_prebake
+// * Rasterizes a fixed set of characters with TextManager and
+//   writes the atlases to a bundle that TextManager can load
+//   at startup (see TextManager::SetAtlasBundle)
+// * The glyphs are generated by shaping text the same way an
+//   application would, so contextual forms and ligatures in a
+//   corpus are baked as well
+
+namespace
+{
+    using namespace ks;
+
+    char const * const kUsage =
+            "Usage: ks_text_prebake [options] -o <bundle> <font> [<font> ...]\n"
+            "\n"
+            "Fonts are added in the order given and the bundle is only\n"
+            "loaded by TextManagers that add the same fonts in the same\n"
+            "order with the same font and atlas settings.\n"
+            "\n"
+            "Font settings (apply to the next font only):\n"
+            "  --font-glyph-res <px>  glyph resolution (--glyph-res)\n"
+            "  --font-sdf-offset <px> sdf offset (--sdf-offset)\n"
+            "  --bitmap               hinted bitmaps instead of distance\n"
+            "                         fields (GlyphImageType::Bitmap)\n"
+            "\n"
+            "Atlas settings (defaults match TextManager):\n"
+            "  --atlas-size <px>      atlas size (1024)\n"
+            "  --glyph-res <px>       glyph resolution (32)\n"
+            "  --sdf-offset <px>      sdf offset (4)\n"
+            "  --sdf-engine <name>    edtaa3, fast, fastbanded, outline\n"
+            "                         or outlinemsdf (edtaa3)\n"
+            "  --packer <name>        shelf, skyline or maxrects (shelf)\n"
+            "  --channel-packing      pack glyphs into the channels of\n"
+            "                         RGBA atlases\n"
+            "\n"
+            "Character sets (any number of each):\n"
+            "  --range <first>-<last> code points in hex, ie. 4E00-9FFF\n"
+            "  --chars <file>         every character in a UTF-8 file in\n"
+            "                         order of first appearance, ie. a\n"
+            "                         GB2312 or JIS frequency list\n"
+            "  --max-chars <n>        only the first n characters from\n"
+            "                         each --chars file\n"
+            "  --corpus <file>        each line of a UTF-8 file is shaped\n"
+            "                         as is\n";
+
+    // Number of characters shaped in each request
+    uint const kCharsPerRequest = 256;
+
+    // * The AddFont arguments for each font; 0 uses the
+    //   TextManager's setting like AddFont does
+    struct FontOptions
+    {
+        std::string path;
+        uint glyph_res_px{0};
+        uint sdf_offset_px{0};
+        text::GlyphImageType image_type{text::GlyphImageType::SDF};
+    };
+
+    struct Options
+    {
+        uint atlas_size_px{1024};
+        uint glyph_res_px{32};
+        uint sdf_offset_px{4};
+        text::SDFEngine sdf_engine{text::SDFEngine::EDTAA3};
+        text::AtlasPackerType packer_type{text::AtlasPackerType::Shelf};
+        bool channel_packing{false};
+        uint max_chars{0};
+
+        std::string bundle_path;
+        std::vector<FontOptions> list_fonts;
+        std::vector<std::pair<u32,u32>> list_ranges;
+        std::vector<std::string> list_char_paths;
+        std::vector<std::string> list_corpus_paths;
+    };
+
+    bool ReadFile(std::string const &file_path, std::string &data)
+    {
+        std::ifstream ifs(file_path,std::ios::in | std::ios::binary);
+        if(!ifs.is_open())
+        {
+            std::cerr << "ks_text_prebake: Failed to open " << file_path << "\n";
+            return false;
+        }
+
+        std::ostringstream ss;
+        ss << ifs.rdbuf();
+        data = ss.str();
+        return true;
+    }
+
+    bool ParseOptions(int argc, char* argv[], Options &options)
+    {
+        std::vector<std::string> list_args(argv+1,argv+argc);
+
+        // Font settings are collected until the next font
+        FontOptions font_options;
+
+        for(uint i=0; i < list_args.size(); i++)
+        {
+            std::string const &arg = list_args[i];
+            if((arg.size() < 2) || (arg[0] != '-'))
+            {
+                font_options.path = arg;
+                options.list_fonts.push_back(font_options);
+                font_options = FontOptions();
+                continue;
+            }
+
+            if(arg == "--channel-packing")
+            {
+                options.channel_packing = true;
+                continue;
+            }
+
+            if(arg == "--bitmap")
+            {
+                font_options.image_type = text::GlyphImageType::Bitmap;
+                continue;
+            }
+
+            if(i+1 == list_args.size())
+            {
+                std::cerr << "ks_text_prebake: Missing value for " << arg << "\n";
+                return false;
+            }
+
+            std::string const &value = list_args[++i];
+            if(arg == "-o")
+            {
+                options.bundle_path = value;
+            }
+            else if(arg == "--atlas-size")
+            {
+                options.atlas_size_px = std::strtoul(value.c_str(),nullptr,10);
+            }
+            else if(arg == "--glyph-res")
+            {
+                options.glyph_res_px = std::strtoul(value.c_str(),nullptr,10);
+            }
+            else if(arg == "--sdf-offset")
+            {
+                options.sdf_offset_px = std::strtoul(value.c_str(),nullptr,10);
+            }
+            else if(arg == "--font-glyph-res")
+            {
+                font_options.glyph_res_px = std::strtoul(value.c_str(),nullptr,10);
+            }
+            else if(arg == "--font-sdf-offset")
+            {
+                font_options.sdf_offset_px = std::strtoul(value.c_str(),nullptr,10);
+            }
+            else if(arg == "--max-chars")
+            {
+                options.max_chars = std::strtoul(value.c_str(),nullptr,10);
+            }
+            else if(arg == "--sdf-engine")
+            {
+                std::vector<std::string> const list_names = {
+                    "edtaa3","fast","fastbanded","outline","outlinemsdf"
+                };
+
+                auto it = std::find(list_names.begin(),list_names.end(),value);
+                if(it == list_names.end())
+                {
+                    std::cerr << "ks_text_prebake: Unknown sdf engine " << value << "\n";
+                    return false;
+                }
+
+                options.sdf_engine = text::SDFEngine(it-list_names.begin());
+            }
+            else if(arg == "--packer")
+            {
+                std::vector<std::string> const list_names = {
+                    "shelf","skyline","maxrects"
+                };
+
+                auto it = std::find(list_names.begin(),list_names.end(),value);
+                if(it == list_names.end())
+                {
+                    std::cerr << "ks_text_prebake: Unknown packer " << value << "\n";
+                    return false;
+                }
+
+                options.packer_type = text::AtlasPackerType(it-list_names.begin());
+            }
+            else if(arg == "--range")
+            {
+                char * end = nullptr;
+                u32 const first = std::strtoul(value.c_str(),&end,16);
+                u32 const last = (*end == '-') ? std::strtoul(end+1,nullptr,16) : first;
+                if((last < first) || (last > 0x10FFFF))
+                {
+                    std::cerr << "ks_text_prebake: Invalid range " << value << "\n";
+                    return false;
+                }
+
+                options.list_ranges.emplace_back(first,last);
+            }
+            else if(arg == "--chars")
+            {
+                options.list_char_paths.push_back(value);
+            }
+            else if(arg == "--corpus")
+            {
+                options.list_corpus_paths.push_back(value);
+            }
+            else
+            {
+                std::cerr << "ks_text_prebake: Unknown option " << arg << "\n";
+                return false;
+            }
+        }
+
+        return !(options.bundle_path.empty() || options.list_fonts.empty());
+    }
+
+    void AppendCodePoint(u32 cp, std::u16string &text)
+    {
+        if(cp < 0x10000)
+        {
+            text.push_back(char16_t(cp));
+        }
+        else
+        {
+            cp -= 0x10000;
+            text.push_back(char16_t(0xD800 + (cp >> 10)));
+            text.push_back(char16_t(0xDC00 + (cp & 0x3FF)));
+        }
+    }
+
+    // * Adds every non-whitespace character in @utf16text
+    //   that isn't already in @list_chars
+    void AddChars(std::u16string const &utf16text,
+                  uint max_chars,
+                  std::vector<u32> &list_chars,
+                  std::vector<bool> &list_char_added)
+    {
+        uint char_count = 0;
+        for(uint i=0; i < utf16text.size(); i++)
+        {
+            u32 cp = utf16text[i];
+            if((cp >= 0xD800) && (cp < 0xDC00) && (i+1 < utf16text.size()))
+            {
+                cp = 0x10000 + ((cp-0xD800) << 10) + (utf16text[++i]-0xDC00);
+            }
+
+            if((cp <= 0x20) || (cp == 0x3000) || (cp == 0xFEFF))
+            {
+                continue;
+            }
+
+            if((max_chars > 0) && (char_count == max_chars))
+            {
+                break;
+            }
+
+            char_count++;
+            if(!list_char_added[cp])
+            {
+                list_char_added[cp] = true;
+                list_chars.push_back(cp);
+            }
+        }
+    }
+}
+
+// ============================================================= //
+// ============================================================= //
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if(!ParseOptions(argc,argv,options))
+    {
+        std::cerr << kUsage;
+        return 1;
+    }
+
+    // Characters are shaped on their own (separated by
+    // spaces so they don't form ligatures); corpus lines
+    // are shaped as they are
+    std::vector<u32> list_chars;
+    std::vector<bool> list_char_added(0x110000,false);
+    std::vector<std::u16string> list_texts;
+
+    for(auto const &range : options.list_ranges)
+    {
+        for(u32 cp=range.first; cp <= range.second; cp++)
+        {
+            if(!list_char_added[cp] && ((cp < 0xD800) || (cp > 0xDFFF)))
+            {
+                list_char_added[cp] = true;
+                list_chars.push_back(cp);
+            }
+        }
+    }
+
+    for(auto const &char_path : options.list_char_paths)
+    {
+        std::string data;
+        if(!ReadFile(char_path,data))
+        {
+            return 1;
+        }
+
+        AddChars(text::TextManager::ConvertStringUTF8ToUTF16(data),
+                 options.max_chars,list_chars,list_char_added);
+    }
+
+    for(auto const &corpus_path : options.list_corpus_paths)
+    {
+        std::string data;
+        if(!ReadFile(corpus_path,data))
+        {
+            return 1;
+        }
+
+        std::istringstream ss(data);
+        std::string line;
+        while(std::getline(ss,line))
+        {
+            if(!line.empty())
+            {
+                list_texts.push_back(text::TextManager::ConvertStringUTF8ToUTF16(line));
+            }
+        }
+    }
+
+    for(uint i=0; i < list_chars.size(); i+=kCharsPerRequest)
+    {
+        std::u16string text;
+        for(uint j=i; j < std::min<uint>(i+kCharsPerRequest,list_chars.size()); j++)
+        {
+            AppendCodePoint(list_chars[j],text);
+            text.push_back(u' ');
+        }
+
+        list_texts.push_back(text);
+    }
+
+    // Bake
+    text::TextManager text_manager(options.atlas_size_px,
+                                   options.glyph_res_px,
+                                   options.sdf_offset_px);
+
+    text_manager.SetSDFEngine(options.sdf_engine);
+    text_manager.SetAtlasPackerType(options.packer_type);
+
+    if(options.channel_packing)
+    {
+        text_manager.EnableChannelPacking();
+    }
+
+    text_manager.SetAtlasCacheFile(options.bundle_path);
+
+    uint glyph_count = 0;
+    text_manager.signal_new_glyph->Connect(
+                [&](uint,glm::u16vec2,shared_ptr<ImageData>) {
+                    glyph_count++;
+                });
+
+    std::string font_names;
+    for(uint i=0; i < options.list_fonts.size(); i++)
+    {
+        FontOptions const &font_options = options.list_fonts[i];
+        std::string const font_name = "font" + ks::ToString(i);
+
+        text_manager.AddFont(font_name,
+                             font_options.path,
+                             font_options.glyph_res_px,
+                             font_options.sdf_offset_px,
+                             font_options.image_type);
+
+        font_names += (i == 0) ? font_name : ("," + font_name);
+    }
+
+    text::Hint hint = text_manager.CreateHint(font_names);
+    hint.max_line_width_px = std::numeric_limits<uint>::max();
+
+    auto const start = std::chrono::steady_clock::now();
+    for(auto const &text : list_texts)
+    {
+        text_manager.GetGlyphs(text,hint);
+    }
+    auto const end = std::chrono::steady_clock::now();
+
+    text_manager.SaveAtlasCache();
+
+    auto const list_occupancy = text_manager.GetAtlasOccupancy();
+
+    std::cout << "ks_text_prebake: " << list_chars.size() << " characters and "
+              << (list_texts.size() - (list_chars.size()+kCharsPerRequest-1)/kCharsPerRequest)
+              << " corpus lines: " << glyph_count << " glyphs in "
+              << list_occupancy.size() << " atlases ("
+              << std::chrono::duration<double,std::milli>(end-start).count()
+              << "ms)\n";
+
+    for(uint i=0; i < list_occupancy.size(); i++)
+    {
+        std::cout << "ks_text_prebake: atlas " << i << ": "
+                  << list_occupancy[i].glyph_count << " glyphs, "
+                  << 100.0*list_occupancy[i].occupancy << "% occupied\n";
+    }
+
+    std::cout << "ks_text_prebake: wrote " << options.bundle_path << "\n";
+    return 0;
+}
+
+
+// ============================================================= //
+// ============================================================= //
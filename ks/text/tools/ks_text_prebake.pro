@@ -0,0 +1,28 @@
+# ks_text_prebake
+# * Bakes atlas bundles for TextManager::SetAtlasBundle; see
+#   KsTextPrebake.cpp for usage
+# * Needs ks_shared like any other project that uses ks_text. Set
+#   PATH_KS_SHARED to the directory with ks_shared.pri if it isn't
+#   checked out next to ks_text, ie:
+#   qmake PATH_KS_SHARED=/path/to/ks_shared ks_text_prebake.pro
+# * KS_TEXT_NO_ICU=1 is passed on to ks_text.pri
+
+TEMPLATE = app
+TARGET = ks_text_prebake
+
+CONFIG += console c++14
+CONFIG -= qt app_bundle
+
+isEmpty(PATH_KS_SHARED) {
+    PATH_KS_SHARED = $${PWD}/../../../../ks_shared
+}
+
+!exists($${PATH_KS_SHARED}/ks_shared.pri) {
+    error("ks_text_prebake: ks_shared.pri not found in $${PATH_KS_SHARED}; set PATH_KS_SHARED")
+}
+
+include($${PATH_KS_SHARED}/ks_shared.pri)
+include($${PWD}/../../../ks_text.pri)
+
+SOURCES += \
+    $${PWD}/KsTextPrebake.cpp
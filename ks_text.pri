@@ -5,22 +5,55 @@ PATH_KS_TEXT = $${PWD}/ks/text
 INCLUDEPATH += $${PATH_KS_TEXT}/thirdparty
 
 HEADERS += \
+    $${PATH_KS_TEXT}/KsTextAtlasCache.hpp \
+    $${PATH_KS_TEXT}/KsTextAtlasPacker.hpp \
     $${PATH_KS_TEXT}/KsTextDataTypes.hpp \
     $${PATH_KS_TEXT}/KsTextGlyphDesc.hpp \
     $${PATH_KS_TEXT}/KsTextFreeType.hpp \
+    $${PATH_KS_TEXT}/KsTextFreeTypeMemory.hpp \
     $${PATH_KS_TEXT}/KsTextFont.hpp \
+    $${PATH_KS_TEXT}/KsTextGlyphTable.hpp \
+    $${PATH_KS_TEXT}/KsTextImageRenderer.hpp \
+    $${PATH_KS_TEXT}/KsTextOutlineSDF.hpp \
+    $${PATH_KS_TEXT}/KsTextPrewarmWorker.hpp \
+    $${PATH_KS_TEXT}/KsTextRasterPool.hpp \
+    $${PATH_KS_TEXT}/KsTextSDF.hpp \
     $${PATH_KS_TEXT}/KsTextTextAtlas.hpp \
     $${PATH_KS_TEXT}/KsTextTextShaper.hpp \
-    $${PATH_KS_TEXT}/KsTextTextManager.hpp
+    $${PATH_KS_TEXT}/KsTextTextManager.hpp \
+    $${PATH_KS_TEXT}/KsTextTextLayout.hpp \
+    $${PATH_KS_TEXT}/KsTextTextMesh.hpp \
+    $${PATH_KS_TEXT}/KsTextUnicode.hpp
 
 SOURCES += \
+    $${PATH_KS_TEXT}/KsTextAtlasCache.cpp \
+    $${PATH_KS_TEXT}/KsTextAtlasPacker.cpp \
     $${PATH_KS_TEXT}/KsTextFreeType.cpp \
+    $${PATH_KS_TEXT}/KsTextFreeTypeMemory.cpp \
+    $${PATH_KS_TEXT}/KsTextGlyphTable.cpp \
+    $${PATH_KS_TEXT}/KsTextImageRenderer.cpp \
+    $${PATH_KS_TEXT}/KsTextOutlineSDF.cpp \
+    $${PATH_KS_TEXT}/KsTextPrewarmWorker.cpp \
+    $${PATH_KS_TEXT}/KsTextRasterPool.cpp \
+    $${PATH_KS_TEXT}/KsTextSDF.cpp \
     $${PATH_KS_TEXT}/KsTextTextAtlas.cpp \
     $${PATH_KS_TEXT}/KsTextTextShaper.cpp \
-    $${PATH_KS_TEXT}/KsTextTextManager.cpp
+    $${PATH_KS_TEXT}/KsTextTextManager.cpp \
+    $${PATH_KS_TEXT}/KsTextTextLayout.cpp \
+    $${PATH_KS_TEXT}/KsTextTextMesh.cpp \
+    $${PATH_KS_TEXT}/KsTextUnicode.cpp
 
 # thirdparty
 include($${PATH_KS_TEXT}/thirdparty/freetype/libfreetype.pri)
-include($${PATH_KS_TEXT}/thirdparty/icu/libicu.pri)
+
+# Set KS_TEXT_NO_ICU=1 to build without ICU; bidi and script
+# itemization and UTF conversion are done by KsTextUnicode
+# using the UCDN tables that come with harfbuzz instead
+equals(KS_TEXT_NO_ICU,1) {
+    DEFINES += KS_TEXT_NO_ICU
+} else {
+    include($${PATH_KS_TEXT}/thirdparty/icu/libicu.pri)
+}
+
 include($${PATH_KS_TEXT}/thirdparty/harfbuzz/libharfbuzz.pri)
 include($${PATH_KS_TEXT}/thirdparty/unibreak/libunibreak.pri)